@@ -0,0 +1,47 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// ===== 微基准测试框架 =====
+//
+// 每个用例提供一个函数：执行iters次被测操作，返回一个依赖于结果的值（防止被优化掉）。
+// 框架自动加倍迭代次数直到单轮耗时超过下限，重复多轮取中位数。
+
+typedef uint64_t (*BenchFunc)(uint64_t iters);
+
+struct BenchCase {
+    std::string name;        // 用例名，形如 "group/variant"
+    uint64_t bytes_per_op;   // 每次操作处理的字节数，用于计算bytes/s
+    BenchFunc func;
+};
+
+std::vector<BenchCase>& benchRegistry();
+
+inline void addBenchmark(const std::string& name, uint64_t bytes_per_op, BenchFunc func) {
+    BenchCase c;
+    c.name = name;
+    c.bytes_per_op = bytes_per_op;
+    c.func = func;
+    benchRegistry().push_back(c);
+}
+
+// 经过volatile中转返回同一个指针，编译器无法把循环内对输入的计算当作不变量外提
+template <typename T>
+inline T* benchOpaque(T* ptr) {
+    static T* volatile slot;
+    slot = ptr;
+    return slot;
+}
+
+// 各模块的用例注册函数
+void registerRdtBenchmarks();     // lab2：校验和、SACK编解码、SACK块生成
+void registerChatBenchmarks();    // lab1：二进制聊天消息序列化
+void registerJsonBenchmarks();    // lab1可视化版：JSON消息序列化
+
+// 测试用的聊天文本（UTF-8，中英混合）
+std::string benchChatText(size_t approx_bytes);
+
+#endif // BENCH_H
@@ -0,0 +1,116 @@
+#include "bench.h"
+#include "../lab1/protocol.h"
+#include "../lab1/frame_decoder.h"
+#include "../lab1/server_metrics.h"
+#include <algorithm>
+#include <mutex>
+
+// ===== lab1 二进制聊天协议的序列化 =====
+
+// MessageView 不持有数据，正文由调用方保存
+static std::string chatText(size_t text_bytes) {
+    std::string text = benchChatText(text_bytes);
+    if (text.size() > MAX_MESSAGE_LEN - 1) text.resize(MAX_MESSAGE_LEN - 1);
+    return text;
+}
+
+static MessageView makeChatMessage(const std::string& text) {
+    return MessageView(MSG_CHAT, "Alice", text, 1766620800ULL);
+}
+
+static int chatWireSize(size_t text_bytes) {
+    return (int)message_wire_size(makeChatMessage(chatText(text_bytes)));
+}
+
+template <int TextBytes>
+static uint64_t benchSerialize(uint64_t iters) {
+    std::string text = chatText(TextBytes);
+    MessageView msg = makeChatMessage(text);
+    char buffer[MAX_PACKET_LEN];
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += write_message(*benchOpaque(&msg), buffer, MAX_PACKET_LEN);
+        sum += (uint8_t)buffer[sum % 8];
+    }
+    return sum;
+}
+
+template <int TextBytes>
+static uint64_t benchDeserialize(uint64_t iters) {
+    std::string text = chatText(TextBytes);
+    char buffer[MAX_PACKET_LEN];
+    int len = write_message(makeChatMessage(text), buffer, MAX_PACKET_LEN);
+    MessageView out;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += parse_message(benchOpaque(buffer), len, out);
+        sum += out.timestamp + (uint8_t)out.message.data[0];
+    }
+    return sum;
+}
+
+// 一次读取中连在一起的 Count 条消息：写入解码缓冲区并逐条取出
+template <int TextBytes, int Count>
+static uint64_t benchFrameDecode(uint64_t iters) {
+    std::string text = chatText(TextBytes);
+    std::vector<char> chunk;
+    char buffer[MAX_PACKET_LEN];
+    int len = write_message(makeChatMessage(text), buffer, MAX_PACKET_LEN);
+    for (int i = 0; i < Count; i++) {
+        chunk.insert(chunk.end(), buffer, buffer + len);
+    }
+
+    FrameDecoder decoder;
+    MessageView out;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        // 与服务器相同，每次只写入连续空间能容纳的部分
+        size_t offset = 0;
+        while (offset < chunk.size()) {
+            int space = 0;
+            char* dst = decoder.write_space(space);
+            int n = (int)std::min((size_t)space, chunk.size() - offset);
+            memcpy(dst, benchOpaque(chunk.data()) + offset, n);
+            decoder.commit(n);
+            offset += n;
+            while (decoder.next(out) > 0) {
+                sum += out.timestamp;
+            }
+        }
+    }
+    return sum;
+}
+
+// 每条消息更新一次统计：原来的全局互斥锁 + 普通计数
+static uint64_t benchStatsMutex(uint64_t iters) {
+    static std::mutex stats_mutex;
+    static uint64_t received = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        received += *benchOpaque(&i) & 1;
+    }
+    return received;
+}
+
+// 同上，改为按线程分片的计数
+static uint64_t benchStatsSharded(uint64_t iters) {
+    static ServerCounters counters;
+    for (uint64_t i = 0; i < iters; i++) {
+        counters.add(CTR_MESSAGES_RECEIVED, *benchOpaque(&i) & 1);
+    }
+    return counters.total(CTR_MESSAGES_RECEIVED);
+}
+
+void registerChatBenchmarks() {
+    // 短消息、一般中英文消息、接近上限的长消息
+    addBenchmark("chat/serialize/16", chatWireSize(16), benchSerialize<16>);
+    addBenchmark("chat/serialize/200", chatWireSize(200), benchSerialize<200>);
+    addBenchmark("chat/serialize/1000", chatWireSize(1000), benchSerialize<1000>);
+    addBenchmark("chat/deserialize/16", chatWireSize(16), benchDeserialize<16>);
+    addBenchmark("chat/deserialize/200", chatWireSize(200), benchDeserialize<200>);
+    addBenchmark("chat/deserialize/1000", chatWireSize(1000), benchDeserialize<1000>);
+    addBenchmark("chat/frame_decode/16x32", chatWireSize(16) * 32, benchFrameDecode<16, 32>);
+    addBenchmark("chat/frame_decode/200x32", chatWireSize(200) * 32, benchFrameDecode<200, 32>);
+    addBenchmark("chat/stats/mutex", 0, benchStatsMutex);
+    addBenchmark("chat/stats/sharded", 0, benchStatsSharded);
+}
@@ -0,0 +1,55 @@
+#include "bench.h"
+#include "../lab1 - 可视化自用非交作业/protocol.h"
+
+// ===== lab1 可视化版 JSON 消息的序列化 =====
+
+static Message makeJsonMessage(size_t text_bytes, bool with_escapes) {
+    std::string text = benchChatText(text_bytes);
+    if (with_escapes) {
+        // 引号、反斜杠和换行都需要转义
+        for (size_t i = 7; i < text.size(); i += 23) {
+            text[i] = "\"\\\n"[i % 3];
+        }
+    }
+    Message msg(MSG_CHAT, "Alice", text);
+    msg.user_id = 42;
+    msg.timestamp = "2025-12-25 10:00:00";
+    return msg;
+}
+
+template <int TextBytes, bool Escapes>
+static uint64_t benchSerialize(uint64_t iters) {
+    Message msg = makeJsonMessage(TextBytes, Escapes);
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        std::string json = JsonMessage::serialize(msg);
+        sum += json.size() + (uint8_t)json[json.size() / 2];
+    }
+    return sum;
+}
+
+template <int TextBytes, bool Escapes>
+static uint64_t benchDeserialize(uint64_t iters) {
+    std::string json = JsonMessage::serialize(makeJsonMessage(TextBytes, Escapes));
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        Message msg = JsonMessage::deserialize(json);
+        sum += msg.content.size() + msg.user_id;
+    }
+    return sum;
+}
+
+static uint64_t jsonSize(size_t text_bytes, bool with_escapes) {
+    return JsonMessage::serialize(makeJsonMessage(text_bytes, with_escapes)).size();
+}
+
+void registerJsonBenchmarks() {
+    addBenchmark("json/serialize/16", jsonSize(16, false), benchSerialize<16, false>);
+    addBenchmark("json/serialize/200", jsonSize(200, false), benchSerialize<200, false>);
+    addBenchmark("json/serialize/1000", jsonSize(1000, false), benchSerialize<1000, false>);
+    addBenchmark("json/serialize/1000_escaped", jsonSize(1000, true), benchSerialize<1000, true>);
+    addBenchmark("json/deserialize/16", jsonSize(16, false), benchDeserialize<16, false>);
+    addBenchmark("json/deserialize/200", jsonSize(200, false), benchDeserialize<200, false>);
+    addBenchmark("json/deserialize/1000", jsonSize(1000, false), benchDeserialize<1000, false>);
+    addBenchmark("json/deserialize/1000_escaped", jsonSize(1000, true), benchDeserialize<1000, true>);
+}
@@ -0,0 +1,181 @@
+#include "bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <winsock2.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+// 微基准测试：协议热点函数的 ns/op 与 bytes/s
+//
+// 编译（在仓库根目录）：
+//   g++ -Wall -std=c++11 -O2 -o bench\bench.exe bench\bench_main.cpp bench\bench_rdt.cpp
+//       bench\bench_chat.cpp bench\bench_json.cpp lab2\rdt_socket.cpp -lws2_32
+//
+// 输出为CSV（name,iterations,ns_per_op,bytes_per_sec），可保存后用 -b 与新结果对比：
+//   bench\bench.exe > before.csv
+//   bench\bench.exe -b before.csv
+
+volatile uint64_t bench_sink = 0;   // 吸收用例返回值，防止编译器删除被测代码
+
+std::vector<BenchCase>& benchRegistry() {
+    static std::vector<BenchCase> registry;
+    return registry;
+}
+
+std::string benchChatText(size_t approx_bytes) {
+    static const char* words[] = {
+        "hello", "大家好", "今天", "network", "的实验", "reliable", "传输", "window",
+        "拥塞控制", "ok", "收到", "packet", "丢包率", "3%", "，", "！", "SACK", "没问题"
+    };
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+    std::string text;
+    uint32_t state = 12345;
+    while (text.size() < approx_bytes) {
+        state = state * 1103515245 + 12345;
+        text += words[(state >> 16) % word_count];
+        text += ' ';
+    }
+    return text;
+}
+
+struct BenchResult {
+    uint64_t iterations;
+    double ns_per_op;
+    double bytes_per_sec;
+};
+
+// 运行一个用例：加倍迭代次数直到单轮超过min_ms，再重复rounds轮取中位数
+BenchResult runBenchmark(const BenchCase& c, double min_ms, int rounds) {
+    typedef std::chrono::steady_clock Clock;
+    uint64_t iters = 1;
+    while (true) {
+        auto start = Clock::now();
+        bench_sink += c.func(iters);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (ms >= min_ms || iters >= (1ULL << 40)) break;
+        iters *= ms > 0 ? std::min(16.0, std::max(2.0, min_ms * 1.2 / ms)) : 16;
+    }
+
+    std::vector<double> samples;
+    for (int r = 0; r < rounds; r++) {
+        auto start = Clock::now();
+        bench_sink += c.func(iters);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+        samples.push_back(ns / iters);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    BenchResult result;
+    result.iterations = iters;
+    result.ns_per_op = samples[samples.size() / 2];
+    result.bytes_per_sec = c.bytes_per_op ? c.bytes_per_op * 1e9 / result.ns_per_op : 0.0;
+    return result;
+}
+
+// 读取之前保存的CSV结果：name -> ns_per_op
+std::map<std::string, double> loadBaseline(const char* path) {
+    std::map<std::string, double> baseline;
+    FILE* fp = fopen(path, "r");
+    if (!fp) return baseline;
+    char line[512];
+    while (fgets(line, sizeof(line), fp)) {
+        char name[256];
+        unsigned long long iters;
+        double ns;
+        if (sscanf(line, "%255[^,],%llu,%lf", name, &iters, &ns) == 3) {
+            baseline[name] = ns;
+        }
+    }
+    fclose(fp);
+    return baseline;
+}
+
+void printUsage(const char* prog_name) {
+    printf("Usage: %s [options] [filter]\n", prog_name);
+    printf("Options:\n");
+    printf("  -t <ms>         Minimum time per measurement round (default 100)\n");
+    printf("  -r <rounds>     Measurement rounds, the median is reported (default 5)\n");
+    printf("  -b <file.csv>   Compare with an earlier result file (adds a change column)\n");
+    printf("  -l              List benchmark names\n");
+    printf("  filter          Only run benchmarks whose name contains this text\n");
+    printf("Example: %s -b before.csv checksum\n", prog_name);
+}
+
+int main(int argc, char* argv[]) {
+    double min_ms = 100;
+    int rounds = 5;
+    const char* baseline_path = nullptr;
+    const char* filter = nullptr;
+    bool list_only = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-t") == 0 && has_value) {
+            min_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && has_value) {
+            rounds = std::max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "-b") == 0 && has_value) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "-l") == 0) {
+            list_only = true;
+        } else if (argv[i][0] != '-' && !filter) {
+            filter = argv[i];
+        } else {
+            printf("[ERROR] Unknown option: %s\n", argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        printf("[ERROR] WSAStartup failed\n");
+        return 1;
+    }
+
+    registerRdtBenchmarks();
+    registerChatBenchmarks();
+    registerJsonBenchmarks();
+
+    std::map<std::string, double> baseline;
+    if (baseline_path) {
+        baseline = loadBaseline(baseline_path);
+        if (baseline.empty()) {
+            fprintf(stderr, "[WARN] No results loaded from %s\n", baseline_path);
+        }
+    }
+
+    if (!list_only) {
+        printf(baseline_path ? "name,iterations,ns_per_op,bytes_per_sec,baseline_ns,change_pct\n"
+                             : "name,iterations,ns_per_op,bytes_per_sec\n");
+    }
+    for (size_t i = 0; i < benchRegistry().size(); i++) {
+        const BenchCase& c = benchRegistry()[i];
+        if (filter && c.name.find(filter) == std::string::npos) continue;
+        if (list_only) {
+            printf("%s\n", c.name.c_str());
+            continue;
+        }
+
+        BenchResult r = runBenchmark(c, min_ms, rounds);
+        printf("%s,%llu,%.2f,%.0f", c.name.c_str(), (unsigned long long)r.iterations,
+               r.ns_per_op, r.bytes_per_sec);
+        if (baseline_path) {
+            auto it = baseline.find(c.name);
+            if (it != baseline.end() && it->second > 0) {
+                printf(",%.2f,%+.1f", it->second, (r.ns_per_op - it->second) * 100.0 / it->second);
+            } else {
+                printf(",,");
+            }
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    WSACleanup();
+    return 0;
+}
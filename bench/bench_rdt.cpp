@@ -0,0 +1,191 @@
+#include "bench.h"
+#include "../lab2/rdt_socket.h"
+
+// ===== lab2 可靠传输协议的热点函数 =====
+
+// 在同一进程内重复使用的输入数据
+static std::vector<char>& payload() {
+    static std::vector<char> data;
+    if (data.empty()) {
+        data.resize(MAX_PACKET_SIZE);
+        uint32_t state = 1;
+        for (size_t i = 0; i < data.size(); i++) {
+            state = state * 1103515245 + 12345;
+            data[i] = (char)(state >> 24);
+        }
+    }
+    return data;
+}
+
+// 对不同大小的数据计算校验和（64字节即单独的包头）
+template <int Size>
+static uint64_t benchChecksum(uint64_t iters) {
+    const char* data = payload().data();
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += calculateChecksum(benchOpaque(data), Size);
+    }
+    return sum;
+}
+
+// 差量传输：数据块的强哈希
+template <int Size>
+static uint64_t benchHash64(uint64_t iters) {
+    const char* data = payload().data();
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += hash64(benchOpaque(data), Size);
+    }
+    return sum;
+}
+
+// 端到端摘要：每个数据包的负载依次计入（数据通路上的增量开销）
+template <uint32_t Size>
+static uint64_t benchStreamDigest(uint64_t iters) {
+    const char* data = payload().data();
+    StreamDigest digest;
+    for (uint64_t i = 0; i < iters; i++) {
+        digest.update(benchOpaque(data), Size);
+    }
+    return digest.digest();
+}
+
+// 事件记录：每个事件读一次时钟、填一条16字节的记录，缓冲满了整块写出（写到空设备）
+static uint64_t benchTraceRecord(uint64_t iters) {
+#ifdef _WIN32
+    static const char* null_device = "NUL";
+#else
+    static const char* null_device = "/dev/null";
+#endif
+    static EventTrace trace;
+    static bool opened = trace.open(null_device);
+    for (uint64_t i = 0; i < iters; i++) {
+        trace.record(std::chrono::steady_clock::now(), TRACE_PACKET_SENT, PKT_DATA, DATA_SIZE,
+                     (uint32_t)i * DATA_SIZE, 0);
+    }
+    return trace.recorded() + opened;
+}
+
+// 差量传输：滚动校验和在整个负载上逐字节滑动（窗口1024字节）
+static uint64_t benchRollingChecksum(uint64_t iters) {
+    const uint8_t* data = (const uint8_t*)payload().data();
+    const uint32_t window = 1024;
+    const uint32_t steps = MAX_PACKET_SIZE - window;
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        RollingChecksum rc;
+        rc.init(benchOpaque(data), window);
+        for (uint32_t j = 0; j < steps; j++) {
+            rc.roll(data[j], data[j + window]);
+            sum += rc.digest() & 1;
+        }
+    }
+    return sum;
+}
+
+// 生成count个SACK块，模拟ACK携带的典型区间
+static void makeSackBlocks(SackBlock* blocks, int count) {
+    uint32_t seq = 100000;
+    for (int i = 0; i < count; i++) {
+        blocks[i].start = seq + DATA_SIZE;
+        blocks[i].end = blocks[i].start + DATA_SIZE * (2 + i % 3);
+        seq = blocks[i].end;
+    }
+}
+
+template <int Blocks>
+static uint64_t benchSackEncode(uint64_t iters) {
+    SackBlock blocks[MAX_SACK_BLOCKS];
+    makeSackBlocks(blocks, Blocks);
+    char buf[DATA_SIZE];
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += encodeSackBlocks(benchOpaque(blocks), Blocks, buf, DATA_SIZE);
+        sum += (uint8_t)buf[1];
+    }
+    return sum;
+}
+
+template <int Blocks>
+static uint64_t benchSackDecode(uint64_t iters) {
+    SackBlock blocks[MAX_SACK_BLOCKS];
+    makeSackBlocks(blocks, Blocks);
+    char buf[DATA_SIZE];
+    uint16_t len = encodeSackBlocks(blocks, Blocks, buf, DATA_SIZE);
+    SackBlock out[MAX_SACK_BLOCKS];
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += decodeSackBlocks(benchOpaque(buf), len, out, MAX_SACK_BLOCKS);
+        sum += out[0].end;
+    }
+    return sum;
+}
+
+// 访问RdtSocket内部状态（RdtSocket中声明为友元）
+class RdtBenchmark {
+public:
+    // 接收窗口内缓存packets个乱序包，分成约runs段连续区间（recv_base处的包缺失）
+    static RdtSocket* makeReceiver(int packets, int runs) {
+        RdtSocket* sock = new RdtSocket();
+        sock->setLogging(false);
+        sock->recv_base = 1000;
+        int gap_every = packets / runs;
+        uint32_t seq = sock->recv_base + DATA_SIZE;
+        for (int i = 0; i < packets; i++) {
+            if (gap_every > 0 && i > 0 && i % gap_every == 0) {
+                seq += DATA_SIZE;   // 制造一个空洞
+            }
+            Packet* pkt = sock->packet_pool.acquire();
+            pkt->header.seq_num = seq;
+            pkt->header.data_length = DATA_SIZE;
+            sock->recv_buffer[seq] = pkt;
+            seq += DATA_SIZE;
+        }
+        return sock;
+    }
+
+    static uint8_t generate(RdtSocket* sock, SackBlock* blocks) {
+        uint8_t count = 0;
+        sock->generateSackBlocks(blocks, count);
+        return count;
+    }
+};
+
+template <int Packets, int Runs>
+static uint64_t benchGenerateSack(uint64_t iters) {
+    static RdtSocket* sock = RdtBenchmark::makeReceiver(Packets, Runs);
+    SackBlock blocks[MAX_SACK_BLOCKS];
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < iters; i++) {
+        sum += RdtBenchmark::generate(benchOpaque(sock), blocks);
+        sum += blocks[0].end;
+    }
+    return sum;
+}
+
+void registerRdtBenchmarks() {
+    addBenchmark("rdt/checksum/64", 64, benchChecksum<64>);
+    addBenchmark("rdt/checksum/960", 960, benchChecksum<DATA_SIZE>);
+    addBenchmark("rdt/checksum/1408", 1408, benchChecksum<1408>);
+    addBenchmark("rdt/checksum/8908", 8908, benchChecksum<8908>);
+    addBenchmark("rdt/checksum/64936", 64936, benchChecksum<MAX_DATA_SIZE>);
+
+    addBenchmark("rdt/hash64/960", 960, benchHash64<DATA_SIZE>);
+    addBenchmark("rdt/hash64/32768", 32768, benchHash64<32768>);
+    addBenchmark("rdt/stream_digest/960", 960, benchStreamDigest<DATA_SIZE>);
+    addBenchmark("rdt/stream_digest/64936", 64936, benchStreamDigest<MAX_DATA_SIZE>);
+    addBenchmark("rdt/rolling_checksum", MAX_PACKET_SIZE - 1024, benchRollingChecksum);
+    addBenchmark("rdt/trace_record", sizeof(TraceRecord), benchTraceRecord);
+
+    addBenchmark("rdt/sack_encode/1", 1 + 1 * SACK_BLOCK_SIZE, benchSackEncode<1>);
+    addBenchmark("rdt/sack_encode/4", 1 + 4 * SACK_BLOCK_SIZE, benchSackEncode<4>);
+    addBenchmark("rdt/sack_encode/10", 1 + 10 * SACK_BLOCK_SIZE, benchSackEncode<10>);
+    addBenchmark("rdt/sack_decode/1", 1 + 1 * SACK_BLOCK_SIZE, benchSackDecode<1>);
+    addBenchmark("rdt/sack_decode/4", 1 + 4 * SACK_BLOCK_SIZE, benchSackDecode<4>);
+    addBenchmark("rdt/sack_decode/10", 1 + 10 * SACK_BLOCK_SIZE, benchSackDecode<10>);
+
+    // 接收缓冲区中的包数 x 连续区间数（超过MAX_SACK_BLOCKS的区间不会被编码）
+    addBenchmark("rdt/generate_sack/8pkt_1run", 0, benchGenerateSack<8, 1>);
+    addBenchmark("rdt/generate_sack/49pkt_4run", 0, benchGenerateSack<49, 4>);
+    addBenchmark("rdt/generate_sack/49pkt_12run", 0, benchGenerateSack<49, 12>);
+}
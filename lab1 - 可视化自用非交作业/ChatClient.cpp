@@ -19,6 +19,7 @@ atomic<bool> g_running(false);
 int g_user_id = -1;
 string g_username;
 mutex g_console_mutex;
+string g_current_room = DEFAULT_ROOM;  // 普通输入发往的房间
 
 // 函数声明
 void receiveMessages();
@@ -26,7 +27,8 @@ void sendUserInput();
 void displayMenu();
 void handleServerMessage(const Message& msg);
 bool sendChatMessage(const string& content);
-bool sendCommand(MessageType type, const string& content = "");
+bool sendCommand(MessageType type, const string& content = "", const string& room = "");
+bool handleRoomCommand(const string& input);
 
 // 处理服务器消息
 void handleServerMessage(const Message& msg) {
@@ -40,8 +42,16 @@ void handleServerMessage(const Message& msg) {
             break;
 
         case MSG_CHAT:
-            cout << "[" << msg.timestamp << "] "
-                 << msg.username << ": " << msg.content << endl;
+            cout << "[" << msg.timestamp << "] ";
+            if (!msg.room.empty() && msg.room != DEFAULT_ROOM) {
+                cout << "[#" << msg.room << "] ";
+            }
+            cout << msg.username << ": " << msg.content << endl;
+            break;
+
+        case MSG_JOIN:
+        case MSG_LEAVE:
+            cout << "[#" << msg.room << "] " << msg.content << endl;
             break;
 
         case MSG_SYSTEM:
@@ -61,13 +71,48 @@ void handleServerMessage(const Message& msg) {
 }
 
 // 发送命令消息
-bool sendCommand(MessageType type, const string& content) {
+bool sendCommand(MessageType type, const string& content, const string& room) {
     Message msg(type, g_username, content);
+    msg.room = room;
     msg.user_id = g_user_id;
     msg.timestamp = getCurrentTime();
     return sendMessage(g_server_socket, JsonMessage::serialize(msg));
 }
 
+// 处理 /join、/leave、/room 命令,不是房间命令时返回false
+bool handleRoomCommand(const string& input) {
+    size_t space = input.find(' ');
+    if (space == string::npos) {
+        return false;
+    }
+    string command = input.substr(0, space);
+    string room = input.substr(space + 1);
+    if (command != "/join" && command != "/leave" && command != "/room") {
+        return false;
+    }
+
+    if (!isValidRoomName(room)) {
+        lock_guard<mutex> lock(g_console_mutex);
+        cout << "[ERROR] Invalid room name" << endl;
+        return true;
+    }
+
+    if (command == "/join") {
+        sendCommand(MSG_JOIN, "", room);
+        g_current_room = room;
+    } else if (command == "/leave") {
+        sendCommand(MSG_LEAVE, "", room);
+        if (g_current_room == room) {
+            g_current_room = DEFAULT_ROOM;
+        }
+    } else {
+        g_current_room = room;
+        lock_guard<mutex> lock(g_console_mutex);
+        cout << "[SYSTEM] Now talking in #" << room << endl;
+    }
+    return true;
+}
+
 // 线程:接收来自服务器的消息
 void receiveMessages() {
     string message;
@@ -103,6 +148,9 @@ void sendUserInput() {
         {"/list", []() {
             return sendCommand(MSG_LIST, "");
         }},
+        {"/who", []() {
+            return sendCommand(MSG_LIST, "", g_current_room);
+        }},
         {"/help", []() {
             lock_guard<mutex> lock(g_console_mutex);
             displayMenu();
@@ -128,9 +176,11 @@ void sendUserInput() {
             if (!cmd_it->second()) {
                 break;  // 命令要求退出
             }
+        } else if (handleRoomCommand(input)) {
+            continue;
         } else {
-            // 发送聊天消息
-            if (!sendCommand(MSG_CHAT, input)) {
+            // 发送聊天消息到当前房间
+            if (!sendCommand(MSG_CHAT, input, g_current_room)) {
                 g_running = false;
                 break;
             }
@@ -141,6 +191,10 @@ void sendUserInput() {
 void displayMenu() {
     cout << "\n========== Chat Commands ==========" << endl;
     cout << "/list  - Show online users" << endl;
+    cout << "/who   - Show users in the current room" << endl;
+    cout << "/join <room>  - Join a room and talk there" << endl;
+    cout << "/leave <room> - Leave a room" << endl;
+    cout << "/room <room>  - Switch the room you talk in" << endl;
     cout << "/help  - Show this help" << endl;
     cout << "/quit  - Exit the chat" << endl;
     cout << "==================================\n" << endl;
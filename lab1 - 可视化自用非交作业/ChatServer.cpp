@@ -7,6 +7,9 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <map>
+#include <deque>
+#include <algorithm>
 #include "protocol.h"
 #include "utils.h"
 
@@ -19,10 +22,17 @@ struct ClientInfo {
     SOCKET socket;
     string username;
     int user_id;
-    bool active;
+    atomic<bool> active;
+    vector<string> rooms;  // 已加入的房间(由 g_rooms_mutex 保护)
+
+    // 发往该客户端的帧先排队再发送: 排队可以在持锁时进行(顺序由锁决定),阻塞的send在锁外
+    deque<shared_ptr<const string>> outgoing;
+    size_t queued_bytes;
+    mutex queue_mutex;     // 保护 outgoing 和 queued_bytes
+    mutex send_mutex;      // 同一时刻只有一个线程写该socket
 
     explicit ClientInfo(SOCKET s = INVALID_SOCKET)
-        : socket(s), user_id(-1), active(false) {}
+        : socket(s), user_id(-1), active(false), queued_bytes(0) {}
 };
 
 // 全局变量
@@ -32,6 +42,20 @@ int g_next_user_id = 1;
 atomic<bool> g_server_running(true);
 SOCKET g_listen_socket = INVALID_SOCKET;
 
+// 房间订阅索引: 房间名 -> 成员,房间消息只发给成员
+map<string, vector<shared_ptr<ClientInfo>>> g_rooms;
+mutex g_rooms_mutex;
+
+// 房间最近的聊天消息(已加上长度头的帧),加入房间时拼成一次send补发
+// 同样由 g_rooms_mutex 保护: 记录和排队转发、加入和排队补发都在同一把锁内,新成员不会重复收到、漏掉消息或先收到新消息
+struct RoomHistory {
+    deque<shared_ptr<const string>> frames;
+    size_t bytes = 0;
+    uint64_t last_write = 0;    // 最近一次写入的序号,房间过多时丢弃最小的
+};
+map<string, RoomHistory> g_history;
+uint64_t g_history_sequence = 0;
+
 // 函数声明
 void handleClient(shared_ptr<ClientInfo> client_info);
 void broadcastMessage(const Message& msg, int exclude_user_id = -1);
@@ -39,22 +63,215 @@ void removeClient(int user_id);
 BOOL WINAPI consoleHandler(DWORD signal);
 bool handleLogin(shared_ptr<ClientInfo> client_info);
 void handleChatMessage(const Message& msg, shared_ptr<ClientInfo> client_info);
-void handleUserListRequest(shared_ptr<ClientInfo> client_info);
+void handleUserListRequest(const Message& msg, shared_ptr<ClientInfo> client_info);
 void notifyUserJoined(const string& username, int user_id);
 void notifyUserLeft(const string& username, int user_id);
+void sendToRoom(const string& room, const Message& msg, bool keep_history = false);
+void recordHistory(const string& room, const shared_ptr<const string>& frame);
+void replayHistory(shared_ptr<ClientInfo> client_info, const string& room);
+bool joinRoom(shared_ptr<ClientInfo> client_info, const string& room);
+bool leaveRoom(shared_ptr<ClientInfo> client_info, const string& room);
+void leaveAllRooms(shared_ptr<ClientInfo> client_info);
+void handleJoinRoom(const Message& msg, shared_ptr<ClientInfo> client_info);
+void handleLeaveRoom(const Message& msg, shared_ptr<ClientInfo> client_info);
+void sendSystemMessage(shared_ptr<ClientInfo> client_info, const string& content);
+void enqueueFrame(const shared_ptr<ClientInfo>& client, const shared_ptr<const string>& frame);
+void flushFrames(const shared_ptr<ClientInfo>& client);
+bool sendToClient(const shared_ptr<ClientInfo>& client, const string& json_msg);
+
+// 把帧排入客户端的发送队列(不阻塞,可以持锁调用),积压超过 MAX_QUEUED_BYTES 时断开该客户端
+void enqueueFrame(const shared_ptr<ClientInfo>& client, const shared_ptr<const string>& frame) {
+    lock_guard<mutex> lock(client->queue_mutex);
+    if (!client->active) {
+        return;
+    }
+    if (!client->outgoing.empty() && client->queued_bytes + frame->size() > MAX_QUEUED_BYTES) {
+        client->outgoing.clear();
+        client->queued_bytes = 0;
+        client->active = false;
+        return;
+    }
+    client->outgoing.push_back(frame);
+    client->queued_bytes += frame->size();
+}
+
+// 按顺序发出客户端队列中的帧(不持有全局锁时调用);另一个线程正在发送时直接返回,由它发完
+void flushFrames(const shared_ptr<ClientInfo>& client) {
+    while (true) {
+        unique_lock<mutex> sending(client->send_mutex, try_to_lock);
+        if (!sending.owns_lock()) {
+            return;
+        }
+        while (true) {
+            shared_ptr<const string> frame;
+            {
+                lock_guard<mutex> lock(client->queue_mutex);
+                if (client->outgoing.empty()) {
+                    break;
+                }
+                frame = client->outgoing.front();
+                client->outgoing.pop_front();
+                client->queued_bytes -= frame->size();
+            }
+            if (client->active && !sendFrame(client->socket, *frame)) {
+                client->active = false;
+            }
+        }
+        sending.unlock();
+
+        // 释放发送锁前其他线程可能刚排入新帧、没拿到锁就返回了,再检查一次
+        lock_guard<mutex> lock(client->queue_mutex);
+        if (client->outgoing.empty()) {
+            return;
+        }
+    }
+}
+
+// 只发给一个客户端,返回客户端是否仍然有效
+bool sendToClient(const shared_ptr<ClientInfo>& client, const string& json_msg) {
+    enqueueFrame(client, make_shared<const string>(makeFrame(json_msg)));
+    flushFrames(client);
+    return client->active;
+}
 
 // 广播消息给所有连接的客户端
 void broadcastMessage(const Message& msg, int exclude_user_id) {
-    string json_msg = JsonMessage::serialize(msg);
-    lock_guard<mutex> lock(g_clients_mutex);
+    auto frame = make_shared<const string>(makeFrame(JsonMessage::serialize(msg)));
+    vector<shared_ptr<ClientInfo>> targets;
+    {
+        lock_guard<mutex> lock(g_clients_mutex);
+        for (auto& client : g_clients) {
+            if (client && client->active && client->user_id != exclude_user_id) {
+                enqueueFrame(client, frame);
+                targets.push_back(client);
+            }
+        }
+    }
+    for (auto& client : targets) {
+        flushFrames(client);
+    }
+}
 
-    for (auto& client : g_clients) {
-        if (client && client->active && client->user_id != exclude_user_id) {
-            if (!sendMessage(client->socket, json_msg)) {
-                client->active = false;
+// 发送消息给房间的所有成员(只遍历该房间,与在线总人数无关)
+// keep_history 为true时记入房间的最近消息(聊天消息),加入/离开通知不记
+// 持锁时只排队,锁外再发送: 一个卡住的客户端不会让其他房间的操作等待
+void sendToRoom(const string& room, const Message& msg, bool keep_history) {
+    auto frame = make_shared<const string>(makeFrame(JsonMessage::serialize(msg)));
+    vector<shared_ptr<ClientInfo>> members;
+    {
+        lock_guard<mutex> lock(g_rooms_mutex);
+        if (keep_history) {
+            recordHistory(room, frame);
+        }
+
+        auto it = g_rooms.find(room);
+        if (it == g_rooms.end()) {
+            return;
+        }
+        for (auto& client : it->second) {
+            if (client->active) {
+                enqueueFrame(client, frame);
+                members.push_back(client);
             }
         }
     }
+    for (auto& client : members) {
+        flushFrames(client);
+    }
+}
+
+// 记入房间的最近消息,超过 HISTORY_SIZE 条或 HISTORY_MAX_BYTES 字节时丢弃最早的(调用方持有 g_rooms_mutex)
+void recordHistory(const string& room, const shared_ptr<const string>& frame) {
+    if (g_history.find(room) == g_history.end() && g_history.size() >= HISTORY_MAX_ROOMS) {
+        auto oldest = min_element(g_history.begin(), g_history.end(),
+            [](const pair<const string, RoomHistory>& a, const pair<const string, RoomHistory>& b) {
+                return a.second.last_write < b.second.last_write;
+            });
+        g_history.erase(oldest);
+    }
+
+    RoomHistory& history = g_history[room];
+    history.frames.push_back(frame);
+    history.bytes += frame->size();
+    history.last_write = ++g_history_sequence;
+    while (history.frames.size() > HISTORY_SIZE || (history.bytes > HISTORY_MAX_BYTES && history.frames.size() > 1)) {
+        history.bytes -= history.frames.front()->size();
+        history.frames.pop_front();
+    }
+}
+
+// 把房间最近的消息拼在一起排入新成员的发送队列,之后一次send发出(调用方持有 g_rooms_mutex)
+void replayHistory(shared_ptr<ClientInfo> client_info, const string& room) {
+    auto it = g_history.find(room);
+    if (it == g_history.end() || it->second.frames.empty()) {
+        return;
+    }
+    auto batch = make_shared<string>();
+    batch->reserve(it->second.bytes);
+    for (const auto& frame : it->second.frames) {
+        *batch += *frame;
+    }
+    enqueueFrame(client_info, batch);
+}
+
+// 加入房间并补发房间最近的消息,已是成员或超过 MAX_ROOMS_PER_USER 时返回false
+bool joinRoom(shared_ptr<ClientInfo> client_info, const string& room) {
+    {
+        lock_guard<mutex> lock(g_rooms_mutex);
+        auto& rooms = client_info->rooms;
+        if (find(rooms.begin(), rooms.end(), room) != rooms.end() || rooms.size() >= MAX_ROOMS_PER_USER) {
+            return false;
+        }
+        rooms.push_back(room);
+        g_rooms[room].push_back(client_info);
+        replayHistory(client_info, room);
+    }
+    flushFrames(client_info);
+    return true;
+}
+
+// 离开房间,最后一个成员离开后删除房间
+bool leaveRoom(shared_ptr<ClientInfo> client_info, const string& room) {
+    lock_guard<mutex> lock(g_rooms_mutex);
+    auto& rooms = client_info->rooms;
+    auto room_it = find(rooms.begin(), rooms.end(), room);
+    if (room_it == rooms.end()) {
+        return false;
+    }
+    rooms.erase(room_it);
+
+    auto& members = g_rooms[room];
+    members.erase(remove(members.begin(), members.end(), client_info), members.end());
+    if (members.empty()) {
+        g_rooms.erase(room);
+    }
+    return true;
+}
+
+// 离开所有房间(客户端断开时调用)
+void leaveAllRooms(shared_ptr<ClientInfo> client_info) {
+    vector<string> rooms;
+    {
+        lock_guard<mutex> lock(g_rooms_mutex);
+        rooms = client_info->rooms;
+    }
+    for (const auto& room : rooms) {
+        leaveRoom(client_info, room);
+    }
+}
+
+// 检查客户端是否在房间中
+bool isInRoom(shared_ptr<ClientInfo> client_info, const string& room) {
+    lock_guard<mutex> lock(g_rooms_mutex);
+    auto& rooms = client_info->rooms;
+    return find(rooms.begin(), rooms.end(), room) != rooms.end();
+}
+
+// 只发给一个客户端的系统消息
+void sendSystemMessage(shared_ptr<ClientInfo> client_info, const string& content) {
+    Message system_msg(MSG_SYSTEM, "System", content);
+    system_msg.timestamp = getCurrentTime();
+    sendToClient(client_info, JsonMessage::serialize(system_msg));
 }
 
 // 移除客户端
@@ -127,11 +344,14 @@ bool handleLogin(shared_ptr<ClientInfo> client_info) {
     Message ack_msg(MSG_LOGIN, "System", "Login successful");
     ack_msg.user_id = client_info->user_id;
     ack_msg.timestamp = getCurrentTime();
-    if (!sendMessage(client_info->socket, JsonMessage::serialize(ack_msg))) {
+    if (!sendToClient(client_info, JsonMessage::serialize(ack_msg))) {
         cout << "Failed to send login ACK" << endl;
         return false;
     }
 
+    // 确认之后再加入默认房间: 补发的历史紧跟在确认后面(代理以第一条消息作为登录确认)
+    joinRoom(client_info, DEFAULT_ROOM);
+
     // 通知其他用户
     notifyUserJoined(client_info->username, client_info->user_id);
     return true;
@@ -143,17 +363,77 @@ void handleChatMessage(const Message& recv_msg, shared_ptr<ClientInfo> client_in
     chat_msg.username = client_info->username;
     chat_msg.user_id = client_info->user_id;
     chat_msg.timestamp = getCurrentTime();
+    if (chat_msg.room.empty()) {
+        chat_msg.room = DEFAULT_ROOM;
+    }
+
+    // 只有房间成员可以发言
+    if (!isInRoom(client_info, chat_msg.room)) {
+        sendSystemMessage(client_info, "You are not in room #" + chat_msg.room);
+        return;
+    }
 
-    cout << "[" << chat_msg.timestamp << "] "
+    cout << "[" << chat_msg.timestamp << "] [#" << chat_msg.room << "] "
          << chat_msg.username << ": " << chat_msg.content << endl;
 
-    broadcastMessage(chat_msg);
+    sendToRoom(chat_msg.room, chat_msg, true);
+}
+
+// 处理加入房间请求,通知房间成员(包括加入者)
+void handleJoinRoom(const Message& recv_msg, shared_ptr<ClientInfo> client_info) {
+    const string& room = recv_msg.room;
+    if (!isValidRoomName(room)) {
+        sendSystemMessage(client_info, "Invalid room name");
+        return;
+    }
+    if (!joinRoom(client_info, room)) {
+        sendSystemMessage(client_info, "Already in room #" + room + " or joined too many rooms");
+        return;
+    }
+
+    cout << client_info->username << " joined room #" << room << endl;
+
+    Message join_msg(MSG_JOIN, client_info->username, client_info->username + " joined #" + room);
+    join_msg.room = room;
+    join_msg.user_id = client_info->user_id;
+    join_msg.timestamp = getCurrentTime();
+    sendToRoom(room, join_msg);
+}
+
+// 处理离开房间请求,先通知再离开,离开者也会收到确认
+void handleLeaveRoom(const Message& recv_msg, shared_ptr<ClientInfo> client_info) {
+    const string& room = recv_msg.room;
+    if (!isInRoom(client_info, room)) {
+        return;
+    }
+
+    cout << client_info->username << " left room #" << room << endl;
+
+    Message leave_msg(MSG_LEAVE, client_info->username, client_info->username + " left #" + room);
+    leave_msg.room = room;
+    leave_msg.user_id = client_info->user_id;
+    leave_msg.timestamp = getCurrentTime();
+    sendToRoom(room, leave_msg);
+    leaveRoom(client_info, room);
 }
 
-// 处理用户列表请求
-void handleUserListRequest(shared_ptr<ClientInfo> client_info) {
+// 处理用户列表请求,指定房间时只列出该房间的成员
+void handleUserListRequest(const Message& recv_msg, shared_ptr<ClientInfo> client_info) {
     string user_list = "[";
-    {
+    if (!recv_msg.room.empty()) {
+        lock_guard<mutex> lock(g_rooms_mutex);
+        auto it = g_rooms.find(recv_msg.room);
+        if (it != g_rooms.end()) {
+            bool first = true;
+            for (const auto& client : it->second) {
+                if (client->active) {
+                    if (!first) user_list += ",";
+                    user_list += "\"" + client->username + "\"";
+                    first = false;
+                }
+            }
+        }
+    } else {
         lock_guard<mutex> lock(g_clients_mutex);
         bool first = true;
         for (const auto& client : g_clients) {
@@ -167,8 +447,9 @@ void handleUserListRequest(shared_ptr<ClientInfo> client_info) {
     user_list += "]";
 
     Message list_msg(MSG_LIST, "System", user_list);
+    list_msg.room = recv_msg.room;
     list_msg.timestamp = getCurrentTime();
-    sendMessage(client_info->socket, JsonMessage::serialize(list_msg));
+    sendToClient(client_info, JsonMessage::serialize(list_msg));
 }
 
 // 处理单个客户端连接
@@ -207,7 +488,15 @@ void handleClient(shared_ptr<ClientInfo> client_info) {
                 break;
 
             case MSG_LIST:
-                handleUserListRequest(client_info);
+                handleUserListRequest(recv_msg, client_info);
+                break;
+
+            case MSG_JOIN:
+                handleJoinRoom(recv_msg, client_info);
+                break;
+
+            case MSG_LEAVE:
+                handleLeaveRoom(recv_msg, client_info);
                 break;
 
             default:
@@ -216,6 +505,7 @@ void handleClient(shared_ptr<ClientInfo> client_info) {
     }
 
     // 清理资源
+    leaveAllRooms(client_info);
     removeClient(client_info->user_id);
     cout << "Client disconnected: " << client_info->username << endl;
 }
@@ -297,6 +587,11 @@ int main() {
             break;
         }
 
+        // 广播是连续的多次小send,关闭Nagle算法,避免后一条等待对端的延迟确认
+        BOOL nodelay = TRUE;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY,
+                   reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+
         cout << "New connection from " << inet_ntoa(client_addr.sin_addr)
              << ":" << ntohs(client_addr.sin_port) << endl;
 
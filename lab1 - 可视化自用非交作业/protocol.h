@@ -12,6 +12,13 @@
 #define MAX_USERNAME_LEN 32
 #define MAX_USERS 100
 #define MAX_MESSAGE_SIZE (1024 * 1024)  // 最大消息大小 1MB
+#define MAX_ROOM_NAME_LEN 32
+#define MAX_ROOMS_PER_USER 16
+#define DEFAULT_ROOM "lobby"            // 登录后自动加入，未指定房间的消息发往这里
+#define HISTORY_SIZE 50                 // 每个房间保存的最近消息条数，登录或加入房间时补发
+#define HISTORY_MAX_BYTES (256 * 1024)  // 每个房间保存的历史最多占用的字节数
+#define HISTORY_MAX_ROOMS 1024          // 最多保存历史的房间数，超出时丢弃最久没有新消息的房间
+#define MAX_QUEUED_BYTES (4 * 1024 * 1024)  // 发往单个客户端还没发出的数据上限，超出时断开该客户端
 
 // 消息类型
 enum MessageType {
@@ -20,7 +27,9 @@ enum MessageType {
     MSG_CHAT = 3,
     MSG_LIST = 4,
     MSG_ACK = 5,
-    MSG_SYSTEM = 6
+    MSG_SYSTEM = 6,
+    MSG_JOIN = 7,
+    MSG_LEAVE = 8
 };
 
 // 消息结构体
@@ -29,6 +38,7 @@ struct Message {
     std::string username;
     std::string content;
     std::string timestamp;
+    std::string room;       // 房间名，为空表示 DEFAULT_ROOM
     int user_id;
 
     Message() : type(MSG_CHAT), user_id(-1) {}
@@ -37,6 +47,19 @@ struct Message {
         : type(t), username(u), content(c), user_id(-1) {}
 };
 
+// 检查房间名是否有效: 1 ~ MAX_ROOM_NAME_LEN 字节,不含空白和控制字符
+inline bool isValidRoomName(const std::string& room) {
+    if (room.empty() || room.length() > MAX_ROOM_NAME_LEN) {
+        return false;
+    }
+    for (unsigned char ch : room) {
+        if (ch <= ' ' || ch == 0x7F) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // JSON 序列化和反序列化类
 class JsonMessage {
 public:
@@ -46,6 +69,7 @@ public:
         json += "\"type\":\"" + getTypeString(msg.type) + "\",";
         json += "\"username\":\"" + escapeJson(msg.username) + "\",";
         json += "\"content\":\"" + escapeJson(msg.content) + "\",";
+        json += "\"room\":\"" + escapeJson(msg.room) + "\",";
         json += "\"user_id\":" + std::to_string(msg.user_id) + ",";
         json += "\"timestamp\":\"" + msg.timestamp + "\"";
         json += "}";
@@ -59,6 +83,7 @@ public:
         msg.username = unescapeJson(getValue(json, "username"));
         msg.content = unescapeJson(getValue(json, "content"));
         msg.timestamp = getValue(json, "timestamp");
+        msg.room = unescapeJson(getValue(json, "room"));
 
         std::string user_id_str = getValue(json, "user_id");
         if (!user_id_str.empty()) {
@@ -76,7 +101,9 @@ private:
             {MSG_CHAT, "message"},
             {MSG_LIST, "list"},
             {MSG_ACK, "ack"},
-            {MSG_SYSTEM, "system"}
+            {MSG_SYSTEM, "system"},
+            {MSG_JOIN, "join"},
+            {MSG_LEAVE, "leave"}
         };
         return map;
     }
@@ -88,7 +115,9 @@ private:
             {"message", MSG_CHAT},
             {"list", MSG_LIST},
             {"ack", MSG_ACK},
-            {"system", MSG_SYSTEM}
+            {"system", MSG_SYSTEM},
+            {"join", MSG_JOIN},
+            {"leave", MSG_LEAVE}
         };
         return map;
     }
@@ -19,6 +19,10 @@ const users = new Map();
 
 const PORT = 3000;
 
+// 每个用户最多缓存的未取消息数，超出时丢弃最早的
+// 登录时服务器会补发房间的最近消息，前端无需依赖代理长期缓存
+const MAX_QUEUED_MESSAGES = 500;
+
 // 创建HTTP服务器
 const server = http.createServer(handleRequest);
 
@@ -265,6 +269,9 @@ function handleSocketData(userId, data) {
 function broadcastMessage(msg) {
     messageQueues.forEach((queue) => {
         queue.push(msg);
+        if (queue.length > MAX_QUEUED_MESSAGES) {
+            queue.splice(0, queue.length - MAX_QUEUED_MESSAGES);
+        }
     });
 }
 
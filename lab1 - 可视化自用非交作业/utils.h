@@ -20,29 +20,34 @@ inline std::string getCurrentTime() {
     return ss.str();
 }
 
-// 发送字符串消息(带长度头)
-inline bool sendMessage(SOCKET sock, const std::string& message) {
-    try {
-        uint32_t len = static_cast<uint32_t>(message.length());
-        uint32_t network_len = htonl(len);
+// 给消息加上长度头,得到可以直接发送的帧
+inline std::string makeFrame(const std::string& message) {
+    uint32_t network_len = htonl(static_cast<uint32_t>(message.length()));
+    std::string frame(reinterpret_cast<const char*>(&network_len), sizeof(network_len));
+    frame += message;
+    return frame;
+}
 
-        // 发送长度头
-        if (send(sock, reinterpret_cast<const char*>(&network_len),
-                 sizeof(network_len), 0) != sizeof(network_len)) {
+// 发送已加上长度头的数据(可以是多条消息拼在一起,处理部分发送)
+inline bool sendFrame(SOCKET sock, const std::string& frame) {
+    int total_sent = 0;
+    int frame_len = static_cast<int>(frame.length());
+    while (total_sent < frame_len) {
+        int bytes_sent = send(sock, frame.c_str() + total_sent,
+                             frame_len - total_sent, 0);
+        if (bytes_sent == SOCKET_ERROR || bytes_sent == 0) {
             return false;
         }
+        total_sent += bytes_sent;
+    }
+    return true;
+}
 
-        // 发送消息内容(处理部分发送)
-        int total_sent = 0;
-        while (total_sent < static_cast<int>(len)) {
-            int bytes_sent = send(sock, message.c_str() + total_sent,
-                                 len - total_sent, 0);
-            if (bytes_sent == SOCKET_ERROR || bytes_sent == 0) {
-                return false;
-            }
-            total_sent += bytes_sent;
-        }
-        return true;
+// 发送字符串消息(带长度头)
+// 长度头和内容拼在一起发送: 分两次send时,第二段会被Nagle算法压住,直到对端的延迟确认(约40ms)
+inline bool sendMessage(SOCKET sock, const std::string& message) {
+    try {
+        return sendFrame(sock, makeFrame(message));
     } catch (...) {
         return false;
     }
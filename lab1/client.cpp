@@ -5,6 +5,8 @@
 #include <atomic>
 #include <chrono>
 #include <cstdlib>
+#include <vector>
+#include <algorithm>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -23,12 +25,18 @@
 #endif
 
 #include "protocol.h"
+#include "frame_decoder.h"
 
 // 全局变量
 std::atomic<bool> client_running(true);
 SOCKET client_socket = INVALID_SOCKET;
 std::string username;
 
+// 房间（只在主线程使用，服务器会再次检查）
+std::vector<std::string> joined_rooms;          // 已加入的房间
+std::string current_room = DEFAULT_ROOM;        // 普通输入发往的房间（为空表示未加入任何房间）
+#define MAX_JOINED_ROOMS 16                     // 与服务器的 MAX_ROOMS_PER_CLIENT 一致
+
 // 消息统计
 struct ClientStats {
     std::atomic<int> messages_sent{0};      // 发送的消息数
@@ -36,88 +44,127 @@ struct ClientStats {
 } client_stats;
 
 // 函数声明
+void handle_server_message(const MessageView& msg);
 void receive_messages();
 void send_message(MessageType type, const std::string& content = "");
+bool send_room_message(MessageType type, const std::string& room, const std::string& text = "");
+void handle_room_command(const std::string& command, const std::string& room);
 void display_help();
 void display_client_statistics();
 
 /**
- * 接收服务器消息的线程函数
+ * 处理服务器发来的一条消息
  */
-void receive_messages() {
-    char buffer[MAX_PACKET_LEN];
-    ChatMessage msg;
+void handle_server_message(const MessageView& msg) {
+    switch (msg.type) {
+        case MSG_LOGIN: {
+            std::cout << "[系统] " << msg.message << std::endl;
+            break;
+        }
 
-    while (client_running) {
-        int received = recv(client_socket, buffer, MAX_PACKET_LEN, 0);
+        case MSG_LOGOUT: {
+            std::cout << "[系统] " << msg.message << std::endl;
+            break;
+        }
 
-        if (received <= 0) {
-            if (client_running) {
-                std::cout << "\n[系统] 与服务器的连接已断开" << std::endl;
-                std::cout << "[系统] 程序即将退出..." << std::endl;
-                client_running = false;
+        case MSG_CHAT: {
+            bool from_self = msg.username == ByteView(username);
+            std::string time_str = format_timestamp(msg.timestamp);
 
-                // 给主线程一点时间显示消息
-                std::this_thread::sleep_for(std::chrono::milliseconds(500));
-                exit(0); // 强制退出程序
+            // 统计接收到的消息（不包括自己发送的）
+            if (!from_self) {
+                client_stats.messages_received++;
             }
+
+            // 如果是自己发送的消息，显示"我"，否则显示发送者用户名
+            ByteView display_name = from_self ? ByteView("我") : msg.username;
+            std::cout << "[" << time_str << "] [" << display_name << "] " << msg.message << std::endl;
             break;
         }
 
-        // 反序列化消息
-        if (deserialize_message(buffer, received, msg) < 0) {
-            std::cerr << "[错误] 消息格式错误" << std::endl;
-            continue;
+        case MSG_JOIN_ROOM:
+        case MSG_LEAVE_ROOM: {
+            ByteView room, text;
+            if (parse_room_message(msg, room, text)) {
+                std::cout << "[系统] [#" << room << "] " << text << std::endl;
+            }
+            break;
         }
 
-        // 处理不同类型的消息
-        switch (msg.type) {
-            case MSG_LOGIN: {
-                std::string message_content(msg.message, msg.message_len);
-                std::cout << "[系统] " << message_content << std::endl;
+        case MSG_ROOM_CHAT: {
+            ByteView room, text;
+            if (!parse_room_message(msg, room, text)) {
                 break;
             }
+            bool from_self = msg.username == ByteView(username);
+            std::string time_str = format_timestamp(msg.timestamp);
 
-            case MSG_LOGOUT: {
-                std::string message_content(msg.message, msg.message_len);
-                std::cout << "[系统] " << message_content << std::endl;
-                break;
+            if (!from_self) {
+                client_stats.messages_received++;
             }
 
-            case MSG_CHAT: {
-                std::string sender(msg.username, msg.username_len);
-                std::string message_content(msg.message, msg.message_len);
-                std::string time_str = format_timestamp(msg.timestamp);
-
-                // 统计接收到的消息（不包括自己发送的）
-                if (sender != username) {
-                    client_stats.messages_received++;
-                }
-
-                // 如果是自己发送的消息，显示"我"，否则显示发送者用户名
-                std::string display_name = (sender == username) ? "我" : sender;
-                std::cout << "[" << time_str << "] [" << display_name << "] " << message_content << std::endl;
-                break;
-            }
+            ByteView display_name = from_self ? ByteView("我") : msg.username;
+            std::cout << "[" << time_str << "] [#" << room << "] [" << display_name << "] " << text << std::endl;
+            break;
+        }
 
-            case MSG_SERVER_SHUTDOWN: {
-                std::string message_content(msg.message, msg.message_len);
-                std::cout << "[系统] " << message_content << std::endl;
-                client_running = false;
+        case MSG_SERVER_SHUTDOWN: {
+            std::cout << "[系统] " << msg.message << std::endl;
+            client_running = false;
 
-                // 主动关闭socket，让主线程能够退出
-                std::cout << "[系统] 程序即将退出..." << std::endl;
+            // 主动关闭socket，让主线程能够退出
+            std::cout << "[系统] 程序即将退出..." << std::endl;
 #ifdef _WIN32
-                // Windows下关闭socket输入，让主线程的getline能够返回
-                closesocket(client_socket);
+            // Windows下关闭socket输入，让主线程的getline能够返回
+            closesocket(client_socket);
 #else
-                close(client_socket);
+            close(client_socket);
 #endif
-                // 给主线程一点时间处理
-                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            // 给主线程一点时间处理
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            exit(0); // 强制退出程序
+            break;
+        }
+    }
+}
+
+/**
+ * 接收服务器消息的线程函数
+ */
+void receive_messages() {
+    FrameDecoder decoder;
+    MessageView msg;
+
+    while (client_running) {
+        int space = 0;
+        char* buffer = decoder.write_space(space);
+        int received = recv(client_socket, buffer, space, 0);
+
+        if (received <= 0) {
+            if (client_running) {
+                std::cout << "\n[系统] 与服务器的连接已断开" << std::endl;
+                std::cout << "[系统] 程序即将退出..." << std::endl;
+                client_running = false;
+
+                // 给主线程一点时间显示消息
+                std::this_thread::sleep_for(std::chrono::milliseconds(500));
                 exit(0); // 强制退出程序
-                break;
             }
+            break;
+        }
+
+        // 逐条处理本次读到的所有完整消息，不完整的部分留到下次读取
+        decoder.commit(received);
+        int result;
+        while ((result = decoder.next(msg)) > 0) {
+            handle_server_message(msg);
+        }
+        if (result < 0) {
+            // 无法确定下一条消息的边界，连接已不可用
+            std::cerr << "[错误] 消息格式错误" << std::endl;
+            std::cout << "[系统] 程序即将退出..." << std::endl;
+            client_running = false;
+            exit(1);
         }
     }
 }
@@ -126,16 +173,11 @@ void receive_messages() {
  * 发送消息到服务器
  */
 void send_message(MessageType type, const std::string& content) {
-    ChatMessage msg;
-    msg.type = type;
-    msg.username_len = username.length();
-    strncpy(msg.username, username.c_str(), MAX_USERNAME_LEN - 1);
-    msg.message_len = content.length();
-    strncpy(msg.message, content.c_str(), MAX_MESSAGE_LEN - 1);
-    msg.timestamp = get_current_timestamp(); // 添加当前时间戳
+    MessageView msg(type, username, content, get_current_timestamp());
 
+    // 直接编码到发送缓冲区
     char buffer[MAX_PACKET_LEN];
-    int len = serialize_message(msg, buffer, MAX_PACKET_LEN);
+    int len = write_message(msg, buffer, MAX_PACKET_LEN);
 
     if (len > 0) {
         int sent = send(client_socket, buffer, len, 0);
@@ -145,6 +187,77 @@ void send_message(MessageType type, const std::string& content) {
     }
 }
 
+/**
+ * 发送房间消息（加入、离开或房间聊天）
+ * @return 房间名无效或消息太长返回false
+ */
+bool send_room_message(MessageType type, const std::string& room, const std::string& text) {
+    if (!valid_room_name(room)) {
+        return false;
+    }
+    MessageView msg(type, username, text, get_current_timestamp());
+
+    char buffer[MAX_PACKET_LEN];
+    int len = write_message(msg, buffer, MAX_PACKET_LEN, room);
+    if (len < 0) {
+        return false;
+    }
+
+    int sent = send(client_socket, buffer, len, 0);
+    if (sent == SOCKET_ERROR) {
+        std::cerr << "[错误] 发送消息失败" << std::endl;
+    }
+    return true;
+}
+
+/**
+ * 处理房间命令：/join、/leave、/room
+ */
+void handle_room_command(const std::string& command, const std::string& room) {
+    if (!valid_room_name(room)) {
+        std::cout << "[警告] 房间名无效（1-" << MAX_ROOM_NAME_LEN << "个字节，不能包含空格）" << std::endl;
+        return;
+    }
+
+    std::vector<std::string>::iterator it = std::find(joined_rooms.begin(), joined_rooms.end(), room);
+
+    if (command == "/join") {
+        if (it != joined_rooms.end()) {
+            current_room = room;
+            std::cout << "[系统] 已在房间 #" << room << " 中，已切换到该房间" << std::endl;
+            return;
+        }
+        if (joined_rooms.size() >= MAX_JOINED_ROOMS) {
+            std::cout << "[警告] 最多同时加入 " << MAX_JOINED_ROOMS << " 个房间" << std::endl;
+            return;
+        }
+        send_room_message(MSG_JOIN_ROOM, room);
+        joined_rooms.push_back(room);
+        current_room = room;
+    } else if (command == "/leave") {
+        if (it == joined_rooms.end()) {
+            std::cout << "[警告] 未加入房间 #" << room << std::endl;
+            return;
+        }
+        send_room_message(MSG_LEAVE_ROOM, room);
+        joined_rooms.erase(it);
+        if (current_room == room) {
+            // 切换到仍在的第一个房间，一个都没有时需先 /join
+            current_room = joined_rooms.empty() ? "" : joined_rooms.front();
+            if (!current_room.empty()) {
+                std::cout << "[系统] 已切换到房间 #" << current_room << std::endl;
+            }
+        }
+    } else if (command == "/room") {
+        if (it == joined_rooms.end()) {
+            std::cout << "[警告] 未加入房间 #" << room << "，请先 /join " << room << std::endl;
+            return;
+        }
+        current_room = room;
+        std::cout << "[系统] 已切换到房间 #" << current_room << std::endl;
+    }
+}
+
 /**
  * 显示帮助信息
  */
@@ -156,12 +269,17 @@ void display_help() {
     std::cout << "  /quit       - 退出聊天程序" << std::endl;
     std::cout << "  /help       - 显示帮助信息" << std::endl;
     std::cout << "  /stats      - 显示消息统计" << std::endl;
-    std::cout << "  其他输入    - 发送聊天消息" << std::endl;
+    std::cout << "  /join 房间  - 加入房间并切换到该房间" << std::endl;
+    std::cout << "  /leave 房间 - 离开房间" << std::endl;
+    std::cout << "  /room 房间  - 切换发言的房间（须已加入）" << std::endl;
+    std::cout << "  /rooms      - 显示已加入的房间" << std::endl;
+    std::cout << "  其他输入    - 发送到当前房间（默认 #" DEFAULT_ROOM "）" << std::endl;
     std::cout << "\n注意:" << std::endl;
     std::cout << "  - 要发送包含'quit'的聊天内容，直接输入即可" << std::endl;
     std::cout << "  - 只有输入 '/quit' 才会退出程序" << std::endl;
     std::cout << "  - 支持中英文聊天内容" << std::endl;
     std::cout << "  - 支持显示消息发送时间" << std::endl;
+    std::cout << "  - 房间消息只有房间成员才能收到" << std::endl;
     std::cout << "========================================\n" << std::endl;
 }
 
@@ -251,8 +369,9 @@ int main(int argc, char* argv[]) {
 
     std::cout << "[信息] 已连接到服务器" << std::endl;
 
-    // 发送登录消息
+    // 发送登录消息（服务器会自动把客户端加入默认房间）
     send_message(MSG_LOGIN, username + " 加入了聊天");
+    joined_rooms.push_back(DEFAULT_ROOM);
 
     // 启动接收消息线程
     std::thread receive_thread(receive_messages);
@@ -291,18 +410,43 @@ int main(int argc, char* argv[]) {
         } else if (input == "/stats") {
             display_client_statistics();
             continue;
+        } else if (input == "/rooms") {
+            std::cout << "[系统] 已加入的房间:";
+            for (size_t i = 0; i < joined_rooms.size(); i++) {
+                std::cout << " #" << joined_rooms[i] << (joined_rooms[i] == current_room ? "（当前）" : "");
+            }
+            std::cout << std::endl;
+            continue;
+        } else if (input.compare(0, 6, "/join ") == 0 || input.compare(0, 7, "/leave ") == 0
+                   || input.compare(0, 6, "/room ") == 0) {
+            size_t space = input.find(' ');
+            handle_room_command(input.substr(0, space), input.substr(space + 1));
+            continue;
         } else if (input.empty()) {
             continue;
         }
 
-        // 检查消息长度
-        if (input.length() > MAX_MESSAGE_LEN - 1) {
-            std::cout << "[警告] 消息太长，请输入较短的消息（最大" << (MAX_MESSAGE_LEN - 1) << "个字符）" << std::endl;
+        if (current_room.empty()) {
+            std::cout << "[警告] 未加入任何房间，请先 /join 房间" << std::endl;
             continue;
         }
 
-        // 发送聊天消息
-        send_message(MSG_CHAT, input);
+        // 检查消息长度（房间消息还要加上房间名）
+        size_t limit = MAX_MESSAGE_LEN - 1;
+        if (current_room != DEFAULT_ROOM) {
+            limit -= 1 + current_room.length();
+        }
+        if (input.length() > limit) {
+            std::cout << "[警告] 消息太长，请输入较短的消息（最大" << limit << "个字符）" << std::endl;
+            continue;
+        }
+
+        // 默认房间沿用 MSG_CHAT，其他房间发送 MSG_ROOM_CHAT
+        if (current_room == DEFAULT_ROOM) {
+            send_message(MSG_CHAT, input);
+        } else {
+            send_room_message(MSG_ROOM_CHAT, current_room, input);
+        }
 
         // 统计发送的消息
         client_stats.messages_sent++;
@@ -0,0 +1,158 @@
+#ifndef CLIENT_REGISTRY_H
+#define CLIENT_REGISTRY_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * 在线客户端登记表
+ * ================
+ *
+ * 1. 槽位 + 代数（slot map）
+ *    每个客户端占一个槽位，编号 ClientId = (代数 << 32) | 槽位下标。
+ *    客户端断开时槽位立即回收给下一个连接，同时代数加一，
+ *    仍持有旧编号的地方（如同一轮中稍后的套接字事件）用 get() 查到的是空指针，不会误用新连接。
+ *    槽位数只等于同时在线数的峰值，与历史连接总数无关。
+ *    代数只用31位，有效编号的最高位恒为0，最高位为1的值留给事件循环中的其他套接字（如监控端口）。
+ *
+ * 2. 写时复制的快照
+ *    加入和离开只在事件循环线程进行。广播、显示在线用户等遍历操作读取 snapshot()：
+ *    一个只读的 shared_ptr<vector>，有变化后第一次读取时重建一次。
+ *    其他线程用 published() 取得最近发布的快照，只在交换指针时短暂同步，不会等待加入/离开。
+ *    快照持有客户端结构的引用，结构在最后一个快照释放后才析构，遍历期间不会失效。
+ */
+
+typedef uint64_t ClientId;
+const ClientId INVALID_CLIENT_ID = 0;   // 代数从1开始，有效编号不为0
+const uint32_t CLIENT_ID_MAX_GENERATION = 0x7FFFFFFF;
+
+template <typename T>
+class SlotRegistry {
+public:
+    typedef std::shared_ptr<T> Ptr;
+    typedef std::shared_ptr<const std::vector<Ptr> > Snapshot;
+
+    SlotRegistry() : count(0), dirty(false) {
+        std::atomic_store(&current, std::make_shared<const std::vector<Ptr> >());
+    }
+
+    /**
+     * 登记一个客户端
+     * @return 分配的编号
+     */
+    ClientId insert(const Ptr& value) {
+        uint32_t index;
+        if (!free_slots.empty()) {
+            index = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            index = (uint32_t)slots.size();
+            slots.push_back(Slot());
+        }
+        slots[index].value = value;
+        count++;
+        dirty = true;
+        return make_id(slots[index].generation, index);
+    }
+
+    /**
+     * 注销客户端并回收槽位，编号随即失效
+     * @return 编号有效返回true
+     */
+    bool erase(ClientId id) {
+        if (!valid(id)) {
+            return false;
+        }
+        Slot& slot = slots[slot_index(id)];
+        slot.value.reset();
+        // 代数在 1 ~ CLIENT_ID_MAX_GENERATION 之间循环，保证编号不为0且最高位为0
+        if (++slot.generation > CLIENT_ID_MAX_GENERATION) {
+            slot.generation = 1;
+        }
+        free_slots.push_back(slot_index(id));
+        count--;
+        dirty = true;
+        return true;
+    }
+
+    /**
+     * 按编号查找客户端
+     * @return 已注销或编号无效时返回空指针
+     */
+    Ptr get(ClientId id) const {
+        return valid(id) ? slots[slot_index(id)].value : Ptr();
+    }
+
+    /**
+     * 按编号查找客户端，不增加引用计数（调用方须保证期间不会注销，如房间消息的逐个转发）
+     * @return 已注销或编号无效时返回空指针
+     */
+    T* find(ClientId id) const {
+        return valid(id) ? slots[slot_index(id)].value.get() : nullptr;
+    }
+
+    /**
+     * 当前登记的客户端数
+     */
+    size_t size() const {
+        return count;
+    }
+
+    /**
+     * 取得当前所有客户端的快照（事件循环线程调用），有变化时先重建并发布
+     */
+    Snapshot snapshot() {
+        if (dirty) {
+            std::shared_ptr<std::vector<Ptr> > fresh = std::make_shared<std::vector<Ptr> >();
+            fresh->reserve(count);
+            for (size_t i = 0; i < slots.size(); i++) {
+                if (slots[i].value) {
+                    fresh->push_back(slots[i].value);
+                }
+            }
+            std::atomic_store(&current, Snapshot(fresh));
+            dirty = false;
+        }
+        return std::atomic_load(&current);
+    }
+
+    /**
+     * 取得最近发布的快照（任意线程调用）
+     */
+    Snapshot published() const {
+        return std::atomic_load(&current);
+    }
+
+private:
+    struct Slot {
+        Ptr value;
+        uint32_t generation;
+
+        Slot() : generation(1) {}
+    };
+
+    static ClientId make_id(uint32_t generation, uint32_t index) {
+        return ((ClientId)generation << 32) | index;
+    }
+
+    static uint32_t slot_index(ClientId id) {
+        return (uint32_t)(id & 0xFFFFFFFFu);
+    }
+
+    // 编号指向的槽位仍被同一个客户端占用
+    bool valid(ClientId id) const {
+        uint32_t index = slot_index(id);
+        return index < slots.size()
+            && slots[index].generation == (uint32_t)(id >> 32)
+            && slots[index].value;
+    }
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free_slots;   // 可复用的槽位下标
+    size_t count;
+    bool dirty;                         // 快照需要重建
+    Snapshot current;                   // 最近发布的快照，用 atomic_load/atomic_store 访问
+};
+
+#endif // CLIENT_REGISTRY_H
@@ -0,0 +1,133 @@
+#ifndef FRAME_DECODER_H
+#define FRAME_DECODER_H
+
+#include <cstddef>
+
+#include "protocol.h"
+
+/**
+ * 流式消息解码
+ * ============
+ *
+ * TCP是字节流，一次recv可能读到多条连在一起的消息，也可能只读到半条。
+ * FrameDecoder 为每个连接维护一个环形输入缓冲区：recv 直接写入缓冲区的空闲部分，
+ * next() 逐条取出其中完整的消息，不完整的尾部留到下次读取后再拼接。
+ * 取出的 MessageView 直接指向环形缓冲区，不复制消息内容；只有跨过缓冲区末尾的消息
+ * 先拼接到一块连续的暂存区。视图在下一次 next() 或 write_space() 之前有效。
+ *
+ * 消息长度由头部推出：2 + 用户名长度 + 2 + 消息长度 + 8，
+ * 用户名长度或消息长度超过上限说明字节流已错位，无法再找到下一条消息的边界，
+ * 此时 next() 返回-1，调用方应断开连接。
+ *
+ * 缓冲区在第一次读取时才分配，只建立了连接的客户端不占用这部分内存。
+ */
+
+// 环形缓冲区容量（2的幂），可容纳十几条最长的消息或数百条短消息
+#define FRAME_BUFFER_SIZE 16384
+
+class FrameDecoder {
+public:
+    FrameDecoder() : data(nullptr), scratch(nullptr), head(0), size(0) {}
+    ~FrameDecoder() {
+        delete[] data;
+        delete[] scratch;
+    }
+
+    /**
+     * 获取可直接写入的连续空闲空间
+     * @param len 输出空闲空间的字节数（空间在尾部回绕时只返回到缓冲区末尾的部分）
+     * @return 写入位置
+     */
+    char* write_space(int& len) {
+        if (!data) {
+            data = new char[FRAME_BUFFER_SIZE];
+        }
+        if (size == 0) {
+            head = 0; // 缓冲区已空，从头开始以获得最大的连续空间
+        }
+        size_t tail = (head + size) & (FRAME_BUFFER_SIZE - 1);
+        size_t contiguous = tail >= head && size < FRAME_BUFFER_SIZE
+            ? FRAME_BUFFER_SIZE - tail
+            : FRAME_BUFFER_SIZE - size;
+        len = (int)contiguous;
+        return data + tail;
+    }
+
+    /**
+     * 确认 write_space() 返回的空间中已写入n字节
+     */
+    void commit(int n) {
+        size += n;
+    }
+
+    /**
+     * 取出下一条完整的消息
+     * @param msg 输出消息，指向缓冲区内部
+     * @return 取到返回1，数据不足一条返回0，消息格式错误返回-1
+     */
+    int next(MessageView& msg) {
+        if (size < 2) {
+            return 0;
+        }
+
+        size_t username_len = byte_at(1);
+        if (username_len > MAX_USERNAME_LEN) {
+            return -1;
+        }
+        if (size < 2 + username_len + 2) {
+            return 0;
+        }
+
+        size_t message_len = (byte_at(2 + username_len) << 8) | byte_at(3 + username_len);
+        if (message_len > MAX_MESSAGE_LEN) {
+            return -1;
+        }
+
+        size_t frame_len = 2 + username_len + 2 + message_len + 8;
+        if (size < frame_len) {
+            return 0;
+        }
+
+        // 消息跨过缓冲区末尾时先拼接成连续的一段
+        const char* frame = data + head;
+        if (head + frame_len > FRAME_BUFFER_SIZE) {
+            if (!scratch) {
+                scratch = new char[MAX_PACKET_LEN];
+            }
+            size_t first = FRAME_BUFFER_SIZE - head;
+            memcpy(scratch, data + head, first);
+            memcpy(scratch + first, data, frame_len - first);
+            frame = scratch;
+        }
+
+        if (parse_message(frame, (int)frame_len, msg) < 0) {
+            return -1;
+        }
+
+        head = (head + frame_len) & (FRAME_BUFFER_SIZE - 1);
+        size -= frame_len;
+        return 1;
+    }
+
+    /**
+     * 缓冲区中尚未取出的字节数
+     */
+    size_t buffered() const {
+        return size;
+    }
+
+private:
+    unsigned char byte_at(size_t offset) const {
+        return (unsigned char)data[(head + offset) & (FRAME_BUFFER_SIZE - 1)];
+    }
+
+    char* data;
+    char* scratch;  // 拼接跨过末尾的消息，第一次用到时才分配
+    size_t head;    // 第一个未取出字节的位置
+    size_t size;    // 未取出的字节数
+
+    FrameDecoder(const FrameDecoder&);
+    FrameDecoder& operator=(const FrameDecoder&);
+};
+
+#endif // FRAME_DECODER_H
@@ -0,0 +1,272 @@
+#ifndef HISTORY_LOG_H
+#define HISTORY_LOG_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "protocol.h"
+#include "outbound_queue.h"
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+/**
+ * 消息历史的持久化日志
+ * ====================
+ *
+ * 一个固定大小、映射到内存的文件，聊天消息按到达顺序追加在末尾，服务器重启后据此恢复各房间的最近消息。
+ * 写入就是一次内存复制，没有系统调用；数据由操作系统写回文件，进程崩溃不会丢失，
+ * 断电时可能丢失最近尚未写回的部分。
+ *
+ * 文件格式：8字节文件头 "CHATLOG1"，之后是连续的记录：
+ *   [记录长度(4字节，大端)] [房间名长度(1字节)] [房间名] [已序列化的消息帧]
+ * 记录长度为0表示结束。每条记录先写内容和其后的结束标记，最后写长度，
+ * 写到一半的记录长度仍为0，读取时自然被忽略。
+ *
+ * 文件写满后由调用方 reset() 并重新写入内存中的历史（压缩），文件大小始终不变。
+ * 内存中的历史应不超过 compact_budget()，压缩后最多占用一半，每次压缩之后至少还能追加半个文件。
+ * 只由一个线程写入，不加锁。
+ * 本文件须在平台套接字定义（SOCKET 等）之后包含。
+ */
+
+// 日志文件的默认大小
+#define HISTORY_LOG_BYTES (16 * 1024 * 1024)
+// 文件头
+#define HISTORY_LOG_MAGIC "CHATLOG1"
+#define HISTORY_LOG_HEADER_LEN 8
+
+class HistoryLog {
+public:
+    HistoryLog() : data(nullptr), size(0), write_offset(0) {
+#ifdef _WIN32
+        file = INVALID_HANDLE_VALUE;
+        mapping = NULL;
+#else
+        fd = -1;
+#endif
+    }
+
+    ~HistoryLog() {
+        close();
+    }
+
+    /**
+     * 打开（不存在时创建）日志文件并映射到内存，文件小于 capacity 时扩展到 capacity
+     * 打开后先 load() 读出已有记录，再 append()
+     * @return 成功返回true；文件不是本格式时返回false，不做任何修改
+     */
+    bool open(const std::string& path, size_t capacity = HISTORY_LOG_BYTES) {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                           OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER existing;
+        if (!GetFileSizeEx(file, &existing)) {
+            close();
+            return false;
+        }
+        size = existing.QuadPart > (LONGLONG)capacity ? (size_t)existing.QuadPart : capacity;
+        // 映射的大小超过文件时，系统把文件扩展到该大小并以0填充
+        mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL);
+        if (mapping == NULL) {
+            close();
+            return false;
+        }
+        data = (char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (data == nullptr) {
+            close();
+            return false;
+        }
+#else
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close();
+            return false;
+        }
+        size = (size_t)st.st_size > capacity ? (size_t)st.st_size : capacity;
+        // 扩展的部分读出来是0
+        if ((size_t)st.st_size < size && ftruncate(fd, (off_t)size) != 0) {
+            close();
+            return false;
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close();
+            return false;
+        }
+        data = (char*)mapped;
+#endif
+
+        if (memcmp(data, HISTORY_LOG_MAGIC, HISTORY_LOG_HEADER_LEN) != 0) {
+            // 新文件全为0，写入文件头；否则不是本格式的文件
+            for (size_t i = 0; i < HISTORY_LOG_HEADER_LEN + 4; i++) {
+                if (data[i] != 0) {
+                    close();
+                    return false;
+                }
+            }
+            memcpy(data, HISTORY_LOG_MAGIC, HISTORY_LOG_HEADER_LEN);
+        }
+        write_offset = HISTORY_LOG_HEADER_LEN;
+        return true;
+    }
+
+    bool is_open() const {
+        return data != nullptr;
+    }
+
+    /**
+     * 依次读出已有的记录，之后的追加接在最后一条有效记录后面
+     * @param visit 形如 void(const std::string& room, const SharedFrame& frame)
+     * @return 读出的记录数
+     */
+    template <typename Visitor>
+    size_t load(Visitor visit) {
+        size_t count = 0;
+        size_t offset = HISTORY_LOG_HEADER_LEN;
+        while (offset + 4 <= size) {
+            uint32_t length = read_length(offset);
+            if (length == 0 || length > size - offset - 4) {
+                break;
+            }
+            const char* record = data + offset + 4;
+            size_t room_len = (unsigned char)record[0];
+            if (room_len + 1 > length) {
+                break;
+            }
+            std::string room(record + 1, room_len);
+            const char* frame = record + 1 + room_len;
+            int frame_len = (int)(length - 1 - room_len);
+
+            // 只接受能完整解析的一条消息，损坏的记录及其后的内容都丢弃
+            MessageView msg;
+            if (!valid_room_name(room) || frame_len > MAX_PACKET_LEN
+                || parse_message(frame, frame_len, msg) != frame_len) {
+                break;
+            }
+            visit(room, std::make_shared<const std::vector<char> >(frame, frame + frame_len));
+            count++;
+            offset += 4 + length;
+        }
+        write_offset = offset;
+        if (write_offset + 4 <= size) {
+            write_length(write_offset, 0);   // 截掉损坏的部分
+        }
+        return count;
+    }
+
+    /**
+     * 追加一条记录
+     * @return 文件已满返回false（调用方应 reset() 后重新写入）
+     */
+    bool append(const std::string& room, const SharedFrame& frame) {
+        if (!data || !frame || room.size() > 255) {
+            return false;
+        }
+        size_t length = 1 + room.size() + frame->size();
+        // 记录之后还要放下4字节的结束标记
+        if (write_offset + 4 + length + 4 > size) {
+            return false;
+        }
+
+        char* record = data + write_offset + 4;
+        write_length(write_offset + 4 + length, 0);
+        record[0] = (char)room.size();
+        memcpy(record + 1, room.data(), room.size());
+        memcpy(record + 1 + room.size(), frame->data(), frame->size());
+        // 长度最后写，之前中断的记录读取时长度为0
+        write_length(write_offset, (uint32_t)length);
+        write_offset += 4 + length;
+        return true;
+    }
+
+    /**
+     * 清空所有记录（文件大小不变）
+     */
+    void reset() {
+        if (data) {
+            write_length(HISTORY_LOG_HEADER_LEN, 0);
+            write_offset = HISTORY_LOG_HEADER_LEN;
+        }
+    }
+
+    /**
+     * 已使用的字节数和文件大小
+     */
+    size_t used_bytes() const {
+        return write_offset;
+    }
+
+    size_t capacity_bytes() const {
+        return size;
+    }
+
+    /**
+     * 压缩后最多占用一半文件时，内存中的历史（帧的字节数合计）的上限
+     * 每条记录的额外开销（长度4字节、房间名）小于帧本身（帧头12字节，房间消息的帧还包含房间名），
+     * 记录不到帧的两倍，因此取可用空间的1/4
+     */
+    size_t compact_budget() const {
+        return size > HISTORY_LOG_HEADER_LEN ? (size - HISTORY_LOG_HEADER_LEN) / 4 : 0;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data) UnmapViewOfFile(data);
+        if (mapping != NULL) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data) munmap(data, size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+        size = 0;
+        write_offset = 0;
+    }
+
+private:
+    HistoryLog(const HistoryLog&);
+    HistoryLog& operator=(const HistoryLog&);
+
+    uint32_t read_length(size_t offset) const {
+        const unsigned char* p = (const unsigned char*)data + offset;
+        return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+    }
+
+    void write_length(size_t offset, uint32_t length) {
+        unsigned char* p = (unsigned char*)data + offset;
+        p[0] = (unsigned char)(length >> 24);
+        p[1] = (unsigned char)(length >> 16);
+        p[2] = (unsigned char)(length >> 8);
+        p[3] = (unsigned char)length;
+    }
+
+    char* data;
+    size_t size;
+    size_t write_offset;    // 下一条记录的位置，此处的长度为0
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+};
+
+#endif // HISTORY_LOG_H
@@ -0,0 +1,723 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+
+#ifdef _WIN32
+    #if !defined(_WIN32_WINNT) || _WIN32_WINNT < 0x0600
+        #undef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
+    #include <process.h>
+    #pragma comment(lib, "ws2_32.lib")
+    #define MSG_NOSIGNAL 0
+    #define getpid _getpid
+#else
+    #include <sys/socket.h>
+    #include <sys/resource.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <arpa/inet.h>
+    #include <unistd.h>
+    #define SOCKET int
+    #define INVALID_SOCKET -1
+    #define SOCKET_ERROR -1
+    #define closesocket close
+#endif
+
+#include "protocol.h"
+#include "reactor.h"
+#include "frame_decoder.h"
+
+/**
+ * 聊天服务器压测工具
+ * ==================
+ *
+ * 在一个事件循环中模拟大量用户：每个用户一个非阻塞连接，登录（可选加入房间）后
+ * 按固定速率发送指定大小的聊天消息，同时接收其他用户的消息。
+ * 支持 lab1 的二进制协议和可视化版的 JSON 协议（4字节长度头 + JSON）。
+ *
+ * 消息正文以 "LG <本次运行的标识> <计划发送时刻ns> <发送者>" 开头，其余用 'x' 填充到指定大小。
+ * 收到后用本进程的单调时钟减去正文中的时刻，得到端到端的送达延迟；
+ * 标识不符的（服务器补发的历史中以前各次运行的消息）不计入，它们的时刻属于别的进程的时钟；
+ * 用计划时刻而不是实际发出的时刻，压测工具自身跟不上时延迟会如实变大，不会被掩盖。
+ * 延迟记入对数分桶的直方图（相对误差约1.6%），最后输出 p50/p99/p99.9。
+ */
+
+// 压测使用的协议
+enum LoadProtocol {
+    PROTO_BINARY,   // lab1：server.cpp
+    PROTO_JSON      // 可视化版：ChatServer.cpp
+};
+
+// 命令行参数
+struct LoadOptions {
+    LoadProtocol protocol;
+    std::string host;
+    int port;
+    int users;              // 模拟用户数
+    double rate;            // 每个用户每秒发送的消息数
+    int size;               // 每条消息正文的字节数
+    double duration;        // 发送阶段的时长（秒）
+    double warmup;          // 全部登录后等待的时长（秒），让登录通知先传完
+    int rooms;              // 房间数，0 表示都在默认房间
+
+    LoadOptions() : protocol(PROTO_BINARY), host("127.0.0.1"), port(0), users(100), rate(1.0),
+                    size(64), duration(10.0), warmup(1.0), rooms(0) {}
+};
+
+// 消息正文的最小长度（运行标识、时刻和发送者编号）
+#define LOAD_MIN_SIZE 64
+// 发送阶段结束后继续接收的时长（毫秒），之后仍未送达的计为丢失
+#define LOAD_DRAIN_MS 2000
+
+/**
+ * 对数分桶的延迟直方图
+ * 小于64的值各占一个桶，之后每个2的幂区间再均分为64个桶
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram() : counts(BUCKETS, 0), total(0), max_value(0) {}
+
+    void record(uint64_t value) {
+        counts[bucket_of(value)]++;
+        total++;
+        if (value > max_value) {
+            max_value = value;
+        }
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    uint64_t max() const {
+        return max_value;
+    }
+
+    /**
+     * 第p百分位的值（取所在桶的中点）
+     * @param p 0 ~ 100
+     */
+    uint64_t percentile(double p) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p / 100.0 * total);
+        if (rank >= total) {
+            rank = total - 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > rank) {
+                return bucket_middle(i);
+            }
+        }
+        return max_value;
+    }
+
+private:
+    enum {
+        SUB_BITS = 6,
+        SUB_BUCKETS = 1 << SUB_BITS,
+        BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS
+    };
+
+    static int bucket_of(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return (int)value;
+        }
+        int msb = 0;
+        while (value >> (msb + 1)) {
+            msb++;
+        }
+        int shift = msb - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS + (int)((value >> shift) - SUB_BUCKETS);
+    }
+
+    static uint64_t bucket_middle(int index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        int shift = index / SUB_BUCKETS - 1;
+        uint64_t low = (uint64_t)(index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+        return low + ((uint64_t)1 << shift) / 2;
+    }
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t max_value;
+};
+
+// 一个模拟用户
+struct SimUser {
+    int index;
+    SOCKET socket;
+    std::string name;
+    std::string room;           // 为空表示默认房间
+    FrameDecoder decoder;       // 二进制协议的输入
+    std::string input;          // JSON协议的输入
+    size_t input_offset;        // input 中已处理的字节数
+    std::string output;         // 发送缓冲区满时积压的数据
+    size_t output_offset;
+
+    SimUser() : index(0), socket(INVALID_SOCKET), input_offset(0), output_offset(0) {}
+};
+
+// 全局变量
+LoadOptions options;
+Poller poller;
+std::vector<std::unique_ptr<SimUser> > users;
+std::chrono::steady_clock::time_point clock_start = std::chrono::steady_clock::now();
+std::string payload_prefix;         // "LG <本次运行的标识> "，启动时生成
+std::vector<int> room_sizes;        // 每个房间的人数
+
+// 结果统计
+struct LoadStats {
+    uint64_t messages_sent = 0;         // 发出的消息数
+    uint64_t deliveries_expected = 0;   // 按房间人数应送达的次数
+    uint64_t deliveries = 0;            // 实际送达的次数（每个接收者计一次）
+    uint64_t bytes_received = 0;
+    uint64_t send_backlog_max = 0;      // 单个连接积压的最大字节数
+    uint64_t late_sends = 0;            // 落后于计划超过一个周期的发送次数
+    int disconnects = 0;                // 被服务器断开的连接数
+    LatencyHistogram latency;           // 送达延迟（纳秒）
+} stats;
+
+/**
+ * 本进程启动以来的单调时钟（纳秒）
+ */
+uint64_t now_ns() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - clock_start).count();
+}
+
+/**
+ * 生成本次运行的标识：挂钟时间（纳秒）与进程号，同时运行或先后运行的压测互不混淆
+ */
+void init_payload_prefix() {
+    uint64_t wall_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    payload_prefix = "LG " + std::to_string(wall_ns) + "-" + std::to_string((long)getpid()) + " ";
+}
+
+/**
+ * 生成消息正文："LG <标识> <计划时刻> <发送者>" + 填充
+ */
+std::string make_payload(uint64_t scheduled_ns, int sender) {
+    std::string text = payload_prefix + std::to_string(scheduled_ns) + " " + std::to_string(sender) + " ";
+    if ((int)text.length() < options.size) {
+        text.append(options.size - text.length(), 'x');
+    }
+    return text;
+}
+
+/**
+ * 记录收到的一条压测消息
+ */
+void on_payload(const char* text, size_t len) {
+    size_t prefix_len = payload_prefix.length();
+    if (len <= prefix_len || memcmp(text, payload_prefix.data(), prefix_len) != 0) {
+        return; // 不是本次运行的压测消息（登录通知、补发的历史等）
+    }
+    uint64_t scheduled_ns = strtoull(text + prefix_len, NULL, 10);
+    uint64_t now = now_ns();
+    stats.deliveries++;
+    stats.latency.record(now > scheduled_ns ? now - scheduled_ns : 0);
+}
+
+/**
+ * 发送数据，发送缓冲区满时积压到用户的输出缓冲区
+ */
+void send_bytes(SimUser* user, const char* data, size_t len) {
+    if (user->socket == INVALID_SOCKET) {
+        return;
+    }
+    size_t sent = 0;
+    if (user->output_offset == user->output.size()) {
+        while (sent < len) {
+            int n = send(user->socket, data + sent, (int)(len - sent), MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += n;
+            } else {
+                break;
+            }
+        }
+    }
+    if (sent < len) {
+        user->output.append(data + sent, len - sent);
+        poller.set_write_interest(user->socket, true);
+        uint64_t backlog = user->output.size() - user->output_offset;
+        if (backlog > stats.send_backlog_max) {
+            stats.send_backlog_max = backlog;
+        }
+    }
+}
+
+/**
+ * 发出积压的数据
+ */
+void flush_output(SimUser* user) {
+    while (user->output_offset < user->output.size()) {
+        int n = send(user->socket, user->output.data() + user->output_offset,
+                     (int)(user->output.size() - user->output_offset), MSG_NOSIGNAL);
+        if (n <= 0) {
+            return;
+        }
+        user->output_offset += n;
+    }
+    user->output.clear();
+    user->output_offset = 0;
+    poller.set_write_interest(user->socket, false);
+}
+
+/**
+ * 发送二进制协议的消息
+ */
+void send_binary(SimUser* user, MessageType type, const std::string& text) {
+    MessageView msg(type, user->name, text, get_current_timestamp());
+    bool room_message = type == MSG_JOIN_ROOM || type == MSG_ROOM_CHAT;
+
+    char buffer[MAX_PACKET_LEN];
+    int len = write_message(msg, buffer, MAX_PACKET_LEN, room_message ? ByteView(user->room) : ByteView());
+    if (len > 0) {
+        send_bytes(user, buffer, len);
+    }
+}
+
+/**
+ * 发送JSON协议的消息（字段与可视化版的 JsonMessage 一致，正文不含需要转义的字符）
+ */
+void send_json(SimUser* user, const char* type, const std::string& content) {
+    std::string json = "{\"type\":\"";
+    json += type;
+    json += "\",\"username\":\"" + user->name;
+    json += "\",\"content\":\"" + content;
+    json += "\",\"room\":\"" + user->room;
+    json += "\",\"user_id\":-1,\"timestamp\":\"\"}";
+
+    uint32_t network_len = htonl((uint32_t)json.length());
+    std::string frame((const char*)&network_len, 4);
+    frame += json;
+    send_bytes(user, frame.data(), frame.length());
+}
+
+/**
+ * 登录，指定了房间数时再加入所属的房间
+ */
+void login(SimUser* user) {
+    if (options.protocol == PROTO_BINARY) {
+        send_binary(user, MSG_LOGIN, user->name + " 加入了聊天");
+        if (!user->room.empty()) {
+            send_binary(user, MSG_JOIN_ROOM, "");
+        }
+    } else {
+        send_json(user, "login", "");
+        if (!user->room.empty()) {
+            send_json(user, "join", "");
+        }
+    }
+}
+
+/**
+ * 发送一条压测消息，并按房间人数累计应送达的次数
+ * 二进制协议不回发给发送者，JSON协议会回发
+ */
+void send_chat(SimUser* user, uint64_t scheduled_ns) {
+    std::string payload = make_payload(scheduled_ns, user->index);
+    if (options.protocol == PROTO_BINARY) {
+        send_binary(user, user->room.empty() ? MSG_CHAT : MSG_ROOM_CHAT, payload);
+    } else {
+        send_json(user, "message", payload);
+    }
+
+    int members = options.rooms > 0 ? room_sizes[user->index % options.rooms] : (int)users.size();
+    stats.messages_sent++;
+    stats.deliveries_expected += options.protocol == PROTO_BINARY ? members - 1 : members;
+}
+
+/**
+ * 处理JSON协议输入中所有完整的消息
+ */
+void parse_json_input(SimUser* user) {
+    while (user->input.size() - user->input_offset >= 4) {
+        uint32_t network_len;
+        memcpy(&network_len, user->input.data() + user->input_offset, 4);
+        size_t len = ntohl(network_len);
+        if (user->input.size() - user->input_offset - 4 < len) {
+            break;
+        }
+        const char* json = user->input.data() + user->input_offset + 4;
+        static const char key[] = "\"content\":\"";
+        const char* end = json + len;
+        const char* content = std::search(json, end, key, key + sizeof(key) - 1);
+        if (content != end) {
+            content += sizeof(key) - 1;
+            const char* quote = std::find(content, end, '"');
+            on_payload(content, quote - content);
+        }
+        user->input_offset += 4 + len;
+    }
+    // 已处理的部分超过一半时再整体前移，避免每条消息都移动
+    if (user->input_offset > user->input.size() / 2) {
+        user->input.erase(0, user->input_offset);
+        user->input_offset = 0;
+    }
+}
+
+/**
+ * 连接被服务器关闭
+ */
+void drop_user(SimUser* user) {
+    if (user->socket != INVALID_SOCKET) {
+        poller.remove(user->socket);
+        closesocket(user->socket);
+        user->socket = INVALID_SOCKET;
+        stats.disconnects++;
+    }
+}
+
+/**
+ * 读到没有数据为止，逐条处理收到的消息
+ */
+void on_readable(SimUser* user) {
+    MessageView msg;
+    char json_buffer[65536];
+
+    while (user->socket != INVALID_SOCKET) {
+        char* buffer;
+        int space;
+        if (options.protocol == PROTO_BINARY) {
+            buffer = user->decoder.write_space(space);
+        } else {
+            buffer = json_buffer;
+            space = sizeof(json_buffer);
+        }
+
+        int received = recv(user->socket, buffer, space, 0);
+        if (received > 0) {
+            stats.bytes_received += received;
+            if (options.protocol == PROTO_BINARY) {
+                user->decoder.commit(received);
+                int result;
+                while ((result = user->decoder.next(msg)) > 0) {
+                    if (msg.type == MSG_CHAT) {
+                        on_payload(msg.message.data, msg.message.size);
+                    } else if (msg.type == MSG_ROOM_CHAT) {
+                        ByteView room, text;
+                        if (parse_room_message(msg, room, text)) {
+                            on_payload(text.data, text.size);
+                        }
+                    }
+                }
+                if (result < 0) {
+                    std::cerr << "[错误] 用户 " << user->name << " 收到格式错误的消息" << std::endl;
+                    drop_user(user);
+                }
+            } else {
+                user->input.append(buffer, received);
+                parse_json_input(user);
+            }
+        } else if (received == SOCKET_ERROR && would_block()) {
+            return;
+        } else {
+            drop_user(user);
+        }
+    }
+}
+
+/**
+ * 处理本轮就绪的所有套接字
+ */
+void poll_events(int timeout_ms) {
+    PollEvent events[POLLER_MAX_EVENTS];
+    int n = poller.wait(events, POLLER_MAX_EVENTS, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        if (events[i].token == 0 || events[i].token > users.size()) {
+            continue;
+        }
+        SimUser* user = users[events[i].token - 1].get();
+        if (events[i].readable || events[i].error) {
+            on_readable(user);
+        }
+        if (user->socket != INVALID_SOCKET && events[i].writable) {
+            flush_output(user);
+        }
+    }
+}
+
+/**
+ * 建立所有连接并登录
+ * @return 全部连接成功返回true
+ */
+bool connect_users(const struct sockaddr_in& server_addr) {
+    room_sizes.assign(options.rooms, 0);
+
+    for (int i = 0; i < options.users; i++) {
+        std::unique_ptr<SimUser> user(new SimUser());
+        user->index = i;
+        user->name = "lg" + std::to_string(i);
+        if (options.rooms > 0) {
+            user->room = "lg-" + std::to_string(i % options.rooms);
+            room_sizes[i % options.rooms]++;
+        }
+
+        user->socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (user->socket == INVALID_SOCKET
+            || connect(user->socket, (const struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
+            std::cerr << "[错误] 第 " << (i + 1) << " 个连接失败" << std::endl;
+            if (user->socket != INVALID_SOCKET) {
+                closesocket(user->socket);
+            }
+            return false;
+        }
+
+        // 消息很小，关闭Nagle算法，避免延迟中混入合并等待
+        int nodelay = 1;
+        setsockopt(user->socket, IPPROTO_TCP, TCP_NODELAY, (char*)&nodelay, sizeof(nodelay));
+
+        if (!set_nonblocking(user->socket) || !poller.add(user->socket, (uint64_t)i + 1)) {
+            std::cerr << "[错误] 注册第 " << (i + 1) << " 个连接失败" << std::endl;
+            closesocket(user->socket);
+            return false;
+        }
+
+        login(user.get());
+        users.push_back(std::move(user));
+
+        // 边连接边处理登录通知，避免服务器的发送队列积压
+        if (i % 64 == 63) {
+            poll_events(0);
+        }
+    }
+    return true;
+}
+
+/**
+ * 发送阶段：按计划时刻发送，直到时长结束；之后继续接收 LOAD_DRAIN_MS
+ */
+void run_load() {
+    typedef std::pair<uint64_t, int> Schedule;   // 计划时刻，用户下标
+    std::priority_queue<Schedule, std::vector<Schedule>, std::greater<Schedule> > schedule;
+
+    stats.bytes_received = 0;   // 只统计发送阶段
+    uint64_t period_ns = (uint64_t)(1e9 / options.rate);
+    uint64_t start_ns = now_ns();
+    uint64_t end_ns = start_ns + (uint64_t)(options.duration * 1e9);
+
+    // 各用户的第一条消息均匀错开，避免同时发送
+    for (int i = 0; i < (int)users.size(); i++) {
+        schedule.push(Schedule(start_ns + period_ns * i / users.size(), i));
+    }
+
+    while (true) {
+        uint64_t now = now_ns();
+        while (!schedule.empty() && schedule.top().first <= now) {
+            Schedule next = schedule.top();
+            schedule.pop();
+            if (next.first >= end_ns) {
+                continue;
+            }
+            SimUser* user = users[next.second].get();
+            if (user->socket == INVALID_SOCKET) {
+                continue;
+            }
+            send_chat(user, next.first);
+
+            // 落后超过一个周期时跳过错过的发送，速率不会超过设定值
+            uint64_t following = next.first + period_ns;
+            if (following + period_ns <= now) {
+                stats.late_sends++;
+                following = now;
+            }
+            schedule.push(Schedule(following, next.second));
+        }
+
+        if (schedule.empty()) {
+            break;
+        }
+        uint64_t wait_ns = schedule.top().first > now ? schedule.top().first - now : 0;
+        poll_events((int)std::min<uint64_t>(wait_ns / 1000000, 10));
+    }
+
+    // 等待最后发出的消息送达
+    uint64_t drain_end = now_ns() + (uint64_t)LOAD_DRAIN_MS * 1000000;
+    while (now_ns() < drain_end && stats.deliveries < stats.deliveries_expected) {
+        poll_events(10);
+    }
+}
+
+/**
+ * 输出压测结果
+ */
+void print_report() {
+    double seconds = options.duration;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "\n========== 压测结果 ==========" << std::endl;
+    std::cout << "协议: " << (options.protocol == PROTO_BINARY ? "binary" : "json")
+              << "  用户数: " << users.size() << "  房间数: " << options.rooms
+              << "  消息大小: " << options.size << " 字节" << std::endl;
+    std::cout << "发送: " << stats.messages_sent << " 条，" << stats.messages_sent / seconds << " 条/秒" << std::endl;
+    double ratio = stats.deliveries_expected ? 100.0 * stats.deliveries / stats.deliveries_expected : 100.0;
+    std::cout << "送达: " << stats.deliveries << " / " << stats.deliveries_expected << "（" << ratio << "%），"
+              << stats.deliveries / seconds << " 条/秒，"
+              << stats.bytes_received / seconds / (1024 * 1024) << " MB/秒" << std::endl;
+    std::cout << "延迟: p50 " << stats.latency.percentile(50) / 1e6 << " ms"
+              << "  p99 " << stats.latency.percentile(99) / 1e6 << " ms"
+              << "  p99.9 " << stats.latency.percentile(99.9) / 1e6 << " ms"
+              << "  最大 " << stats.latency.max() / 1e6 << " ms" << std::endl;
+    if (stats.late_sends > 0) {
+        std::cout << "[警告] 有 " << stats.late_sends << " 次发送落后于计划，压测工具本身可能已到上限" << std::endl;
+    }
+    if (stats.send_backlog_max > 0) {
+        std::cout << "[信息] 单个连接发送积压最多 " << stats.send_backlog_max << " 字节" << std::endl;
+    }
+    if (stats.disconnects > 0) {
+        std::cout << "[警告] " << stats.disconnects << " 个连接被服务器断开" << std::endl;
+    }
+    std::cout << "============================" << std::endl;
+}
+
+/**
+ * 显示命令行用法
+ */
+void print_usage(const char* program) {
+    std::cout << "用法: " << program << " [-P binary|json] [-h 地址] [-p 端口] [-u 用户数] [-r 每人每秒条数]"
+              << " [-s 消息字节数] [-d 秒数] [-w 预热秒数] [-R 房间数]" << std::endl;
+    std::cout << "  -P  协议：binary 为 server.cpp（默认端口8888），json 为可视化版 ChatServer（默认端口12345）" << std::endl;
+    std::cout << "  -u  模拟用户数（默认100）" << std::endl;
+    std::cout << "  -r  每个用户每秒发送的消息数（默认1，可为小数）" << std::endl;
+    std::cout << "  -s  每条消息正文的字节数（默认64，最小" << LOAD_MIN_SIZE << "）" << std::endl;
+    std::cout << "  -d  发送阶段的时长（默认10秒）" << std::endl;
+    std::cout << "  -w  全部登录后开始发送前的等待时长（默认1秒）" << std::endl;
+    std::cout << "  -R  把用户平均分到若干房间，消息只发到所在房间（默认0，都在默认房间）" << std::endl;
+}
+
+/**
+ * 解析命令行参数
+ * @return 参数有效返回true
+ */
+bool parse_options(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "-P") {
+            if (value == "binary") {
+                options.protocol = PROTO_BINARY;
+            } else if (value == "json") {
+                options.protocol = PROTO_JSON;
+            } else {
+                return false;
+            }
+        } else if (arg == "-h") {
+            options.host = value;
+        } else if (arg == "-p") {
+            options.port = atoi(value.c_str());
+        } else if (arg == "-u") {
+            options.users = atoi(value.c_str());
+        } else if (arg == "-r") {
+            options.rate = atof(value.c_str());
+        } else if (arg == "-s") {
+            options.size = atoi(value.c_str());
+        } else if (arg == "-d") {
+            options.duration = atof(value.c_str());
+        } else if (arg == "-w") {
+            options.warmup = atof(value.c_str());
+        } else if (arg == "-R") {
+            options.rooms = atoi(value.c_str());
+        } else {
+            return false;
+        }
+    }
+
+    if (options.port == 0) {
+        options.port = options.protocol == PROTO_BINARY ? 8888 : 12345;
+    }
+    // 二进制协议的正文上限，房间消息还要放下房间名
+    int max_size = options.protocol == PROTO_BINARY ? MAX_MESSAGE_LEN - 1 - (1 + MAX_ROOM_NAME_LEN) : 65536;
+    return options.users > 0 && options.rate > 0 && options.duration > 0 && options.warmup >= 0
+        && options.size >= LOAD_MIN_SIZE && options.size <= max_size
+        && options.rooms >= 0 && options.rooms <= options.users
+        && options.port > 0 && options.port <= 65535;
+}
+
+int main(int argc, char* argv[]) {
+    if (!parse_options(argc, argv)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    init_payload_prefix();
+
+#ifdef _WIN32
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        std::cerr << "[错误] WSAStartup 失败" << std::endl;
+        return 1;
+    }
+    system("chcp 65001 > nul");
+#else
+    // 每个用户一个连接，尽量放宽文件描述符上限
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons((unsigned short)options.port);
+    server_addr.sin_addr.s_addr = inet_addr(options.host.c_str());
+    if (server_addr.sin_addr.s_addr == INADDR_NONE) {
+        std::cerr << "[错误] 无效的服务器IP地址: " << options.host << std::endl;
+        return 1;
+    }
+
+    if (!poller.open()) {
+        std::cerr << "[错误] 初始化事件循环失败" << std::endl;
+        return 1;
+    }
+
+    std::cout << "[信息] 正在建立 " << options.users << " 个连接到 " << options.host << ":" << options.port << "..." << std::endl;
+    if (!connect_users(server_addr)) {
+        return 1;
+    }
+
+    // 等待登录通知和加入房间的确认传完
+    std::cout << "[信息] 全部登录，预热 " << options.warmup << " 秒" << std::endl;
+    uint64_t warmup_end = now_ns() + (uint64_t)(options.warmup * 1e9);
+    while (now_ns() < warmup_end) {
+        poll_events(10);
+    }
+
+    std::cout << "[信息] 开始发送：每人每秒 " << options.rate << " 条，共 " << options.duration << " 秒" << std::endl;
+    run_load();
+    print_report();
+
+    for (size_t i = 0; i < users.size(); i++) {
+        if (users[i]->socket != INVALID_SOCKET) {
+            closesocket(users[i]->socket);
+        }
+    }
+
+#ifdef _WIN32
+    WSACleanup();
+#endif
+
+    return 0;
+}
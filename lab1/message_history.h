@@ -0,0 +1,162 @@
+#ifndef MESSAGE_HISTORY_H
+#define MESSAGE_HISTORY_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "outbound_queue.h"
+
+/**
+ * 房间的最近消息
+ * ==============
+ *
+ * 每个房间一个环形缓冲区，保存最近 capacity 条已序列化的聊天消息（SharedFrame），
+ * 新用户登录或加入房间时整批放入其发送队列，随本轮的其他消息一次 writev 发出。
+ * 保存的就是转发时用的同一个帧，只多一个引用，不复制消息内容。
+ *
+ * 内存有上限：每个房间最多 capacity 条，有历史的房间最多 HISTORY_MAX_ROOMS 个，
+ * 设置了字节上限时所有房间的帧合计不超过该值，超出时都丢弃最久没有新消息的房间。
+ * 只在事件循环线程使用，不加锁。
+ * 本文件须在平台套接字定义（SOCKET 等）之后包含。
+ */
+
+// 每个房间默认保存的消息条数
+#define HISTORY_DEFAULT_CAPACITY 50
+// 最多保存历史的房间数
+#define HISTORY_MAX_ROOMS 1024
+
+class MessageHistory {
+public:
+    MessageHistory() : capacity(HISTORY_DEFAULT_CAPACITY), byte_limit(0), sequence(0), bytes(0), frames(0) {}
+
+    /**
+     * 设置每个房间保存的条数（须在记录之前设置），0 表示不保存
+     */
+    void set_capacity(size_t per_room) {
+        capacity = per_room;
+    }
+
+    /**
+     * 设置所有房间合计的字节上限（须在记录之前设置），0 表示只按条数限制
+     * 刚写入的房间不会被丢弃，调用方应保证一个房间写满（capacity 条最长的消息）不超过该值
+     */
+    void set_byte_limit(size_t limit) {
+        byte_limit = limit;
+    }
+
+    /**
+     * 记录一条发到房间的消息，房间已满时覆盖最早的一条
+     */
+    void record(const std::string& room, const SharedFrame& frame) {
+        if (capacity == 0 || !frame) {
+            return;
+        }
+
+        std::unordered_map<std::string, Ring>::iterator it = rooms.find(room);
+        if (it == rooms.end()) {
+            if (rooms.size() >= HISTORY_MAX_ROOMS) {
+                evict_oldest_room();
+            }
+            it = rooms.insert(std::make_pair(room, Ring())).first;
+            it->second.frames.reserve(capacity);
+        }
+
+        Ring& ring = it->second;
+        if (ring.frames.size() < capacity) {
+            ring.frames.push_back(frame);
+            frames++;
+        } else {
+            bytes -= ring.frames[ring.next]->size();
+            ring.frames[ring.next] = frame;
+        }
+        bytes += frame->size();
+        ring.next = (ring.next + 1) % capacity;
+        ring.last_write = ++sequence;
+
+        // 刚写入的房间序号最大，不会被选中
+        while (byte_limit > 0 && bytes > byte_limit && rooms.size() > 1) {
+            evict_oldest_room();
+        }
+    }
+
+    /**
+     * 按从早到晚的顺序把房间的历史追加到 out
+     * @return 追加的条数
+     */
+    size_t collect(const std::string& room, std::vector<SharedFrame>& out) const {
+        std::unordered_map<std::string, Ring>::const_iterator it = rooms.find(room);
+        if (it == rooms.end()) {
+            return 0;
+        }
+        const Ring& ring = it->second;
+        // 未写满时从0开始，写满后 next 指向最早的一条
+        size_t start = ring.frames.size() < capacity ? 0 : ring.next;
+        for (size_t i = 0; i < ring.frames.size(); i++) {
+            out.push_back(ring.frames[(start + i) % ring.frames.size()]);
+        }
+        return ring.frames.size();
+    }
+
+    /**
+     * 按房间依次访问所有历史，房间内从早到晚
+     * @param visit 形如 void(const std::string& room, const SharedFrame& frame)
+     */
+    template <typename Visitor>
+    void for_each(Visitor visit) const {
+        std::vector<SharedFrame> ordered;
+        for (std::unordered_map<std::string, Ring>::const_iterator it = rooms.begin(); it != rooms.end(); ++it) {
+            ordered.clear();
+            collect(it->first, ordered);
+            for (size_t i = 0; i < ordered.size(); i++) {
+                visit(it->first, ordered[i]);
+            }
+        }
+    }
+
+    /**
+     * 保存的消息条数和这些帧的总字节数
+     */
+    size_t frame_count() const {
+        return frames;
+    }
+
+    size_t byte_count() const {
+        return bytes;
+    }
+
+private:
+    struct Ring {
+        std::vector<SharedFrame> frames;
+        size_t next;            // 下一条写入的位置
+        uint64_t last_write;    // 最近一次写入的序号，房间过多时丢弃最小的
+
+        Ring() : next(0), last_write(0) {}
+    };
+
+    void evict_oldest_room() {
+        std::unordered_map<std::string, Ring>::iterator oldest = rooms.begin();
+        for (std::unordered_map<std::string, Ring>::iterator it = rooms.begin(); it != rooms.end(); ++it) {
+            if (it->second.last_write < oldest->second.last_write) {
+                oldest = it;
+            }
+        }
+        if (oldest != rooms.end()) {
+            for (size_t i = 0; i < oldest->second.frames.size(); i++) {
+                bytes -= oldest->second.frames[i]->size();
+            }
+            frames -= oldest->second.frames.size();
+            rooms.erase(oldest);
+        }
+    }
+
+    std::unordered_map<std::string, Ring> rooms;
+    size_t capacity;
+    size_t byte_limit;
+    uint64_t sequence;
+    size_t bytes;
+    size_t frames;
+};
+
+#endif // MESSAGE_HISTORY_H
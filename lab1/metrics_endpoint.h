@@ -0,0 +1,224 @@
+#ifndef METRICS_ENDPOINT_H
+#define METRICS_ENDPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "reactor.h"
+
+/**
+ * 监控接口
+ * ========
+ *
+ * 一个极简的HTTP服务，只响应 GET /metrics，返回 Prometheus 文本格式的指标。
+ * 监听套接字和连接都登记在服务器自己的 Poller 中，由事件循环线程处理，不另开线程；
+ * 指标内容由调用方在事件循环线程中生成，可以直接读取客户端列表而不加锁。
+ *
+ * 每个连接只处理一个请求，回复后关闭（Connection: close）。
+ * 同时最多 METRICS_MAX_CONNECTIONS 个连接，已满时关闭最早的连接，慢连接占不住端口。
+ * 事件标识的最高位为1，不会与客户端编号（最高位为0）冲突。
+ * 本文件须在平台套接字定义（SOCKET、closesocket 等）之后包含。
+ */
+
+#define METRICS_MAX_CONNECTIONS 8
+// 请求头的上限，超过即视为无效请求
+#define METRICS_MAX_REQUEST 4096
+// 监听套接字的事件标识，连接为 METRICS_LISTEN_TOKEN + 1 + 下标
+#define METRICS_LISTEN_TOKEN (UINT64_C(1) << 63)
+
+class MetricsEndpoint {
+public:
+    // 生成指标内容（在事件循环线程中调用）
+    typedef std::string (*Renderer)();
+
+    MetricsEndpoint() : listen_socket(INVALID_SOCKET), next_serial(0) {}
+
+    /**
+     * 在指定端口监听并登记到 poller
+     * @return 成功返回true
+     */
+    bool open(Poller& poller, unsigned short port) {
+        listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listen_socket == INVALID_SOCKET) {
+            return false;
+        }
+
+        int reuse = 1;
+        setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse, sizeof(reuse));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+
+        if (bind(listen_socket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR
+            || listen(listen_socket, METRICS_MAX_CONNECTIONS) == SOCKET_ERROR
+            || !set_nonblocking(listen_socket)
+            || !poller.add(listen_socket, METRICS_LISTEN_TOKEN)) {
+            closesocket(listen_socket);
+            listen_socket = INVALID_SOCKET;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * 事件是否属于监控接口
+     */
+    bool owns(uint64_t token) const {
+        return listen_socket != INVALID_SOCKET
+            && token >= METRICS_LISTEN_TOKEN && token <= METRICS_LISTEN_TOKEN + METRICS_MAX_CONNECTIONS;
+    }
+
+    /**
+     * 处理一个属于监控接口的事件
+     */
+    void on_event(Poller& poller, const PollEvent& event, Renderer render) {
+        if (event.token == METRICS_LISTEN_TOKEN) {
+            accept_pending(poller);
+            return;
+        }
+
+        Connection& conn = connections[event.token - METRICS_LISTEN_TOKEN - 1];
+        if (conn.socket == INVALID_SOCKET) {
+            return;
+        }
+        if (conn.response.empty()) {
+            // 刚登记时就会报告可写，请求读完之前忽略
+            if (event.readable || event.error) {
+                read_request(poller, conn, render);
+            }
+        } else if (event.writable) {
+            write_response(poller, conn);
+        }
+    }
+
+    /**
+     * 关闭监听套接字和所有连接
+     */
+    void stop(Poller& poller) {
+        for (int i = 0; i < METRICS_MAX_CONNECTIONS; i++) {
+            close_connection(poller, connections[i]);
+        }
+        if (listen_socket != INVALID_SOCKET) {
+            poller.remove(listen_socket);
+            closesocket(listen_socket);
+            listen_socket = INVALID_SOCKET;
+        }
+    }
+
+private:
+    struct Connection {
+        SOCKET socket;
+        uint64_t serial;        // 接受的先后，连接已满时关闭最小的
+        std::string request;    // 已读到的请求
+        std::string response;   // 待发送的回复，非空表示请求已处理
+        size_t sent;
+
+        Connection() : socket(INVALID_SOCKET), serial(0), sent(0) {}
+    };
+
+    void accept_pending(Poller& poller) {
+        while (true) {
+            SOCKET s = accept(listen_socket, NULL, NULL);
+            if (s == INVALID_SOCKET) {
+                return;
+            }
+
+            // 找空位，没有就关闭最早的连接
+            int slot = 0;
+            for (int i = 0; i < METRICS_MAX_CONNECTIONS; i++) {
+                if (connections[i].socket == INVALID_SOCKET) {
+                    slot = i;
+                    break;
+                }
+                if (connections[i].serial < connections[slot].serial) {
+                    slot = i;
+                }
+            }
+            close_connection(poller, connections[slot]);
+
+            Connection& conn = connections[slot];
+            if (!set_nonblocking(s) || !poller.add(s, METRICS_LISTEN_TOKEN + 1 + slot)) {
+                closesocket(s);
+                continue;
+            }
+            conn.socket = s;
+            conn.serial = next_serial++;
+        }
+    }
+
+    // 读到请求头结束，生成回复并开始发送
+    void read_request(Poller& poller, Connection& conn, Renderer render) {
+        char buffer[1024];
+        while (true) {
+            int received = recv(conn.socket, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                conn.request.append(buffer, received);
+                if (conn.request.size() > METRICS_MAX_REQUEST) {
+                    close_connection(poller, conn);
+                    return;
+                }
+            } else if (received == SOCKET_ERROR && would_block()) {
+                break;
+            } else {
+                close_connection(poller, conn);
+                return;
+            }
+        }
+
+        if (conn.request.find("\r\n\r\n") == std::string::npos) {
+            return; // 请求还没读完
+        }
+
+        // 只看请求行: GET /metrics[?...] HTTP/1.x
+        if (conn.request.compare(0, 13, "GET /metrics ") == 0 || conn.request.compare(0, 13, "GET /metrics?") == 0) {
+            conn.response = make_response("200 OK", "text/plain; version=0.0.4; charset=utf-8", render());
+        } else {
+            conn.response = make_response("404 Not Found", "text/plain; charset=utf-8", "only /metrics is served\n");
+        }
+        write_response(poller, conn);
+    }
+
+    void write_response(Poller& poller, Connection& conn) {
+        while (conn.sent < conn.response.size()) {
+            int n = send(conn.socket, conn.response.data() + conn.sent, (int)(conn.response.size() - conn.sent), MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.sent += n;
+            } else if (n == SOCKET_ERROR && would_block()) {
+                poller.set_write_interest(conn.socket, true);
+                return;
+            } else {
+                break;
+            }
+        }
+        close_connection(poller, conn);
+    }
+
+    static std::string make_response(const char* status, const char* content_type, const std::string& body) {
+        std::string response = "HTTP/1.1 ";
+        response += status;
+        response += "\r\nContent-Type: ";
+        response += content_type;
+        response += "\r\nContent-Length: " + std::to_string(body.size());
+        response += "\r\nConnection: close\r\n\r\n";
+        response += body;
+        return response;
+    }
+
+    void close_connection(Poller& poller, Connection& conn) {
+        if (conn.socket != INVALID_SOCKET) {
+            poller.remove(conn.socket);
+            closesocket(conn.socket);
+        }
+        conn = Connection();
+    }
+
+    SOCKET listen_socket;
+    Connection connections[METRICS_MAX_CONNECTIONS];
+    uint64_t next_serial;
+};
+
+#endif // METRICS_ENDPOINT_H
@@ -0,0 +1,80 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <utility>
+
+/**
+ * 多生产者单消费者的无锁队列
+ * ==========================
+ *
+ * 用于事件循环之间转交消息：任意线程 push()，只有队列所属的事件循环 pop()。
+ *
+ * 链表实现（Vyukov MPSC）：队头始终有一个已取走内容的哨兵节点。
+ * push() 用一次原子交换把新节点挂到队尾，再把前一个节点的 next 指向它；
+ * pop() 只读写消费者自己的队头，生产者之间、生产者与消费者之间都不加锁。
+ * 同一生产者先后 push 的元素按顺序取出。
+ *
+ * 生产者交换完队尾、尚未链接 next 的一瞬间，pop() 会暂时看到队列为空，
+ * 随后的元素要等到下一次 pop()；调用方在 push() 之后唤醒消费者即可，不会丢失。
+ */
+
+template <typename T>
+class MpscQueue {
+public:
+    MpscQueue() {
+        Node* stub = new Node();
+        tail.store(stub, std::memory_order_relaxed);
+        head = stub;
+    }
+
+    ~MpscQueue() {
+        T value;
+        while (pop(value)) {}
+        delete head;
+    }
+
+    /**
+     * 放入一个元素（任意线程调用）
+     */
+    void push(T value) {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* prev = tail.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * 取出最早的元素（只在消费者线程调用）
+     * @return 队列为空返回false
+     */
+    bool pop(T& value) {
+        Node* next = head->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        // next 成为新的哨兵，内容移出后释放旧哨兵
+        value = std::move(next->value);
+        delete head;
+        head = next;
+        return true;
+    }
+
+private:
+    MpscQueue(const MpscQueue&);
+    MpscQueue& operator=(const MpscQueue&);
+
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+
+        Node() : next(nullptr) {}
+    };
+
+    // 生产者写 tail、消费者写 head，中间隔开一个缓存行，互不干扰
+    std::atomic<Node*> tail;                // 生产者挂入新节点的位置
+    char padding[64];
+    Node* head;                             // 哨兵节点，只由消费者访问
+};
+
+#endif // MPSC_QUEUE_H
@@ -0,0 +1,148 @@
+#ifndef OUTBOUND_QUEUE_H
+#define OUTBOUND_QUEUE_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "protocol.h"
+
+#ifndef _WIN32
+    #include <sys/uio.h>
+    #include <cerrno>
+#endif
+
+/**
+ * 客户端发送队列
+ * ==============
+ *
+ * 广播时消息只序列化一次，得到的 SharedFrame 由所有接收者的队列共享（引用计数），
+ * 事件循环在套接字可写时把队列中的多条消息合并成一次 writev（Windows为WSASend）发出。
+ * 发不完的部分留在队列里等下次可写，不会阻塞其他客户端。
+ */
+
+// 一条已序列化的消息，发送完毕后由最后一个持有者释放
+typedef std::shared_ptr<const std::vector<char> > SharedFrame;
+
+// 一次系统调用最多合并的消息条数
+#define OUTBOUND_IOV_MAX 64
+
+/**
+ * 编码消息，得到可共享的发送帧
+ * 按编码后的长度分配一次，直接写入帧的缓冲区，不经过中间缓冲区
+ * @param room 非空时编码为房间消息，msg.message 为正文
+ * @return 长度超过上限返回空指针
+ */
+inline SharedFrame make_frame(const MessageView& msg, ByteView room = ByteView()) {
+    size_t len = message_wire_size(msg, room);
+    if (len > MAX_PACKET_LEN) {
+        return SharedFrame();
+    }
+    std::shared_ptr<std::vector<char> > frame = std::make_shared<std::vector<char> >(len);
+    if (write_message(msg, frame->data(), (int)len, room) != (int)len) {
+        return SharedFrame();
+    }
+    return frame;
+}
+
+class OutboundQueue {
+public:
+    OutboundQueue() : front_offset(0), bytes(0) {}
+
+    void push(const SharedFrame& frame) {
+        frames.push_back(frame);
+        bytes += frame->size();
+    }
+
+    bool empty() const {
+        return frames.empty();
+    }
+
+    /**
+     * 尚未发出的字节数
+     */
+    size_t pending_bytes() const {
+        return bytes - front_offset;
+    }
+
+    /**
+     * 丢弃所有还没开始发送的消息（已发出一部分的第一条须发完，否则字节流会错位）
+     * @return 丢弃的消息条数
+     */
+    size_t discard_unsent() {
+        size_t keep = front_offset > 0 ? 1 : 0;
+        size_t discarded = frames.size() - keep;
+        while (frames.size() > keep) {
+            bytes -= frames.back()->size();
+            frames.pop_back();
+        }
+        return discarded;
+    }
+
+    /**
+     * 尽可能多地发出队列中的数据，直到队列为空或套接字发送缓冲区已满
+     * @return 队列已空返回1，发送缓冲区已满返回0，出错返回-1
+     */
+    int flush(SOCKET s) {
+        while (!frames.empty()) {
+            int count = 0;
+#ifdef _WIN32
+            WSABUF iov[OUTBOUND_IOV_MAX];
+            for (std::deque<SharedFrame>::const_iterator it = frames.begin();
+                 it != frames.end() && count < OUTBOUND_IOV_MAX; ++it, ++count) {
+                size_t skip = count == 0 ? front_offset : 0;
+                iov[count].buf = const_cast<char*>((*it)->data()) + skip;
+                iov[count].len = (ULONG)((*it)->size() - skip);
+            }
+            DWORD sent_bytes = 0;
+            if (WSASend(s, iov, count, &sent_bytes, 0, NULL, NULL) == SOCKET_ERROR) {
+                return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+            }
+            size_t sent = sent_bytes;
+#else
+            struct iovec iov[OUTBOUND_IOV_MAX];
+            for (std::deque<SharedFrame>::const_iterator it = frames.begin();
+                 it != frames.end() && count < OUTBOUND_IOV_MAX; ++it, ++count) {
+                size_t skip = count == 0 ? front_offset : 0;
+                iov[count].iov_base = const_cast<char*>((*it)->data()) + skip;
+                iov[count].iov_len = (*it)->size() - skip;
+            }
+            // 等同于 writev，但可以带 MSG_NOSIGNAL，对端已关闭时不会收到SIGPIPE
+            struct msghdr header;
+            memset(&header, 0, sizeof(header));
+            header.msg_iov = iov;
+            header.msg_iovlen = count;
+            ssize_t n = sendmsg(s, &header, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+            }
+            size_t sent = (size_t)n;
+#endif
+            consume(sent);
+        }
+        return 1;
+    }
+
+private:
+    // 移除已发出的字节
+    void consume(size_t sent) {
+        while (sent > 0) {
+            size_t remaining = frames.front()->size() - front_offset;
+            if (sent < remaining) {
+                front_offset += sent;
+                return;
+            }
+            sent -= remaining;
+            bytes -= frames.front()->size();
+            frames.pop_front();
+            front_offset = 0;
+        }
+    }
+
+    std::deque<SharedFrame> frames;
+    size_t front_offset;    // 第一条消息已发出的字节数
+    size_t bytes;           // 队列中所有消息的总字节数（包括第一条已发出的部分）
+};
+
+#endif // OUTBOUND_QUEUE_H
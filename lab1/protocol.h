@@ -3,6 +3,7 @@
 
 #include <string>
 #include <cstring>
+#include <ostream>
 #include <ctime>
 #include <sstream>
 #include <iomanip>
@@ -25,6 +26,13 @@
  *    MSG_CHAT    (0x03): 普通聊天消息
  *    MSG_SERVER_SHUTDOWN (0x04): 服务器关闭消息
  *    MSG_USER_LIST (0x05): 在线用户列表
+ *    MSG_JOIN_ROOM (0x06): 加入房间
+ *    MSG_LEAVE_ROOM (0x07): 离开房间
+ *    MSG_ROOM_CHAT (0x08): 发到指定房间的聊天消息
+ *
+ *    房间相关消息的消息内容为 [房间名长度(1字节)] [房间名(变长)] [正文(变长)]，
+ *    加入/离开时正文为空，服务器转发的通知中正文为提示文字。
+ *    MSG_CHAT 等同于发到默认房间 DEFAULT_ROOM，所有客户端登录后自动加入该房间。
  *
  * 4. 消息流程
  *    a) 客户端连接 -> 发送 MSG_LOGIN
@@ -33,12 +41,14 @@
  *    d) 服务器转发给所有其他客户端
  *    e) 客户端断开 -> 发送 MSG_LOGOUT 或检测连接断开
  *    f) 服务器关闭 -> 发送 MSG_SERVER_SHUTDOWN 给所有客户端
+ *    g) 客户端加入房间 -> MSG_JOIN_ROOM，之后该房间的 MSG_ROOM_CHAT 只转发给房间成员
  *
  * 5. 编码
  *    消息内容支持UTF-8编码，兼容中英文
  *
  * 6. 可靠性
  *    基于TCP协议，保证消息顺序和可靠传输
+ *    TCP不保留消息边界，接收方按长度字段切分字节流（见 frame_decoder.h）
  *    通过返回值检测是否有数据包丢失或连接断开
  */
 
@@ -48,63 +58,124 @@ enum MessageType {
     MSG_LOGOUT = 0x02,          // 退出消息
     MSG_CHAT = 0x03,            // 聊天消息
     MSG_SERVER_SHUTDOWN = 0x04, // 服务器关闭
-    MSG_USER_LIST = 0x05        // 用户列表（可选扩展）
+    MSG_USER_LIST = 0x05,       // 用户列表（可选扩展）
+    MSG_JOIN_ROOM = 0x06,       // 加入房间
+    MSG_LEAVE_ROOM = 0x07,      // 离开房间
+    MSG_ROOM_CHAT = 0x08        // 房间聊天消息
 };
 
 // 最大用户名长度
 #define MAX_USERNAME_LEN 32
 // 最大消息长度
 #define MAX_MESSAGE_LEN 1024
+// 最大房间名长度
+#define MAX_ROOM_NAME_LEN 32
+// 默认房间（MSG_CHAT 发往的房间）
+#define DEFAULT_ROOM "lobby"
 // 最大完整包长度 (增加了8字节的时间戳)
 #define MAX_PACKET_LEN (1 + 1 + MAX_USERNAME_LEN + 2 + MAX_MESSAGE_LEN + 8)
 
-// 消息包结构
-struct ChatMessage {
+/**
+ * 不持有数据的字节序列（指针 + 长度），相当于C++17的 std::string_view
+ * 指向的数据须在使用期间保持有效
+ */
+struct ByteView {
+    const char* data;
+    size_t size;
+
+    ByteView() : data(""), size(0) {}
+    ByteView(const char* d, size_t n) : data(d), size(n) {}
+    ByteView(const char* s) : data(s), size(strlen(s)) {}
+    ByteView(const std::string& s) : data(s.data()), size(s.length()) {}
+
+    bool empty() const {
+        return size == 0;
+    }
+
+    std::string str() const {
+        return std::string(data, size);
+    }
+
+    bool operator==(const ByteView& other) const {
+        return size == other.size && memcmp(data, other.data, size) == 0;
+    }
+
+    bool operator!=(const ByteView& other) const {
+        return !(*this == other);
+    }
+};
+
+inline std::ostream& operator<<(std::ostream& out, const ByteView& view) {
+    return out.write(view.data, (std::streamsize)view.size);
+}
+
+/**
+ * 一条消息（不持有数据）
+ * 解析得到的 username、message 直接指向接收缓冲区，发送时由写入函数直接编码到发送缓冲区，
+ * 收发一条消息都不需要复制到中间结构，也不分配内存
+ */
+struct MessageView {
     unsigned char type;                  // 消息类型
-    unsigned char username_len;          // 用户名长度
-    char username[MAX_USERNAME_LEN];     // 用户名
-    unsigned short message_len;          // 消息长度
-    char message[MAX_MESSAGE_LEN];       // 消息内容
+    ByteView username;                   // 用户名
+    ByteView message;                    // 消息内容（房间消息包含房间名前缀）
     unsigned long long timestamp;        // 时间戳 (Unix时间戳，8字节)
 
-    // 构造函数
-    ChatMessage() : type(0), username_len(0), message_len(0), timestamp(0) {
-        memset(username, 0, MAX_USERNAME_LEN);
-        memset(message, 0, MAX_MESSAGE_LEN);
-    }
+    MessageView() : type(0), timestamp(0) {}
+    MessageView(unsigned char t, ByteView user, ByteView content, unsigned long long ts)
+        : type(t), username(user), message(content), timestamp(ts) {}
 };
 
 /**
- * 序列化消息到缓冲区
- * @param msg 要序列化的消息
- * @param buffer 输出缓冲区
+ * 消息编码后的字节数
+ * @param room 非空时消息内容为 [房间名长度] [房间名] [message]
+ */
+inline size_t message_wire_size(const MessageView& msg, ByteView room = ByteView()) {
+    size_t content_len = msg.message.size + (room.empty() ? 0 : 1 + room.size);
+    return 1 + 1 + msg.username.size + 2 + content_len + 8;
+}
+
+/**
+ * 将消息编码到缓冲区
+ * @param msg 要编码的消息
+ * @param buffer 输出缓冲区（通常就是发送缓冲区）
  * @param buffer_size 缓冲区大小
- * @return 序列化后的字节数，失败返回-1
+ * @param room 非空时编码为房间消息，msg.message 为正文
+ * @return 编码后的字节数，缓冲区不足或长度超过上限返回-1
  */
-inline int serialize_message(const ChatMessage& msg, char* buffer, int buffer_size) {
-    int offset = 0;
+inline int write_message(const MessageView& msg, char* buffer, int buffer_size, ByteView room = ByteView()) {
+    size_t content_len = msg.message.size + (room.empty() ? 0 : 1 + room.size);
+    if (msg.username.size > MAX_USERNAME_LEN || content_len > MAX_MESSAGE_LEN || room.size > MAX_ROOM_NAME_LEN) {
+        return -1;
+    }
 
-    // 检查缓冲区大小 (增加8字节时间戳)
-    int required_size = 1 + 1 + msg.username_len + 2 + msg.message_len + 8;
+    // 检查缓冲区大小 (包含8字节时间戳)
+    int required_size = (int)message_wire_size(msg, room);
     if (buffer_size < required_size) {
         return -1;
     }
 
+    int offset = 0;
+
     // 消息类型
     buffer[offset++] = msg.type;
 
     // 用户名长度和用户名
-    buffer[offset++] = msg.username_len;
-    memcpy(buffer + offset, msg.username, msg.username_len);
-    offset += msg.username_len;
+    buffer[offset++] = (char)msg.username.size;
+    memcpy(buffer + offset, msg.username.data, msg.username.size);
+    offset += (int)msg.username.size;
 
     // 消息长度（网络字节序）
-    buffer[offset++] = (msg.message_len >> 8) & 0xFF;
-    buffer[offset++] = msg.message_len & 0xFF;
+    buffer[offset++] = (content_len >> 8) & 0xFF;
+    buffer[offset++] = content_len & 0xFF;
 
-    // 消息内容
-    memcpy(buffer + offset, msg.message, msg.message_len);
-    offset += msg.message_len;
+    // 消息内容，房间消息先写房间名
+    if (!room.empty()) {
+        buffer[offset++] = (char)room.size;
+        memcpy(buffer + offset, room.data, room.size);
+        offset += (int)room.size;
+    }
+    memcpy(buffer + offset, msg.message.data, msg.message.size);
+    offset += (int)msg.message.size;
 
     // 时间戳（8字节，网络字节序）
     for (int i = 7; i >= 0; i--) {
@@ -115,13 +186,13 @@ inline int serialize_message(const ChatMessage& msg, char* buffer, int buffer_si
 }
 
 /**
- * 从缓冲区反序列化消息
+ * 从缓冲区解析消息，不复制内容
  * @param buffer 输入缓冲区
  * @param buffer_size 缓冲区大小
- * @param msg 输出消息
+ * @param msg 输出消息，username 和 message 指向 buffer 内部
  * @return 消耗的字节数，失败返回-1
  */
-inline int deserialize_message(const char* buffer, int buffer_size, ChatMessage& msg) {
+inline int parse_message(const char* buffer, int buffer_size, MessageView& msg) {
     if (buffer_size < 12) { // 至少需要类型+用户名长度+消息长度+时间戳 (4+8=12)
         return -1;
     }
@@ -131,29 +202,25 @@ inline int deserialize_message(const char* buffer, int buffer_size, ChatMessage&
     // 消息类型
     msg.type = buffer[offset++];
 
-    // 用户名长度
-    msg.username_len = buffer[offset++];
-    if (msg.username_len > MAX_USERNAME_LEN || offset + msg.username_len + 2 + 8 > buffer_size) {
+    // 用户名长度和用户名
+    size_t username_len = (unsigned char)buffer[offset++];
+    if (username_len > MAX_USERNAME_LEN || offset + (int)username_len + 2 + 8 > buffer_size) {
         return -1;
     }
-
-    // 用户名
-    memcpy(msg.username, buffer + offset, msg.username_len);
-    msg.username[msg.username_len] = '\0';
-    offset += msg.username_len;
+    msg.username = ByteView(buffer + offset, username_len);
+    offset += (int)username_len;
 
     // 消息长度（网络字节序）
-    msg.message_len = ((unsigned char)buffer[offset] << 8) | (unsigned char)buffer[offset + 1];
+    size_t message_len = ((unsigned char)buffer[offset] << 8) | (unsigned char)buffer[offset + 1];
     offset += 2;
 
-    if (msg.message_len > MAX_MESSAGE_LEN || offset + msg.message_len + 8 > buffer_size) {
+    if (message_len > MAX_MESSAGE_LEN || offset + (int)message_len + 8 > buffer_size) {
         return -1;
     }
 
     // 消息内容
-    memcpy(msg.message, buffer + offset, msg.message_len);
-    msg.message[msg.message_len] = '\0';
-    offset += msg.message_len;
+    msg.message = ByteView(buffer + offset, message_len);
+    offset += (int)message_len;
 
     // 时间戳（8字节，网络字节序）
     msg.timestamp = 0;
@@ -164,6 +231,39 @@ inline int deserialize_message(const char* buffer, int buffer_size, ChatMessage&
     return offset;
 }
 
+/**
+ * 检查房间名是否有效：1 ~ MAX_ROOM_NAME_LEN 字节，不含空白和控制字符
+ */
+inline bool valid_room_name(ByteView room) {
+    if (room.empty() || room.size > MAX_ROOM_NAME_LEN) {
+        return false;
+    }
+    for (size_t i = 0; i < room.size; i++) {
+        unsigned char ch = (unsigned char)room.data[i];
+        if (ch <= ' ' || ch == 0x7F) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * 从房间消息的内容中取出房间名和正文（都指向消息内容内部）
+ * @return 成功返回true，格式错误返回false
+ */
+inline bool parse_room_message(const MessageView& msg, ByteView& room, ByteView& text) {
+    if (msg.message.size < 1) {
+        return false;
+    }
+    size_t room_len = (unsigned char)msg.message.data[0];
+    if (room_len == 0 || room_len > MAX_ROOM_NAME_LEN || 1 + room_len > msg.message.size) {
+        return false;
+    }
+    room = ByteView(msg.message.data + 1, room_len);
+    text = ByteView(msg.message.data + 1 + room_len, msg.message.size - 1 - room_len);
+    return true;
+}
+
 /**
  * 获取当前时间戳
  * @return Unix时间戳
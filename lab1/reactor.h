@@ -0,0 +1,291 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+/**
+ * 事件循环的就绪通知
+ * ==================
+ *
+ * 每个事件循环线程用一个 Poller 管理自己的一组客户端套接字：套接字设为非阻塞，
+ * 由 Poller 报告哪些套接字可读/可写，再由调用方读（写）到 would_block 为止。
+ *
+ * - Linux：边沿触发的epoll，每个套接字只在有新数据到达、或发送缓冲区由满变为可写时报告一次，
+ *   因此始终同时关注可读和可写；另有一个eventfd，其他线程用 wake() 让 wait() 立即返回
+ * - Windows：WSAPoll（水平触发），只在发送队列非空时关注可写（set_write_interest），
+ *   否则每轮都会报告可写；另有一个连向自己的UDP套接字，wake() 向它发一个字节
+ *
+ * 两种方式下处理代码都读（写）到 would_block 为止，所以行为相同。
+ * 本文件须在平台套接字定义（SOCKET、closesocket 等）之后包含。
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+    #include <unordered_map>
+#else
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <cerrno>
+#endif
+
+// 一次 wait() 最多返回的事件数
+#define POLLER_MAX_EVENTS 256
+// 内部唤醒用的标识，调用方登记的标识不能使用
+#define POLLER_WAKE_TOKEN UINT64_MAX
+
+// 一个就绪的套接字
+struct PollEvent {
+    uint64_t token;     // add() 时登记的标识
+    bool readable;      // 可读（包括对端关闭）
+    bool writable;      // 可写
+    bool error;         // 出错或挂断，读一次即可得到具体情况
+};
+
+/**
+ * 将套接字设为非阻塞
+ * @return 成功返回true
+ */
+inline bool set_nonblocking(SOCKET s) {
+#ifdef _WIN32
+    u_long mode = 1;
+    return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    return flags >= 0 && fcntl(s, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+/**
+ * 最近一次套接字调用是否只是因为非阻塞而没有完成（没有数据可读或发送缓冲区已满）
+ */
+inline bool would_block() {
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+/**
+ * 等待单个套接字变为可写
+ * @param timeout_ms 最长等待时间（毫秒）
+ * @return 可写返回true，超时或出错返回false
+ */
+inline bool wait_writable(SOCKET s, int timeout_ms) {
+#ifdef _WIN32
+    WSAPOLLFD pfd;
+    pfd.fd = s;
+    pfd.events = POLLWRNORM;
+    pfd.revents = 0;
+    return WSAPoll(&pfd, 1, timeout_ms) == 1 && (pfd.revents & POLLWRNORM);
+#else
+    struct pollfd pfd;
+    pfd.fd = s;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    int n;
+    do {
+        n = poll(&pfd, 1, timeout_ms);
+    } while (n < 0 && errno == EINTR);
+    return n == 1 && (pfd.revents & POLLOUT);
+#endif
+}
+
+class Poller {
+public:
+    Poller() {
+#ifdef _WIN32
+        wake_socket = INVALID_SOCKET;
+#else
+        epoll_fd = -1;
+        wake_fd = -1;
+#endif
+    }
+
+    ~Poller() {
+#ifdef _WIN32
+        if (wake_socket != INVALID_SOCKET) closesocket(wake_socket);
+#else
+        if (wake_fd >= 0) close(wake_fd);
+        if (epoll_fd >= 0) close(epoll_fd);
+#endif
+    }
+
+    /**
+     * 创建底层的epoll实例和唤醒用的eventfd（Windows为唤醒用的UDP套接字）
+     * @return 成功返回true
+     */
+    bool open() {
+#ifdef _WIN32
+        // 绑定到回环地址的任意端口，再连接到自己，send() 的数据由自己收到
+        wake_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (wake_socket == INVALID_SOCKET) return false;
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        int len = sizeof(addr);
+        if (bind(wake_socket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR
+            || getsockname(wake_socket, (struct sockaddr*)&addr, &len) == SOCKET_ERROR
+            || connect(wake_socket, (struct sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR
+            || !set_nonblocking(wake_socket)) {
+            return false;
+        }
+        return add(wake_socket, POLLER_WAKE_TOKEN);
+#else
+        epoll_fd = epoll_create1(0);
+        if (epoll_fd < 0) return false;
+        wake_fd = eventfd(0, EFD_NONBLOCK);
+        if (wake_fd < 0) return false;
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.u64 = POLLER_WAKE_TOKEN;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) == 0;
+#endif
+    }
+
+    /**
+     * 开始关注套接字的可读（Linux下同时关注可写）事件
+     * @param token wait() 返回事件时带回的标识
+     */
+    bool add(SOCKET s, uint64_t token) {
+#ifdef _WIN32
+        WSAPOLLFD pfd;
+        pfd.fd = s;
+        pfd.events = POLLRDNORM;
+        pfd.revents = 0;
+        index[s] = fds.size();
+        fds.push_back(pfd);
+        tokens.push_back(token);
+        return true;
+#else
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = token;
+        return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s, &ev) == 0;
+#endif
+    }
+
+    /**
+     * 设置是否关注可写事件（发送队列非空时打开，发完后关闭）
+     * Linux下边沿触发的可写事件本身只在状态变化时报告，无需切换
+     */
+    void set_write_interest(SOCKET s, bool enable) {
+#ifdef _WIN32
+        std::unordered_map<SOCKET, size_t>::iterator it = index.find(s);
+        if (it == index.end()) return;
+        fds[it->second].events = enable ? (POLLRDNORM | POLLWRNORM) : POLLRDNORM;
+#else
+        (void)s;
+        (void)enable;
+#endif
+    }
+
+    /**
+     * 不再关注套接字（须在关闭套接字之前调用）
+     */
+    void remove(SOCKET s) {
+#ifdef _WIN32
+        std::unordered_map<SOCKET, size_t>::iterator it = index.find(s);
+        if (it == index.end()) return;
+        // 用最后一项填补空位
+        size_t i = it->second;
+        index.erase(it);
+        if (i + 1 != fds.size()) {
+            fds[i] = fds.back();
+            tokens[i] = tokens.back();
+            index[fds[i].fd] = i;
+        }
+        fds.pop_back();
+        tokens.pop_back();
+#else
+        struct epoll_event ev;  // 旧内核要求非空指针
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s, &ev);
+#endif
+    }
+
+    /**
+     * 等待套接字就绪
+     * @param events 输出的就绪事件
+     * @param max_events events 的容量
+     * @param timeout_ms 最长等待时间（毫秒），被 wake() 唤醒时提前返回
+     * @return 就绪事件数，出错返回-1
+     */
+    int wait(PollEvent* events, int max_events, int timeout_ms) {
+#ifdef _WIN32
+        if (fds.empty()) {
+            Sleep(timeout_ms);
+            return 0;
+        }
+        int n = WSAPoll(fds.data(), (ULONG)fds.size(), timeout_ms);
+        if (n <= 0) return n;
+        int count = 0;
+        for (size_t i = 0; i < fds.size() && count < max_events; i++) {
+            if (fds[i].revents == 0) continue;
+            if (tokens[i] == POLLER_WAKE_TOKEN) {
+                char drain[64];
+                while (recv(wake_socket, drain, sizeof(drain), 0) > 0) {}
+                fds[i].revents = 0;
+                continue;
+            }
+            events[count].token = tokens[i];
+            events[count].readable = (fds[i].revents & (POLLRDNORM | POLLHUP)) != 0;
+            events[count].writable = (fds[i].revents & POLLWRNORM) != 0;
+            events[count].error = (fds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+            fds[i].revents = 0;
+            count++;
+        }
+        return count;
+#else
+        struct epoll_event ready[POLLER_MAX_EVENTS];
+        if (max_events > POLLER_MAX_EVENTS) max_events = POLLER_MAX_EVENTS;
+        int n = epoll_wait(epoll_fd, ready, max_events, timeout_ms);
+        if (n < 0) return errno == EINTR ? 0 : -1;
+        int count = 0;
+        for (int i = 0; i < n; i++) {
+            if (ready[i].data.u64 == POLLER_WAKE_TOKEN) {
+                uint64_t value;
+                while (read(wake_fd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+            events[count].token = ready[i].data.u64;
+            events[count].readable = (ready[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0;
+            events[count].writable = (ready[i].events & EPOLLOUT) != 0;
+            events[count].error = (ready[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+            count++;
+        }
+        return count;
+#endif
+    }
+
+    /**
+     * 让正在 wait() 的线程立即返回（可在其他线程调用）
+     */
+    void wake() {
+#ifdef _WIN32
+        char one = 1;
+        send(wake_socket, &one, 1, 0);
+#else
+        uint64_t one = 1;
+        ssize_t n = write(wake_fd, &one, sizeof(one));
+        (void)n;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    SOCKET wake_socket;
+    std::vector<WSAPOLLFD> fds;
+    std::vector<uint64_t> tokens;
+    std::unordered_map<SOCKET, size_t> index;
+#else
+    int epoll_fd;
+    int wake_fd;
+#endif
+};
+
+#endif // REACTOR_H
@@ -0,0 +1,97 @@
+#ifndef ROOM_INDEX_H
+#define ROOM_INDEX_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "client_registry.h"
+
+/**
+ * 房间订阅索引
+ * ============
+ *
+ * 房间名 -> 成员编号列表。房间消息只遍历该房间的成员，
+ * 转发开销与实际接收人数成正比，与在线总人数无关。
+ *
+ * 成员列表是连续数组，另记每个成员在数组中的位置，
+ * 离开时用最后一个成员填补空位，加入和离开都是O(1)。
+ * 最后一个成员离开后房间随即删除。
+ * 只在事件循环线程使用，不加锁。
+ */
+
+// 每个客户端最多同时加入的房间数
+#define MAX_ROOMS_PER_CLIENT 16
+
+class RoomIndex {
+public:
+    /**
+     * 加入房间（房间不存在时创建）
+     * @return 新加入返回true，已是成员返回false
+     */
+    bool join(const std::string& room, ClientId id) {
+        Room& r = rooms[room];
+        if (r.position.count(id)) {
+            return false;
+        }
+        r.position[id] = r.members.size();
+        r.members.push_back(id);
+        return true;
+    }
+
+    /**
+     * 离开房间
+     * @return 原来是成员返回true
+     */
+    bool leave(const std::string& room, ClientId id) {
+        std::unordered_map<std::string, Room>::iterator it = rooms.find(room);
+        if (it == rooms.end()) {
+            return false;
+        }
+        Room& r = it->second;
+        std::unordered_map<ClientId, size_t>::iterator pos = r.position.find(id);
+        if (pos == r.position.end()) {
+            return false;
+        }
+
+        // 用最后一个成员填补空位
+        size_t index = pos->second;
+        r.position.erase(pos);
+        if (index + 1 != r.members.size()) {
+            r.members[index] = r.members.back();
+            r.position[r.members[index]] = index;
+        }
+        r.members.pop_back();
+
+        if (r.members.empty()) {
+            rooms.erase(it);
+        }
+        return true;
+    }
+
+    /**
+     * 房间的成员列表
+     * @return 房间不存在时返回空指针
+     */
+    const std::vector<ClientId>* members(const std::string& room) const {
+        std::unordered_map<std::string, Room>::const_iterator it = rooms.find(room);
+        return it == rooms.end() ? nullptr : &it->second.members;
+    }
+
+    /**
+     * 当前的房间数
+     */
+    size_t size() const {
+        return rooms.size();
+    }
+
+private:
+    struct Room {
+        std::vector<ClientId> members;
+        std::unordered_map<ClientId, size_t> position;  // 成员在 members 中的下标
+    };
+
+    std::unordered_map<std::string, Room> rooms;
+};
+
+#endif // ROOM_INDEX_H
@@ -2,20 +2,33 @@
 #include <vector>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <algorithm>
 #include <cstring>
 #include <string>
+#include <memory>
+#include <cstdlib>
 
 #ifdef _WIN32
+    // WSAPoll 需要 Vista 及以上的头文件定义
+    #if !defined(_WIN32_WINNT) || _WIN32_WINNT < 0x0600
+        #undef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0600
+    #endif
     #include <winsock2.h>
     #include <ws2tcpip.h>
     #pragma comment(lib, "ws2_32.lib")
     typedef int socklen_t;
+    #define MSG_NOSIGNAL 0
 #else
     #include <sys/socket.h>
     #include <netinet/in.h>
+    #include <netinet/tcp.h>
     #include <arpa/inet.h>
     #include <unistd.h>
+    #include <pthread.h>
+    #include <sched.h>
     #define SOCKET int
     #define INVALID_SOCKET -1
     #define SOCKET_ERROR -1
@@ -23,276 +36,1098 @@
 #endif
 
 #include "protocol.h"
+#include "reactor.h"
+#include "frame_decoder.h"
+#include "outbound_queue.h"
+#include "client_registry.h"
+#include "room_index.h"
+#include "server_metrics.h"
+#include "metrics_endpoint.h"
+#include "mpsc_queue.h"
+#include "message_history.h"
+#include "history_log.h"
+
+// 事件循环每轮最长等待时间（毫秒），也是各线程发布队列长度等瞬时值的间隔
+#define REACTOR_TICK_MS 200
+// 关闭服务器时等待各客户端发完关闭通知的最长时间（毫秒）
+#define SHUTDOWN_FLUSH_MS 1000
+
+// 发送队列超过上限时的处理方式（慢速客户端策略）
+enum SlowConsumerPolicy {
+    SLOW_DROP,          // 丢弃新消息
+    SLOW_COALESCE,      // 丢弃队列中尚未发送的消息，换成一条“已跳过N条消息”的提示
+    SLOW_DISCONNECT     // 断开该客户端
+};
+
+struct Reactor;
 
-// 客户端信息结构
+// 客户端信息结构（每个连接只占这一个结构，不再有独立线程）
 struct ClientInfo {
+    ClientId id;
+    Reactor* owner;         // 管理该连接的事件循环，只在该线程访问
     SOCKET socket;
     std::string username;
     bool active;
+    bool logged_in;
+    bool flush_pending;     // 已在 flush_list 中
+    bool closing;           // 已在 closing_list 中（接收过慢，等待断开）
+    FrameDecoder decoder;   // 未处理完的输入（不完整的消息留到下次读取）
+    OutboundQueue outbox;   // 待发送的消息
+    std::vector<std::string> rooms;     // 已加入的房间（最多 MAX_ROOMS_PER_CLIENT 个）
+
+    ClientInfo(SOCKET s, Reactor* r) : id(INVALID_CLIENT_ID), owner(r), socket(s), active(true), logged_in(false), flush_pending(false), closing(false) {}
+};
+
+typedef SlotRegistry<ClientInfo> ClientRegistry;
+typedef ClientRegistry::Ptr ClientPtr;
 
-    ClientInfo(SOCKET s) : socket(s), active(true) {}
+// 转交给其他事件循环的一条消息
+struct RemoteDelivery {
+    SharedFrame frame;      // 已序列化的消息，各线程的发送队列共享同一份
+    std::string room;       // 目标房间，为空表示发给所有客户端
+    bool keep_history;      // 记入该房间的消息历史
+};
+
+/**
+ * 一个事件循环线程及其管理的连接
+ * 每个线程有自己的监听套接字、Poller 和客户端，处理消息时不与其他线程共享可变数据；
+ * 要发给其他线程客户端的消息放入对方的 inbox，由对方在自己的线程中分发。
+ */
+struct Reactor {
+    int index;
+    SOCKET listen_socket;
+    bool owns_listen_socket;                // 不支持 SO_REUSEPORT 时与0号线程共用监听套接字
+    Poller poller;                          // 套接字事件的标识为 ClientId，监听套接字为 INVALID_CLIENT_ID
+    ClientRegistry clients;                 // 本线程的客户端，只在本线程修改
+    RoomIndex rooms;                        // 房间 -> 本线程的成员
+    MessageHistory history;                 // 各房间最近的消息，每个线程一份（帧是共享的）
+    std::vector<ClientId> flush_list;       // 本轮有新消息入队、待发送的客户端
+    std::vector<ClientId> closing_list;     // 本轮因接收过慢要断开的客户端
+    MpscQueue<RemoteDelivery> inbox;        // 其他线程转来的消息
+    std::atomic<bool> wake_pending;         // 已唤醒、尚未取走 inbox，期间不再重复唤醒
+
+    // 供其他线程读取的瞬时值：登录人数随时更新，其余在每轮结束时最多每 REACTOR_TICK_MS 更新一次
+    std::atomic<size_t> logged_in;
+    std::atomic<size_t> room_count;
+    std::atomic<size_t> queued_bytes;
+    std::atomic<size_t> max_queued_bytes;
+    std::chrono::steady_clock::time_point gauges_updated;
+
+    std::thread thread;
+
+    Reactor(int i) : index(i), listen_socket(INVALID_SOCKET), owns_listen_socket(false), wake_pending(false),
+                     logged_in(0), room_count(0), queued_bytes(0), max_queued_bytes(0) {}
 };
 
 // 全局变量
-std::vector<ClientInfo*> clients;
-std::mutex clients_mutex;
-bool server_running = true;
-
-// 消息统计
-struct MessageStats {
-    int total_messages_received = 0;    // 服务器接收到的总消息数
-    int total_messages_forwarded = 0;   // 服务器转发的总消息数
-    int total_login_count = 0;          // 总登录次数
-    int total_logout_count = 0;         // 总退出次数
-} message_stats;
-std::mutex stats_mutex;
+std::vector<std::unique_ptr<Reactor> > reactors;    // 启动前创建，运行期间不变
+std::atomic<bool> server_running(true);
+
+// 慢速客户端策略（可由命令行指定）
+SlowConsumerPolicy slow_policy = SLOW_COALESCE;
+size_t outbound_limit = 256 * 1024;     // 每个客户端发送队列的上限（字节）
+
+// 事件循环线程数（-t）及是否绑定CPU核（-n 关闭）
+int reactor_count = 1;
+bool pin_threads = true;
+// 不打印每条聊天消息（-q），压测时避免日志成为瓶颈
+bool quiet = false;
+
+// 每个房间保存的历史消息条数（-H，0 表示不保存）及持久化日志（-L，只由0号事件循环写入）
+size_t history_capacity = HISTORY_DEFAULT_CAPACITY;
+std::string history_log_path;
+HistoryLog history_log;
+
+// 消息统计（按线程分片，消息处理路径上不加锁）
+ServerCounters counters;
+MetricsEndpoint metrics;                // 监控接口，由 -m 开启，登记在0号事件循环中
+int metrics_port = 0;
 
 // 函数声明
-void broadcast_message(const ChatMessage& msg, SOCKET exclude_socket = INVALID_SOCKET);
-void handle_client(ClientInfo* client);
-void accept_clients(SOCKET listen_socket);
+void log_line(std::ostream& out, const std::string& line);
+bool enqueue_frame(ClientInfo* client, const SharedFrame& frame);
+void enqueue_to_all(Reactor& reactor, const SharedFrame& frame, ClientId exclude);
+void enqueue_to_room(Reactor& reactor, const std::string& room, const SharedFrame& frame, ClientId exclude);
+void forward_to_other_reactors(Reactor& from, const SharedFrame& frame, const std::string& room, bool keep_history);
+void drain_inbox(Reactor& reactor);
+void broadcast_message(Reactor& reactor, const MessageView& msg, ClientId exclude = INVALID_CLIENT_ID);
+void deliver_to_room(Reactor& reactor, const std::string& room, const MessageView& msg,
+                     ClientId exclude = INVALID_CLIENT_ID, bool keep_history = false);
+void deliver_frame_to_room(Reactor& reactor, const std::string& room, const SharedFrame& frame,
+                           ClientId exclude, bool keep_history);
+void record_history(Reactor& reactor, const std::string& room, const SharedFrame& frame);
+void compact_history_log(Reactor& reactor);
+void replay_history(ClientInfo* client, const std::string& room);
+bool load_history_log();
+bool join_room(ClientInfo* client, const std::string& room);
+void leave_room(ClientInfo* client, const std::string& room);
+void flush_client(ClientInfo* client);
+void flush_pending_clients(Reactor& reactor);
+void process_message(ClientInfo* client, const MessageView& msg);
+void client_disconnected(ClientInfo* client);
+void close_client(ClientInfo* client);
+void accept_pending_clients(Reactor& reactor);
+void on_client_readable(ClientInfo* client);
+void run_reactor(Reactor* reactor);
+bool pin_current_thread(int index);
+SOCKET open_listen_socket(unsigned short port, bool reuse_port);
 void server_command_handler();
-void display_online_users();
+void display_online_users(Reactor& reactor);
 void display_statistics();
+void publish_gauges(Reactor& reactor);
+std::string render_metrics();
+void print_usage(const char* program);
+
+/**
+ * 输出一行日志
+ * 多个事件循环线程同时输出时整行一次写出，不会互相穿插
+ */
+void log_line(std::ostream& out, const std::string& line) {
+    out << (line + '\n') << std::flush;
+}
+
+/**
+ * 生成发给慢速客户端的“已跳过N条消息”提示
+ */
+SharedFrame make_skipped_notice(size_t skipped) {
+    std::string text = "网络过慢，已跳过 " + std::to_string(skipped) + " 条消息";
+    return make_frame(MessageView(MSG_CHAT, "Server", text, get_current_timestamp()));
+}
+
+/**
+ * 将消息放入客户端的发送队列，由事件循环在本轮结束时统一发出
+ * 队列超过上限时按 slow_policy 处理，不影响其他客户端
+ * @return 消息已入队返回true
+ */
+bool enqueue_frame(ClientInfo* client, const SharedFrame& frame) {
+    Reactor& reactor = *client->owner;
+    if (client->closing) {
+        return false;
+    }
+
+    if (client->outbox.pending_bytes() + frame->size() > outbound_limit) {
+        switch (slow_policy) {
+            case SLOW_DROP:
+                counters.add(CTR_MESSAGES_DROPPED);
+                return false;
+
+            case SLOW_COALESCE: {
+                size_t skipped = client->outbox.discard_unsent() + 1;
+                counters.add(CTR_MESSAGES_DROPPED, skipped);
+                SharedFrame notice = make_skipped_notice(skipped);
+                if (notice) {
+                    client->outbox.push(notice);
+                }
+                return false;
+            }
+
+            case SLOW_DISCONNECT: {
+                // 此时可能正在遍历客户端列表，断开留到本轮结束时进行
+                client->closing = true;
+                reactor.closing_list.push_back(client->id);
+                counters.add(CTR_SLOW_DISCONNECTS);
+                return false;
+            }
+        }
+    }
+
+    client->outbox.push(frame);
+    if (!client->flush_pending) {
+        client->flush_pending = true;
+        reactor.flush_list.push_back(client->id);
+    }
+    return true;
+}
+
+/**
+ * 把消息放入本线程所有客户端的发送队列（可排除某个客户端）
+ */
+void enqueue_to_all(Reactor& reactor, const SharedFrame& frame, ClientId exclude) {
+    int forwarded_count = 0; // 统计成功转发的消息数
+    ClientRegistry::Snapshot snapshot = reactor.clients.snapshot();
+    for (const ClientPtr& client : *snapshot) {
+        if (client->active && client->id != exclude) {
+            if (enqueue_frame(client.get(), frame)) {
+                forwarded_count++;
+            }
+        }
+    }
+
+    // 更新转发统计
+    counters.add(CTR_MESSAGES_FORWARDED, forwarded_count);
+}
+
+/**
+ * 把消息放入本线程中房间成员的发送队列（可排除某个客户端）
+ * 只遍历该房间的成员，开销与接收人数成正比
+ */
+void enqueue_to_room(Reactor& reactor, const std::string& room, const SharedFrame& frame, ClientId exclude) {
+    const std::vector<ClientId>* members = reactor.rooms.members(room);
+    if (!members) {
+        return;
+    }
+
+    int forwarded_count = 0;
+    for (ClientId id : *members) {
+        if (id == exclude) {
+            continue;
+        }
+        ClientInfo* member = reactor.clients.find(id);
+        if (member && member->active && enqueue_frame(member, frame)) {
+            forwarded_count++;
+        }
+    }
+
+    counters.add(CTR_MESSAGES_FORWARDED, forwarded_count);
+}
+
+/**
+ * 把消息转交给其他事件循环，由它们发给各自的客户端
+ * 各线程共享同一个已序列化的帧，只增加引用计数
+ * @param room 目标房间，为空表示所有客户端
+ * @param keep_history 对方同样把消息记入该房间的历史
+ */
+void forward_to_other_reactors(Reactor& from, const SharedFrame& frame, const std::string& room, bool keep_history) {
+    for (size_t i = 0; i < reactors.size(); i++) {
+        Reactor& target = *reactors[i];
+        if (&target == &from) {
+            continue;
+        }
+        RemoteDelivery delivery;
+        delivery.frame = frame;
+        delivery.room = room;
+        delivery.keep_history = keep_history;
+        target.inbox.push(std::move(delivery));
+
+        // 对方取走 inbox 之前只唤醒一次，繁忙时不必每条消息都进行系统调用
+        if (!target.wake_pending.exchange(true)) {
+            target.poller.wake();
+        }
+    }
+}
+
+/**
+ * 分发其他事件循环转来的消息（本线程调用）
+ */
+void drain_inbox(Reactor& reactor) {
+    // 先清除标记再取：之后放入的消息会再次唤醒本线程
+    reactor.wake_pending.store(false);
+
+    RemoteDelivery delivery;
+    while (reactor.inbox.pop(delivery)) {
+        if (delivery.keep_history) {
+            record_history(reactor, delivery.room, delivery.frame);
+        }
+        if (delivery.room.empty()) {
+            enqueue_to_all(reactor, delivery.frame, INVALID_CLIENT_ID);
+        } else {
+            enqueue_to_room(reactor, delivery.room, delivery.frame, INVALID_CLIENT_ID);
+        }
+    }
+}
 
 /**
  * 广播消息给所有客户端（可排除某个客户端）
+ * 消息只序列化一次，各客户端的发送队列共享同一份数据
  */
-void broadcast_message(const ChatMessage& msg, SOCKET exclude_socket) {
+void broadcast_message(Reactor& reactor, const MessageView& msg, ClientId exclude) {
     // 如果服务器正在关闭，不发送新消息
     if (!server_running) {
         return;
     }
 
-    char buffer[MAX_PACKET_LEN];
-    int len = serialize_message(msg, buffer, MAX_PACKET_LEN);
+    SharedFrame frame = make_frame(msg);
+    if (!frame) {
+        log_line(std::cerr, "[错误] 序列化消息失败");
+        return;
+    }
 
-    if (len <= 0) {
-        std::cerr << "[错误] 序列化消息失败" << std::endl;
+    enqueue_to_all(reactor, frame, exclude);
+    forward_to_other_reactors(reactor, frame, std::string(), false);
+}
+
+/**
+ * 将消息转发给房间的所有成员（可排除某个客户端）
+ * 成员可能分布在各个事件循环中，本线程之外的成员由其所在线程转发
+ * @param keep_history 记入房间的消息历史（聊天消息），加入/离开通知不记
+ */
+void deliver_to_room(Reactor& reactor, const std::string& room, const MessageView& msg, ClientId exclude, bool keep_history) {
+    if (!server_running) {
         return;
     }
 
-    int forwarded_count = 0; // 统计成功转发的消息数
-    std::lock_guard<std::mutex> lock(clients_mutex);
-    for (auto client : clients) {
-        if (client->active && client->socket != exclude_socket && client->socket != INVALID_SOCKET) {
-            int sent = send(client->socket, buffer, len, 0);
-            if (sent == SOCKET_ERROR) {
-                // 发送失败时标记客户端为非活跃状态，但不输出错误
-                client->active = false;
-            } else {
-                forwarded_count++; // 成功转发消息
-            }
+    SharedFrame frame = make_frame(msg);
+    if (!frame) {
+        log_line(std::cerr, "[错误] 序列化消息失败");
+        return;
+    }
+    deliver_frame_to_room(reactor, room, frame, exclude, keep_history);
+}
+
+/**
+ * 将已编码的消息帧转发给房间的所有成员
+ */
+void deliver_frame_to_room(Reactor& reactor, const std::string& room, const SharedFrame& frame,
+                           ClientId exclude, bool keep_history) {
+    if (keep_history) {
+        record_history(reactor, room, frame);
+    }
+    enqueue_to_room(reactor, room, frame, exclude);
+    forward_to_other_reactors(reactor, frame, room, keep_history);
+}
+
+/**
+ * 记入房间的消息历史
+ * 每个事件循环都记录所有房间的消息（转来的帧是共享的，只多一个引用），新成员在哪个线程都能补发；
+ * 0号线程同时追加到持久化日志，写满时用内存中的历史压缩
+ */
+void record_history(Reactor& reactor, const std::string& room, const SharedFrame& frame) {
+    reactor.history.record(room, frame);
+    if (reactor.index == 0 && history_log.is_open() && !history_log.append(room, frame)) {
+        compact_history_log(reactor);
+    }
+}
+
+/**
+ * 清空持久化日志，重新写入内存中的历史（0号事件循环调用）
+ * 内存中的历史有上限，压缩后日志的大小同样有上限
+ */
+void compact_history_log(Reactor& reactor) {
+    history_log.reset();
+    size_t dropped = 0;
+    reactor.history.for_each([&dropped](const std::string& room, const SharedFrame& frame) {
+        if (!history_log.append(room, frame)) {
+            dropped++;
+        }
+    });
+    if (dropped > 0) {
+        log_line(std::cerr, "[警告] 消息历史超过日志文件大小，" + std::to_string(dropped) + " 条未写入日志");
+    }
+}
+
+/**
+ * 把房间最近的消息补发给客户端
+ * 历史整批放入发送队列，与本轮的其他消息一起用 writev 发出，不会每条消息一次系统调用
+ */
+void replay_history(ClientInfo* client, const std::string& room) {
+    std::vector<SharedFrame> frames;
+    client->owner->history.collect(room, frames);
+
+    size_t replayed = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (!enqueue_frame(client, frames[i])) {
+            break; // 超过发送队列上限，不再补发
         }
+        replayed++;
     }
+    counters.add(CTR_HISTORY_REPLAYED, replayed);
+}
 
-    // 更新转发统计
-    if (forwarded_count > 0) {
-        std::lock_guard<std::mutex> stats_lock(stats_mutex);
-        message_stats.total_messages_forwarded += forwarded_count;
+/**
+ * 打开持久化日志，把其中的消息恢复到各事件循环的历史中（启动时在主线程调用）
+ * 内存中的历史限制在 compact_budget() 以内，写满时压缩总能腾出一半文件，不会每条消息都重写日志；
+ * 恢复后立即压缩，日志只保留内存中仍在的部分
+ * @return 无法打开或不是日志文件时返回false
+ */
+bool load_history_log() {
+    if (!history_log.open(history_log_path)) {
+        return false;
+    }
+
+    // 一个房间写满最长的消息也不能超过上限
+    size_t budget = history_log.compact_budget();
+    size_t max_per_room = budget / MAX_PACKET_LEN;
+    if (history_capacity > max_per_room) {
+        std::cerr << "[警告] 日志文件只能容纳每个房间 " << max_per_room << " 条历史，-H 改为 " << max_per_room << std::endl;
+        history_capacity = max_per_room;
+    }
+    for (size_t i = 0; i < reactors.size(); i++) {
+        reactors[i]->history.set_capacity(history_capacity);
+        reactors[i]->history.set_byte_limit(budget);
+    }
+    size_t loaded = history_log.load([](const std::string& room, const SharedFrame& frame) {
+        for (size_t i = 0; i < reactors.size(); i++) {
+            reactors[i]->history.record(room, frame);
+        }
+    });
+    compact_history_log(*reactors[0]);
+    std::cout << "[信息] 从 " << history_log_path << " 恢复 " << loaded << " 条历史消息，保留 "
+              << reactors[0]->history.frame_count() << " 条" << std::endl;
+    return true;
+}
+
+/**
+ * 客户端是否已加入房间
+ */
+bool in_room(const ClientInfo* client, const std::string& room) {
+    return std::find(client->rooms.begin(), client->rooms.end(), room) != client->rooms.end();
+}
+
+/**
+ * 加入房间
+ * @return 已是成员或已达到 MAX_ROOMS_PER_CLIENT 时返回false
+ */
+bool join_room(ClientInfo* client, const std::string& room) {
+    if (in_room(client, room) || client->rooms.size() >= MAX_ROOMS_PER_CLIENT) {
+        return false;
+    }
+    client->owner->rooms.join(room, client->id);
+    client->rooms.push_back(room);
+    return true;
+}
+
+/**
+ * 离开房间
+ */
+void leave_room(ClientInfo* client, const std::string& room) {
+    std::vector<std::string>::iterator it = std::find(client->rooms.begin(), client->rooms.end(), room);
+    if (it != client->rooms.end()) {
+        client->owner->rooms.leave(room, client->id);
+        client->rooms.erase(it);
+    }
+}
+
+/**
+ * 向房间成员发送加入/离开通知
+ */
+void notify_room(const std::string& room, MessageType type, const ClientInfo* client, const std::string& text) {
+    if (!server_running) {
+        return;
+    }
+    // 房间名和正文直接编码进消息帧
+    SharedFrame frame = make_frame(MessageView(type, client->username, text, get_current_timestamp()), room);
+    if (frame) {
+        deliver_frame_to_room(*client->owner, room, frame, INVALID_CLIENT_ID, false);
+    }
+}
+
+/**
+ * 发送客户端队列中的消息，发不完的部分等套接字可写时继续
+ */
+void flush_client(ClientInfo* client) {
+    if (!client->active || client->socket == INVALID_SOCKET) {
+        return;
+    }
+
+    size_t pending = client->outbox.pending_bytes();
+    int result = client->outbox.flush(client->socket);
+    counters.add(CTR_BYTES_SENT, pending - client->outbox.pending_bytes());
+    if (result < 0) {
+        // 发送出错说明连接已断开
+        client_disconnected(client);
+        return;
+    }
+    client->owner->poller.set_write_interest(client->socket, result == 0);
+}
+
+/**
+ * 本轮事件处理完之后：断开接收过慢的客户端，发出所有新入队的消息
+ * 两者都可能产生新的广播，因此循环到都为空为止
+ */
+void flush_pending_clients(Reactor& reactor) {
+    while (!reactor.flush_list.empty() || !reactor.closing_list.empty()) {
+        for (size_t i = 0; i < reactor.closing_list.size(); i++) {
+            ClientPtr client = reactor.clients.get(reactor.closing_list[i]);
+            if (client) {
+                log_line(std::cout, "[警告] 客户端 " + (client->username.empty() ? std::string("(未登录)") : client->username)
+                                    + " 接收过慢，断开连接");
+                client_disconnected(client.get());
+            }
+        }
+        reactor.closing_list.clear();
+
+        // client_disconnected 可能向 flush_list 追加客户端，按下标遍历
+        for (size_t i = 0; i < reactor.flush_list.size(); i++) {
+            ClientPtr client = reactor.clients.get(reactor.flush_list[i]);
+            if (client) {
+                client->flush_pending = false;
+                flush_client(client.get());
+            }
+        }
+        reactor.flush_list.clear();
     }
 }
 
 /**
  * 显示当前在线用户信息
+ * 在线人数是所有事件循环的合计；用户名只列出本线程的（其他线程的客户端不能跨线程读取）
  */
-void display_online_users() {
-    std::lock_guard<std::mutex> lock(clients_mutex);
+void display_online_users(Reactor& reactor) {
+    size_t online_count = 0;
+    for (size_t i = 0; i < reactors.size(); i++) {
+        online_count += reactors[i]->logged_in.load(std::memory_order_relaxed);
+    }
 
-    // 统计活跃用户
+    // 统计本线程的活跃用户
     std::vector<std::string> online_users;
-    for (auto client : clients) {
-        if (client->active && !client->username.empty()) {
+    ClientRegistry::Snapshot snapshot = reactor.clients.snapshot();
+    for (const ClientPtr& client : *snapshot) {
+        if (client->logged_in && !client->username.empty()) {
             online_users.push_back(client->username);
         }
     }
 
-    std::cout << "[统计] 当前在线人数: " << online_users.size() << " 人" << std::endl;
-
+    std::string text = "[统计] 当前在线人数: " + std::to_string(online_count) + " 人\n";
     if (!online_users.empty()) {
-        std::cout << "[统计] 在线用户列表: ";
+        text += reactors.size() > 1 ? "[统计] 本线程在线用户: " : "[统计] 在线用户列表: ";
         for (size_t i = 0; i < online_users.size(); ++i) {
-            std::cout << online_users[i];
+            text += online_users[i];
             if (i < online_users.size() - 1) {
-                std::cout << ", ";
+                text += ", ";
             }
         }
-        std::cout << std::endl;
+    } else if (online_count == 0) {
+        text += "[统计] 当前没有在线用户";
     } else {
-        std::cout << "[统计] 当前没有在线用户" << std::endl;
+        text.erase(text.size() - 1);
     }
+    log_line(std::cout, text);
 }
 
 /**
  * 显示消息统计信息
  */
 void display_statistics() {
-    std::lock_guard<std::mutex> lock(stats_mutex);
+    // 在主线程调用，读取各事件循环最近发布的快照
+    size_t connections = 0;
+    for (size_t i = 0; i < reactors.size(); i++) {
+        connections += reactors[i]->clients.published()->size();
+    }
+
     std::cout << "\n========== 消息统计 ==========" << std::endl;
-    std::cout << "接收消息总数: " << message_stats.total_messages_received << std::endl;
-    std::cout << "转发消息总数: " << message_stats.total_messages_forwarded << std::endl;
-    std::cout << "用户登录次数: " << message_stats.total_login_count << std::endl;
-    std::cout << "用户退出次数: " << message_stats.total_logout_count << std::endl;
+    std::cout << "事件循环线程数: " << reactors.size() << std::endl;
+    std::cout << "当前连接数: " << connections << std::endl;
+    std::cout << "接收消息总数: " << counters.total(CTR_MESSAGES_RECEIVED) << std::endl;
+    std::cout << "转发消息总数: " << counters.total(CTR_MESSAGES_FORWARDED) << std::endl;
+    std::cout << "丢弃消息总数: " << counters.total(CTR_MESSAGES_DROPPED) << std::endl;
+    std::cout << "慢速断开次数: " << counters.total(CTR_SLOW_DISCONNECTS) << std::endl;
+    std::cout << "用户登录次数: " << counters.total(CTR_LOGINS) << std::endl;
+    std::cout << "用户退出次数: " << counters.total(CTR_LOGOUTS) << std::endl;
     std::cout << "============================\n" << std::endl;
 }
 
 /**
- * 处理单个客户端的连接
+ * 统计本线程的房间数和发送队列长度，供其他线程读取（本线程调用）
  */
-void handle_client(ClientInfo* client) {
-    char buffer[MAX_PACKET_LEN];
-    ChatMessage msg;
-    bool logged_in = false;
-    std::string safe_username; // 保存用户名的安全副本
+void publish_gauges(Reactor& reactor) {
+    size_t queued = 0;
+    size_t max_queued = 0;
+    ClientRegistry::Snapshot snapshot = reactor.clients.snapshot();
+    for (const ClientPtr& client : *snapshot) {
+        size_t pending = client->outbox.pending_bytes();
+        queued += pending;
+        max_queued = std::max(max_queued, pending);
+    }
+    reactor.room_count.store(reactor.rooms.size(), std::memory_order_relaxed);
+    reactor.queued_bytes.store(queued, std::memory_order_relaxed);
+    reactor.max_queued_bytes.store(max_queued, std::memory_order_relaxed);
+    reactor.gauges_updated = std::chrono::steady_clock::now();
+}
 
-    while (server_running && client->active) {
-        // 接收消息类型和用户名长度
-        int received = recv(client->socket, buffer, MAX_PACKET_LEN, 0);
+/**
+ * 生成 Prometheus 文本格式的指标（0号事件循环线程调用）
+ * 0号线程的瞬时值当场统计，其他线程的取其最近一次发布的值
+ */
+std::string render_metrics() {
+    publish_gauges(*reactors[0]);
+
+    size_t connections = 0;
+    size_t logged_in = 0;
+    size_t room_count = 0;
+    size_t queued_bytes = 0;
+    size_t max_queued_bytes = 0;
+    for (size_t i = 0; i < reactors.size(); i++) {
+        const Reactor& reactor = *reactors[i];
+        connections += reactor.clients.published()->size();
+        logged_in += reactor.logged_in.load(std::memory_order_relaxed);
+        room_count += reactor.room_count.load(std::memory_order_relaxed);
+        queued_bytes += reactor.queued_bytes.load(std::memory_order_relaxed);
+        max_queued_bytes = std::max(max_queued_bytes, reactor.max_queued_bytes.load(std::memory_order_relaxed));
+    }
 
-        if (received <= 0) {
-            // 连接断开
-            if (logged_in && !safe_username.empty()) {
-                std::cout << "[信息] 用户 " << safe_username << " 连接断开" << std::endl;
-
-                // 只有在服务器仍在运行时才广播用户离开消息
-                if (server_running) {
-                    ChatMessage logout_msg;
-                    logout_msg.type = MSG_LOGOUT;
-                    logout_msg.username_len = safe_username.length();
-                    strncpy(logout_msg.username, safe_username.c_str(), MAX_USERNAME_LEN - 1);
-                    logout_msg.username[MAX_USERNAME_LEN - 1] = '\0'; // 确保字符串终止
-                    std::string leave_text = safe_username + " 退出了聊天";
-                    logout_msg.message_len = leave_text.length();
-                    strncpy(logout_msg.message, leave_text.c_str(), MAX_MESSAGE_LEN - 1);
-                    logout_msg.message[MAX_MESSAGE_LEN - 1] = '\0'; // 确保字符串终止
-
-                    broadcast_message(logout_msg, client->socket);
-
-                    // 显示当前在线用户统计
-                    display_online_users();
-                }
+    std::string out;
+    append_metric(out, "chat_reactor_threads", "gauge", "Event loop threads (-t).", reactors.size());
+    append_metric(out, "chat_connections", "gauge", "Open client connections.", connections);
+    append_metric(out, "chat_users_logged_in", "gauge", "Clients that have logged in.", logged_in);
+    append_metric(out, "chat_rooms", "gauge", "Rooms with at least one member, counted once per event loop thread.", room_count);
+    append_metric(out, "chat_outbound_queue_bytes", "gauge", "Bytes waiting in all client send queues.", queued_bytes);
+    append_metric(out, "chat_outbound_queue_max_bytes", "gauge", "Largest single client send queue in bytes.", max_queued_bytes);
+    append_metric(out, "chat_outbound_queue_limit_bytes", "gauge", "Per-client send queue limit (-b).", outbound_limit);
+    append_metric(out, "chat_connections_accepted_total", "counter", "Accepted client connections.", counters.total(CTR_CONNECTIONS_ACCEPTED));
+    append_metric(out, "chat_logins_total", "counter", "Successful logins.", counters.total(CTR_LOGINS));
+    append_metric(out, "chat_logouts_total", "counter", "Explicit logouts.", counters.total(CTR_LOGOUTS));
+    append_metric(out, "chat_messages_received_total", "counter", "Chat messages received from clients.", counters.total(CTR_MESSAGES_RECEIVED));
+    append_metric(out, "chat_messages_forwarded_total", "counter", "Messages queued for delivery, one per recipient.", counters.total(CTR_MESSAGES_FORWARDED));
+    append_metric(out, "chat_messages_dropped_total", "counter", "Messages dropped because the recipient was too slow.", counters.total(CTR_MESSAGES_DROPPED));
+    append_metric(out, "chat_slow_disconnects_total", "counter", "Clients disconnected for reading too slowly.", counters.total(CTR_SLOW_DISCONNECTS));
+    append_metric(out, "chat_bytes_received_total", "counter", "Bytes read from client sockets.", counters.total(CTR_BYTES_RECEIVED));
+    append_metric(out, "chat_bytes_sent_total", "counter", "Bytes written to client sockets.", counters.total(CTR_BYTES_SENT));
+    append_metric(out, "chat_history_messages", "gauge", "Recent messages kept for replay (-H per room).", reactors[0]->history.frame_count());
+    append_metric(out, "chat_history_bytes", "gauge", "Bytes of the recent messages kept for replay.", reactors[0]->history.byte_count());
+    append_metric(out, "chat_history_replayed_total", "counter", "History messages replayed on login or room join.", counters.total(CTR_HISTORY_REPLAYED));
+    return out;
+}
+
+/**
+ * 处理客户端发来的一条消息
+ */
+void process_message(ClientInfo* client, const MessageView& msg) {
+    Reactor& reactor = *client->owner;
+
+    // 处理不同类型的消息
+    switch (msg.type) {
+        case MSG_LOGIN: {
+            client->username = msg.username.str();
+            if (!client->logged_in) {
+                client->logged_in = true;
+                reactor.logged_in++;
             }
+            // 加入默认房间并补发其最近的消息，之后的消息接在后面
+            if (join_room(client, DEFAULT_ROOM)) {
+                replay_history(client, DEFAULT_ROOM);
+            }
+
+            // 更新登录统计
+            counters.add(CTR_LOGINS);
+
+            log_line(std::cout, "[信息] 用户 " + client->username + " 加入聊天");
+
+            // 广播用户加入消息
+            std::string join_text = client->username + " 加入了聊天";
+            broadcast_message(reactor, MessageView(MSG_LOGIN, msg.username, join_text, get_current_timestamp()), client->id);
+
+            // 显示当前在线用户统计
+            display_online_users(reactor);
             break;
         }
 
-        // 反序列化消息
-        if (deserialize_message(buffer, received, msg) < 0) {
-            std::cerr << "[错误] 反序列化消息失败" << std::endl;
-            continue;
-        }
+        case MSG_LOGOUT: {
+            // 更新退出统计
+            counters.add(CTR_LOGOUTS);
 
-        // 处理不同类型的消息
-        switch (msg.type) {
-            case MSG_LOGIN: {
-                client->username = std::string(msg.username, msg.username_len);
-                safe_username = client->username; // 保存安全副本
-                logged_in = true;
+            log_line(std::cout, "[信息] 用户 " + client->username + " 主动退出");
 
-                // 更新登录统计
-                {
-                    std::lock_guard<std::mutex> stats_lock(stats_mutex);
-                    message_stats.total_login_count++;
-                }
+            // 广播用户离开消息
+            std::string leave_text = client->username + " 退出了聊天";
+            broadcast_message(reactor, MessageView(MSG_LOGOUT, msg.username, leave_text, msg.timestamp), client->id);
 
-                std::cout << "[信息] 用户 " << safe_username << " 加入聊天" << std::endl;
+            // 已经通知过其他用户，直接关闭，不再广播连接断开
+            close_client(client);
 
-                // 广播用户加入消息
-                ChatMessage join_msg;
-                join_msg.type = MSG_LOGIN;
-                join_msg.username_len = msg.username_len;
-                strncpy(join_msg.username, msg.username, MAX_USERNAME_LEN - 1);
-                join_msg.username[MAX_USERNAME_LEN - 1] = '\0'; // 确保字符串终止
-                std::string join_text = safe_username + " 加入了聊天";
-                join_msg.message_len = join_text.length();
-                strncpy(join_msg.message, join_text.c_str(), MAX_MESSAGE_LEN - 1);
-                join_msg.message[MAX_MESSAGE_LEN - 1] = '\0'; // 确保字符串终止
+            // 显示当前在线用户统计
+            display_online_users(reactor);
+            break;
+        }
 
-                broadcast_message(join_msg, client->socket);
+        case MSG_CHAT: {
+            // 更新消息接收统计
+            counters.add(CTR_MESSAGES_RECEIVED);
 
-                // 显示当前在线用户统计
-                display_online_users();
-                break;
+            if (!quiet) {
+                std::string time_str = format_timestamp(msg.timestamp);
+                log_line(std::cout, "[" + time_str + "] [" + client->username + "] " + msg.message.str());
             }
 
-            case MSG_LOGOUT: {
-                // 更新退出统计
-                {
-                    std::lock_guard<std::mutex> stats_lock(stats_mutex);
-                    message_stats.total_logout_count++;
-                }
+            // 转发给默认房间的其他成员（离开了默认房间的客户端发言不转发），
+            // 收到的消息直接编码进发送帧，中间不复制
+            if (in_room(client, DEFAULT_ROOM)) {
+                deliver_to_room(reactor, DEFAULT_ROOM, msg, client->id, true);
+            }
+            break;
+        }
 
-                std::cout << "[信息] 用户 " << safe_username << " 主动退出" << std::endl;
+        case MSG_JOIN_ROOM: {
+            ByteView room_name, text;
+            if (!client->logged_in || !parse_room_message(msg, room_name, text) || !valid_room_name(room_name)) {
+                log_line(std::cerr, "[错误] 无效的加入房间请求");
+                break;
+            }
+            std::string room = room_name.str();
+            if (!join_room(client, room)) {
+                log_line(std::cout, "[信息] 用户 " + client->username + " 加入房间 #" + room
+                                    + " 失败（已加入或超过 " + std::to_string(MAX_ROOMS_PER_CLIENT) + " 个房间）");
+                break;
+            }
 
-                // 广播用户离开消息
-                std::string leave_text = safe_username + " 退出了聊天";
-                msg.message_len = leave_text.length();
-                strncpy(msg.message, leave_text.c_str(), MAX_MESSAGE_LEN - 1);
-                msg.message[MAX_MESSAGE_LEN - 1] = '\0'; // 确保字符串终止
+            // 房间成员可能分布在多个事件循环中，这里只知道本线程的人数
+            log_line(std::cout, "[信息] 用户 " + client->username + " 加入房间 #" + room
+                                + (reactors.size() > 1 ? "（本线程 " : "（")
+                                + std::to_string(reactor.rooms.members(room)->size()) + " 人）");
 
-                broadcast_message(msg, client->socket);
-                client->active = false;
+            // 先补发房间最近的消息，再通知房间成员，加入者自己也会收到，作为确认
+            replay_history(client, room);
+            notify_room(room, MSG_JOIN_ROOM, client, client->username + " 加入了房间");
+            break;
+        }
 
-                // 显示当前在线用户统计
-                display_online_users();
+        case MSG_LEAVE_ROOM: {
+            ByteView room_name, text;
+            if (!parse_room_message(msg, room_name, text)) {
+                break;
+            }
+            std::string room = room_name.str();
+            if (!in_room(client, room)) {
                 break;
             }
 
-            case MSG_CHAT: {
-                // 更新消息接收统计
-                {
-                    std::lock_guard<std::mutex> stats_lock(stats_mutex);
-                    message_stats.total_messages_received++;
-                }
+            log_line(std::cout, "[信息] 用户 " + client->username + " 离开房间 #" + room);
 
-                std::string message_content(msg.message, msg.message_len);
-                std::string time_str = format_timestamp(msg.timestamp);
-                std::cout << "[" << time_str << "] [" << safe_username << "] " << message_content << std::endl;
+            // 先通知再离开，离开者也会收到确认
+            notify_room(room, MSG_LEAVE_ROOM, client, client->username + " 离开了房间");
+            leave_room(client, room);
+            break;
+        }
 
-                // 转发聊天消息给其他客户端
-                broadcast_message(msg, client->socket);
+        case MSG_ROOM_CHAT: {
+            ByteView room_name, text;
+            if (!parse_room_message(msg, room_name, text)) {
                 break;
             }
+            std::string room = room_name.str();
+            if (!in_room(client, room)) {
+                break; // 只有房间成员可以发言
+            }
+
+            // 更新消息接收统计
+            counters.add(CTR_MESSAGES_RECEIVED);
+
+            if (!quiet) {
+                std::string time_str = format_timestamp(msg.timestamp);
+                log_line(std::cout, "[" + time_str + "] [#" + room + "] [" + client->username + "] " + text.str());
+            }
+
+            // 只转发给该房间的其他成员
+            deliver_to_room(reactor, room, msg, client->id, true);
+            break;
         }
     }
+}
 
-    // 清理客户端资源
-    closesocket(client->socket);
+/**
+ * 客户端连接断开（未发送LOGOUT）：通知其他用户并关闭连接
+ */
+void client_disconnected(ClientInfo* client) {
+    if (client->logged_in && !client->username.empty()) {
+        log_line(std::cout, "[信息] 用户 " + client->username + " 连接断开");
+    }
+
+    Reactor& reactor = *client->owner;
+    bool announce = client->logged_in && !client->username.empty() && server_running;
+    std::string username = client->username;
+    close_client(client);
+
+    // 只有在服务器仍在运行时才广播用户离开消息
+    if (announce) {
+        std::string leave_text = username + " 退出了聊天";
+        broadcast_message(reactor, MessageView(MSG_LOGOUT, username, leave_text, get_current_timestamp()));
+
+        // 显示当前在线用户统计
+        display_online_users(reactor);
+    }
+}
+
+/**
+ * 关闭客户端连接并注销，槽位立即回收
+ * 结构本身在调用方和快照都不再引用后释放
+ */
+void close_client(ClientInfo* client) {
+    Reactor& reactor = *client->owner;
+    if (client->socket != INVALID_SOCKET) {
+        reactor.poller.remove(client->socket);
+        closesocket(client->socket);
+        client->socket = INVALID_SOCKET;
+    }
     client->active = false;
+    if (client->logged_in) {
+        client->logged_in = false;
+        reactor.logged_in--;
+    }
+
+    // 退出所有房间（不单独通知，其他用户已收到退出消息）
+    for (const std::string& room : client->rooms) {
+        reactor.rooms.leave(room, client->id);
+    }
+    client->rooms.clear();
+
+    reactor.clients.erase(client->id);
 }
 
 /**
- * 接受新客户端连接
+ * 接受所有排队的新连接（监听套接字为非阻塞，直到没有新连接为止）
  */
-void accept_clients(SOCKET listen_socket) {
+void accept_pending_clients(Reactor& reactor) {
     while (server_running) {
         struct sockaddr_in client_addr;
         socklen_t addr_len = sizeof(client_addr);
 
-        SOCKET client_socket = accept(listen_socket, (struct sockaddr*)&client_addr, &addr_len);
+        SOCKET client_socket = accept(reactor.listen_socket, (struct sockaddr*)&client_addr, &addr_len);
 
         if (client_socket == INVALID_SOCKET) {
-            if (server_running) {
-                std::cerr << "[错误] 接受客户端连接失败" << std::endl;
+            // 共用监听套接字时，其他线程先接受了连接也会得到 would_block
+            if (!would_block()) {
+                log_line(std::cerr, "[错误] 接受客户端连接失败");
             }
+            return;
+        }
+
+        if (!set_nonblocking(client_socket)) {
+            log_line(std::cerr, "[错误] 设置非阻塞模式失败");
+            closesocket(client_socket);
             continue;
         }
 
+        // 发送队列已在一次 writev 中合并多条消息，关闭Nagle算法，避免小消息等待对端的延迟确认
+        int nodelay = 1;
+        setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (char*)&nodelay, sizeof(nodelay));
+
         std::string client_ip = inet_ntoa(client_addr.sin_addr);
-        std::cout << "[信息] 新客户端连接: " << client_ip << ":" << ntohs(client_addr.sin_port) << std::endl;
+        std::string line = "[信息] 新客户端连接: " + client_ip + ":" + std::to_string(ntohs(client_addr.sin_port));
+        if (reactors.size() > 1) {
+            line += "（线程 " + std::to_string(reactor.index) + "）";
+        }
+        log_line(std::cout, line);
+
+        // 创建客户端信息并交给本线程的事件循环
+        ClientPtr client = std::make_shared<ClientInfo>(client_socket, &reactor);
+        client->id = reactor.clients.insert(client);
+        counters.add(CTR_CONNECTIONS_ACCEPTED);
+
+        if (!reactor.poller.add(client_socket, client->id)) {
+            log_line(std::cerr, "[错误] 注册客户端连接失败");
+            close_client(client.get());
+        }
+    }
+}
+
+/**
+ * 客户端套接字可读：读到没有数据为止，处理每次读到的所有完整消息
+ * 边沿触发下不读完就不会再收到通知
+ */
+void on_client_readable(ClientInfo* client) {
+    // 解析出的消息指向 decoder 的缓冲区，处理完再读取下一批
+    MessageView msg;
+
+    while (client->active && server_running) {
+        int space = 0;
+        char* buffer = client->decoder.write_space(space);
+        int received = recv(client->socket, buffer, space, 0);
+
+        if (received > 0) {
+            client->decoder.commit(received);
+            counters.add(CTR_BYTES_RECEIVED, received);
+
+            int result = 0;
+            while (client->active && (result = client->decoder.next(msg)) > 0) {
+                process_message(client, msg);
+            }
+            if (client->active && result < 0) {
+                // 无法确定下一条消息的边界，只能断开
+                log_line(std::cerr, "[错误] 反序列化消息失败，断开连接");
+                client_disconnected(client);
+                return;
+            }
+        } else if (received == SOCKET_ERROR && would_block()) {
+            return;
+        } else {
+            // 连接断开
+            client_disconnected(client);
+            return;
+        }
+    }
+}
+
+/**
+ * 事件循环（每个线程一个）：接受连接、读取并处理本线程所有客户端的消息，分发其他线程转来的消息
+ * 退出前通知本线程的客户端服务器关闭，再关闭这些连接
+ */
+void run_reactor(Reactor* reactor) {
+    if (pin_threads && reactor_count > 1 && !pin_current_thread(reactor->index)) {
+        log_line(std::cerr, "[警告] 事件循环线程 " + std::to_string(reactor->index) + " 绑定CPU核失败");
+    }
+
+    Poller& poller = reactor->poller;
+    PollEvent events[POLLER_MAX_EVENTS];
+
+    while (server_running) {
+        int n = poller.wait(events, POLLER_MAX_EVENTS, REACTOR_TICK_MS);
+        if (n < 0) {
+            log_line(std::cerr, "[错误] 等待套接字事件失败");
+            break;
+        }
 
-        // 创建客户端信息并启动处理线程
-        ClientInfo* client = new ClientInfo(client_socket);
+        for (int i = 0; i < n && server_running; i++) {
+            if (events[i].token == INVALID_CLIENT_ID) {
+                accept_pending_clients(*reactor);
+                continue;
+            }
+            if (reactor->index == 0 && metrics.owns(events[i].token)) {
+                metrics.on_event(poller, events[i], render_metrics);
+                continue;
+            }
 
-        {
-            std::lock_guard<std::mutex> lock(clients_mutex);
-            clients.push_back(client);
+            // 处理期间持有引用，客户端在处理中断开也不会被释放
+            ClientPtr client = reactor->clients.get(events[i].token);
+            if (!client) {
+                continue; // 本轮前面的事件中已关闭
+            }
+            if (events[i].readable || events[i].error) {
+                on_client_readable(client.get());
+            }
+            if (client->active && events[i].writable) {
+                flush_client(client.get());
+            }
         }
 
-        std::thread client_thread(handle_client, client);
-        client_thread.detach();
+        drain_inbox(*reactor);
+        flush_pending_clients(*reactor);
+
+        // 发布本轮的加入/离开，供其他线程读取
+        reactor->clients.snapshot();
+        if (std::chrono::steady_clock::now() - reactor->gauges_updated >= std::chrono::milliseconds(REACTOR_TICK_MS)) {
+            publish_gauges(*reactor);
+        }
+    }
+
+    if (reactor->index == 0) {
+        metrics.stop(poller);
+    }
+
+    // 向所有客户端发送服务器关闭消息
+    SharedFrame frame = make_frame(MessageView(MSG_SERVER_SHUTDOWN, "Server", "服务器已断开连接", get_current_timestamp()));
+    ClientRegistry::Snapshot snapshot = reactor->clients.snapshot();
+    if (frame) {
+        for (const ClientPtr& client : *snapshot) {
+            if (client->active) {
+                client->outbox.push(frame); // 不受队列上限限制
+            }
+        }
+    }
+
+    // 队列中的消息连同关闭通知一起发出，接收过慢的客户端最多等待 SHUTDOWN_FLUSH_MS
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SHUTDOWN_FLUSH_MS);
+    while (true) {
+        bool pending = false;
+        for (const ClientPtr& client : *snapshot) {
+            if (client->active && !client->outbox.empty()) {
+                if (client->outbox.flush(client->socket) == 0) {
+                    pending = true;
+                }
+            }
+        }
+        if (!pending || std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // 关闭所有客户端连接
+    for (const ClientPtr& client : *snapshot) {
+        close_client(client.get());
     }
 }
 
+/**
+ * 把当前线程绑定到第 index 个可用的CPU核（超过核数时循环使用）
+ * 每个事件循环固定在一个核上，客户端数据一直留在该核的缓存中
+ * @return 成功返回true
+ */
+bool pin_current_thread(int index) {
+#ifdef _WIN32
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+        return false;
+    }
+    int available = 0;
+    for (int cpu = 0; cpu < (int)(sizeof(DWORD_PTR) * 8); cpu++) {
+        if (process_mask & ((DWORD_PTR)1 << cpu)) {
+            available++;
+        }
+    }
+    if (available == 0) {
+        return false;
+    }
+    int target = index % available;
+    for (int cpu = 0; cpu < (int)(sizeof(DWORD_PTR) * 8); cpu++) {
+        if ((process_mask & ((DWORD_PTR)1 << cpu)) && target-- == 0) {
+            return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+        }
+    }
+    return false;
+#else
+    // 只在进程允许使用的核中选择（容器或 taskset 可能限制了范围）
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) {
+        return false;
+    }
+    int target = index % CPU_COUNT(&allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && target-- == 0) {
+            cpu_set_t one;
+            CPU_ZERO(&one);
+            CPU_SET(cpu, &one);
+            return pthread_setaffinity_np(pthread_self(), sizeof(one), &one) == 0;
+        }
+    }
+    return false;
+#endif
+}
+
+/**
+ * 创建监听套接字（非阻塞）
+ * @param reuse_port 设置 SO_REUSEPORT，允许每个事件循环各自绑定同一端口，由内核把新连接分给它们
+ * @return 失败返回 INVALID_SOCKET；平台不支持 SO_REUSEPORT 时同样失败，且不输出错误
+ */
+SOCKET open_listen_socket(unsigned short port, bool reuse_port) {
+    SOCKET listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listen_socket == INVALID_SOCKET) {
+        std::cerr << "[错误] 创建套接字失败" << std::endl;
+        return INVALID_SOCKET;
+    }
+
+    // 设置地址重用
+    int reuse = 1;
+    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse, sizeof(reuse));
+
+    if (reuse_port) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, (char*)&reuse, sizeof(reuse)) == SOCKET_ERROR) {
+            closesocket(listen_socket);
+            return INVALID_SOCKET;
+        }
+#else
+        closesocket(listen_socket);
+        return INVALID_SOCKET;
+#endif
+    }
+
+    // 绑定地址和端口
+    struct sockaddr_in server_addr;
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    if (bind(listen_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
+        std::cerr << "[错误] 绑定地址失败" << std::endl;
+        closesocket(listen_socket);
+        return INVALID_SOCKET;
+    }
+
+    // 开始监听
+    if (listen(listen_socket, SOMAXCONN) == SOCKET_ERROR) {
+        std::cerr << "[错误] 监听失败" << std::endl;
+        closesocket(listen_socket);
+        return INVALID_SOCKET;
+    }
+
+    if (!set_nonblocking(listen_socket)) {
+        std::cerr << "[错误] 设置非阻塞模式失败" << std::endl;
+        closesocket(listen_socket);
+        return INVALID_SOCKET;
+    }
+    return listen_socket;
+}
+
 /**
  * 服务器命令处理（主线程）
  */
@@ -301,7 +1136,9 @@ void server_command_handler() {
     std::cout << "服务器命令: 输入 'stats' 查看统计, 'quit' 关闭服务器" << std::endl;
 
     while (server_running) {
-        std::getline(std::cin, command);
+        if (!std::getline(std::cin, command)) {
+            command = "quit"; // 标准输入关闭时同样关闭服务器
+        }
 
         if (command == "quit") {
             std::cout << "[信息] 正在关闭服务器..." << std::endl;
@@ -309,18 +1146,11 @@ void server_command_handler() {
             // 显示最终统计
             display_statistics();
 
+            // 由各事件循环通知各自的客户端后退出
             server_running = false;
-
-            // 向所有客户端发送服务器关闭消息
-            ChatMessage shutdown_msg;
-            shutdown_msg.type = MSG_SERVER_SHUTDOWN;
-            shutdown_msg.username_len = 6;
-            strncpy(shutdown_msg.username, "Server", MAX_USERNAME_LEN - 1);
-            std::string shutdown_text = "服务器已断开连接";
-            shutdown_msg.message_len = shutdown_text.length();
-            strncpy(shutdown_msg.message, shutdown_text.c_str(), MAX_MESSAGE_LEN - 1);
-
-            broadcast_message(shutdown_msg);
+            for (size_t i = 0; i < reactors.size(); i++) {
+                reactors[i]->poller.wake();
+            }
             break;
         } else if (command == "stats") {
             display_statistics();
@@ -328,7 +1158,83 @@ void server_command_handler() {
     }
 }
 
+/**
+ * 显示命令行用法
+ */
+void print_usage(const char* program) {
+    std::cout << "用法: " << program << " [-p drop|coalesce|disconnect] [-b 队列上限KB] [-m 监控端口] [-t 线程数] [-n] [-q] [-H 条数] [-L 日志文件]" << std::endl;
+    std::cout << "  -p  客户端接收过慢、发送队列超过上限时的处理方式（默认 coalesce）" << std::endl;
+    std::cout << "        drop       丢弃新消息" << std::endl;
+    std::cout << "        coalesce   丢弃积压的消息，改发一条“已跳过N条消息”的提示" << std::endl;
+    std::cout << "        disconnect 断开该客户端" << std::endl;
+    std::cout << "  -b  每个客户端发送队列的上限（默认 256KB）" << std::endl;
+    std::cout << "  -m  在指定端口提供 HTTP /metrics（Prometheus 文本格式），默认不开启" << std::endl;
+    std::cout << "  -t  事件循环线程数，0 表示CPU核数（默认 1）" << std::endl;
+    std::cout << "  -n  多线程时不把事件循环线程绑定到CPU核" << std::endl;
+    std::cout << "  -q  不打印每条聊天消息" << std::endl;
+    std::cout << "  -H  每个房间保存的最近消息条数，登录或加入房间时补发（默认 " << HISTORY_DEFAULT_CAPACITY << "，0 表示不保存）" << std::endl;
+    std::cout << "  -L  把消息历史写入内存映射的日志文件，重启后恢复（默认不开启）" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
+    // 解析命令行参数
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-p" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "drop") {
+                slow_policy = SLOW_DROP;
+            } else if (policy == "coalesce") {
+                slow_policy = SLOW_COALESCE;
+            } else if (policy == "disconnect") {
+                slow_policy = SLOW_DISCONNECT;
+            } else {
+                std::cerr << "[错误] 未知的慢速客户端策略: " << policy << std::endl;
+                print_usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "-b" && i + 1 < argc) {
+            int kb = atoi(argv[++i]);
+            if (kb <= 0) {
+                std::cerr << "[错误] 无效的队列上限: " << argv[i] << std::endl;
+                return 1;
+            }
+            outbound_limit = (size_t)kb * 1024;
+        } else if (arg == "-m" && i + 1 < argc) {
+            metrics_port = atoi(argv[++i]);
+            if (metrics_port <= 0 || metrics_port > 65535) {
+                std::cerr << "[错误] 无效的监控端口: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (arg == "-t" && i + 1 < argc) {
+            reactor_count = atoi(argv[++i]);
+            if (reactor_count == 0) {
+                reactor_count = std::max(1, (int)std::thread::hardware_concurrency());
+            }
+            if (reactor_count < 1 || reactor_count > METRICS_MAX_SHARDS) {
+                std::cerr << "[错误] 无效的线程数: " << argv[i] << "（1 ~ " << METRICS_MAX_SHARDS << "）" << std::endl;
+                return 1;
+            }
+        } else if (arg == "-n") {
+            pin_threads = false;
+        } else if (arg == "-q") {
+            quiet = true;
+        } else if (arg == "-H" && i + 1 < argc) {
+            int count = atoi(argv[++i]);
+            if (count < 0 || (count == 0 && strcmp(argv[i], "0") != 0)) {
+                std::cerr << "[错误] 无效的历史条数: " << argv[i] << std::endl;
+                return 1;
+            }
+            history_capacity = (size_t)count;
+        } else if (arg == "-L" && i + 1 < argc) {
+            history_log_path = argv[++i];
+        } else {
+            std::cerr << "[错误] 未知参数: " << arg << std::endl;
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
     // Windows平台初始化Winsock
 #ifdef _WIN32
     WSADATA wsa_data;
@@ -343,75 +1249,113 @@ int main(int argc, char* argv[]) {
     system("chcp 65001 > nul");
 #endif
 
-    // 创建监听套接字
-    SOCKET listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (listen_socket == INVALID_SOCKET) {
-        std::cerr << "[错误] 创建套接字失败" << std::endl;
+    // 创建各事件循环及其监听套接字：多线程时每个线程用 SO_REUSEPORT 各自监听同一端口，
+    // 平台不支持时所有线程共用0号的监听套接字，由非阻塞的 accept 争抢新连接
+    bool reuse_port = reactor_count > 1;
+    for (int i = 0; i < reactor_count; i++) {
+        std::unique_ptr<Reactor> reactor(new Reactor(i));
+        reactor->listen_socket = open_listen_socket(8888, reuse_port);
+        if (reactor->listen_socket == INVALID_SOCKET && i == 0 && reuse_port) {
+            reuse_port = false;
+            reactor->listen_socket = open_listen_socket(8888, false);
+        }
+        if (reactor->listen_socket != INVALID_SOCKET) {
+            reactor->owns_listen_socket = true;
+        } else if (i > 0) {
+            reactor->listen_socket = reactors[0]->listen_socket;
+        }
+
+        if (reactor->listen_socket == INVALID_SOCKET || !reactor->poller.open()
+            || !reactor->poller.add(reactor->listen_socket, INVALID_CLIENT_ID)) {
+            std::cerr << "[错误] 初始化事件循环失败" << std::endl;
+            if (reactor->owns_listen_socket) {
+                closesocket(reactor->listen_socket);
+            }
+            for (size_t j = 0; j < reactors.size(); j++) {
+                if (reactors[j]->owns_listen_socket) {
+                    closesocket(reactors[j]->listen_socket);
+                }
+            }
 #ifdef _WIN32
-        WSACleanup();
+            WSACleanup();
 #endif
-        return 1;
+            return 1;
+        }
+        reactor->history.set_capacity(history_capacity);
+        reactors.push_back(std::move(reactor));
     }
 
-    // 设置地址重用
-    int reuse = 1;
-    setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (char*)&reuse, sizeof(reuse));
-
-    // 绑定地址和端口
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(8888);
+    std::cout << "========================================" << std::endl;
+    std::cout << "    多人聊天服务器" << std::endl;
+    std::cout << "========================================" << std::endl;
 
-    if (bind(listen_socket, (struct sockaddr*)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
-        std::cerr << "[错误] 绑定地址失败" << std::endl;
-        closesocket(listen_socket);
+    if (metrics_port > 0 && !metrics.open(reactors[0]->poller, (unsigned short)metrics_port)) {
+        std::cerr << "[错误] 监控端口 " << metrics_port << " 监听失败" << std::endl;
+        for (size_t i = 0; i < reactors.size(); i++) {
+            if (reactors[i]->owns_listen_socket) {
+                closesocket(reactors[i]->listen_socket);
+            }
+        }
 #ifdef _WIN32
         WSACleanup();
 #endif
         return 1;
     }
 
-    // 开始监听
-    if (listen(listen_socket, 5) == SOCKET_ERROR) {
-        std::cerr << "[错误] 监听失败" << std::endl;
-        closesocket(listen_socket);
+    if (!history_log_path.empty()) {
+        if (history_capacity == 0) {
+            std::cerr << "[警告] -H 0 不保存消息历史，忽略 -L" << std::endl;
+        } else if (!load_history_log()) {
+            std::cerr << "[错误] 无法打开消息历史日志: " << history_log_path << std::endl;
+            for (size_t i = 0; i < reactors.size(); i++) {
+                if (reactors[i]->owns_listen_socket) {
+                    closesocket(reactors[i]->listen_socket);
+                }
+            }
 #ifdef _WIN32
-        WSACleanup();
+            WSACleanup();
 #endif
-        return 1;
+            return 1;
+        }
     }
 
-    std::cout << "========================================" << std::endl;
-    std::cout << "    多人聊天服务器" << std::endl;
-    std::cout << "========================================" << std::endl;
     std::cout << "[信息] 服务器已启动，监听端口 8888" << std::endl;
+    if (reactor_count > 1) {
+        std::cout << "[信息] 事件循环线程: " << reactor_count
+                  << (reuse_port ? "，各自监听（SO_REUSEPORT）" : "，共用监听套接字")
+                  << (pin_threads ? "，绑定CPU核" : "") << std::endl;
+    }
+    if (metrics_port > 0) {
+        std::cout << "[信息] 监控接口: http://0.0.0.0:" << metrics_port << "/metrics" << std::endl;
+    }
+    const char* policy_names[] = {"drop", "coalesce", "disconnect"};
+    std::cout << "[信息] 慢速客户端策略: " << policy_names[slow_policy]
+              << "，发送队列上限 " << outbound_limit / 1024 << "KB" << std::endl;
+    if (history_capacity > 0) {
+        std::cout << "[信息] 消息历史: 每个房间保存最近 " << history_capacity << " 条"
+                  << (history_log.is_open() ? "，写入 " + history_log_path : std::string()) << std::endl;
+    }
 
-    // 启动接受客户端线程
-    std::thread accept_thread(accept_clients, listen_socket);
+    // 启动事件循环线程
+    for (size_t i = 0; i < reactors.size(); i++) {
+        reactors[i]->thread = std::thread(run_reactor, reactors[i].get());
+    }
 
     // 主线程处理服务器命令
     server_command_handler();
 
-    // 关闭监听套接字
-    closesocket(listen_socket);
-
-    // 等待接受线程结束
-    if (accept_thread.joinable()) {
-        accept_thread.join();
+    // 等待事件循环结束
+    for (size_t i = 0; i < reactors.size(); i++) {
+        if (reactors[i]->thread.joinable()) {
+            reactors[i]->thread.join();
+        }
     }
 
-    // 关闭所有客户端连接
-    {
-        std::lock_guard<std::mutex> lock(clients_mutex);
-        for (auto client : clients) {
-            if (client->active) {
-                closesocket(client->socket);
-            }
-            delete client;
+    // 关闭监听套接字
+    for (size_t i = 0; i < reactors.size(); i++) {
+        if (reactors[i]->owns_listen_socket) {
+            closesocket(reactors[i]->listen_socket);
         }
-        clients.clear();
     }
 
     std::cout << "[信息] 服务器已关闭" << std::endl;
@@ -0,0 +1,107 @@
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * 服务器统计计数
+ * ==============
+ *
+ * 每个线程第一次计数时分到一个独占的分片（按缓存行对齐），之后只写自己的分片：
+ * 单一写者，用普通的 load + store 即可，不加锁、不需要原子的读改写，
+ * 也不会和其他线程争用同一缓存行。读取时把所有分片相加，读到的是近似的瞬时值。
+ * 线程数超过 METRICS_MAX_SHARDS 时，多出的线程共用最后一个分片，改用 fetch_add。
+ *
+ * 计数只增不减（Prometheus 的 counter），连接数、队列长度等瞬时值由事件循环在输出时现算。
+ */
+
+// 计数项
+enum ServerCounter {
+    CTR_CONNECTIONS_ACCEPTED,   // 接受的连接数
+    CTR_MESSAGES_RECEIVED,      // 接收的聊天消息数
+    CTR_MESSAGES_FORWARDED,     // 转发的消息数（每个接收者计一次）
+    CTR_MESSAGES_DROPPED,       // 因接收方过慢而丢弃的消息数
+    CTR_SLOW_DISCONNECTS,       // 因接收过慢而断开的客户端数
+    CTR_LOGINS,                 // 登录次数
+    CTR_LOGOUTS,                // 退出次数
+    CTR_BYTES_RECEIVED,         // 从客户端读到的字节数
+    CTR_BYTES_SENT,             // 发给客户端的字节数
+    CTR_HISTORY_REPLAYED,       // 登录或加入房间时补发的历史消息数
+    SERVER_COUNTER_COUNT
+};
+
+// 独占分片数（再加一个共用分片）
+#define METRICS_MAX_SHARDS 32
+
+class ServerCounters {
+public:
+    ServerCounters() {
+        for (int i = 0; i <= METRICS_MAX_SHARDS; i++) {
+            for (int c = 0; c < SERVER_COUNTER_COUNT; c++) {
+                shards[i].values[c].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * 计数加n（任意线程调用，只写本线程的分片）
+     */
+    void add(ServerCounter counter, uint64_t n = 1) {
+        int index = thread_shard();
+        if (index < METRICS_MAX_SHARDS) {
+            std::atomic<uint64_t>& value = shards[index].values[counter];
+            value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        } else {
+            shards[METRICS_MAX_SHARDS].values[counter].fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * 所有分片的合计（任意线程调用）
+     */
+    uint64_t total(ServerCounter counter) const {
+        uint64_t sum = 0;
+        for (int i = 0; i <= METRICS_MAX_SHARDS; i++) {
+            sum += shards[i].values[counter].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    // 本线程的分片下标，第一次调用时分配，所有实例共用同一编号
+    static int thread_shard() {
+        static std::atomic<int> next_shard(0);
+        static thread_local int index = next_shard.fetch_add(1);
+        return index;
+    }
+
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> values[SERVER_COUNTER_COUNT];
+    };
+
+    Shard shards[METRICS_MAX_SHARDS + 1];   // 最后一个由超出的线程共用
+};
+
+/**
+ * 按 Prometheus 文本格式追加一项指标
+ * @param type "counter" 或 "gauge"
+ */
+inline void append_metric(std::string& out, const char* name, const char* type, const char* help, uint64_t value) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+#endif // SERVER_METRICS_H
@@ -0,0 +1,580 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "protocol.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <errno.h>
+#endif
+
+// ===== 多文件传输 =====
+//
+// 一次连接发送多个文件（目录或文件列表）：所有文件首尾相接成一个字节流，流的开头是清单，
+// 列出每个文件的名字、大小和在流中的偏移。连接只建立和关闭一次，序号空间连续，
+// 接收端按清单把收到的字节分发到各个文件，不需要额外的往返。
+//
+// 清单格式（网络字节序）：
+//   magic(4) | manifest_len(4) | file_count(4) | file_count × [offset(4) | size(4) | name_len(2) | name]
+// 文件名是以'/'分隔的相对路径；文件按偏移顺序排列，第一个文件从manifest_len开始，彼此相接。
+
+const uint32_t MANIFEST_MAGIC = 0x4D544452;               // "RDTM"
+const uint32_t MANIFEST_HEADER_SIZE = 12;
+const uint32_t MANIFEST_ENTRY_SIZE = 10;                  // 不含文件名
+const uint32_t MANIFEST_MAX_SIZE = 16 * 1024 * 1024;      // 接收端接受的清单上限
+const uint16_t MANIFEST_NAME_MAX = 1024;                  // 文件名（相对路径）的最大长度
+
+// 一个待发送的文件
+struct BatchFile {
+    std::string path;       // 本地路径
+    std::string name;       // 清单中的相对路径
+    uint32_t size;
+};
+
+// ===== 文件系统辅助函数 =====
+
+inline bool isDirectory(const char* path) {
+#ifdef _WIN32
+    DWORD attrs = GetFileAttributesA(path);
+    return attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY);
+#else
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+// 创建一级目录，已存在也算成功
+inline bool makeDirectory(const std::string& path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+// 路径中最后一个分隔符之后的部分（忽略末尾的分隔符）
+inline std::string baseName(std::string path) {
+    while (path.size() > 1 && (path.back() == '/' || path.back() == '\\')) path.pop_back();
+    size_t pos = path.find_last_of("/\\");
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+// 清单中的名字只能是目录内的相对路径：不能是绝对路径、带盘符，也不能含有"."、".."或空的路径段
+inline bool isSafeName(const std::string& name) {
+    if (name.empty() || name.size() > MANIFEST_NAME_MAX) return false;
+    if (name.find('\\') != std::string::npos || name.find(':') != std::string::npos) return false;
+    size_t start = 0;
+    while (true) {
+        size_t end = name.find('/', start);
+        std::string part = name.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        if (part.empty() || part == "." || part == "..") return false;
+        if (end == std::string::npos) return true;
+        start = end + 1;
+    }
+}
+
+// 递归收集目录下的普通文件，名字为相对于root的路径；同一目录内按名字排序，结果是确定的
+inline bool collectDirectory(const std::string& root, std::vector<BatchFile>& files,
+                             const std::string& prefix = "") {
+    std::string dir = prefix.empty() ? root : root + "/" + prefix;
+    std::vector<std::string> names;
+    std::vector<std::string> subdirs;
+#ifdef _WIN32
+    WIN32_FIND_DATAA fd;
+    HANDLE find = FindFirstFileA((dir + "\\*").c_str(), &fd);
+    if (find == INVALID_HANDLE_VALUE) return false;
+    do {
+        std::string name = fd.cFileName;
+        if (name == "." || name == "..") continue;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            subdirs.push_back(name);
+        } else {
+            names.push_back(name);
+        }
+    } while (FindNextFileA(find, &fd));
+    FindClose(find);
+#else
+    DIR* d = opendir(dir.c_str());
+    if (!d) return false;
+    while (dirent* ent = readdir(d)) {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..") continue;
+        struct stat st;
+        if (stat((dir + "/" + name).c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) {
+            subdirs.push_back(name);
+        } else if (S_ISREG(st.st_mode)) {
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+#endif
+    std::sort(names.begin(), names.end());
+    std::sort(subdirs.begin(), subdirs.end());
+
+    for (size_t i = 0; i < names.size(); i++) {
+        BatchFile file;
+        file.path = dir + "/" + names[i];
+        file.name = prefix.empty() ? names[i] : prefix + "/" + names[i];
+        file.size = 0;
+        files.push_back(file);
+    }
+    for (size_t i = 0; i < subdirs.size(); i++) {
+        if (!collectDirectory(root, files, prefix.empty() ? subdirs[i] : prefix + "/" + subdirs[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 从列表文件读取路径（每行一个）；相对路径原样作为名字，否则只用文件名
+inline bool collectList(const char* list_path, std::vector<BatchFile>& files) {
+    std::ifstream list(list_path);
+    if (!list) return false;
+    std::string line;
+    while (std::getline(list, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        if (line.empty()) continue;
+
+        BatchFile file;
+        file.path = line;
+        file.name = line;
+        std::replace(file.name.begin(), file.name.end(), '\\', '/');
+        while (file.name.compare(0, 2, "./") == 0) file.name.erase(0, 2);
+        if (!isSafeName(file.name)) file.name = baseName(line);
+        file.size = 0;
+        files.push_back(file);
+    }
+    return true;
+}
+
+// ===== 发送端的字节流 =====
+
+class StreamSource {
+public:
+    virtual ~StreamSource() {}
+
+    virtual uint32_t size() const = 0;
+    virtual void read(char* buffer, uint32_t len) = 0;   // 从当前位置顺序读取
+    virtual void seek(uint32_t pos) = 0;                 // 断点续传时跳过已完成的区间
+    // 字节流不是文件内容本身时（如差量指令流），由数据源给出文件内容的摘要
+    virtual bool contentDigest(uint64_t& digest) const { (void)digest; return false; }
+};
+
+// 单个文件
+class FileSource : public StreamSource {
+public:
+    FileSource() : file_size(0) {}
+
+    bool open(const char* path) {
+        file.open(path, std::ios::binary);
+        if (!file) return false;
+        file.seekg(0, std::ios::end);
+        file_size = (uint32_t)file.tellg();
+        file.seekg(0, std::ios::beg);
+        return true;
+    }
+
+    uint32_t size() const { return file_size; }
+    void seek(uint32_t pos) { file.seekg(pos); }
+
+    // 文件在发送过程中变短时以0补齐
+    void read(char* buffer, uint32_t len) {
+        file.read(buffer, len);
+        uint32_t got = (uint32_t)file.gcount();
+        if (got < len) {
+            memset(buffer + got, 0, len - got);
+            file.clear();
+        }
+    }
+
+private:
+    std::ifstream file;
+    uint32_t file_size;
+};
+
+// 内存中的数据（多路流时单独成为一条流的清单）
+class MemorySource : public StreamSource {
+public:
+    explicit MemorySource(const std::vector<char>& bytes) : data(bytes), pos(0) {}
+
+    uint32_t size() const { return (uint32_t)data.size(); }
+    void seek(uint32_t new_pos) { pos = new_pos; }
+
+    void read(char* buffer, uint32_t len) {
+        uint32_t n = pos < data.size() ? std::min(len, (uint32_t)data.size() - pos) : 0;
+        if (n > 0) memcpy(buffer, data.data() + pos, n);
+        memset(buffer + n, 0, len - n);
+        pos += len;
+    }
+
+private:
+    std::vector<char> data;
+    uint32_t pos;
+};
+
+// 清单 + 多个文件首尾相接。文件按顺序打开，同一时刻只打开一个
+class BatchSource : public StreamSource {
+public:
+    BatchSource() : total(0), pos(0), current(0), fp(nullptr) {}
+    ~BatchSource() { closeCurrent(); }
+
+    // 读取各文件大小、计算偏移并生成清单；打不开的文件或总大小超过32位序号空间时失败
+    bool open(const std::vector<BatchFile>& batch, std::string& error) {
+        files = batch;
+        uint32_t manifest_len = MANIFEST_HEADER_SIZE;
+        for (size_t i = 0; i < files.size(); i++) {
+            if (!isSafeName(files[i].name)) {
+                error = "invalid name: " + files[i].name;
+                return false;
+            }
+            manifest_len += MANIFEST_ENTRY_SIZE + (uint32_t)files[i].name.size();
+        }
+
+        uint64_t offset = manifest_len;
+        offsets.resize(files.size());
+        for (size_t i = 0; i < files.size(); i++) {
+            FILE* f = fopen(files[i].path.c_str(), "rb");
+            if (!f) {
+                error = "cannot open " + files[i].path;
+                return false;
+            }
+            fseek(f, 0, SEEK_END);
+            long len = ftell(f);
+            fclose(f);
+            if (len < 0 || offset + len > UINT32_MAX) {
+                error = "batch larger than 4 GB";
+                return false;
+            }
+            files[i].size = (uint32_t)len;
+            offsets[i] = (uint32_t)offset;
+            offset += len;
+        }
+        total = (uint32_t)offset;
+
+        manifest.resize(manifest_len);
+        char* p = manifest.data();
+        putU32(p, MANIFEST_MAGIC);
+        putU32(p, manifest_len);
+        putU32(p, (uint32_t)files.size());
+        for (size_t i = 0; i < files.size(); i++) {
+            putU32(p, offsets[i]);
+            putU32(p, files[i].size);
+            uint16_t name_len = htons((uint16_t)files[i].name.size());
+            memcpy(p, &name_len, 2);
+            memcpy(p + 2, files[i].name.data(), files[i].name.size());
+            p += 2 + files[i].name.size();
+        }
+        return true;
+    }
+
+    uint32_t size() const { return total; }
+    size_t fileCount() const { return files.size(); }
+    uint32_t manifestSize() const { return (uint32_t)manifest.size(); }
+
+    // 多路流：流0是清单，流i是第i个文件；数据源按需打开，由调用者释放
+    size_t streamCount() const { return files.size() + 1; }
+    uint32_t streamSize(size_t i) const { return i == 0 ? manifestSize() : files[i - 1].size; }
+    StreamSource* openStream(size_t i) const {
+        if (i == 0) return new MemorySource(manifest);
+        FileSource* source = new FileSource;
+        source->open(files[i - 1].path.c_str());   // 打不开时读出全0，与read()的处理一致
+        return source;
+    }
+
+    void read(char* buffer, uint32_t len) {
+        while (len > 0) {
+            uint32_t n;
+            if (pos < manifest.size()) {
+                n = std::min(len, (uint32_t)manifest.size() - pos);
+                memcpy(buffer, manifest.data() + pos, n);
+            } else {
+                // 跳过已读完的文件（包括空文件）
+                while (current < files.size() && pos >= offsets[current] + files[current].size) {
+                    closeCurrent();
+                    current++;
+                }
+                if (current >= files.size()) {
+                    memset(buffer, 0, len);
+                    return;
+                }
+                if (!fp) {
+                    fp = fopen(files[current].path.c_str(), "rb");
+                    if (fp && pos > offsets[current]) fseek(fp, pos - offsets[current], SEEK_SET);
+                }
+                n = std::min(len, offsets[current] + files[current].size - pos);
+                // 文件在发送过程中变短时以0补齐，保持后续文件的偏移不变
+                size_t got = fp ? fread(buffer, 1, n, fp) : 0;
+                if (got < n) memset(buffer + got, 0, n - got);
+            }
+            buffer += n;
+            len -= n;
+            pos += n;
+        }
+    }
+
+    void seek(uint32_t new_pos) {
+        closeCurrent();
+        pos = new_pos;
+        current = std::upper_bound(offsets.begin(), offsets.end(), pos) - offsets.begin();
+        if (current > 0) current--;
+    }
+
+private:
+    static void putU32(char*& p, uint32_t v) {
+        v = htonl(v);
+        memcpy(p, &v, 4);
+        p += 4;
+    }
+
+    void closeCurrent() {
+        if (fp) fclose(fp);
+        fp = nullptr;
+    }
+
+    std::vector<BatchFile> files;
+    std::vector<uint32_t> offsets;   // 各文件在流中的起始偏移
+    std::vector<char> manifest;
+    uint32_t total;
+    uint32_t pos;                    // 下一个读取的流偏移
+    size_t current;                  // pos所在（或之后第一个）的文件
+    FILE* fp;
+};
+
+// ===== 接收端：按清单把字节流写入各个文件 =====
+//
+// 接收端按序交付数据，写入总是连续的：先收齐清单，之后依次写各个文件，
+// 写完一个就关闭，同一时刻只打开一个文件。
+// 多路流时清单和各文件分别按序写入（writeManifest/writeFile），正在接收的文件同时打开。
+class BatchWriter {
+public:
+    BatchWriter() : total(0), cursor(0), manifest_len(0), parsed(false), multi(false), current(0),
+                    fp(nullptr), files_done(0) {}
+    ~BatchWriter() {
+        closeCurrent();
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].fp) fclose(entries[i].fp);
+        }
+    }
+
+    // 在root目录下接收总长为stream_size的字节流（清单中的偏移以它为准）
+    bool open(const std::string& root, uint32_t stream_size, bool streams = false) {
+        dir = root;
+        total = stream_size;
+        multi = streams;
+        if (!makeDirectory(dir)) return fail("cannot create directory " + dir);
+        created_dirs.insert("");
+        return true;
+    }
+
+    // 多路流：清单（流0）的下一段
+    bool writeManifest(const char* data, uint32_t len) {
+        while (len > 0) {
+            if (parsed) return fail("data beyond the manifest");
+            uint32_t n = consumeManifest(data, len);
+            if (n == 0) return false;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // 多路流：第index个文件（流index+1）的下一段，写满后关闭
+    bool writeFile(size_t index, const char* data, uint32_t len) {
+        if (!parsed || index >= entries.size()) return fail("data for an unknown file");
+        Entry& e = entries[index];
+        if (len > e.size - e.written) return fail("data beyond the end of " + e.name);
+        if (!e.fp && !(e.fp = createFile(e.name))) return false;
+        if (fwrite(data, 1, len, e.fp) != len) return fail("cannot write " + e.name);
+        e.written += len;
+        if (e.written == e.size) {
+            fclose(e.fp);
+            e.fp = nullptr;
+            files_done++;
+        }
+        return true;
+    }
+
+    // 写入流偏移offset处的数据，必须紧接在上次写入之后
+    bool write(uint32_t offset, const char* data, uint32_t len) {
+        if (offset != cursor) return fail("non-sequential write");
+        while (len > 0) {
+            uint32_t n;
+            if (!parsed) {
+                n = consumeManifest(data, len);
+                if (n == 0) return false;
+            } else {
+                if (current >= entries.size()) return fail("data beyond the last file");
+                const Entry& e = entries[current];
+                if (!fp && !openCurrent()) return false;
+                n = std::min(len, e.offset + e.size - cursor);
+                if (fwrite(data, 1, n, fp) != n) return fail("cannot write " + e.name);
+            }
+            cursor += n;
+            data += n;
+            len -= n;
+            if (parsed && !closeFinished()) return false;
+        }
+        return true;
+    }
+
+    bool manifestReady() const { return parsed; }
+    uint32_t manifestSize() const { return manifest_len; }
+    uint32_t fileOffset(size_t index) const { return entries[index].offset; }
+    uint32_t fileSize(size_t index) const { return entries[index].size; }
+    size_t fileCount() const { return entries.size(); }
+    size_t filesDone() const { return files_done; }
+    const std::string& lastError() const { return error; }
+
+private:
+    struct Entry {
+        uint32_t offset;
+        uint32_t size;
+        std::string name;
+        uint32_t written;            // 多路流：已写入的字节数
+        FILE* fp;                    // 多路流：正在写入时打开
+    };
+
+    bool fail(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    static uint32_t getU32(const char* p) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return ntohl(v);
+    }
+
+    // 收集清单字节，收齐后解析；返回消耗的字节数，出错返回0
+    uint32_t consumeManifest(const char* data, uint32_t len) {
+        uint32_t want = manifest_len ? manifest_len : MANIFEST_HEADER_SIZE;
+        uint32_t n = std::min(len, want - (uint32_t)manifest.size());
+        manifest.insert(manifest.end(), data, data + n);
+        if (manifest.size() < want) return n;
+
+        if (manifest_len == 0) {
+            manifest_len = getU32(manifest.data() + 4);
+            if (getU32(manifest.data()) != MANIFEST_MAGIC || manifest_len < MANIFEST_HEADER_SIZE ||
+                manifest_len > MANIFEST_MAX_SIZE || manifest_len > total) {
+                fail("bad manifest header");
+                return 0;
+            }
+            manifest.reserve(manifest_len);
+            if (manifest.size() < manifest_len) return n;
+        }
+        if (!parseManifest()) return 0;
+        return n;
+    }
+
+    bool parseManifest() {
+        const char* p = manifest.data() + MANIFEST_HEADER_SIZE;
+        const char* end = manifest.data() + manifest_len;
+        uint32_t count = getU32(manifest.data() + 8);
+        uint32_t expected = manifest_len;
+        for (uint32_t i = 0; i < count; i++) {
+            if (end - p < (ptrdiff_t)MANIFEST_ENTRY_SIZE) return fail("truncated manifest");
+            Entry e;
+            e.offset = getU32(p);
+            e.size = getU32(p + 4);
+            e.written = 0;
+            e.fp = nullptr;
+            uint16_t name_len;
+            memcpy(&name_len, p + 8, 2);
+            name_len = ntohs(name_len);
+            p += MANIFEST_ENTRY_SIZE;
+            if (end - p < name_len) return fail("truncated manifest");
+            e.name.assign(p, name_len);
+            p += name_len;
+
+            // 文件必须首尾相接、不超出流，名字只能指向目录内部
+            if (e.offset != expected || e.size > total - e.offset) return fail("bad file offsets");
+            if (!isSafeName(e.name)) return fail("unsafe file name: " + e.name);
+            expected += e.size;
+            entries.push_back(e);
+        }
+        if (p != end || expected != total) return fail("manifest does not match stream size");
+        parsed = true;
+        manifest.clear();
+        manifest.shrink_to_fit();
+        if (!multi) return closeFinished();   // 开头的空文件
+
+        // 多路流：空文件没有自己的流，在这里创建
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].size > 0) continue;
+            FILE* f = createFile(entries[i].name);
+            if (!f) return false;
+            fclose(f);
+            files_done++;
+        }
+        return true;
+    }
+
+    // 创建文件（及其上级目录）
+    FILE* createFile(const std::string& name) {
+        for (size_t slash = name.find('/'); slash != std::string::npos; slash = name.find('/', slash + 1)) {
+            std::string sub = name.substr(0, slash);
+            if (created_dirs.count(sub)) continue;
+            if (!makeDirectory(dir + "/" + sub)) {
+                fail("cannot create directory " + sub);
+                return nullptr;
+            }
+            created_dirs.insert(sub);
+        }
+        FILE* f = fopen((dir + "/" + name).c_str(), "wb");
+        if (!f) fail("cannot create " + name);
+        return f;
+    }
+
+    bool openCurrent() {
+        fp = createFile(entries[current].name);
+        return fp != nullptr;
+    }
+
+    void closeCurrent() {
+        if (fp) fclose(fp);
+        fp = nullptr;
+    }
+
+    // 关闭已写完的文件，空文件在这里创建
+    bool closeFinished() {
+        while (current < entries.size() && cursor >= entries[current].offset + entries[current].size) {
+            if (!fp && !openCurrent()) return false;
+            closeCurrent();
+            current++;
+            files_done++;
+        }
+        return true;
+    }
+
+    std::string dir;
+    uint32_t total;                  // 字节流总长（SYN中的file_size）
+    uint32_t cursor;                 // 下一个待写入的流偏移
+    std::vector<char> manifest;      // 尚未收齐的清单
+    uint32_t manifest_len;
+    bool parsed;
+    bool multi;                      // 多路流
+    std::vector<Entry> entries;
+    size_t current;                  // 正在写入的文件
+    FILE* fp;
+    size_t files_done;
+    std::set<std::string> created_dirs;
+    std::string error;
+
+    BatchWriter(const BatchWriter&);
+    BatchWriter& operator=(const BatchWriter&);
+};
+
+#endif // BATCH_H
@@ -0,0 +1,174 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <cstdint>
+#include <cstring>
+
+// ===== 轻量级LZ77分块压缩（LZ4风格的块格式） =====
+//
+// 压缩后的块由若干"序列"组成，每个序列为：
+//   [token(1字节)] [字面量长度扩展(0~n字节)] [字面量] [偏移(2字节,小端)] [匹配长度扩展(0~n字节)]
+// token高4位为字面量长度，低4位为(匹配长度-4)，取值15时后续用255累加的字节扩展。
+// 最后一个序列只有字面量，没有偏移和匹配部分。
+// 偏移最大65535，因此单块最大为COMPRESS_BLOCK_MAX时窗口覆盖整块。
+
+const int LZ_MIN_MATCH = 4;         // 最短匹配长度
+const int LZ_HASH_LOG = 12;         // 哈希表大小 2^12
+const int LZ_LAST_LITERALS = 5;     // 块末尾必须保留为字面量的字节数
+const int LZ_MATCH_LIMIT = 12;      // 距块末尾不足该长度时不再查找匹配
+
+inline uint32_t lzRead32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint32_t lzHash(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - LZ_HASH_LOG);
+}
+
+// 写入长度扩展字节，返回写入后的位置，空间不足返回nullptr
+inline uint8_t* lzWriteLength(uint8_t* op, const uint8_t* op_end, uint32_t len) {
+    while (len >= 255) {
+        if (op >= op_end) return nullptr;
+        *op++ = 255;
+        len -= 255;
+    }
+    if (op >= op_end) return nullptr;
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// 输出一个序列（match_len为0表示最后的纯字面量序列）
+inline uint8_t* lzWriteSequence(uint8_t* op, const uint8_t* op_end,
+                                const uint8_t* literals, uint32_t lit_len,
+                                uint32_t offset, uint32_t match_len) {
+    if (op >= op_end) return nullptr;
+    uint8_t* token = op++;
+    uint32_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    *token = (uint8_t)(((lit_len >= 15 ? 15 : lit_len) << 4) | (ml >= 15 ? 15 : ml));
+
+    if (lit_len >= 15) {
+        op = lzWriteLength(op, op_end, lit_len - 15);
+        if (!op) return nullptr;
+    }
+    if (op + lit_len > op_end) return nullptr;
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+
+    if (match_len == 0) return op;
+
+    if (op + 2 > op_end) return nullptr;
+    *op++ = (uint8_t)(offset & 0xFF);
+    *op++ = (uint8_t)(offset >> 8);
+    if (ml >= 15) {
+        op = lzWriteLength(op, op_end, ml - 15);
+    }
+    return op;
+}
+
+// 压缩一个块
+// 返回压缩后的字节数；输出空间不足（即数据不可压缩）时返回-1
+inline int lzCompress(const void* src, int src_len, void* dst, int dst_cap) {
+    const uint8_t* in = (const uint8_t*)src;
+    uint8_t* op = (uint8_t*)dst;
+    const uint8_t* op_end = op + dst_cap;
+
+    int32_t table[1 << LZ_HASH_LOG];
+    for (int i = 0; i < (1 << LZ_HASH_LOG); i++) table[i] = -1;
+
+    int anchor = 0;
+    int ip = 0;
+    int match_limit = src_len - LZ_MATCH_LIMIT;
+    int extend_limit = src_len - LZ_LAST_LITERALS;
+    uint32_t misses = 0;
+
+    while (ip < match_limit) {
+        uint32_t seq = lzRead32(in + ip);
+        uint32_t h = lzHash(seq);
+        int32_t ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > 0xFFFF || lzRead32(in + ref) != seq) {
+            // 连续未命中时逐渐加大步长，快速跳过不可压缩的数据
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        int match_len = LZ_MIN_MATCH;
+        while (ip + match_len < extend_limit && in[ref + match_len] == in[ip + match_len]) {
+            match_len++;
+        }
+
+        op = lzWriteSequence(op, op_end, in + anchor, ip - anchor, ip - ref, match_len);
+        if (!op) return -1;
+
+        ip += match_len;
+        anchor = ip;
+    }
+
+    op = lzWriteSequence(op, op_end, in + anchor, src_len - anchor, 0, 0);
+    if (!op) return -1;
+    return (int)(op - (uint8_t*)dst);
+}
+
+// 解压一个块
+// 返回解压后的字节数；数据损坏或输出空间不足时返回-1
+inline int lzDecompress(const void* src, int src_len, void* dst, int dst_cap) {
+    const uint8_t* ip = (const uint8_t*)src;
+    const uint8_t* ip_end = ip + src_len;
+    uint8_t* out = (uint8_t*)dst;
+    uint8_t* op = out;
+    uint8_t* op_end = out + dst_cap;
+
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+
+        // 字面量
+        uint32_t lit_len = token >> 4;
+        if (lit_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) return -1;
+                b = *ip++;
+                lit_len += b;
+            } while (b == 255);
+        }
+        if ((uint32_t)(ip_end - ip) < lit_len || (uint32_t)(op_end - op) < lit_len) return -1;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip >= ip_end) break;  // 最后一个序列没有匹配部分
+
+        // 匹配
+        if (ip + 2 > ip_end) return -1;
+        uint32_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - out)) return -1;
+
+        uint32_t match_len = (token & 0x0F);
+        if (match_len == 15) {
+            uint8_t b;
+            do {
+                if (ip >= ip_end) return -1;
+                b = *ip++;
+                match_len += b;
+            } while (b == 255);
+        }
+        match_len += LZ_MIN_MATCH;
+        if ((uint32_t)(op_end - op) < match_len) return -1;
+
+        // 逐字节复制，允许匹配与输出重叠（如重复的短模式）
+        const uint8_t* match = op - offset;
+        for (uint32_t i = 0; i < match_len; i++) {
+            op[i] = match[i];
+        }
+        op += match_len;
+    }
+
+    return (int)(op - out);
+}
+
+#endif // COMPRESS_H
@@ -0,0 +1,618 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include "protocol.h"
+#include "hash.h"
+#include "batch.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ===== 差量传输（rsync算法） =====
+//
+// 接收端已有同名文件的旧版本（基准文件）时，只传输发生变化的部分：
+//   1. 接收端把基准文件切成固定大小的块，每块计算弱校验和（可滚动）和64位强哈希，
+//      组成签名，发送端按块序号分片拉取（PKT_SIG_REQ / PKT_SIG）；
+//   2. 发送端在新文件上逐字节滑动窗口，弱校验和命中后再比较强哈希，
+//      相同的块用"复制第i块"代替，其余字节作为字面数据；
+//   3. 指令流像普通文件一样走数据通道（可压缩、选择重传），接收端按顺序执行：
+//      从基准文件复制块或写入字面数据，生成临时文件，完成后替换基准文件。
+//
+// 块大小约为 sqrt(文件大小)，签名约 12 × sqrt(文件大小) 字节，远小于相同内容节省的数据量。
+//
+// 签名格式（网络字节序）：块数 × [weak(4) | strong(8)]，最后一块可能不足一个块大小
+// 指令流格式（网络字节序）：
+//   magic(4) | target_size(4) | block_size(4) | 指令...
+//   COPY:    0x01 | first_block(4) | block_count(4)   从基准文件复制连续的块
+//   LITERAL: 0x02 | length(4) | 数据                    字面数据
+
+const uint32_t DELTA_MAGIC = 0x44544452;                 // "RDTD"
+const uint32_t DELTA_HEADER_SIZE = 12;
+const uint32_t DELTA_SIG_ENTRY_SIZE = 12;                // weak(4) + strong(8)
+const uint32_t DELTA_BLOCK_MIN = 1024;
+const uint32_t DELTA_BLOCK_MAX = 64 * 1024;
+const uint32_t DELTA_SIG_WINDOW = 32;                    // 同时在途的签名分片请求数
+const uint32_t DELTA_PARALLEL_MIN = 4 * 1024 * 1024;     // 基准文件超过该大小时多线程计算签名
+const unsigned DELTA_MAX_THREADS = 8;
+const uint32_t DELTA_READ_SIZE = 1024 * 1024;            // 流式读取的缓冲大小
+const char DELTA_TEMP_SUFFIX[] = ".rdtd";                // 接收端重建中的临时文件
+
+const uint8_t DELTA_OP_COPY = 0x01;
+const uint8_t DELTA_OP_LITERAL = 0x02;
+const uint32_t DELTA_COPY_SIZE = 9;                      // 指令编码长度
+const uint32_t DELTA_LITERAL_HEADER_SIZE = 5;            // 不含数据
+
+// 块大小：2的幂，约为sqrt(size)，限制在[DELTA_BLOCK_MIN, DELTA_BLOCK_MAX]
+inline uint32_t deltaBlockSize(uint32_t basis_size) {
+    uint32_t block = DELTA_BLOCK_MIN;
+    while (block < DELTA_BLOCK_MAX && (uint64_t)block * block < basis_size) block <<= 1;
+    return block;
+}
+
+inline uint32_t deltaBlockCount(uint32_t size, uint32_t block) {
+    return (uint32_t)(((uint64_t)size + block - 1) / block);
+}
+
+// ===== 大文件定位（long在Windows上只有32位） =====
+
+inline bool seekFile(FILE* fp, uint64_t pos) {
+#ifdef _WIN32
+    return _fseeki64(fp, (__int64)pos, SEEK_SET) == 0;
+#else
+    return fseeko(fp, (off_t)pos, SEEK_SET) == 0;
+#endif
+}
+
+// 用from原子地替换to（to可以已存在），失败时两个文件都保持原样
+inline bool replaceFile(const char* from, const char* to) {
+#ifdef _WIN32
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;   // rename在Windows上不覆盖已有文件
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+// 普通文件的大小；不存在、是目录或超过4 GB时返回false
+inline bool getFileSize(const char* path, uint32_t& size) {
+    if (isDirectory(path)) return false;
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return false;
+#ifdef _WIN32
+    bool ok = _fseeki64(fp, 0, SEEK_END) == 0;
+    int64_t len = ok ? _ftelli64(fp) : -1;
+#else
+    bool ok = fseeko(fp, 0, SEEK_END) == 0;
+    int64_t len = ok ? (int64_t)ftello(fp) : -1;
+#endif
+    fclose(fp);
+    if (len < 0 || len > (int64_t)UINT32_MAX) return false;
+    size = (uint32_t)len;
+    return true;
+}
+
+inline void deltaPutU32(char* p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+inline uint32_t deltaGetU32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+// ===== 弱校验和（rsync的滚动校验和） =====
+// a = Σx[i]，b = Σ(n-i)·x[i]，各取低16位；窗口右移一个字节只需O(1)更新
+class RollingChecksum {
+public:
+    RollingChecksum() : a(0), b(0), len(0) {}
+
+    void init(const uint8_t* data, uint32_t n) {
+        a = b = 0;
+        len = n;
+        for (uint32_t i = 0; i < n; i++) {
+            a += data[i];
+            b += (n - i) * data[i];
+        }
+    }
+
+    // 移出窗口首字节out，移入新字节in
+    void roll(uint8_t out, uint8_t in) {
+        a += in - out;
+        b += a - len * out;
+    }
+
+    uint32_t digest() const { return (a & 0xFFFF) | (b << 16); }
+
+private:
+    uint32_t a, b, len;
+};
+
+// ===== 接收端：计算基准文件的签名 =====
+//
+// 基准文件按块号均分给若干线程，每个线程用自己的文件句柄流式读取自己那一段，
+// 内存占用与文件大小无关；结果直接写入签名数组中对应的位置
+inline bool computeSignature(const char* path, uint32_t size, uint32_t block, std::vector<char>& sig) {
+    uint32_t blocks = deltaBlockCount(size, block);
+    sig.assign((size_t)blocks * DELTA_SIG_ENTRY_SIZE, 0);
+    if (blocks == 0) return true;
+
+    unsigned threads = 1;
+    if (size >= DELTA_PARALLEL_MIN) {
+        threads = std::max(1u, std::min(std::thread::hardware_concurrency(), DELTA_MAX_THREADS));
+        threads = std::min<unsigned>(threads, blocks);
+    }
+    std::vector<char> ok(threads, 0);
+
+    auto work = [&](unsigned t) {
+        uint32_t first = (uint32_t)((uint64_t)blocks * t / threads);
+        uint32_t last = (uint32_t)((uint64_t)blocks * (t + 1) / threads);
+        FILE* fp = fopen(path, "rb");
+        if (!fp) return;
+        if (!seekFile(fp, (uint64_t)first * block)) {
+            fclose(fp);
+            return;
+        }
+        uint32_t per_read = std::max(1u, DELTA_READ_SIZE / block);
+        std::vector<uint8_t> buf((size_t)per_read * block);
+        RollingChecksum weak;
+        for (uint32_t i = first; i < last; ) {
+            uint32_t n = std::min(per_read, last - i);
+            uint32_t bytes = (uint32_t)std::min<uint64_t>((uint64_t)n * block, size - (uint64_t)i * block);
+            if (fread(buf.data(), 1, bytes, fp) != bytes) {
+                fclose(fp);
+                return;   // 文件在计算过程中变短
+            }
+            for (uint32_t j = 0; j < n; j++) {
+                const uint8_t* data = buf.data() + (size_t)j * block;
+                uint32_t len = std::min(block, bytes - j * block);
+                weak.init(data, len);
+                uint64_t strong = hash64(data, len);
+                char* entry = sig.data() + (size_t)(i + j) * DELTA_SIG_ENTRY_SIZE;
+                deltaPutU32(entry, weak.digest());
+                deltaPutU32(entry + 4, (uint32_t)(strong >> 32));
+                deltaPutU32(entry + 8, (uint32_t)strong);
+            }
+            i += n;
+        }
+        fclose(fp);
+        ok[t] = 1;
+    };
+
+    if (threads == 1) {
+        work(0);
+    } else {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++) workers.push_back(std::thread(work, t));
+        for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+    }
+    return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
+
+// ===== 发送端：生成指令流 =====
+
+struct DeltaOp {
+    uint8_t type;
+    uint32_t a;      // COPY：首块序号；LITERAL：数据在新文件中的偏移
+    uint32_t b;      // COPY：块数；LITERAL：长度
+};
+
+// 指令流作为数据通道上的字节流：指令在build时算好（字面数据只记偏移），
+// 读取时再从新文件取出字面数据，内存占用与指令数而不是文件大小成正比
+class DeltaSource : public StreamSource {
+public:
+    DeltaSource() : target_size(0), block_size(0), total(0), pos(0), current(0), fp(nullptr),
+                    file_pos(0), matched_blocks(0), literal_bytes(0), digest(0) {}
+    ~DeltaSource() { if (fp) fclose(fp); }
+
+    // 用接收端的签名（基准文件basis_size字节，块大小block）比对新文件path
+    bool build(const char* path, uint32_t file_size, const std::vector<char>& sig,
+               uint32_t basis_size, uint32_t block) {
+        target_size = file_size;
+        block_size = block;
+        fp = fopen(path, "rb");
+        if (!fp || block == 0) return false;
+
+        uint32_t blocks = deltaBlockCount(basis_size, block);
+        if (sig.size() != (size_t)blocks * DELTA_SIG_ENTRY_SIZE) return false;
+        std::vector<uint32_t> weak(blocks);
+        std::vector<uint64_t> strong(blocks);
+        for (uint32_t i = 0; i < blocks; i++) {
+            const char* entry = sig.data() + (size_t)i * DELTA_SIG_ENTRY_SIZE;
+            weak[i] = deltaGetU32(entry);
+            strong[i] = ((uint64_t)deltaGetU32(entry + 4) << 32) | deltaGetU32(entry + 8);
+        }
+
+        // 完整块按弱校验和建哈希表（链表法，同一桶内按块号升序）；不足一块的尾块单独比较。
+        // 另建一个位图过滤器（每块约16位），绝大多数位置只查位图就能排除，不必访问哈希表
+        uint32_t full_blocks = basis_size / block;
+        int bucket_bits = 1;
+        while (bucket_bits < 30 && (1u << bucket_bits) < full_blocks * 2) bucket_bits++;
+        int filter_bits = std::min(bucket_bits + 3, 30);
+        std::vector<int32_t> head((size_t)1 << bucket_bits, -1);
+        std::vector<int32_t> next(full_blocks, -1);
+        std::vector<uint64_t> filter(((size_t)1 << filter_bits) / 64 + 1, 0);
+        for (uint32_t i = full_blocks; i-- > 0; ) {
+            uint32_t mixed = weak[i] * 0x9E3779B1u;
+            uint32_t bucket = mixed >> (32 - bucket_bits);
+            next[i] = head[bucket];
+            head[bucket] = (int32_t)i;
+            uint32_t bit = mixed >> (32 - filter_bits);
+            filter[bit / 64] |= 1ULL << (bit % 64);
+        }
+        auto maybeBlock = [&](uint32_t digest) -> bool {
+            uint32_t bit = (digest * 0x9E3779B1u) >> (32 - filter_bits);
+            return (filter[bit / 64] >> (bit % 64)) & 1;
+        };
+
+        // 流式读取新文件：buf保存文件[buf_off, buf_off + buf_len)，窗口之前的字节不再需要。
+        // 接收端比对的是文件内容的摘要，读入的字节顺带计入
+        std::vector<uint8_t> buf(std::max<size_t>((size_t)block * 8, DELTA_READ_SIZE));
+        uint32_t buf_off = 0;
+        size_t buf_len = 0;
+        StreamDigest content;
+        auto ensure = [&](uint32_t at, uint32_t need) -> bool {
+            if ((uint64_t)at + need <= (uint64_t)buf_off + buf_len) return true;
+            size_t keep = at - buf_off;
+            memmove(buf.data(), buf.data() + keep, buf_len - keep);
+            buf_off = at;
+            buf_len -= keep;
+            size_t room = std::min<size_t>(buf.size() - buf_len, file_size - (buf_off + buf_len));
+            size_t got = fread(buf.data() + buf_len, 1, room, fp);
+            content.update(buf.data() + buf_len, got);
+            buf_len += got;
+            return (uint64_t)at + need <= (uint64_t)buf_off + buf_len;
+        };
+
+        uint32_t literal_start = 0;
+        uint32_t at = 0;
+        bool rolling = false;
+        RollingChecksum rc;
+        while (full_blocks > 0 && (uint64_t)at + block <= file_size) {
+            bool more = (uint64_t)at + block < file_size;   // 窗口之后还有字节可以移入
+            if (!ensure(at, block + (more ? 1 : 0))) return false;
+            const uint8_t* window = buf.data() + (at - buf_off);
+            if (!rolling) {
+                rc.init(window, block);
+                rolling = true;
+            }
+
+            // 快速路径：过滤器排除的位置直接滚动，缓冲区中已有的字节一次处理完
+            size_t room = buf_off + buf_len - at - block;   // 窗口之后已读入的字节数
+            uint32_t digest = rc.digest();
+            while (room > 0 && !maybeBlock(digest)) {
+                rc.roll(window[0], window[block]);
+                window++;
+                room--;
+                digest = rc.digest();
+            }
+            at = buf_off + (uint32_t)(window - buf.data());
+
+            int32_t match = -1;
+            bool hashed = false;
+            uint64_t window_strong = 0;
+            uint32_t bucket = (digest * 0x9E3779B1u) >> (32 - bucket_bits);
+            for (int32_t i = maybeBlock(digest) ? head[bucket] : -1; i >= 0; i = next[i]) {
+                if (weak[i] != digest) continue;
+                if (!hashed) {
+                    window_strong = hash64(window, block);
+                    hashed = true;
+                }
+                if (strong[i] == window_strong) {
+                    match = i;
+                    break;
+                }
+            }
+
+            if (match >= 0) {
+                addLiteral(literal_start, at);
+                addCopy((uint32_t)match);
+                at += block;
+                literal_start = at;
+                rolling = false;
+                continue;
+            }
+            if ((uint64_t)at + block >= file_size) break;
+            if (room == 0) continue;   // 先读入更多数据（同一位置会再检查一次）
+            rc.roll(window[0], window[block]);
+            at++;
+        }
+
+        // 滑动窗口没有读到的结尾部分补进摘要
+        uint32_t hashed = buf_off + (uint32_t)buf_len;
+        if (hashed < file_size && !seekFile(fp, hashed)) return false;
+        while (hashed < file_size) {
+            size_t got = fread(buf.data(), 1, std::min<size_t>(buf.size(), file_size - hashed), fp);
+            if (got == 0) return false;   // 文件在计算过程中变短
+            content.update(buf.data(), got);
+            hashed += (uint32_t)got;
+        }
+        digest = content.digest();
+
+        // 基准文件的尾块（不足一块）只可能与新文件的结尾对齐
+        uint32_t tail_len = basis_size - full_blocks * block;
+        if (tail_len > 0 && file_size >= tail_len && file_size - tail_len >= literal_start) {
+            std::vector<uint8_t> tail(tail_len);
+            RollingChecksum tail_weak;
+            if (seekFile(fp, file_size - tail_len) && fread(tail.data(), 1, tail_len, fp) == tail_len) {
+                tail_weak.init(tail.data(), tail_len);
+                if (tail_weak.digest() == weak[full_blocks] && hash64(tail.data(), tail_len) == strong[full_blocks]) {
+                    addLiteral(literal_start, file_size - tail_len);
+                    addCopy(full_blocks);
+                    literal_start = file_size;
+                }
+            }
+        }
+        addLiteral(literal_start, file_size);
+
+        // 各指令在流中的起始偏移
+        header.resize(DELTA_HEADER_SIZE);
+        deltaPutU32(header.data(), DELTA_MAGIC);
+        deltaPutU32(header.data() + 4, target_size);
+        deltaPutU32(header.data() + 8, block_size);
+        uint64_t offset = DELTA_HEADER_SIZE;
+        op_pos.resize(ops.size() + 1);
+        for (size_t i = 0; i < ops.size(); i++) {
+            op_pos[i] = (uint32_t)offset;
+            offset += ops[i].type == DELTA_OP_COPY ? DELTA_COPY_SIZE : DELTA_LITERAL_HEADER_SIZE + ops[i].b;
+            if (offset > UINT32_MAX) return false;
+        }
+        op_pos[ops.size()] = (uint32_t)offset;
+        total = (uint32_t)offset;
+        file_pos = UINT32_MAX;   // 读取字面数据前需要重新定位
+        return true;
+    }
+
+    uint32_t size() const { return total; }
+    uint32_t matchedBlocks() const { return matched_blocks; }
+    uint32_t literalBytes() const { return literal_bytes; }
+    size_t opCount() const { return ops.size(); }
+
+    bool contentDigest(uint64_t& value) const {
+        value = digest;
+        return true;
+    }
+
+    void read(char* buffer, uint32_t len) {
+        while (len > 0) {
+            uint32_t n;
+            if (pos < DELTA_HEADER_SIZE) {
+                n = std::min(len, DELTA_HEADER_SIZE - pos);
+                memcpy(buffer, header.data() + pos, n);
+            } else if (current >= ops.size()) {
+                memset(buffer, 0, len);
+                return;
+            } else {
+                const DeltaOp& op = ops[current];
+                uint32_t inner = pos - op_pos[current];
+                uint32_t op_header = op.type == DELTA_OP_COPY ? DELTA_COPY_SIZE : DELTA_LITERAL_HEADER_SIZE;
+                if (inner < op_header) {
+                    char encoded[DELTA_COPY_SIZE];
+                    encoded[0] = (char)op.type;
+                    deltaPutU32(encoded + 1, op.type == DELTA_OP_COPY ? op.a : op.b);
+                    deltaPutU32(encoded + 5, op.b);
+                    n = std::min(len, op_header - inner);
+                    memcpy(buffer, encoded + inner, n);
+                } else {
+                    // 字面数据从新文件读取，文件在发送过程中变短时以0补齐
+                    uint32_t data_pos = op.a + (inner - op_header);
+                    n = std::min(len, op_pos[current + 1] - pos);
+                    if (file_pos != data_pos) seekFile(fp, data_pos);
+                    size_t got = fread(buffer, 1, n, fp);
+                    if (got < n) memset(buffer + got, 0, n - got);
+                    file_pos = data_pos + n;
+                }
+            }
+            buffer += n;
+            len -= n;
+            pos += n;
+            while (current < ops.size() && pos >= op_pos[current + 1]) current++;
+        }
+    }
+
+    void seek(uint32_t new_pos) {
+        pos = new_pos;
+        current = std::upper_bound(op_pos.begin(), op_pos.end(), pos) - op_pos.begin();
+        current = current > 0 ? current - 1 : 0;
+    }
+
+private:
+    void addLiteral(uint32_t start, uint32_t end) {
+        if (end <= start) return;
+        literal_bytes += end - start;
+        if (!ops.empty() && ops.back().type == DELTA_OP_LITERAL && ops.back().a + ops.back().b == start) {
+            ops.back().b += end - start;
+            return;
+        }
+        DeltaOp op = {DELTA_OP_LITERAL, start, end - start};
+        ops.push_back(op);
+    }
+
+    void addCopy(uint32_t index) {
+        matched_blocks++;
+        if (!ops.empty() && ops.back().type == DELTA_OP_COPY && ops.back().a + ops.back().b == index) {
+            ops.back().b++;
+            return;
+        }
+        DeltaOp op = {DELTA_OP_COPY, index, 1};
+        ops.push_back(op);
+    }
+
+    uint32_t target_size;
+    uint32_t block_size;
+    std::vector<DeltaOp> ops;
+    std::vector<uint32_t> op_pos;    // 各指令在流中的起始偏移，末尾为流长度
+    std::vector<char> header;
+    uint32_t total;
+    uint32_t pos;                    // 下一个读取的流偏移
+    size_t current;                  // pos所在的指令
+    FILE* fp;
+    uint32_t file_pos;               // fp的当前位置
+    uint32_t matched_blocks;
+    uint32_t literal_bytes;
+    uint64_t digest;                 // 新文件内容的摘要（build时计算）
+
+    DeltaSource(const DeltaSource&);
+    DeltaSource& operator=(const DeltaSource&);
+};
+
+// ===== 接收端：执行指令流 =====
+//
+// 与BatchWriter一样要求顺序写入：指令可能跨包，未收齐的指令头暂存在pending中；
+// 输出写到临时文件，finish()确认长度正确后替换基准文件
+class DeltaWriter {
+public:
+    DeltaWriter() : basis(nullptr), out(nullptr), basis_size(0), block_size(0), target_size(0),
+                    cursor(0), written(0), header_done(false), pending_len(0), literal_left(0),
+                    copied_bytes(0), literal_bytes(0) {}
+    ~DeltaWriter() { abort(); }
+
+    bool open(const std::string& basis_path, uint32_t basis_len, uint32_t block) {
+        path = basis_path;
+        temp_path = basis_path + DELTA_TEMP_SUFFIX;
+        basis_size = basis_len;
+        block_size = block;
+        basis = fopen(path.c_str(), "rb");
+        if (!basis) return fail("cannot open " + path);
+        out = fopen(temp_path.c_str(), "wb");
+        if (!out) return fail("cannot create " + temp_path);
+        return true;
+    }
+
+    // 写入流偏移offset处的数据，必须紧接在上次写入之后
+    bool write(uint32_t offset, const char* data, uint32_t len) {
+        if (offset != cursor) return fail("non-sequential write");
+        cursor += len;
+        while (len > 0) {
+            if (literal_left > 0) {
+                uint32_t n = std::min(len, literal_left);
+                if (!emit(data, n)) return false;
+                literal_bytes += n;
+                literal_left -= n;
+                data += n;
+                len -= n;
+                continue;
+            }
+
+            // 收集指令头：流头部12字节，之后每条指令先看类型字节决定长度
+            uint32_t want = !header_done ? DELTA_HEADER_SIZE :
+                            pending_len == 0 ? 1 :
+                            (uint8_t)pending[0] == DELTA_OP_COPY ? DELTA_COPY_SIZE :
+                            (uint8_t)pending[0] == DELTA_OP_LITERAL ? DELTA_LITERAL_HEADER_SIZE : 0;
+            if (want == 0) return fail("bad delta instruction");
+            uint32_t n = std::min(len, want - pending_len);
+            memcpy(pending + pending_len, data, n);
+            pending_len += n;
+            data += n;
+            len -= n;
+            if (pending_len < want || want == 1) continue;
+
+            pending_len = 0;
+            if (!header_done) {
+                if (deltaGetU32(pending) != DELTA_MAGIC || deltaGetU32(pending + 8) != block_size) {
+                    return fail("bad delta header");
+                }
+                target_size = deltaGetU32(pending + 4);
+                header_done = true;
+            } else if ((uint8_t)pending[0] == DELTA_OP_COPY) {
+                if (!copyBlocks(deltaGetU32(pending + 1), deltaGetU32(pending + 5))) return false;
+            } else {
+                literal_left = deltaGetU32(pending + 1);
+                if (literal_left > target_size - written) return fail("literal beyond target size");
+            }
+        }
+        return true;
+    }
+
+    // 指令流结束：检查长度并用重建的文件替换基准文件
+    bool finish() {
+        bool complete = header_done && pending_len == 0 && literal_left == 0 && written == target_size;
+        closeFiles();
+        if (!complete) {
+            remove(temp_path.c_str());
+            return fail("delta stream incomplete");
+        }
+        if (!replaceFile(temp_path.c_str(), path.c_str())) {
+            remove(temp_path.c_str());
+            return fail("cannot replace " + path);
+        }
+        return true;
+    }
+
+    // 连接中断：丢弃临时文件，基准文件保持不变
+    void abort() {
+        if (!basis && !out) return;
+        closeFiles();
+        remove(temp_path.c_str());
+    }
+
+    uint32_t targetSize() const { return target_size; }
+    uint32_t copiedBytes() const { return copied_bytes; }
+    uint32_t literalBytes() const { return literal_bytes; }
+    uint64_t digest() const { return output_digest.digest(); }   // 已输出内容的摘要
+    const std::string& lastError() const { return error; }
+
+private:
+    bool fail(const std::string& message) {
+        error = message;
+        return false;
+    }
+
+    bool emit(const char* data, uint32_t len) {
+        if (len > target_size - written) return fail("output beyond target size");
+        if (fwrite(data, 1, len, out) != len) return fail("cannot write " + temp_path);
+        output_digest.update(data, len);
+        written += len;
+        return true;
+    }
+
+    bool copyBlocks(uint32_t first, uint32_t count) {
+        uint64_t start = (uint64_t)first * block_size;
+        if (count == 0 || start >= basis_size) return fail("copy beyond basis file");
+        uint64_t bytes = std::min<uint64_t>((uint64_t)count * block_size, basis_size - start);
+        if (!seekFile(basis, start)) return fail("cannot seek " + path);
+        if (copy_buf.empty()) copy_buf.resize(DELTA_READ_SIZE);
+        while (bytes > 0) {
+            uint32_t n = (uint32_t)std::min<uint64_t>(bytes, copy_buf.size());
+            if (fread(copy_buf.data(), 1, n, basis) != n) return fail("basis file changed");
+            if (!emit(copy_buf.data(), n)) return false;
+            copied_bytes += n;
+            bytes -= n;
+        }
+        return true;
+    }
+
+    void closeFiles() {
+        if (basis) fclose(basis);
+        if (out) fclose(out);
+        basis = out = nullptr;
+    }
+
+    std::string path;
+    std::string temp_path;
+    FILE* basis;
+    FILE* out;
+    uint32_t basis_size;
+    uint32_t block_size;
+    uint32_t target_size;            // 重建后的文件大小（指令流头部）
+    uint32_t cursor;                 // 下一个待写入的流偏移
+    uint32_t written;                // 已输出的字节数
+    bool header_done;
+    char pending[DELTA_HEADER_SIZE]; // 未收齐的流头部或指令头
+    uint32_t pending_len;
+    uint32_t literal_left;           // 当前LITERAL指令剩余的数据字节
+    std::vector<char> copy_buf;
+    uint32_t copied_bytes;
+    uint32_t literal_bytes;
+    StreamDigest output_digest;
+    std::string error;
+
+    DeltaWriter(const DeltaWriter&);
+    DeltaWriter& operator=(const DeltaWriter&);
+};
+
+#endif // DELTA_H
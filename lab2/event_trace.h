@@ -0,0 +1,123 @@
+#ifndef EVENT_TRACE_H
+#define EVENT_TRACE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+// ===== 连接事件记录（qlog风格） =====
+// 每个事件是一条16字节的定长记录，先攒在内存里，满了整块写入文件；
+// 记录一个事件只是读一次时钟、填一条记录，压测时也可以一直开着。
+// 文件格式：8字节文件头（"RDTQ"、版本、记录大小）后接记录，均为本机字节序（x86为小端）。
+// trace_dump把它转换成qlog的JSON-SEQ和序号/cwnd随时间变化的SVG图
+
+const uint16_t TRACE_VERSION = 1;
+const size_t TRACE_BUFFER_RECORDS = 4096;   // 缓冲满了写一次文件（64KB）
+
+enum TraceEventType {
+    TRACE_PACKET_SENT = 1,      // info=包类型，a=seq，b=ack，len=数据长度
+    TRACE_PACKET_RECEIVED = 2,  // 同上
+    TRACE_PACKET_LOST = 3,      // info=TraceLossReason，a=seq，len=数据长度（随后重传）
+    TRACE_METRICS = 4,          // info=TraceCongestionState，a=cwnd（包数），b=ssthresh，len=分段大小
+    TRACE_RTT = 5,              // a=本次样本（微秒），b=平滑后的srtt（微秒），len=RTO（毫秒，超过65535截断）
+    TRACE_CONNECTION = 6        // info=TraceConnectionState
+};
+
+enum TraceLossReason {
+    TRACE_LOSS_RACK = 0,        // RACK按时间判定丢失（快速重传）
+    TRACE_LOSS_TIMEOUT = 1,     // 重传超时
+    TRACE_LOSS_PROBE = 2        // 尾部探测重发最后一个包（不一定丢失）
+};
+
+enum TraceCongestionState {
+    TRACE_SLOW_START = 0,
+    TRACE_CONGESTION_AVOIDANCE = 1,
+    TRACE_RECOVERY = 2          // RACK快速恢复中
+};
+
+enum TraceConnectionState {
+    TRACE_CONN_ESTABLISHED = 0, // 握手完成
+    TRACE_CONN_CLOSED = 1
+};
+
+struct TraceRecord {
+    uint32_t time_us;           // 相对记录开始的微秒数（约71分钟回绕一次，转换时按单调递增展开）
+    uint8_t type;               // TraceEventType
+    uint8_t info;
+    uint16_t len;
+    uint32_t a;
+    uint32_t b;
+};
+
+struct TraceFileHeader {
+    char magic[4];              // "RDTQ"
+    uint16_t version;
+    uint16_t record_size;
+};
+
+class EventTrace {
+public:
+    EventTrace() : fp(nullptr), count(0), written(0), started(false) {}
+    ~EventTrace() { close(); }
+
+    // 时间从第一个事件开始计
+    bool open(const char* path) {
+        close();
+        fp = fopen(path, "wb");
+        if (!fp) return false;
+        TraceFileHeader header;
+        memcpy(header.magic, "RDTQ", 4);
+        header.version = TRACE_VERSION;
+        header.record_size = sizeof(TraceRecord);
+        fwrite(&header, sizeof(header), 1, fp);
+        buffer.resize(TRACE_BUFFER_RECORDS);
+        count = 0;
+        written = 0;
+        started = false;
+        return true;
+    }
+
+    void record(std::chrono::steady_clock::time_point t, uint8_t type, uint8_t info,
+                uint16_t len, uint32_t a, uint32_t b) {
+        if (!started) {
+            start = t;
+            started = true;
+        }
+        TraceRecord& r = buffer[count];
+        r.time_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(t - start).count();
+        r.type = type;
+        r.info = info;
+        r.len = len;
+        r.a = a;
+        r.b = b;
+        if (++count == TRACE_BUFFER_RECORDS) flush();
+    }
+
+    void flush() {
+        if (!fp || count == 0) return;
+        fwrite(buffer.data(), sizeof(TraceRecord), count, fp);
+        written += count;
+        count = 0;
+    }
+
+    void close() {
+        if (!fp) return;
+        flush();
+        fclose(fp);
+        fp = nullptr;
+    }
+
+    uint64_t recorded() const { return written + count; }
+
+private:
+    FILE* fp;
+    std::vector<TraceRecord> buffer;
+    size_t count;
+    uint64_t written;
+    bool started;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // EVENT_TRACE_H
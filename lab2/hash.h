@@ -0,0 +1,302 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// SIMD：x86上基线为SSE2；GCC/Clang另外编译一份AVX2版本，运行时按CPU选择（不需要-mavx2）。
+// 定义HASH_NO_SIMD时只用标量实现（结果相同，用于对照）
+#if !defined(HASH_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64))
+#include <emmintrin.h>
+#define HASH_SSE2 1
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define HASH_AVX2 1
+#endif
+#endif
+
+// ===== 64位强哈希（xxHash64算法） =====
+//
+// 用于差量传输中数据块的强校验：弱校验和（滚动）命中后再比较强哈希，
+// 64位哈希在一个文件的块数量级上碰撞概率可以忽略。
+// 每次处理32字节、4路独立累加，没有数据依赖链，单线程约数GB/s。
+
+const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t xxhRotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t xxhRead64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint32_t xxhRead32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+inline uint64_t xxhRound(uint64_t acc, uint64_t input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxhRotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+inline uint64_t xxhMergeRound(uint64_t acc, uint64_t val) {
+    acc ^= xxhRound(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+inline uint64_t hash64(const void* data, size_t len, uint64_t seed = 0) {
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = xxhRound(v1, xxhRead64(p));
+            v2 = xxhRound(v2, xxhRead64(p + 8));
+            v3 = xxhRound(v3, xxhRead64(p + 16));
+            v4 = xxhRound(v4, xxhRead64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = xxhRotl64(v1, 1) + xxhRotl64(v2, 7) + xxhRotl64(v3, 12) + xxhRotl64(v4, 18);
+        h = xxhMergeRound(h, v1);
+        h = xxhMergeRound(h, v2);
+        h = xxhMergeRound(h, v3);
+        h = xxhMergeRound(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+    h += (uint64_t)len;
+
+    while (p + 8 <= end) {
+        h ^= xxhRound(0, xxhRead64(p));
+        h = xxhRotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)xxhRead32(p) * XXH_PRIME64_1;
+        h = xxhRotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * XXH_PRIME64_5;
+        h = xxhRotl64(h, 11) * XXH_PRIME64_1;
+        p++;
+    }
+
+    // 最终混合
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ===== 流式文件摘要 =====
+//
+// 两端在读取/写入数据时顺带计算整个文件的64位摘要，FIN时交换比较，不需要再读一遍文件。
+// 数据按64字节条带处理，8个64位累加器，每个条带：
+//   acc[i] += data[i^1] + lo32(data[i] ^ key[i]) × hi32(data[i] ^ key[i])
+// （与XXH3的累加步骤相同），每16个条带（1KB）扰乱一次累加器。乘法只用32×32→64，
+// SSE2/AVX2一条指令处理2/4个累加器；标量实现的结果完全相同，两端的编译选项可以不同。
+// 摘要只与数据内容有关，与update的分段方式无关。
+
+const size_t DIGEST_LANES = 8;
+const size_t DIGEST_STRIPE = 64;
+const size_t DIGEST_STRIPES_PER_BLOCK = 16;
+const uint64_t DIGEST_PRIME32 = 0x9E3779B1ULL;
+
+class StreamDigest {
+public:
+    StreamDigest() { reset(); }
+
+    void reset() {
+        static const uint64_t init[DIGEST_LANES] = {
+            0x165667B1ULL, XXH_PRIME64_1, XXH_PRIME64_2, XXH_PRIME64_3,
+            XXH_PRIME64_4, 0x85EBCA77ULL, XXH_PRIME64_5, DIGEST_PRIME32};
+        memcpy(acc, init, sizeof(acc));
+        buffered = 0;
+        stripe = 0;
+        total = 0;
+    }
+
+    void update(const void* data, size_t len) {
+        const uint8_t* p = (const uint8_t*)data;
+        total += len;
+        if (buffered > 0) {
+            size_t n = std::min(len, DIGEST_STRIPE - buffered);
+            memcpy(buffer + buffered, p, n);
+            buffered += n;
+            p += n;
+            len -= n;
+            if (buffered < DIGEST_STRIPE) return;
+            consume(buffer, 1);
+            buffered = 0;
+        }
+        size_t stripes = len / DIGEST_STRIPE;
+        consume(p, stripes);
+        p += stripes * DIGEST_STRIPE;
+        len -= stripes * DIGEST_STRIPE;
+        memcpy(buffer, p, len);
+        buffered = len;
+    }
+
+    uint64_t digest() const {
+        uint64_t h = total * XXH_PRIME64_1;
+        for (size_t i = 0; i < DIGEST_LANES; i++) {
+            h ^= xxhRound(0, acc[i]);
+            h = xxhRotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+        }
+        return hash64(buffer, buffered, h);   // 不足一个条带的结尾，顺带完成最终混合
+    }
+
+    uint64_t length() const { return total; }
+
+private:
+    // 条带s（块内序号）使用keys()[s..s+7]，扰乱使用最后8个
+    static const uint64_t* keys() {
+        struct Table {
+            uint64_t k[DIGEST_STRIPES_PER_BLOCK + DIGEST_LANES];
+            Table() {
+                uint64_t x = XXH_PRIME64_5;   // splitmix64
+                for (size_t i = 0; i < sizeof(k) / sizeof(k[0]); i++) {
+                    uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+                    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                    k[i] = z ^ (z >> 31);
+                }
+            }
+        };
+        static const Table table;
+        return table.k;
+    }
+
+    // 处理count个完整条带，块结束时扰乱
+    void consume(const uint8_t* p, size_t count) {
+        const uint64_t* key = keys();
+        while (count > 0) {
+            size_t n = std::min(count, DIGEST_STRIPES_PER_BLOCK - stripe);
+            digestAccumulate(acc, p, n, key + stripe);
+            p += n * DIGEST_STRIPE;
+            count -= n;
+            stripe += n;
+            if (stripe == DIGEST_STRIPES_PER_BLOCK) {
+                scramble(key + DIGEST_STRIPES_PER_BLOCK);
+                stripe = 0;
+            }
+        }
+    }
+
+    // 每1KB一次，标量即可
+    void scramble(const uint64_t* key) {
+        for (size_t i = 0; i < DIGEST_LANES; i++) {
+            uint64_t a = acc[i];
+            a ^= a >> 47;
+            a ^= key[i];
+            acc[i] = a * DIGEST_PRIME32;
+        }
+    }
+
+    static void digestAccumulateScalar(uint64_t* acc, const uint8_t* p, size_t n, const uint64_t* key) {
+        for (size_t s = 0; s < n; s++, p += DIGEST_STRIPE) {
+            for (size_t i = 0; i < DIGEST_LANES; i++) {
+                uint64_t d = xxhRead64(p + 8 * i);
+                uint64_t dk = d ^ key[s + i];
+                acc[i ^ 1] += d;
+                acc[i] += (dk & 0xFFFFFFFFULL) * (dk >> 32);
+            }
+        }
+    }
+
+#if defined(HASH_SSE2)
+    static __m128i accumulateLanes(__m128i a, const uint8_t* p, const uint64_t* key) {
+        __m128i d = _mm_loadu_si128((const __m128i*)p);
+        __m128i dk = _mm_xor_si128(d, _mm_loadu_si128((const __m128i*)key));
+        __m128i product = _mm_mul_epu32(dk, _mm_shuffle_epi32(dk, _MM_SHUFFLE(0, 3, 0, 1)));
+        __m128i swapped = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));   // data[i^1]
+        return _mm_add_epi64(a, _mm_add_epi64(swapped, product));
+    }
+
+    static void digestAccumulateSse2(uint64_t* acc, const uint8_t* p, size_t n, const uint64_t* key) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)acc);
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(acc + 2));
+        __m128i a2 = _mm_loadu_si128((const __m128i*)(acc + 4));
+        __m128i a3 = _mm_loadu_si128((const __m128i*)(acc + 6));
+        for (size_t s = 0; s < n; s++, p += DIGEST_STRIPE) {
+            a0 = accumulateLanes(a0, p, key + s);
+            a1 = accumulateLanes(a1, p + 16, key + s + 2);
+            a2 = accumulateLanes(a2, p + 32, key + s + 4);
+            a3 = accumulateLanes(a3, p + 48, key + s + 6);
+        }
+        _mm_storeu_si128((__m128i*)acc, a0);
+        _mm_storeu_si128((__m128i*)(acc + 2), a1);
+        _mm_storeu_si128((__m128i*)(acc + 4), a2);
+        _mm_storeu_si128((__m128i*)(acc + 6), a3);
+    }
+#endif
+
+#if defined(HASH_AVX2)
+    __attribute__((target("avx2")))
+    static void digestAccumulateAvx2(uint64_t* acc, const uint8_t* p, size_t n, const uint64_t* key) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)acc);
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(acc + 4));
+        for (size_t s = 0; s < n; s++, p += DIGEST_STRIPE) {
+            __m256i d0 = _mm256_loadu_si256((const __m256i*)p);
+            __m256i d1 = _mm256_loadu_si256((const __m256i*)(p + 32));
+            __m256i dk0 = _mm256_xor_si256(d0, _mm256_loadu_si256((const __m256i*)(key + s)));
+            __m256i dk1 = _mm256_xor_si256(d1, _mm256_loadu_si256((const __m256i*)(key + s + 4)));
+            __m256i p0 = _mm256_mul_epu32(dk0, _mm256_shuffle_epi32(dk0, _MM_SHUFFLE(0, 3, 0, 1)));
+            __m256i p1 = _mm256_mul_epu32(dk1, _mm256_shuffle_epi32(dk1, _MM_SHUFFLE(0, 3, 0, 1)));
+            a0 = _mm256_add_epi64(a0, _mm256_add_epi64(_mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2)), p0));
+            a1 = _mm256_add_epi64(a1, _mm256_add_epi64(_mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2)), p1));
+        }
+        _mm256_storeu_si256((__m256i*)acc, a0);
+        _mm256_storeu_si256((__m256i*)(acc + 4), a1);
+    }
+
+    static bool hasAvx2() {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+#endif
+
+    static void digestAccumulate(uint64_t* acc, const uint8_t* p, size_t n, const uint64_t* key) {
+#if defined(HASH_AVX2)
+        if (hasAvx2()) {
+            digestAccumulateAvx2(acc, p, n, key);
+            return;
+        }
+#endif
+#if defined(HASH_SSE2)
+        digestAccumulateSse2(acc, p, n, key);
+#else
+        digestAccumulateScalar(acc, p, n, key);
+#endif
+    }
+
+    uint64_t acc[DIGEST_LANES];
+    uint8_t buffer[DIGEST_STRIPE];   // 不足一个条带的数据
+    size_t buffered;
+    size_t stripe;                   // 当前块内已处理的条带数
+    uint64_t total;
+};
+
+#endif // HASH_H
@@ -0,0 +1,186 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "protocol.h"
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// ===== 断点续传接收日志 =====
+//
+// 接收端在输出文件旁边保存一个 <save_path>.rdtj 文件，记录已经写入磁盘的文件区间。
+// 重新连接时把区间列表发给发送端，发送端跳过这些区间只发送缺失部分。
+//
+// 日志文件格式（本机字节序，只在同一台机器上读写）：
+//   JournalHeader + range_count 个 [start, end) 区间（各4字节）
+// 校验和覆盖头部（checksum字段置0）和全部区间，损坏的日志会被当作不存在。
+
+const uint32_t JOURNAL_MAGIC = 0x4A544452;           // "RDTJ"
+const uint32_t JOURNAL_VERSION = 1;
+const uint32_t JOURNAL_FLUSH_BYTES = 1024 * 1024;    // 每写入多少新数据持久化一次日志
+const char JOURNAL_SUFFIX[] = ".rdtj";
+
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t file_size;
+    char filename[32];
+    uint32_t range_count;
+    uint32_t checksum;
+};
+
+class ReceiveJournal {
+public:
+    ReceiveJournal() : file_size(0), completed(0) {
+        memset(filename, 0, sizeof(filename));
+    }
+
+    void setPath(const std::string& save_path) {
+        path = save_path + JOURNAL_SUFFIX;
+    }
+
+    // 加载并校验日志，失败时保持为空
+    bool load() {
+        clear(0, "");
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (!fp) return false;
+
+        JournalHeader header;
+        bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+                  header.magic == JOURNAL_MAGIC && header.version == JOURNAL_VERSION;
+
+        // 区间数来自磁盘，分配之前先用文件剩余长度检查，损坏的计数不会导致巨大的分配
+        if (ok) {
+            long data_start = ftell(fp);
+            ok = data_start >= 0 && fseek(fp, 0, SEEK_END) == 0;
+            long file_len = ok ? ftell(fp) : -1;
+            ok = ok && file_len >= data_start && fseek(fp, data_start, SEEK_SET) == 0 &&
+                 header.range_count <= (unsigned long)(file_len - data_start) / sizeof(SackBlock);
+        }
+
+        std::vector<SackBlock> list;
+        if (ok) {
+            list.resize(header.range_count);
+            ok = header.range_count == 0 ||
+                 fread(list.data(), sizeof(SackBlock), list.size(), fp) == list.size();
+        }
+        fclose(fp);
+
+        if (ok) {
+            uint32_t received_checksum = header.checksum;
+            header.checksum = 0;
+            ok = checksumOf(header, list) == received_checksum;
+        }
+        if (!ok) return false;
+
+        clear(header.file_size, header.filename);
+        for (size_t i = 0; i < list.size(); i++) {
+            if (list[i].start < list[i].end && list[i].end <= file_size) {
+                addRange(list[i].start, list[i].end);
+            }
+        }
+        return true;
+    }
+
+    // 覆盖写入日志文件
+    bool save() const {
+        std::vector<SackBlock> list = getRanges();
+
+        JournalHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = JOURNAL_MAGIC;
+        header.version = JOURNAL_VERSION;
+        header.file_size = file_size;
+        memcpy(header.filename, filename, sizeof(header.filename));
+        header.range_count = (uint32_t)list.size();
+        header.checksum = checksumOf(header, list);
+
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (!fp) return false;
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                  (list.empty() || fwrite(list.data(), sizeof(SackBlock), list.size(), fp) == list.size());
+        ok = (fclose(fp) == 0) && ok;
+        return ok;
+    }
+
+    void remove() const {
+        ::remove(path.c_str());
+    }
+
+    // 清空区间并设置新的文件标识
+    void clear(uint32_t size, const char* name) {
+        ranges.clear();
+        completed = 0;
+        file_size = size;
+        memset(filename, 0, sizeof(filename));
+        // 超长的文件名截断，末尾保留memset写入的结束符
+        size_t len = strlen(name);
+        memcpy(filename, name, len < sizeof(filename) - 1 ? len : sizeof(filename) - 1);
+    }
+
+    // 日志是否属于同一个文件
+    bool matches(uint32_t size, const char* name) const {
+        return file_size == size && strncmp(filename, name, sizeof(filename)) == 0;
+    }
+
+    // 记录区间 [start, end) 已写入，与相邻或重叠的区间合并
+    void addRange(uint32_t start, uint32_t end) {
+        if (start >= end) return;
+
+        auto it = ranges.upper_bound(start);
+        if (it != ranges.begin()) {
+            auto prev = it;
+            --prev;
+            if (prev->second >= start) {
+                start = prev->first;
+                if (prev->second > end) end = prev->second;
+                completed -= prev->second - prev->first;
+                it = ranges.erase(prev);
+            }
+        }
+        while (it != ranges.end() && it->first <= end) {
+            if (it->second > end) end = it->second;
+            completed -= it->second - it->first;
+            it = ranges.erase(it);
+        }
+
+        ranges[start] = end;
+        completed += end - start;
+    }
+
+    std::vector<SackBlock> getRanges() const {
+        std::vector<SackBlock> list;
+        list.reserve(ranges.size());
+        for (auto& r : ranges) {
+            SackBlock block;
+            block.start = r.first;
+            block.end = r.second;
+            list.push_back(block);
+        }
+        return list;
+    }
+
+    uint32_t completedBytes() const { return completed; }
+    uint32_t getFileSize() const { return file_size; }
+    bool isComplete() const { return completed >= file_size; }
+
+private:
+    static uint32_t checksumOf(const JournalHeader& header, const std::vector<SackBlock>& list) {
+        uint32_t sum = calculateChecksum(&header, sizeof(header));
+        if (!list.empty()) {
+            sum += calculateChecksum(list.data(), list.size() * sizeof(SackBlock));
+        }
+        return sum & 0xFFFF;
+    }
+
+    std::string path;
+    uint32_t file_size;
+    char filename[32];
+    std::map<uint32_t, uint32_t> ranges;   // start -> end，互不重叠且不相邻
+    uint32_t completed;                    // 所有区间的总字节数
+};
+
+#endif // JOURNAL_H
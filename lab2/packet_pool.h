@@ -0,0 +1,224 @@
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include "protocol.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// ===== 数据包缓冲池 =====
+//
+// 发送窗口和接收缓冲区只保存指向池中缓冲的指针，数据包在池里原地构造、原地接收，
+// 不再随容器整体拷贝。缓冲按slab成批分配（64字节对齐），用完放回空闲链表，
+// 复用时只清零64字节的包头，数据部分不清零（线上只发送data_length字节，校验和也只覆盖这部分）。
+// 定义RDT_LARGE_PAGES时Windows上尝试用大页分配slab（需要"锁定内存页"权限，失败时退回普通页）。
+//
+// 一次传输的稳定阶段，缓冲池和下面的NodeCache都不再向堆申请内存。
+
+const size_t POOL_ALIGN = 64;                     // 缓冲对齐（缓存行）
+const size_t POOL_STRIDE = (sizeof(Packet) + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+const size_t POOL_SLAB_PACKETS = 32;              // 每个slab的缓冲数（约2MB，正好是一个大页）
+
+class PacketPool {
+public:
+    PacketPool() : free_head(nullptr), total(0), available(0) {}
+
+    ~PacketPool() {
+        for (size_t i = 0; i < slabs.size(); i++) {
+            freeSlab(slabs[i]);
+        }
+    }
+
+    // 取出一个缓冲：包头清零，数据部分保持原样
+    Packet* acquire() {
+        if (!free_head && !grow()) throw std::bad_alloc();
+        FreeNode* node = free_head;
+        free_head = node->next;
+        available--;
+        Packet* pkt = reinterpret_cast<Packet*>(node);
+        pkt->header = PacketHeader();
+        return pkt;
+    }
+
+    // 放回缓冲（nullptr忽略）
+    void release(Packet* pkt) {
+        if (!pkt) return;
+        FreeNode* node = reinterpret_cast<FreeNode*>(pkt);
+        node->next = free_head;
+        free_head = node;
+        available++;
+    }
+
+    size_t capacity() const { return total; }
+    size_t inUse() const { return total - available; }
+    size_t slabCount() const { return slabs.size(); }
+
+private:
+    // 空闲缓冲的前8字节用作链表指针
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    bool grow() {
+        size_t bytes = POOL_STRIDE * POOL_SLAB_PACKETS;
+        char* slab = static_cast<char*>(allocSlab(bytes));
+        if (!slab) return false;
+        slabs.push_back(slab);
+        for (size_t i = POOL_SLAB_PACKETS; i-- > 0;) {
+            FreeNode* node = reinterpret_cast<FreeNode*>(slab + i * POOL_STRIDE);
+            node->next = free_head;
+            free_head = node;
+        }
+        total += POOL_SLAB_PACKETS;
+        available += POOL_SLAB_PACKETS;
+        return true;
+    }
+
+#ifdef _WIN32
+    static void* allocSlab(size_t bytes) {
+        void* p = nullptr;
+#ifdef RDT_LARGE_PAGES
+        SIZE_T large = GetLargePageMinimum();
+        if (large > 0) {
+            SIZE_T rounded = (bytes + large - 1) / large * large;
+            p = VirtualAlloc(nullptr, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        }
+#endif
+        if (!p) p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        return p;  // VirtualAlloc按页对齐
+    }
+
+    static void freeSlab(void* slab) {
+        VirtualFree(slab, 0, MEM_RELEASE);
+    }
+#else
+    // 在分配块前部记录原始指针，手工对齐
+    static void* allocSlab(size_t bytes) {
+        char* raw = static_cast<char*>(malloc(bytes + POOL_ALIGN + sizeof(void*)));
+        if (!raw) return nullptr;
+        uintptr_t start = reinterpret_cast<uintptr_t>(raw + sizeof(void*));
+        char* aligned = reinterpret_cast<char*>((start + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN);
+        reinterpret_cast<void**>(aligned)[-1] = raw;
+        return aligned;
+    }
+
+    static void freeSlab(void* slab) {
+        free(reinterpret_cast<void**>(slab)[-1]);
+    }
+#endif
+
+    std::vector<void*> slabs;
+    FreeNode* free_head;
+    size_t total;        // 已分配的缓冲总数
+    size_t available;    // 空闲缓冲数
+
+    PacketPool(const PacketPool&);
+    PacketPool& operator=(const PacketPool&);
+};
+
+// ===== 容器节点回收 =====
+//
+// std::map/std::set 每插入一个元素都要申请一个节点。NodeCache按节点大小维护空闲链表，
+// 容器释放的节点留给下次插入使用；CachedAllocator把它接到标准容器上。
+class NodeCache {
+public:
+    NodeCache() : list_count(0) {}
+
+    ~NodeCache() {
+        for (int i = 0; i < list_count; i++) {
+            while (lists[i].head) {
+                FreeNode* next = lists[i].head->next;
+                ::operator delete(lists[i].head);
+                lists[i].head = next;
+            }
+        }
+    }
+
+    void* allocate(size_t size) {
+        FreeList* list = find(size);
+        if (list && list->head) {
+            FreeNode* node = list->head;
+            list->head = node->next;
+            return node;
+        }
+        return ::operator new(size < sizeof(FreeNode) ? sizeof(FreeNode) : size);
+    }
+
+    void deallocate(void* p, size_t size) {
+        FreeList* list = find(size);
+        if (!list) {
+            ::operator delete(p);
+            return;
+        }
+        FreeNode* node = static_cast<FreeNode*>(p);
+        node->next = list->head;
+        list->head = node;
+    }
+
+private:
+    struct FreeNode {
+        FreeNode* next;
+    };
+
+    struct FreeList {
+        size_t size;
+        FreeNode* head;
+    };
+
+    static const int MAX_SIZE_CLASSES = 8;
+
+    // 查找（必要时新建）该大小的空闲链表，种类太多时不缓存
+    FreeList* find(size_t size) {
+        for (int i = 0; i < list_count; i++) {
+            if (lists[i].size == size) return &lists[i];
+        }
+        if (list_count == MAX_SIZE_CLASSES) return nullptr;
+        lists[list_count].size = size;
+        lists[list_count].head = nullptr;
+        return &lists[list_count++];
+    }
+
+    FreeList lists[MAX_SIZE_CLASSES];
+    int list_count;
+
+    NodeCache(const NodeCache&);
+    NodeCache& operator=(const NodeCache&);
+};
+
+template <typename T>
+class CachedAllocator {
+public:
+    typedef T value_type;
+
+    explicit CachedAllocator(NodeCache* cache) : cache(cache) {}
+
+    template <typename U>
+    CachedAllocator(const CachedAllocator<U>& other) : cache(other.cache) {}
+
+    T* allocate(size_t n) {
+        if (n == 1) return static_cast<T*>(cache->allocate(sizeof(T)));
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (n == 1) {
+            cache->deallocate(p, sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    template <typename U>
+    bool operator==(const CachedAllocator<U>& other) const { return cache == other.cache; }
+    template <typename U>
+    bool operator!=(const CachedAllocator<U>& other) const { return cache != other.cache; }
+
+    NodeCache* cache;
+};
+
+#endif // PACKET_POOL_H
@@ -6,16 +6,62 @@
 #include <winsock2.h>
 
 // 协议常量定义
-const uint16_t PACKET_SIZE = 1024;           // 数据包大小（包括头部）
-const uint16_t DATA_SIZE = PACKET_SIZE - 64; // 实际数据大小 = 1024 - 64字节头
+const uint16_t HEADER_SIZE = 64;             // 包头大小
+const uint16_t PACKET_SIZE = 1024;           // 基础数据包大小（包括头部），任何路径都能通过
+const uint16_t DATA_SIZE = PACKET_SIZE - HEADER_SIZE;         // 基础数据大小 = 1024 - 64字节头，控制包也以此为上限
+const uint16_t MAX_PACKET_SIZE = 65000;      // 最大数据包大小（UDP数据报上限65507以内）
+const uint16_t MAX_DATA_SIZE = MAX_PACKET_SIZE - HEADER_SIZE; // 最大数据大小（大负载模式）
 const uint16_t WINDOW_SIZE = 50;             // 滑动窗口大小（固定）
 const uint32_t TIMEOUT_MS = 500;             // 超时时间（毫秒）
 const uint32_t CONNECT_TIMEOUT_MS = 5000;   // 连接超时时间
+const uint32_t EARLY_DATA_WINDOW = 10;      // 握手完成前允许发出的数据包数（0-RTT首个窗口）
+const int SOCKET_BUFFER_SIZE = 4 * 1024 * 1024;  // UDP收发缓冲区大小（大负载时窗口可达数MB）
+
+// 路径MTU探测（PLPMTUD）：从基础包大小开始，逐级用填充包探测更大的数据报，
+// 收到探测确认后才把该尺寸用于数据包；探测丢失不触发拥塞控制
+const uint16_t PMTU_PROBE_SIZES[] = {1472, 4096, 8972, 16384, 32768, MAX_PACKET_SIZE};
+const int PMTU_PROBE_LEVELS = sizeof(PMTU_PROBE_SIZES) / sizeof(PMTU_PROBE_SIZES[0]);
+const uint32_t PMTU_MAX_PROBES = 3;         // 每个尺寸最多探测次数，全部丢失视为超过路径MTU
+const uint32_t PMTU_BLACKHOLE_RETRIES = 3;  // 大包连续重传多少次后回退到基础包大小
+
+// RACK丢包检测与尾部丢包探测（TLP）
+// 比某个包晚发出的包已经送达，且超过 RTT + 乱序窗口 仍未确认，就判定该包丢失；
+// 乱序窗口默认为 min_rtt/4，收到D-SACK（说明误判过）时按倍数放大，不超过 srtt
+const uint32_t RACK_REO_WND_MAX_MULT = 16;  // 乱序窗口的最大倍数
+const uint32_t TLP_MIN_MS = 10;             // 尾部探测超时（2×srtt）的下限
+
+// 重传超时（RFC 6298）：RTO = srtt + 4×rttvar，有RTT样本之前用TIMEOUT_MS，超时后加倍
+const uint32_t RTO_MIN_MS = 200;            // RTO中偏差项（4×rttvar）的下限，也是RTO的下限
+// RTO上限取CONNECT_TIMEOUT_MS的1/3：一次重传丢失后，下一次退避的重传仍落在各处按
+// CONNECT_TIMEOUT_MS计的等待之内
+const uint32_t RTO_MAX_MS = CONNECT_TIMEOUT_MS / 3;
+const uint32_t RTO_MAX_RETRIES = 15;        // 连续超时（期间没有新的ACK）多少次后发送端放弃
+// 接收端在传输中等待下一个包的最长时间：发送端要连续超时RTO_MAX_RETRIES次才放弃，
+// 接收端至少等到那时，不会在发送端仍在重传时先退出。收齐数据后等待FIN也用这个时间：
+// 最后几个包的ACK丢失时发送端仍在重传，接收端要留下来补发ACK
+const uint32_t RECV_IDLE_TIMEOUT_MS = RTO_MAX_RETRIES * RTO_MAX_MS;
+
+// 多路流（OPT_STREAMS）：连接共用一个拥塞窗口，每条流另有接收端给出的流量控制上限，
+// 一条流因丢包停止交付时只有它自己被限制，其余的流继续发送和交付
+const uint16_t STREAM_MAX_ACTIVE = 64;       // 发送端同时进行（已开始、未确认完）的流数上限
+const uint32_t STREAM_WINDOW_SEGMENTS = 32;  // 每条流在已交付位置之后允许发送的数据（按最大分段计）
+const uint32_t STREAM_ID_MAX = 65535;        // 流号为16位，文件更多时退回单一字节流
 
 // SACK相关常量
 const uint8_t MAX_SACK_BLOCKS = 10;          // 最多SACK块数量
 const uint16_t SACK_BLOCK_SIZE = 8;          // 每个SACK块大小（4字节start + 4字节end）
 
+// 端到端文件摘要：两端在数据通路上边读写边计算，FIN/FIN-ACK交换后比对
+const uint16_t DIGEST_SIZE = 8;              // 摘要长度（网络字节序）
+const uint32_t DIGEST_READ_SIZE = 64 * 1024; // 补算未经数据通路的区间（续传已有部分）时的读取单位
+
+// 压缩相关常量
+const uint16_t COMPRESS_BLOCK_DEFAULT = 16 * 1024;  // 默认压缩块大小（原始字节数）
+const uint16_t COMPRESS_BLOCK_MIN = 1024;            // 最小压缩块大小
+const uint16_t COMPRESS_BLOCK_MAX = 60 * 1024;       // 最大压缩块大小（需能放入16位block_len）
+const uint32_t COMPRESS_GIVEUP_RUN = 4;              // 连续多少块不可压缩后暂停压缩尝试
+const uint32_t COMPRESS_SKIP_BLOCKS = 32;            // 暂停压缩尝试的块数
+
 // RENO拥塞控制状态
 enum CongestionState {
     SLOW_START,              // 慢启动
@@ -29,33 +75,100 @@ enum PacketType {
     PKT_ACK = 2,       // 确认包
     PKT_DATA = 3,      // 数据包
     PKT_FIN = 4,       // 结束连接
-    PKT_FIN_ACK = 5    // 结束确认
+    PKT_FIN_ACK = 5,   // 结束确认
+    PKT_PROBE = 6,     // 路径MTU探测包（data部分为填充）
+    PKT_PROBE_ACK = 7, // 探测确认（ack_num为收到的探测包字节数）
+    PKT_SIG_REQ = 8,   // 差量传输：请求签名分片（ack_num为分片序号）
+    PKT_SIG = 9        // 差量传输：签名分片（ack_num为分片序号，data为签名的一段）
+};
+
+// 连接选项（在SYN中提出，SYN-ACK中回显双方都支持的部分）
+enum ConnectionOption {
+    OPT_COMPRESS = 0x01,     // 分块压缩
+    OPT_RESUME = 0x02,       // 断点续传（SYN-ACK的data部分带回已完成区间）
+    OPT_FILE_INFO = 0x04,    // SYN携带文件名和大小，数据可在握手完成前发送（0-RTT）
+    OPT_TIMESTAMP = 0x08,    // DATA/ACK包携带时间戳选项，每个ACK都能得到RTT样本
+    OPT_MANIFEST = 0x10,     // 字节流以清单开头，包含多个文件（见batch.h）；对端不支持时发送端放弃
+    OPT_DELTA = 0x20,        // 差量传输（见delta.h）：接收端有旧文件时才在SYN-ACK中保留，data部分带回签名参数
+    OPT_DIGEST = 0x40,       // FIN/FIN-ACK的data部分带文件内容摘要（见hash.h的StreamDigest），两端比对
+    OPT_STREAMS = 0x80       // 多路流（仅多文件传输）：清单和每个文件各占一条流，各流独立按序交付
+};
+
+// 数据包标志位（前三个用于DATA包，FLAG_DSACK和FLAG_STREAM_CREDIT用于ACK包，FLAG_TIMESTAMP两者都用）
+enum PacketFlag {
+    FLAG_BLOCK_START = 0x01, // 压缩块的第一个包
+    FLAG_BLOCK_END = 0x02,   // 压缩块的最后一个包（block_len有效）
+    FLAG_COMPRESSED = 0x04,  // 该块的数据经过压缩（否则为原始数据）
+    FLAG_DSACK = 0x08,       // 第一个SACK块是重复收到的区间（D-SACK），不表示新确认的数据
+    FLAG_TIMESTAMP = 0x10,   // 包头的ts字段有效（此时没有文件名）
+    FLAG_STREAM_CREDIT = 0x20 // data部分在SACK块之后带各流的流量控制上限
+};
+
+// 时间戳选项（与文件名共用包头空间）
+// 发送端在每个DATA包（包括重传）里写入发送时刻，接收端在由它触发的ACK中原样带回，
+// 并附上从收到该包到发出ACK之间的停留时间；发送端用ACK的到达时刻减去两者即得RTT。
+// 时间为发送端各自时钟的微秒数（取低32位，只做差值）
+struct TimestampOption {
+    uint32_t ts_val;            // 本包的发送时刻
+    uint32_t ts_ecr;            // ACK中：带回的DATA包ts_val
+    uint32_t ack_delay;         // ACK中：接收端收到该DATA包到发出本ACK的时间（微秒）
 };
 
 // 数据包头结构体（64字节）
+// 序列号按线上字节计数；压缩或断点续传时与文件偏移不同，文件偏移见file_offset。
+// 多路流时序列号仍是整个连接的（确认、SACK、丢包检测和拥塞控制都按连接进行），
+// file_offset改为stream_id这条流内的线上字节偏移
 struct PacketHeader {
     uint32_t seq_num;           // 序列号 (4字节)
     uint32_t ack_num;           // 确认号 (4字节)
     uint16_t packet_type;       // 包类型 (2字节)
     uint16_t data_length;       // 数据长度 (2字节)
     uint32_t checksum;          // 校验和 (4字节)
-    uint32_t file_size;         // 文件大小（仅在首个SYN或DATA包中有效）(4字节)
-    char filename[32];          // 文件名（仅在首个SYN中有效）(32字节)
-    uint8_t reserved[6];        // 保留字段 (6字节)
+    uint32_t file_size;         // 文件大小（SYN和DATA包中有效）(4字节)
+    union {
+        char filename[32];      // 文件名（SYN和首个DATA包中有效）(32字节)
+        TimestampOption ts;     // 时间戳选项（FLAG_TIMESTAMP时有效）
+    };
+    uint8_t flags;              // 包标志位，见PacketFlag (1字节)
+    uint8_t options;            // 连接选项，仅在SYN/SYN-ACK中有效，见ConnectionOption (1字节)
+    uint16_t block_len;         // SYN/SYN-ACK中为压缩块大小；FLAG_BLOCK_END包中为该块原始长度 (2字节)
+    uint16_t max_seg_size;      // SYN/SYN-ACK中为本端能接收的最大数据负载 (2字节)
+    uint16_t stream_id;         // 多路流时DATA包所属的流，0为清单；原为对齐填充，旧版本总是0 (2字节)
+    uint32_t file_offset;       // DATA包负载在文件中的偏移（压缩块为块起始偏移）(4字节)
 
     PacketHeader() {
-        memset(this, 0, sizeof(PacketHeader));
+        memset(static_cast<void*>(this), 0, sizeof(PacketHeader));
     }
 };
 
 // 完整数据包结构
+// data按最大负载分配，但线上只发送 header + data_length 字节；
+// 拷贝时也只复制有效部分，避免小包搬运整块缓冲区
 struct Packet {
     PacketHeader header;
-    char data[DATA_SIZE];
+    char data[MAX_DATA_SIZE];
 
     Packet() {
         header = PacketHeader();
-        memset(data, 0, DATA_SIZE);
+    }
+
+    Packet(const Packet& other) {
+        *this = other;
+    }
+
+    Packet& operator=(const Packet& other) {
+        if (this != &other) {
+            header = other.header;
+            uint16_t len = other.header.data_length;
+            if (len > MAX_DATA_SIZE) len = MAX_DATA_SIZE;
+            memcpy(data, other.data, len);
+        }
+        return *this;
+    }
+
+    // 线上长度
+    int wireSize() const {
+        return (int)sizeof(PacketHeader) + header.data_length;
     }
 };
 
@@ -150,4 +263,101 @@ inline uint8_t decodeSackBlocks(const char* data, uint16_t data_len, SackBlock*
     return count;
 }
 
+// ===== 多路流的流量控制上限（ACK中SACK块之后，FLAG_STREAM_CREDIT） =====
+// 格式：[流数量(1字节)] [stream_id(2字节) limit(4字节)] ...，均为网络字节序
+// limit是发送端在该流上可以发送到的流偏移（线上字节），没有出现的流保持原来的上限
+
+struct StreamCredit {
+    uint16_t stream_id;
+    uint32_t limit;
+};
+
+const uint16_t STREAM_CREDIT_SIZE = 6;
+
+// 返回编码后的字节数，放不下的条目被丢弃（之后的ACK还会再带）
+inline uint16_t encodeStreamCredits(const StreamCredit* credits, size_t count, char* data, uint16_t max_len) {
+    if (max_len < 1) return 0;
+    size_t fit = (max_len - 1) / STREAM_CREDIT_SIZE;
+    if (count > fit) count = fit;
+    if (count > 255) count = 255;
+
+    uint8_t* ptr = (uint8_t*)data;
+    ptr[0] = (uint8_t)count;
+    uint16_t offset = 1;
+    for (size_t i = 0; i < count; i++) {
+        uint16_t id = htons(credits[i].stream_id);
+        uint32_t limit = htonl(credits[i].limit);
+        memcpy(&ptr[offset], &id, 2);
+        memcpy(&ptr[offset + 2], &limit, 4);
+        offset += STREAM_CREDIT_SIZE;
+    }
+    return offset;
+}
+
+// 返回解码的条目数（不超过max_count，截断的条目被忽略）
+inline uint8_t decodeStreamCredits(const char* data, uint16_t data_len, StreamCredit* credits, uint8_t max_count) {
+    if (data_len < 1) return 0;
+    const uint8_t* ptr = (const uint8_t*)data;
+    uint8_t count = ptr[0] < max_count ? ptr[0] : max_count;
+    uint16_t offset = 1;
+    uint8_t n = 0;
+    for (; n < count && offset + STREAM_CREDIT_SIZE <= data_len; n++) {
+        uint16_t id;
+        uint32_t limit;
+        memcpy(&id, &ptr[offset], 2);
+        memcpy(&limit, &ptr[offset + 2], 4);
+        credits[n].stream_id = ntohs(id);
+        credits[n].limit = ntohl(limit);
+        offset += STREAM_CREDIT_SIZE;
+    }
+    return n;
+}
+
+// ===== 区间列表编码/解码（断点续传） =====
+// 格式：[区间数量(2字节)] [start(4字节) end(4字节)] ...，均为网络字节序
+
+// 返回编码后的字节数，放不下的区间被丢弃（对端只是多发一些数据）
+inline uint16_t encodeRangeList(const SackBlock* ranges, size_t count, char* data, uint16_t max_len) {
+    if (max_len < 2) return 0;
+    size_t fit = (max_len - 2) / SACK_BLOCK_SIZE;
+    if (count > fit) count = fit;
+
+    uint8_t* ptr = (uint8_t*)data;
+    uint16_t n = htons((uint16_t)count);
+    memcpy(ptr, &n, 2);
+    uint16_t offset = 2;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t start = htonl(ranges[i].start);
+        uint32_t end = htonl(ranges[i].end);
+        memcpy(&ptr[offset], &start, 4);
+        memcpy(&ptr[offset + 4], &end, 4);
+        offset += SACK_BLOCK_SIZE;
+    }
+    return offset;
+}
+
+// 返回解码的区间数量
+inline uint16_t decodeRangeList(const char* data, uint16_t data_len, SackBlock* ranges, uint16_t max_ranges) {
+    if (data_len < 2) return 0;
+
+    const uint8_t* ptr = (const uint8_t*)data;
+    uint16_t count;
+    memcpy(&count, ptr, 2);
+    count = ntohs(count);
+    if (count > max_ranges) count = max_ranges;
+    if (count > (data_len - 2) / SACK_BLOCK_SIZE) count = (data_len - 2) / SACK_BLOCK_SIZE;
+
+    uint16_t offset = 2;
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t start, end;
+        memcpy(&start, &ptr[offset], 4);
+        memcpy(&end, &ptr[offset + 4], 4);
+        ranges[i].start = ntohl(start);
+        ranges[i].end = ntohl(end);
+        offset += SACK_BLOCK_SIZE;
+    }
+    return count;
+}
+
 #endif // PROTOCOL_H
@@ -1,15 +1,53 @@
 #include "rdt_socket.h"
+#include "compress.h"
+#include <ws2tcpip.h>
 #include <cstdio>
 #include <cstdarg>
 #include <fstream>
 #include <algorithm>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+// 时间戳选项中的时间：本端时钟的微秒数，取低32位（只用来求差）
+static uint32_t timestampUs(std::chrono::steady_clock::time_point t) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+}
+
+// FIN/FIN-ACK中的文件摘要：高32位在前，网络字节序
+static void putDigest(char* p, uint64_t digest) {
+    deltaPutU32(p, (uint32_t)(digest >> 32));
+    deltaPutU32(p + 4, (uint32_t)digest);
+}
+
+static uint64_t getDigest(const char* p) {
+    return ((uint64_t)deltaGetU32(p) << 32) | deltaGetU32(p + 4);
+}
 
 RdtSocket::RdtSocket()
-    : sock(INVALID_SOCKET), connected(false), local_seq(0), remote_seq(0),
-      recv_base(0), send_base(0), cong_state(SLOW_START), cwnd(1), ssthresh(10),
-      dup_ack_count(0), last_ack_seq(0), ca_acc(0) {
+    : sock(INVALID_SOCKET), connected(false), transport(&udp_transport), logging_enabled(true),
+      local_seq(0), remote_seq(0),
+      recv_base(0), send_base(0),
+      send_window(std::less<uint32_t>(), SendWindow::allocator_type(&node_cache)),
+      recv_buffer(std::less<uint32_t>(), RecvBuffer::allocator_type(&node_cache)),
+      sacked_packets(std::less<uint32_t>(), SeqSet::allocator_type(&node_cache)),
+      cong_state(SLOW_START), cwnd(1), ssthresh(10),
+      dup_ack_count(0), last_ack_seq(0), ca_acc(0),
+      srtt_us(0), rttvar_us(0), min_rtt_us(0), rto_ms(TIMEOUT_MS), consecutive_rtos(0), ts_echo_pending(false), ts_recent(0),
+      rack_end_seq(0), rack_rtt_us(0), rack_reo_mult(1),
+      in_recovery(false), recovery_high(0), tlp_pending(false),
+      compress_enabled(false), compress_block_size(COMPRESS_BLOCK_DEFAULT), resume_enabled(false),
+      delta_enabled(false), negotiated_options(0), handshake_pending(false), resume_ranges_ready(false),
+      peer_file_size(0), delta_basis_size(0), delta_block_size(0),
+      max_seg_size(MAX_DATA_SIZE), seg_size(DATA_SIZE), probe_level(0), probe_size(0), probe_count(0),
+      probe_done(false), traced_cwnd(0), traced_ssthresh(0), traced_seg_size(0), traced_state(0) {
+    memset(peer_filename, 0, sizeof(peer_filename));
     memset(&local_addr, 0, sizeof(local_addr));
     memset(&remote_addr, 0, sizeof(remote_addr));
+    memset(episodes, 0, sizeof(episodes));
+    memset(&stats, 0, sizeof(stats));
 }
 
 RdtSocket::~RdtSocket() {
@@ -18,7 +56,62 @@ RdtSocket::~RdtSocket() {
     }
 }
 
+void RdtSocket::setCompression(bool enable, uint16_t block_size) {
+    compress_enabled = enable;
+    compress_block_size = std::max(COMPRESS_BLOCK_MIN, std::min(COMPRESS_BLOCK_MAX, block_size));
+}
+
+void RdtSocket::setResume(bool enable) {
+    resume_enabled = enable;
+}
+
+void RdtSocket::setDelta(bool enable) {
+    delta_enabled = enable;
+}
+
+void RdtSocket::setMaxSegment(uint16_t max_payload) {
+    max_seg_size = std::max(DATA_SIZE, std::min(MAX_DATA_SIZE, max_payload));
+}
+
+void RdtSocket::setTransport(RdtTransport* custom_transport) {
+    transport = custom_transport ? custom_transport : &udp_transport;
+}
+
+bool RdtSocket::setTrace(const char* path) {
+    trace.reset(new EventTrace());
+    if (!trace->open(path)) {
+        log("[ERROR] Cannot create trace file: %s", path);
+        trace.reset();
+        return false;
+    }
+    return true;
+}
+
+void RdtSocket::traceMetrics() {
+    if (!trace) return;
+    uint8_t state = in_recovery ? TRACE_RECOVERY :
+                    cong_state == SLOW_START ? TRACE_SLOW_START : TRACE_CONGESTION_AVOIDANCE;
+    if (cwnd == traced_cwnd && ssthresh == traced_ssthresh && seg_size == traced_seg_size && state == traced_state) {
+        return;
+    }
+    traced_cwnd = cwnd;
+    traced_ssthresh = ssthresh;
+    traced_seg_size = seg_size;
+    traced_state = state;
+    trace->record(transport->now(), TRACE_METRICS, state, seg_size, cwnd, ssthresh);
+}
+
+uint8_t RdtSocket::localOptions() const {
+    uint8_t options = 0;
+    if (compress_enabled) options |= OPT_COMPRESS;
+    if (resume_enabled) options |= OPT_RESUME;
+    if (delta_enabled) options |= OPT_DELTA;
+    options |= OPT_TIMESTAMP | OPT_DIGEST;
+    return options;
+}
+
 void RdtSocket::log(const char* format, ...) {
+    if (!logging_enabled) return;
     va_list args;
     va_start(args, format);
     char buffer[2048];
@@ -43,6 +136,18 @@ void RdtSocket::logPacketHeader(const char* label, const PacketHeader& header) {
     log("[%s]   %s", label, hex_buffer);
 }
 
+void RdtSocket::setSocketOptions() {
+    // 大负载模式下一个窗口可达数MB，默认缓冲区会造成本地丢包
+    int buf_size = SOCKET_BUFFER_SIZE;
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)&buf_size, sizeof(buf_size));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)&buf_size, sizeof(buf_size));
+#ifdef IP_DONTFRAGMENT
+    // 禁止IP分片，超过路径MTU的探测包直接丢弃，而不是被分片后"探测成功"
+    DWORD dont_fragment = 1;
+    setsockopt(sock, IPPROTO_IP, IP_DONTFRAGMENT, (char*)&dont_fragment, sizeof(dont_fragment));
+#endif
+}
+
 bool RdtSocket::bind(const char* ip, uint16_t port) {
     sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (sock == INVALID_SOCKET) {
@@ -61,62 +166,352 @@ bool RdtSocket::bind(const char* ip, uint16_t port) {
         return false;
     }
 
+    udp_transport.setSocket(sock);
+    setSocketOptions();
     log("[BIND] Local address bound: %s:%d", ip, port);
     return true;
 }
 
 bool RdtSocket::connect(const char* ip, uint16_t port) {
-    log("[CONN] Starting connection to %s:%d", ip, port);
-
     remote_addr.sin_family = AF_INET;
     remote_addr.sin_port = htons(port);
     remote_addr.sin_addr.s_addr = inet_addr(ip);
 
-    Packet syn_pkt;
-    syn_pkt.header.packet_type = PKT_SYN;
-    syn_pkt.header.seq_num = local_seq;
-    syn_pkt.header.data_length = 0;
-    syn_pkt.header.checksum = 0;  // 计算前清零
-    syn_pkt.header.checksum = calculateChecksum(&syn_pkt.header,
-                                               sizeof(syn_pkt.header) - sizeof(syn_pkt.header.checksum));
-
-    log("[CONN] Sending SYN (seq=%u)", local_seq);
-    if (!sendPacket(syn_pkt)) {
-        log("[ERROR] Failed to send SYN");
+    // 0-RTT：SYN推迟到sendFile时发送，携带文件元数据，并紧跟首个数据窗口
+    log("[CONN] Peer set to %s:%d, SYN will carry file metadata (0-RTT)", ip, port);
+    return true;
+}
+
+bool RdtSocket::sendSyn(uint32_t file_size, const char* filename, uint8_t extra_options) {
+    syn_packet = Packet();
+    syn_packet.header.packet_type = PKT_SYN;
+    syn_packet.header.seq_num = local_seq;
+    syn_packet.header.data_length = 0;
+    syn_packet.header.options = localOptions() | OPT_FILE_INFO | extra_options;
+    syn_packet.header.file_size = file_size;
+    strncpy_s(syn_packet.header.filename, sizeof(syn_packet.header.filename), filename, _TRUNCATE);
+    if (compress_enabled) {
+        syn_packet.header.block_len = compress_block_size;
+    }
+    syn_packet.header.max_seg_size = max_seg_size;
+    syn_packet.header.checksum = 0;  // 计算前清零
+    syn_packet.header.checksum = calculateChecksum(&syn_packet.header,
+                                                  sizeof(syn_packet.header));
+
+    log("[CONN] Sending SYN (seq=%u, options=0x%02x, mss=%u, file=%s, size=%u)",
+        local_seq, syn_packet.header.options, max_seg_size, syn_packet.header.filename, file_size);
+    handshake_pending = true;
+    syn_first_time = syn_last_time = transport->now();
+    return sendPacket(syn_packet);
+}
+
+bool RdtSocket::checkHandshake() {
+    if (!handshake_pending) {
+        // 对端不认识清单，会把整个字节流存成一个文件，不能继续
+        if (connected && (syn_packet.header.options & OPT_MANIFEST) && !(negotiated_options & OPT_MANIFEST)) {
+            log("[ERROR] Receiver does not support multi-file transfer");
+            return false;
+        }
+        return true;
+    }
+
+    auto now = transport->now();
+    if (std::chrono::duration_cast<std::chrono::milliseconds>(now - syn_first_time).count() > CONNECT_TIMEOUT_MS) {
+        log("[ERROR] Connection timeout (no SYN-ACK)");
         return false;
     }
+    if (std::chrono::duration_cast<std::chrono::milliseconds>(now - syn_last_time).count() > TIMEOUT_MS) {
+        log("[CONN] SYN-ACK timeout, retransmitting SYN");
+        sendPacket(syn_packet);
+        syn_last_time = now;
+    }
+    return true;
+}
 
-    auto start = std::chrono::steady_clock::now();
-    Packet ack_pkt;
-    while (true) {
-        if (recvPacket(ack_pkt, 100)) {
-            if (ack_pkt.header.packet_type == PKT_SYN_ACK) {
-                remote_seq = ack_pkt.header.seq_num;
-                recv_base = remote_seq;
-                log("[CONN] Received SYN-ACK (seq=%u, ack=%u)", remote_seq, ack_pkt.header.ack_num);
-
-                Packet final_ack;
-                final_ack.header.packet_type = PKT_ACK;
-                final_ack.header.seq_num = local_seq;
-                final_ack.header.ack_num = remote_seq;
-                final_ack.header.checksum = 0;  // 计算前清零
-                final_ack.header.checksum = calculateChecksum(&final_ack.header,
-                                                             sizeof(final_ack.header) - sizeof(final_ack.header.checksum));
-
-                log("[CONN] Sending ACK (seq=%u, ack=%u)", final_ack.header.seq_num, final_ack.header.ack_num);
-                if (sendPacket(final_ack)) {
-                    connected = true;
-                    log("[CONN] Connection established!");
-                    return true;
+bool RdtSocket::checkProgress() {
+    if (consecutive_rtos >= RTO_MAX_RETRIES) {
+        log("[ERROR] No ACK progress after %u consecutive timeouts, giving up", consecutive_rtos);
+        return false;
+    }
+    return true;
+}
+
+bool RdtSocket::waitHandshake() {
+    Packet& pkt = *packet_pool.acquire();
+    bool ok = true;
+    while (ok && handshake_pending) {
+        if (recvPacket(pkt, 50)) {
+            handleAckPacket(pkt);
+        }
+        ok = checkHandshake();
+    }
+    packet_pool.release(&pkt);
+    return ok;
+}
+
+bool RdtSocket::sendProbe() {
+    Packet probe;
+    probe.header.packet_type = PKT_PROBE;
+    probe.header.seq_num = local_seq;
+    probe.header.ack_num = probe_size;
+    probe.header.data_length = probe_size - HEADER_SIZE;
+    memset(probe.data, 0, probe.header.data_length);  // 填充部分
+    probe.header.checksum = 0;  // 计算前清零
+    probe.header.checksum = (calculateChecksum(&probe.header, sizeof(probe.header)) +
+                             calculateChecksum(probe.data, probe.header.data_length)) & 0xFFFF;
+
+    probe_count++;
+    probe_time = transport->now();
+    log("[PMTU] Probing %u-byte datagrams (attempt %u)", probe_size, probe_count);
+    return sendPacket(probe);
+}
+
+void RdtSocket::pmtuProbe() {
+    // 握手完成后才探测，探测包不占发送窗口，丢失也不影响拥塞窗口
+    if (!connected || probe_done) return;
+
+    if (probe_size == 0) {
+        // 选择下一个比当前分段大的探测尺寸，不超过协商的上限
+        while (probe_level < PMTU_PROBE_LEVELS &&
+               PMTU_PROBE_SIZES[probe_level] - HEADER_SIZE <= seg_size) {
+            probe_level++;
+        }
+        uint16_t size = probe_level < PMTU_PROBE_LEVELS ? PMTU_PROBE_SIZES[probe_level] : 0;
+        size = std::min(size, (uint16_t)(max_seg_size + HEADER_SIZE));
+        if (size <= seg_size + HEADER_SIZE) {
+            probe_done = true;
+            log("[PMTU] Probing finished, segment size %u bytes", seg_size);
+            return;
+        }
+        probe_size = size;
+        probe_count = 0;
+    } else if (std::chrono::duration_cast<std::chrono::milliseconds>(
+                   transport->now() - probe_time).count() <= TIMEOUT_MS) {
+        return;  // 等待探测确认
+    } else if (probe_count >= PMTU_MAX_PROBES) {
+        // 该尺寸的探测全部丢失，认为超过了路径MTU，停在当前分段大小
+        log("[PMTU] %u-byte probes lost, keeping segment size %u bytes", probe_size, seg_size);
+        probe_size = 0;
+        probe_done = true;
+        return;
+    }
+
+    if (!sendProbe()) {
+        // 本地直接拒绝（如超过出口MTU且禁止分片）
+        log("[PMTU] %u-byte datagram rejected locally, keeping segment size %u bytes", probe_size, seg_size);
+        probe_size = 0;
+        probe_done = true;
+    }
+}
+
+void RdtSocket::fallbackToBaseSegment() {
+    log("[PMTU] Large packets repeatedly lost (black hole?), falling back to %u-byte segments", DATA_SIZE);
+    seg_size = DATA_SIZE;
+    probe_size = 0;
+    probe_done = true;
+
+    // 大包确实丢了，本轮重传不能撤销；切分后的小包与已交付的大包重叠，接收端会报D-SACK
+    episodes[0].armed = false;
+    episodes[1].armed = false;
+
+    // 把在途的大包按DATA_SIZE重新切分并立即发送（序号按字节计，切分后仍连续）
+    std::vector<uint32_t> oversized;
+    for (auto& entry : send_window) {
+        if (entry.second.packet->header.data_length > DATA_SIZE &&
+            sacked_packets.find(entry.first) == sacked_packets.end()) {
+            oversized.push_back(entry.first);
+        }
+    }
+
+    auto now = transport->now();
+    for (size_t i = 0; i < oversized.size(); i++) {
+        uint32_t seq = oversized[i];
+        Packet& big = *send_window[seq].packet;
+        send_window.erase(seq);
+
+        uint16_t total = big.header.data_length;
+        for (uint16_t off = 0; off < total; off += DATA_SIZE) {
+            uint16_t len = std::min((uint16_t)DATA_SIZE, (uint16_t)(total - off));
+            SendWindowEntry& entry = send_window[seq + off];
+            entry.packet = packet_pool.acquire();
+            Packet& piece = *entry.packet;
+            piece.header = big.header;
+            piece.header.seq_num = seq + off;
+            piece.header.data_length = len;
+
+            // 块标志只留在首尾分片；压缩块整体解压，偏移保持块起始，原始数据按分片偏移写入。
+            // 多路流的偏移是流内线上字节，压缩块的分片也按分片偏移
+            piece.header.flags = big.header.flags & FLAG_COMPRESSED;
+            if (off == 0) piece.header.flags |= big.header.flags & FLAG_BLOCK_START;
+            if (off + len == total) {
+                piece.header.flags |= big.header.flags & FLAG_BLOCK_END;
+            } else {
+                piece.header.block_len = 0;
+            }
+            if (!(big.header.flags & FLAG_COMPRESSED) || (negotiated_options & OPT_STREAMS)) {
+                piece.header.file_offset = big.header.file_offset + off;
+            }
+            memcpy(piece.data, big.data + off, len);
+
+            piece.header.checksum = 0;
+            piece.header.checksum = (calculateChecksum(&piece.header, sizeof(piece.header)) +
+                                     calculateChecksum(piece.data, len)) & 0xFFFF;
+            stampTimestamp(piece);
+            entry.send_time = now;
+            entry.retransmit_count = 0;
+            sendPacket(piece);
+        }
+        packet_pool.release(&big);
+        log("[PMTU] Re-split packet (seq=%u, len=%u) into %u-byte segments", seq, total, DATA_SIZE);
+    }
+    traceMetrics();
+}
+
+void RdtSocket::handleAckPacket(Packet& pkt) {
+    if (pkt.header.packet_type == PKT_PROBE_ACK) {
+        if (probe_size == 0 || pkt.header.ack_num != probe_size) return;  // 过期的探测确认
+        seg_size = probe_size - HEADER_SIZE;
+        log("[PMTU] %u-byte datagrams confirmed, segment size now %u bytes", probe_size, seg_size);
+        probe_size = 0;
+        probe_level++;
+        traceMetrics();
+        return;
+    }
+
+    if (pkt.header.packet_type == PKT_SYN_ACK) {
+        if (!handshake_pending) return;  // 重复的SYN-ACK
+
+        uint32_t received_checksum = pkt.header.checksum;
+        pkt.header.checksum = 0;
+        uint32_t expected = (calculateChecksum(&pkt.header, sizeof(pkt.header)) +
+                             calculateChecksum(pkt.data, pkt.header.data_length)) & 0xFFFF;
+        if (expected != received_checksum || pkt.header.data_length > DATA_SIZE) {
+            log("[CONN] Corrupted SYN-ACK ignored");
+            return;
+        }
+
+        remote_seq = pkt.header.seq_num;
+        recv_base = remote_seq;
+        log("[CONN] Received SYN-ACK (seq=%u, ack=%u)", remote_seq, pkt.header.ack_num);
+
+        // SYN没有重传过时，握手的往返就是第一个RTT样本，首个窗口的RTO不必用默认值
+        if (syn_last_time == syn_first_time) {
+            onRttSample((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                last_rx_time - syn_first_time).count());
+        }
+
+        // 只启用双方都同意的选项
+        negotiated_options = pkt.header.options & syn_packet.header.options;
+        if (negotiated_options & OPT_COMPRESS) {
+            compress_block_size = std::max(COMPRESS_BLOCK_MIN,
+                                           std::min(compress_block_size, pkt.header.block_len));
+            log("[CONN] Compression negotiated (block=%u bytes)", compress_block_size);
+        }
+
+        // 分段上限取双方的较小值；不认识该字段的对端（为0）只用基础大小
+        max_seg_size = pkt.header.max_seg_size ?
+            std::max(DATA_SIZE, std::min(max_seg_size, pkt.header.max_seg_size)) : DATA_SIZE;
+        log("[CONN] Max segment negotiated: %u bytes", max_seg_size);
+        if (negotiated_options & OPT_TIMESTAMP) {
+            log("[CONN] Timestamps negotiated");
+        }
+
+        // 差量传输：接收端有基准文件，data部分为其大小和签名块大小
+        if (negotiated_options & OPT_DELTA) {
+            if (pkt.header.data_length < 8) {
+                negotiated_options &= ~OPT_DELTA;
+            } else {
+                delta_basis_size = deltaGetU32(pkt.data);
+                delta_block_size = deltaGetU32(pkt.data + 4);
+                if (delta_block_size < DELTA_BLOCK_MIN || delta_block_size > DELTA_BLOCK_MAX) {
+                    negotiated_options &= ~OPT_DELTA;
+                } else {
+                    log("[DELTA] Receiver has a %u-byte basis file (block=%u bytes)",
+                        delta_basis_size, delta_block_size);
                 }
             }
         }
 
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - start).count();
-        if (elapsed > CONNECT_TIMEOUT_MS) {
-            log("[ERROR] Connection timeout");
-            return false;
+        // 接收端在SYN-ACK中带回已完成的区间
+        if ((negotiated_options & OPT_RESUME) && pkt.header.data_length > 0) {
+            SackBlock ranges[DATA_SIZE / SACK_BLOCK_SIZE];
+            uint16_t count = decodeRangeList(pkt.data, pkt.header.data_length,
+                                             ranges, DATA_SIZE / SACK_BLOCK_SIZE);
+            resume_ranges.clear();
+            for (uint16_t i = 0; i < count; i++) {
+                if (ranges[i].start < ranges[i].end && ranges[i].end <= syn_packet.header.file_size) {
+                    resume_ranges.push_back(ranges[i]);
+                }
+            }
+            std::sort(resume_ranges.begin(), resume_ranges.end(),
+                      [](const SackBlock& a, const SackBlock& b) { return a.start < b.start; });
+            resume_ranges_ready = true;
+            log("[RESUME] Receiver already has %zu ranges", resume_ranges.size());
+        }
+
+        handshake_pending = false;
+        connected = true;
+        log("[CONN] Connection established!");
+        traceEvent(TRACE_CONNECTION, TRACE_CONN_ESTABLISHED, 0, local_seq, remote_seq);
+        traceMetrics();
+        return;
+    }
+
+    if (pkt.header.packet_type != PKT_ACK) return;
+
+    last_activity_time = transport->now();
+
+    // 时间戳选项：ACK到达时间 - 带回的发送时间 - 接收端的停留时间 = RTT样本，
+    // 带回的是触发该ACK的那个包的发送时间，重传包的ACK同样可用
+    if ((negotiated_options & OPT_TIMESTAMP) && (pkt.header.flags & FLAG_TIMESTAMP)) {
+        uint32_t elapsed = timestampUs(last_rx_time) - pkt.header.ts.ts_ecr;
+        if (pkt.header.ts.ack_delay < elapsed && elapsed - pkt.header.ts.ack_delay < CONNECT_TIMEOUT_MS * 1000) {
+            onRttSample(elapsed - pkt.header.ts.ack_delay);
+        }
+    }
+
+    // 只报告重复包的ACK不说明有丢包，不计入重复ACK
+    bool dsack = (pkt.header.flags & FLAG_DSACK) != 0;
+    if (!dsack || pkt.header.ack_num != last_ack_seq) {
+        processAck(pkt.header.ack_num);
+    }
+
+    if (pkt.header.data_length > 0) {
+        SackBlock sack_blocks[MAX_SACK_BLOCKS];
+        uint8_t sack_count = decodeSackBlocks(pkt.data, pkt.header.data_length,
+                                             sack_blocks, MAX_SACK_BLOCKS);
+        if (sack_count > 0) {
+            log("[SACK] Received %u SACK blocks:", sack_count);
+            for (uint8_t i = 0; i < sack_count; i++) {
+                log("[SACK]   Block[%u]: %u-%u", i, sack_blocks[i].start, sack_blocks[i].end);
+                if (i == 0 && dsack) {
+                    onDsack(sack_blocks[0]);
+                    continue;
+                }
+                // 标记发送窗口中起始序号落在SACK块内的包
+                for (auto it = send_window.lower_bound(sack_blocks[i].start);
+                     it != send_window.end() && it->first < sack_blocks[i].end; ++it) {
+                    if (sacked_packets.insert(it->first).second) {
+                        rackOnDelivered(it->second, it->first);
+                    }
+                }
+            }
+        }
+    }
+
+    // 多路流：SACK块之后是各流的流量控制上限，只会增大
+    if ((pkt.header.flags & FLAG_STREAM_CREDIT) && pkt.header.data_length > 0) {
+        uint16_t sack_len = 1 + (uint8_t)pkt.data[0] * SACK_BLOCK_SIZE;
+        if (sack_len < pkt.header.data_length) {
+            StreamCredit credits[DATA_SIZE / STREAM_CREDIT_SIZE];
+            uint8_t count = decodeStreamCredits(pkt.data + sack_len, pkt.header.data_length - sack_len,
+                                                credits, DATA_SIZE / STREAM_CREDIT_SIZE);
+            for (uint8_t i = 0; i < count; i++) {
+                if (credits[i].stream_id < stream_limits.size()) {
+                    uint32_t& limit = stream_limits[credits[i].stream_id];
+                    limit = std::max(limit, credits[i].limit);
+                }
+            }
         }
     }
 }
@@ -139,90 +534,171 @@ bool RdtSocket::listen(uint16_t port) {
         return false;
     }
 
+    udp_transport.setSocket(sock);
+    setSocketOptions();
     log("[LISTEN] Listening on port: %d", port);
     return true;
 }
 
 RdtSocket* RdtSocket::accept() {
     Packet syn_pkt;
-    int addr_len = sizeof(remote_addr);
-
     log("[ACCEPT] Waiting for connection...");
 
-    if (recvfrom(sock, (char*)&syn_pkt, sizeof(syn_pkt), 0,
-                 (sockaddr*)&remote_addr, &addr_len) == SOCKET_ERROR) {
-        log("[ERROR] Failed to receive SYN");
-        return nullptr;
-    }
+    // SYN丢失时发送端的首个数据窗口可能先到达，暂存起来等待重传的SYN
+    std::vector<std::pair<sockaddr_in, Packet> > early;
+    while (true) {
+        Packet pkt;
+        sockaddr_in from;
+        int n = transport->recvFrom(&pkt, sizeof(pkt), from, 0);
+        if (n < 0) {
+            log("[ERROR] Failed to receive SYN");
+            return nullptr;
+        }
+        if (n < (int)sizeof(PacketHeader) || pkt.header.data_length > n - (int)sizeof(PacketHeader)) {
+            continue;  // 截断或格式错误的数据报
+        }
 
-    if (syn_pkt.header.packet_type != PKT_SYN) {
-        log("[ERROR] Expected SYN, got type: %d", syn_pkt.header.packet_type);
-        return nullptr;
+        if (pkt.header.packet_type == PKT_SYN) {
+            uint32_t received_checksum = pkt.header.checksum;
+            pkt.header.checksum = 0;
+            if (calculateChecksum(&pkt.header, sizeof(pkt.header)) != received_checksum) {
+                log("[ACCEPT] Corrupted SYN ignored");
+                continue;
+            }
+            syn_pkt = pkt;
+            remote_addr = from;
+            break;
+        }
+        if (pkt.header.packet_type == PKT_DATA && early.size() < WINDOW_SIZE) {
+            early.push_back(std::make_pair(from, pkt));
+            continue;
+        }
+        log("[ACCEPT] Ignoring packet before SYN (type=%d)", pkt.header.packet_type);
     }
 
-    log("[ACCEPT] Received connection from %s:%d (seq=%u)",
-        inet_ntoa(remote_addr.sin_addr), ntohs(remote_addr.sin_port), syn_pkt.header.seq_num);
+    log("[ACCEPT] Received connection from %s:%d (seq=%u, options=0x%02x)",
+        inet_ntoa(remote_addr.sin_addr), ntohs(remote_addr.sin_port),
+        syn_pkt.header.seq_num, syn_pkt.header.options);
 
     RdtSocket* new_sock = new RdtSocket();
     new_sock->sock = this->sock;
+    new_sock->udp_transport.setSocket(this->sock);
+    new_sock->setTransport(transport == &udp_transport ? nullptr : transport);
+    new_sock->logging_enabled = logging_enabled;
+    new_sock->trace = std::move(trace);   // 监听套接字只等SYN，事件都记在连接上
+    new_sock->traceEvent(TRACE_PACKET_RECEIVED, PKT_SYN, syn_pkt.header.data_length, syn_pkt.header.seq_num, 0);
     new_sock->remote_addr = this->remote_addr;
     new_sock->local_addr = this->local_addr;
     new_sock->remote_seq = syn_pkt.header.seq_num;
     new_sock->recv_base = syn_pkt.header.seq_num;
     new_sock->local_seq = 100;
+    new_sock->compress_enabled = compress_enabled;
+    new_sock->resume_enabled = resume_enabled;
+    new_sock->delta_enabled = delta_enabled;
+    new_sock->max_seg_size = syn_pkt.header.max_seg_size ?
+        std::max(DATA_SIZE, std::min(max_seg_size, syn_pkt.header.max_seg_size)) : DATA_SIZE;
+
+    // 选项协商：只接受本端也支持的选项，块大小限制在合法范围内
+    new_sock->negotiated_options = syn_pkt.header.options &
+                                   (localOptions() | OPT_FILE_INFO | OPT_MANIFEST | OPT_STREAMS);
+    if (new_sock->negotiated_options & OPT_MANIFEST) {
+        // 多文件传输不做断点续传：续传时清单区间已完成，接收端却没有保存清单；也不做差量传输
+        new_sock->negotiated_options &= ~(OPT_RESUME | OPT_DELTA);
+    } else {
+        new_sock->negotiated_options &= ~OPT_STREAMS;   // 多路流只用于多文件传输
+    }
+    if (new_sock->negotiated_options & OPT_COMPRESS) {
+        new_sock->compress_block_size = std::max(COMPRESS_BLOCK_MIN,
+                                                 std::min(COMPRESS_BLOCK_MAX, syn_pkt.header.block_len));
+    }
+    if (new_sock->negotiated_options & OPT_FILE_INFO) {
+        new_sock->peer_file_size = syn_pkt.header.file_size;
+        strncpy_s(new_sock->peer_filename, sizeof(new_sock->peer_filename),
+                 syn_pkt.header.filename, _TRUNCATE);
+    }
 
+    for (size_t i = 0; i < early.size(); i++) {
+        if (early[i].first.sin_addr.s_addr == remote_addr.sin_addr.s_addr &&
+            early[i].first.sin_port == remote_addr.sin_port) {
+            new_sock->early_packets.push_back(early[i].second);
+        }
+    }
+    if (!new_sock->early_packets.empty()) {
+        log("[ACCEPT] %zu data packets arrived before SYN", new_sock->early_packets.size());
+    }
+
+    // SYN-ACK由recvFile发送：那时才知道保存路径，可以带回断点续传区间
+    new_sock->handshake_pending = true;
+    return new_sock;
+}
+
+bool RdtSocket::sendSynAck(const ReceiveJournal* journal) {
     Packet syn_ack;
     syn_ack.header.packet_type = PKT_SYN_ACK;
-    syn_ack.header.seq_num = new_sock->local_seq;
-    syn_ack.header.ack_num = new_sock->remote_seq;
-    syn_ack.header.checksum = 0;  // 计算前清零
-    syn_ack.header.checksum = calculateChecksum(&syn_ack.header,
-                                               sizeof(syn_ack.header) - sizeof(syn_ack.header.checksum));
-
-    log("[ACCEPT] Sending SYN-ACK (seq=%u, ack=%u)", syn_ack.header.seq_num, syn_ack.header.ack_num);
-    if (!new_sock->sendPacket(syn_ack)) {
-        log("[ERROR] Failed to send SYN-ACK");
-        delete new_sock;
-        return nullptr;
+    syn_ack.header.seq_num = local_seq;
+    syn_ack.header.ack_num = remote_seq;
+    syn_ack.header.options = negotiated_options;
+    if (negotiated_options & OPT_COMPRESS) {
+        syn_ack.header.block_len = compress_block_size;
     }
-
-    Packet ack_pkt;
-    if (!new_sock->recvPacket(ack_pkt, CONNECT_TIMEOUT_MS)) {
-        log("[ERROR] ACK timeout");
-        delete new_sock;
-        return nullptr;
+    syn_ack.header.max_seg_size = max_seg_size;
+
+    // 断点续传：带回已完成的文件区间
+    size_t range_count = 0;
+    if (journal && (negotiated_options & OPT_RESUME)) {
+        std::vector<SackBlock> ranges = journal->getRanges();
+        range_count = ranges.size();
+        syn_ack.header.file_size = journal->getFileSize();
+        syn_ack.header.data_length = encodeRangeList(ranges.data(), ranges.size(), syn_ack.data, DATA_SIZE);
     }
 
-    if (ack_pkt.header.packet_type == PKT_ACK) {
-        new_sock->connected = true;
-        log("[ACCEPT] Connection established!");
-        return new_sock;
+    // 差量传输：带回基准文件大小和签名块大小，签名本身由发送端随后分片拉取
+    if (negotiated_options & OPT_DELTA) {
+        deltaPutU32(syn_ack.data, delta_basis_size);
+        deltaPutU32(syn_ack.data + 4, delta_block_size);
+        syn_ack.header.data_length = 8;
     }
 
-    delete new_sock;
-    return nullptr;
+    syn_ack.header.checksum = 0;  // 计算前清零
+    syn_ack.header.checksum = (calculateChecksum(&syn_ack.header, sizeof(syn_ack.header)) +
+                               calculateChecksum(syn_ack.data, syn_ack.header.data_length)) & 0xFFFF;
+
+    log("[ACCEPT] Sending SYN-ACK (seq=%u, ack=%u, options=0x%02x, mss=%u, resume_ranges=%zu)",
+        syn_ack.header.seq_num, syn_ack.header.ack_num, syn_ack.header.options, max_seg_size, range_count);
+    return sendPacket(syn_ack);
 }
 
 bool RdtSocket::sendPacket(const Packet& pkt) {
-    if (sendto(sock, (const char*)&pkt, sizeof(Packet), 0,
-               (sockaddr*)&remote_addr, sizeof(remote_addr)) == SOCKET_ERROR) {
-        return false;
-    }
-    return true;
+    traceEvent(TRACE_PACKET_SENT, (uint8_t)pkt.header.packet_type, pkt.header.data_length,
+               pkt.header.seq_num, pkt.header.ack_num);
+    // 只发送头部和有效数据
+    return transport->sendTo(&pkt, pkt.wireSize(), remote_addr);
 }
 
 bool RdtSocket::recvPacket(Packet& pkt, uint32_t timeout_ms) {
-    int timeout = timeout_ms;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
-
-    int addr_len = sizeof(remote_addr);
-    int n = recvfrom(sock, (char*)&pkt, sizeof(Packet), 0,
-                     (sockaddr*)&remote_addr, &addr_len);
-
-    return (n != SOCKET_ERROR);
+    while (true) {
+        int n = transport->recvFrom(&pkt, sizeof(Packet), remote_addr, timeout_ms, &last_rx_time);
+        if (n < 0) return false;
+
+        // 数据报长度必须与头部声明的数据长度一致
+        if (n >= (int)sizeof(PacketHeader) &&
+            pkt.header.data_length <= n - (int)sizeof(PacketHeader)) {
+            // 用到达时间（有内核时间戳时更准）而不是处理时间
+            if (trace) {
+                trace->record(last_rx_time, TRACE_PACKET_RECEIVED, (uint8_t)pkt.header.packet_type,
+                              pkt.header.data_length, pkt.header.seq_num, pkt.header.ack_num);
+            }
+            return true;
+        }
+        log("[RECV] Malformed datagram ignored (%d bytes)", n);
+    }
 }
 
 uint32_t RdtSocket::getEffectiveWindow() {
+    // 握手完成前允许先发出首个数据窗口（0-RTT）
+    if (handshake_pending) {
+        return std::min((uint32_t)WINDOW_SIZE, std::max(cwnd, EARLY_DATA_WINDOW));
+    }
     return std::min((uint32_t)WINDOW_SIZE, cwnd);
 }
 
@@ -233,14 +709,17 @@ bool RdtSocket::canSendPacket() {
 void RdtSocket::slideWindow(uint32_t ack_seq) {
     auto it = send_window.begin();
     while (it != send_window.end() && it->first < ack_seq) {
-        // 移除SACK记录（已连续确认的包）
-        sacked_packets.erase(it->first);
+        // 移除SACK记录（已连续确认的包），之前没有SACK过的包在这里才算送达
+        if (sacked_packets.erase(it->first) == 0) {
+            rackOnDelivered(it->second, it->first);
+        }
+        packet_pool.release(it->second.packet);
         it = send_window.erase(it);
     }
 }
 
 bool RdtSocket::isPacketInWindow(uint32_t seq) {
-    return seq >= recv_base && seq < recv_base + WINDOW_SIZE * DATA_SIZE;
+    return seq >= recv_base && seq < recv_base + WINDOW_SIZE * (uint32_t)max_seg_size;
 }
 
 void RdtSocket::processAck(uint32_t ack_seq) {
@@ -248,37 +727,21 @@ void RdtSocket::processAck(uint32_t ack_seq) {
         // 新的 ACK，重置重复计数
         onNewAck();
         last_ack_seq = ack_seq;
+        consecutive_rtos = 0;
         slideWindow(ack_seq);
+        tlp_pending = false;
+        if (in_recovery && ack_seq >= recovery_high) {
+            in_recovery = false;
+            log("[RACK] Recovery finished (ack=%u)", ack_seq);
+        }
+        traceMetrics();
     } else if (ack_seq == last_ack_seq) {
         // 重复 ACK
         onDuplicateAck();
         log("[DUPACK] Duplicate ACK received (ack=%u), count=%u", ack_seq, dup_ack_count);
         
-        if (dup_ack_count == 3) {
-            // 3 个重复 ACK，触发快速重传和快速恢复
-            log("[DUPACK] 3 duplicate ACKs received! Triggering Fast Retransmit and Fast Recovery");
-            
-            // 设置阈值为当前拥塞窗口的一半
-            ssthresh = (cwnd / 2 > 0) ? cwnd / 2 : 1;
-            log("[DUPACK] ssthresh set to %u", ssthresh);
-            
-            // 快速恢复（Reno 的经典写法）
-            // cwnd = ssthresh + 3*MSS（因为收到了 3 个 dupACK）
-            cwnd = ssthresh + 3;  // 这里 3 代表 3*MSS，假设一个包就是一个 MSS
-            ca_acc = 0;  // 重置累加器
-            cong_state = CONGESTION_AVOIDANCE;
-            log("[DUPACK] cwnd set to %u (ssthresh + 3), ca_acc reset, entering Congestion Avoidance", cwnd);
-            
-            // 快速重传：重传丢失的数据包
-            // 找到需要重传的最早未确认包
-            if (!send_window.empty()) {
-                auto first_unacked = send_window.begin();
-                log("[DUPACK] Fast Retransmit: retransmitting packet (seq=%u)", first_unacked->first);
-                sendPacket(first_unacked->second.packet);
-                first_unacked->second.send_time = std::chrono::steady_clock::now();
-                first_unacked->second.retransmit_count++;
-            }
-        }
+        // 丢包由RACK按时间判定（rackDetectLoss），不再依赖恰好3个重复ACK：
+        // 路由器乱序时重复ACK会误判，文件末尾的丢包又凑不够3个
     }
     // 如果 ack_seq < last_ack_seq，说明是更早的 ACK，直接忽略
 }
@@ -317,10 +780,199 @@ void RdtSocket::onTimeout() {
     cong_state = SLOW_START;
     ca_acc = 0;  // 重置累加器，重新开始慢启动
     log("[TIMEOUT] Timeout: cwnd reset to 1, ssthresh to %u, entering Slow Start", ssthresh);
+    traceMetrics();
+}
+
+void RdtSocket::onRetransmit(uint32_t seq, bool timeout) {
+    if (timeout) {
+        stats.timeout_retransmits++;
+    } else {
+        stats.fast_retransmits++;
+    }
+
+    // 没有进行中的恢复轮次，或ACK已越过当前轮次的最高序号：开始新一轮，记下重传前的状态
+    RecoveryEpisode& cur = episodes[0];
+    if (!cur.armed || last_ack_seq >= cur.high) {
+        episodes[1] = cur;
+        auto last = send_window.rbegin();
+        cur.armed = true;
+        cur.had_timeout = false;
+        cur.prior_cwnd = cwnd;
+        cur.prior_ssthresh = ssthresh;
+        cur.start = send_window.begin()->first;
+        cur.high = last->first + last->second.packet->header.data_length;
+        cur.retrans = 0;
+        log("[UNDO] Recovery episode started at seq=%u (cwnd=%u, ssthresh=%u)", seq, cwnd, ssthresh);
+    }
+    if (timeout) cur.had_timeout = true;
+    cur.retrans++;
+}
+
+void RdtSocket::onDsack(const SackBlock& block) {
+    stats.dsacks_received++;
+    log("[DSACK] Receiver got a duplicate of %u-%u", block.start, block.end);
+
+    // 有重传是多余的，可能是乱序被误判为丢包：放大RACK的乱序窗口
+    if (rack_reo_mult < RACK_REO_WND_MAX_MULT) rack_reo_mult++;
+
+    // 每个D-SACK说明所在轮次有一次重传是多余的
+    for (int i = 0; i < 2; i++) {
+        RecoveryEpisode& ep = episodes[i];
+        if (!ep.armed || ep.retrans == 0 || block.start < ep.start || block.start >= ep.high) continue;
+        if (--ep.retrans > 0) return;
+
+        // 本轮所有重传的原包都已到达：超时/快速重传是伪触发，恢复重传前的拥塞状态
+        if (ep.had_timeout) {
+            stats.spurious_timeouts++;
+        } else {
+            stats.spurious_fast_retransmits++;
+        }
+        cwnd = std::max(cwnd, ep.prior_cwnd);
+        ssthresh = std::max(ssthresh, ep.prior_ssthresh);
+        cong_state = cwnd < ssthresh ? SLOW_START : CONGESTION_AVOIDANCE;
+        ca_acc = 0;
+        ep.armed = false;
+        if (i == 1) {
+            // 当前轮次是在上一轮多余的降窗之后开始的，撤销时至少回到上一轮之前的状态
+            episodes[0].prior_cwnd = std::max(episodes[0].prior_cwnd, ep.prior_cwnd);
+            episodes[0].prior_ssthresh = std::max(episodes[0].prior_ssthresh, ep.prior_ssthresh);
+        }
+        log("[UNDO] Spurious %s, cwnd restored to %u, ssthresh to %u",
+            ep.had_timeout ? "timeout" : "fast retransmit", cwnd, ssthresh);
+        traceMetrics();
+        return;
+    }
+}
+
+void RdtSocket::rackOnDelivered(const SendWindowEntry& entry, uint32_t seq) {
+    uint32_t rtt = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        transport->now() - entry.send_time).count();
+    // 重传过的包比最小RTT还快被确认，多半确认的是原包，这个样本不可靠
+    if (entry.retransmit_count > 0 && rtt < min_rtt_us) return;
+
+    if (entry.retransmit_count == 0 && !(negotiated_options & OPT_TIMESTAMP)) {
+        // 没有时间戳选项时，只用没有重传过的包更新RTT估计（Karn算法）
+        onRttSample(rtt);
+    }
+
+    uint32_t end_seq = seq + entry.packet->header.data_length;
+    if (entry.send_time > rack_xmit_time ||
+        (entry.send_time == rack_xmit_time && end_seq > rack_end_seq)) {
+        rack_xmit_time = entry.send_time;
+        rack_end_seq = end_seq;
+        rack_rtt_us = rtt;
+    }
+}
+
+void RdtSocket::onRttSample(uint32_t rtt_us) {
+    // RFC 6298：第一个样本直接作为srtt，rttvar取其一半
+    if (stats.rtt_samples++ == 0) {
+        srtt_us = rtt_us;
+        rttvar_us = rtt_us / 2;
+    } else {
+        uint32_t err = rtt_us > srtt_us ? rtt_us - srtt_us : srtt_us - rtt_us;
+        rttvar_us = (rttvar_us * 3 + err) / 4;
+        srtt_us = (srtt_us * 7 + rtt_us) / 8;
+    }
+    min_rtt_us = min_rtt_us ? std::min(min_rtt_us, rtt_us) : rtt_us;
+
+    // RTO = srtt + 4×rttvar，偏差项不小于RTO_MIN_MS（与Linux相同）：路径很稳定时rttvar趋近于0，
+    // RTO贴着srtt，排队稍有波动就会超时。新样本同时结束超时退避
+    uint32_t rto = (srtt_us + std::max(4 * rttvar_us, RTO_MIN_MS * 1000) + 999) / 1000;
+    rto_ms = std::min(RTO_MAX_MS, rto);
+    traceEvent(TRACE_RTT, 0, (uint16_t)std::min(rto_ms, 65535u), rtt_us, srtt_us);
+}
+
+void RdtSocket::stampTimestamp(Packet& pkt) {
+    if (!(negotiated_options & OPT_TIMESTAMP)) return;
+
+    // 数据部分的校验和由原校验和减去包头部分得到，重传时不必重新扫描数据
+    uint32_t old_checksum = pkt.header.checksum;
+    pkt.header.checksum = 0;
+    uint32_t data_checksum = (old_checksum - calculateChecksum(&pkt.header, sizeof(pkt.header))) & 0xFFFF;
+
+    // 对端同意时间戳选项时也支持OPT_FILE_INFO，文件名已在SYN中，首个数据包的文件名可以覆盖
+    memset(pkt.header.filename, 0, sizeof(pkt.header.filename));
+    pkt.header.flags |= FLAG_TIMESTAMP;
+    pkt.header.ts.ts_val = timestampUs(transport->now());
+    pkt.header.checksum = (calculateChecksum(&pkt.header, sizeof(pkt.header)) + data_checksum) & 0xFFFF;
+}
+
+void RdtSocket::rackDetectLoss() {
+    if (rack_end_seq == 0) return;  // 还没有包送达
+
+    auto now = transport->now();
+    uint32_t reo_wnd = std::min(min_rtt_us / 4 * rack_reo_mult, srtt_us);
+    for (auto& entry : send_window) {
+        if (sacked_packets.find(entry.first) != sacked_packets.end()) continue;
+
+        // 只看比最近送达的包更早发出的包
+        uint32_t end_seq = entry.first + entry.second.packet->header.data_length;
+        if (entry.second.send_time > rack_xmit_time ||
+            (entry.second.send_time == rack_xmit_time && end_seq >= rack_end_seq)) {
+            continue;
+        }
+        uint32_t waited = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            now - entry.second.send_time).count();
+        if (waited < rack_rtt_us + reo_wnd) continue;
+
+        onRetransmit(entry.first, false);  // 在调整窗口之前记下原状态
+        if (!in_recovery) {
+            // 一轮恢复只降一次窗口
+            auto last = send_window.rbegin();
+            in_recovery = true;
+            recovery_high = last->first + last->second.packet->header.data_length;
+            // 与原来的Reno快速恢复相同：cwnd = ssthresh + 3（判定丢失时至少已有后发的包离开网络）
+            ssthresh = (cwnd / 2 > 0) ? cwnd / 2 : 1;
+            cwnd = ssthresh + 3;
+            ca_acc = 0;
+            cong_state = CONGESTION_AVOIDANCE;
+            log("[RACK] Entering Fast Recovery: ssthresh=%u, cwnd=%u", ssthresh, cwnd);
+            traceMetrics();
+        }
+        traceEvent(TRACE_PACKET_LOST, TRACE_LOSS_RACK, entry.second.packet->header.data_length, entry.first, 0);
+        log("[RACK] Packet lost (seq=%u, waited %u us, rack_rtt=%u us, reo_wnd=%u us), retransmitting",
+            entry.first, waited, rack_rtt_us, reo_wnd);
+        stampTimestamp(*entry.second.packet);
+        sendPacket(*entry.second.packet);
+        entry.second.send_time = now;
+        entry.second.retransmit_count++;
+    }
+}
+
+void RdtSocket::tailLossProbe() {
+    if (send_window.empty() || tlp_pending || srtt_us == 0) return;
+
+    // 探测超时取2×srtt，不短于TLP_MIN_MS；不比重传超时更早就没有意义
+    uint32_t pto_us = std::max(2 * srtt_us, TLP_MIN_MS * 1000);
+    if (pto_us >= rto_ms * 1000) return;
+
+    auto now = transport->now();
+    if (std::chrono::duration_cast<std::chrono::microseconds>(now - last_activity_time).count() < pto_us) return;
+
+    // 重发最后一个未被SACK的包，它的ACK/SACK能让RACK发现前面的丢包
+    for (auto it = send_window.rbegin(); it != send_window.rend(); ++it) {
+        if (sacked_packets.find(it->first) != sacked_packets.end()) continue;
+        log("[TLP] No ACK for %u us, probing with the last segment (seq=%u)", pto_us, it->first);
+        traceEvent(TRACE_PACKET_LOST, TRACE_LOSS_PROBE, it->second.packet->header.data_length, it->first, 0);
+        stampTimestamp(*it->second.packet);
+        sendPacket(*it->second.packet);
+        it->second.send_time = now;
+        it->second.retransmit_count++;
+        tlp_pending = true;
+        last_activity_time = now;
+        stats.tail_loss_probes++;
+        return;
+    }
 }
 
 void RdtSocket::retransmitPackets() {
-    auto now = std::chrono::steady_clock::now();
+    tailLossProbe();
+    rackDetectLoss();
+
+    auto now = transport->now();
+    bool black_hole = false;
+    bool timed_out = false;
     for (auto& entry : send_window) {
         // 如果已通过SACK块确认，则不需重传
         if (sacked_packets.find(entry.first) != sacked_packets.end()) {
@@ -330,21 +982,39 @@ void RdtSocket::retransmitPackets() {
 
         auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
             now - entry.second.send_time).count();
-        if (elapsed > TIMEOUT_MS) {
-            log("[RETX] Packet timeout, retransmitting (seq=%u)", entry.first);
+        if (elapsed > rto_ms) {
+            log("[RETX] Packet timeout, retransmitting (seq=%u, rto=%u ms)", entry.first, rto_ms);
+            traceEvent(TRACE_PACKET_LOST, TRACE_LOSS_TIMEOUT, entry.second.packet->header.data_length, entry.first, 0);
+            onRetransmit(entry.first, true);
             entry.second.send_time = now;
             entry.second.retransmit_count++;
-            sendPacket(entry.second.packet);
+            stampTimestamp(*entry.second.packet);
+            sendPacket(*entry.second.packet);
             onTimeout();
+            timed_out = true;
+
+            // 大包反复超时而小包正常：路径MTU可能变小了
+            if (entry.second.packet->header.data_length > DATA_SIZE &&
+                entry.second.retransmit_count >= PMTU_BLACKHOLE_RETRIES) {
+                black_hole = true;
+            }
         }
     }
+    if (timed_out) {
+        // 超时退避：RTO加倍，直到新的RTT样本重新计算
+        rto_ms = std::min(rto_ms * 2, RTO_MAX_MS);
+        consecutive_rtos++;
+    }
+    if (black_hole) {
+        fallbackToBaseSegment();
+    }
 }
 
 bool RdtSocket::isTimerExpired(uint32_t seq) {
     if (send_window.find(seq) == send_window.end()) return false;
     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::steady_clock::now() - send_window[seq].send_time).count();
-    return elapsed > TIMEOUT_MS;
+        transport->now() - send_window[seq].send_time).count();
+    return elapsed > rto_ms;
 }
 
 bool RdtSocket::sendAck(uint32_t ack_seq) {
@@ -355,7 +1025,7 @@ bool RdtSocket::sendAck(uint32_t ack_seq) {
     ack.header.data_length = 0;
     ack.header.checksum = 0;  // 计算前清零
     ack.header.checksum = calculateChecksum(&ack.header,
-                                           sizeof(ack.header) - sizeof(ack.header.checksum));
+                                           sizeof(ack.header));
     return sendPacket(ack);
 }
 
@@ -390,7 +1060,7 @@ void RdtSocket::generateSackBlocks(SackBlock* blocks, uint8_t& count) {
         }
 
         // 更新块的结束位置
-        const Packet& pkt = entry.second;
+        const Packet& pkt = *entry.second;
         current_block.end = seq + pkt.header.data_length;
         prev_end = current_block.end;
     }
@@ -408,27 +1078,55 @@ void RdtSocket::generateSackBlocks(SackBlock* blocks, uint8_t& count) {
     }
 }
 
-bool RdtSocket::sendAckWithSack(uint32_t ack_seq) {
+bool RdtSocket::sendAckWithSack(uint32_t ack_seq, const SackBlock* dsack) {
     Packet ack;
     ack.header.packet_type = PKT_ACK;
     ack.header.seq_num = local_seq;
     ack.header.ack_num = ack_seq;
 
-    // 生成SACK块
-    SackBlock sack_blocks[MAX_SACK_BLOCKS];
+    // 生成SACK块（第0个位置留给D-SACK块）
+    SackBlock sack_blocks[MAX_SACK_BLOCKS + 1];
     uint8_t sack_count = 0;
-    generateSackBlocks(sack_blocks, sack_count);
+    generateSackBlocks(sack_blocks + 1, sack_count);
+
+    SackBlock* first = sack_blocks + 1;
+    if (dsack) {
+        sack_blocks[0] = *dsack;
+        first = sack_blocks;
+        sack_count = std::min((uint8_t)(sack_count + 1), MAX_SACK_BLOCKS);
+        ack.header.flags |= FLAG_DSACK;
+    }
 
     // 编码SACK块到data部分
     uint16_t data_len = 0;
     if (sack_count > 0) {
-        data_len = encodeSackBlocks(sack_blocks, sack_count, ack.data, DATA_SIZE);
+        data_len = encodeSackBlocks(first, sack_count, ack.data, DATA_SIZE);
+    }
+
+    // 多路流：每个ACK都带上各条进行中的流的上限（没有SACK块时先写出块数0，以便对端定位）
+    if (!stream_credits.empty() && (negotiated_options & OPT_STREAMS)) {
+        if (data_len == 0) ack.data[data_len++] = 0;
+        data_len += encodeStreamCredits(stream_credits.data(), stream_credits.size(),
+                                        ack.data + data_len, DATA_SIZE - data_len);
+        ack.header.flags |= FLAG_STREAM_CREDIT;
     }
 
     ack.header.data_length = data_len;
+
+    // 带回触发本ACK的DATA包的时间戳，附上该包在本端停留的时间
+    if (ts_echo_pending) {
+        auto now = transport->now();
+        ack.header.flags |= FLAG_TIMESTAMP;
+        ack.header.ts.ts_val = timestampUs(now);
+        ack.header.ts.ts_ecr = ts_recent;
+        ack.header.ts.ack_delay = now > ts_recent_rx ? (uint32_t)std::chrono::duration_cast<
+            std::chrono::microseconds>(now - ts_recent_rx).count() : 0;
+        ts_echo_pending = false;
+    }
+
     ack.header.checksum = 0;  // 计算前清零
     ack.header.checksum = calculateChecksum(&ack.header,
-                                           sizeof(ack.header) - sizeof(ack.header.checksum));
+                                           sizeof(ack.header));
     if (data_len > 0) {
         ack.header.checksum += calculateChecksum(ack.data, data_len);
     }
@@ -437,16 +1135,12 @@ bool RdtSocket::sendAckWithSack(uint32_t ack_seq) {
 }
 
 bool RdtSocket::sendFile(const char* filename) {
-    std::ifstream file(filename, std::ios::binary);
-    if (!file) {
+    FileSource file;
+    if (!file.open(filename)) {
         log("[ERROR] Cannot open file: %s", filename);
         return false;
     }
 
-    file.seekg(0, std::ios::end);
-    uint32_t file_size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
     const char* base_filename = strrchr(filename, '\\');
     if (!base_filename) base_filename = strrchr(filename, '/');
     if (!base_filename) base_filename = filename;
@@ -455,53 +1149,400 @@ bool RdtSocket::sendFile(const char* filename) {
     log("\n========== File Transfer Started ==========");
     log("[SEND] Filename: %s", base_filename);
     log("[SEND] File path: %s", filename);
-    log("[SEND] File size: %u bytes", file_size);
+    log("[SEND] File size: %u bytes", file.size());
     log("==========================================\n");
 
-    uint32_t sent = 0;
+    // 差量传输要先知道接收端有没有旧文件，因此不发0-RTT数据，等SYN-ACK后再决定发什么
+    if (delta_enabled && !connected && !handshake_pending) {
+        if (!sendSyn(file.size(), base_filename, 0)) {
+            log("[ERROR] Failed to send SYN");
+            return false;
+        }
+        if (!waitHandshake()) return false;
+
+        if (negotiated_options & OPT_DELTA) {
+            auto start_time = transport->now();
+            std::vector<char> sig;
+            if (!fetchSignature(sig)) return false;
+            auto sig_time = transport->now();
+
+            // 生成指令流要扫描整个新文件，放到工作线程中；期间定时重发一个签名请求作保活，
+            // 避免接收端在第一个数据包到达之前超时
+            DeltaSource delta;
+            bool built = false;
+            std::atomic<bool> build_done(false);
+            std::thread worker([&]() {
+                built = delta.build(filename, file.size(), sig, delta_basis_size, delta_block_size);
+                build_done = true;
+            });
+            Packet& pkt = *packet_pool.acquire();
+            auto last_keepalive = sig_time;
+            while (!build_done) {
+                recvPacket(pkt, 50);   // 丢弃签名应答和重复的SYN-ACK
+                if (std::chrono::duration_cast<std::chrono::milliseconds>(
+                        transport->now() - last_keepalive).count() >= TIMEOUT_MS) {
+                    sendSigRequest(0);
+                    last_keepalive = transport->now();
+                }
+            }
+            worker.join();
+            packet_pool.release(&pkt);
+            if (!built) {
+                log("[ERROR] Cannot compute delta for %s", filename);
+                return false;
+            }
+            auto delta_time = transport->now();
+            log("[DELTA] Signature: %zu blocks (%zu bytes) in %lld ms; delta computed in %lld ms",
+                sig.size() / DELTA_SIG_ENTRY_SIZE, sig.size(),
+                (long long)std::chrono::duration_cast<std::chrono::milliseconds>(sig_time - start_time).count(),
+                (long long)std::chrono::duration_cast<std::chrono::milliseconds>(delta_time - sig_time).count());
+            log("[DELTA] %u blocks matched, %u literal bytes, %zu instructions: stream %u bytes for a %u-byte file",
+                delta.matchedBlocks(), delta.literalBytes(), delta.opCount(), delta.size(), file.size());
+            return sendStream(delta, base_filename, 0);
+        }
+        log("[DELTA] Not accepted by receiver (no basis file, resuming instead, or unsupported)");
+    }
+
+    return sendStream(file, base_filename, 0);
+}
+
+bool RdtSocket::sendFiles(const std::vector<BatchFile>& files, const char* batch_name) {
+    BatchSource batch;
+    std::string error;
+    if (!batch.open(files, error)) {
+        log("[ERROR] Cannot prepare batch: %s", error.c_str());
+        return false;
+    }
+
+    log("\n========== Batch Transfer Started ==========");
+    log("[SEND] Batch: %s", batch_name);
+    log("[SEND] Files: %zu, total %u bytes (manifest %u bytes)",
+        batch.fileCount(), batch.size(), batch.manifestSize());
+    log("==========================================\n");
+
+    // 多路流：清单和每个文件各占一条流，一个文件的丢包不阻塞其他文件的交付。
+    // 包头的含义取决于对端是否支持，所以先等握手完成；流号只有16位，文件过多时不用。
+    // 对端不支持时清单和文件数据在同一个字节流里流水线发送
+    auto start_time = transport->now();
+    if (batch.streamCount() <= STREAM_ID_MAX) {
+        if (!sendSyn(batch.size(), batch_name, OPT_MANIFEST | OPT_STREAMS)) {
+            log("[ERROR] Failed to send SYN");
+            return false;
+        }
+        if (!waitHandshake()) return false;
+    }
+    if (negotiated_options & OPT_STREAMS) {
+        std::vector<OutStream> streams(batch.streamCount());
+        for (size_t i = 0; i < streams.size(); i++) streams[i].size = batch.streamSize(i);
+        if (!sendStreams(streams, &batch, batch.size(), batch_name, 0)) return false;
+    } else if (!sendStream(batch, batch_name, OPT_MANIFEST)) {
+        return false;
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(transport->now() - start_time).count();
+    log("[SEND] Batch: %zu files in %lld ms (%.0f files/s)", batch.fileCount(), (long long)duration,
+        duration > 0 ? batch.fileCount() * 1000.0 / duration : 0.0);
+    return true;
+}
+
+bool RdtSocket::sendSigRequest(uint32_t index) {
+    Packet req;
+    req.header.packet_type = PKT_SIG_REQ;
+    req.header.seq_num = local_seq;
+    req.header.ack_num = index;
+    req.header.checksum = 0;  // 计算前清零
+    req.header.checksum = calculateChecksum(&req.header, sizeof(req.header));
+    return sendPacket(req);
+}
+
+bool RdtSocket::fetchSignature(std::vector<char>& sig) {
+    uint32_t blocks = deltaBlockCount(delta_basis_size, delta_block_size);
+    sig.assign((size_t)blocks * DELTA_SIG_ENTRY_SIZE, 0);
+    uint32_t chunks = (uint32_t)((sig.size() + DATA_SIZE - 1) / DATA_SIZE);
+
+    // 由发送端驱动：最多DELTA_SIG_WINDOW个分片请求在途，超过RTO未收到就重新请求；
+    // 接收端无状态地应答每个请求，不需要自己的重传逻辑
+    std::vector<char> received(chunks, 0);
+    std::vector<std::chrono::steady_clock::time_point> requested(chunks);
+    std::vector<char> sent(chunks, 0);
+    uint32_t done = 0;
+    uint32_t first_missing = 0;
+    auto last_progress = transport->now();
+    Packet& pkt = *packet_pool.acquire();
+
+    while (done < chunks) {
+        auto now = transport->now();
+        uint32_t outstanding = 0;
+        for (uint32_t i = first_missing; i < chunks && outstanding < DELTA_SIG_WINDOW; i++) {
+            if (received[i]) continue;
+            outstanding++;
+            if (sent[i] && std::chrono::duration_cast<std::chrono::milliseconds>(now - requested[i]).count() < rto_ms) {
+                continue;
+            }
+            sendSigRequest(i);
+            sent[i] = 1;
+            requested[i] = now;
+        }
+
+        if (recvPacket(pkt, 10)) {
+            if (pkt.header.packet_type == PKT_SIG) {
+                uint32_t received_checksum = pkt.header.checksum;
+                pkt.header.checksum = 0;
+                uint32_t expected = (calculateChecksum(&pkt.header, sizeof(pkt.header)) +
+                                     calculateChecksum(pkt.data, pkt.header.data_length)) & 0xFFFF;
+                uint32_t index = pkt.header.ack_num;
+                if (expected == received_checksum && index < chunks && !received[index] &&
+                    pkt.header.data_length == std::min<size_t>(DATA_SIZE, sig.size() - (size_t)index * DATA_SIZE)) {
+                    memcpy(sig.data() + (size_t)index * DATA_SIZE, pkt.data, pkt.header.data_length);
+                    received[index] = 1;
+                    done++;
+                    last_progress = transport->now();
+                    while (first_missing < chunks && received[first_missing]) first_missing++;
+                }
+            } else {
+                handleAckPacket(pkt);   // 重复的SYN-ACK等
+            }
+        }
+
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(transport->now() - last_progress).count() >
+            CONNECT_TIMEOUT_MS) {
+            log("[ERROR] Signature transfer timeout (%u / %u chunks)", done, chunks);
+            packet_pool.release(&pkt);
+            return false;
+        }
+    }
+    packet_pool.release(&pkt);
+    return true;
+}
+
+bool RdtSocket::sendStream(StreamSource& file, const char* base_filename, uint8_t syn_options) {
+    std::vector<OutStream> streams(1);
+    streams[0].source = &file;
+    streams[0].size = file.size();
+    return sendStreams(streams, nullptr, file.size(), base_filename, syn_options);
+}
+
+bool RdtSocket::sendStreams(std::vector<OutStream>& streams, const BatchSource* batch, uint32_t file_size,
+                            const char* base_filename, uint8_t syn_options) {
     uint32_t seq = local_seq;
     bool first_data = true;
 
-    auto start_time = std::chrono::steady_clock::now(); // 记录开始时间
+    // 0-RTT：SYN携带文件名/大小/选项，随后立即发送首个数据窗口，不等SYN-ACK
+    if (!connected && !handshake_pending) {
+        if (!sendSyn(file_size, base_filename, syn_options)) {
+            log("[ERROR] Failed to send SYN");
+            return false;
+        }
+    }
 
-    while (sent < file_size) {
-        if (!canSendPacket()) {
-            Packet ack_pkt;
-            if (recvPacket(ack_pkt, 50)) {
-                if (ack_pkt.header.packet_type == PKT_ACK) {
-                    processAck(ack_pkt.header.ack_num);
-
-                    if (ack_pkt.header.data_length > 0) {
-                        SackBlock sack_blocks[MAX_SACK_BLOCKS];
-                        uint8_t sack_count = decodeSackBlocks(ack_pkt.data, ack_pkt.header.data_length,
-                                                             sack_blocks, MAX_SACK_BLOCKS);
-                        if (sack_count > 0) {
-                            for (uint8_t i = 0; i < sack_count; i++) {
-                                for (uint32_t seq_num = sack_blocks[i].start; seq_num < sack_blocks[i].end; seq_num++) {
-                                    if (send_window.find(seq_num) != send_window.end()) {
-                                        sacked_packets.insert(seq_num);
-                                    }
-                                }
-                            }
-                        }
+    // 多路流（握手完成后才会协商）：每个包带流号，file_offset为流内的线上字节偏移；
+    // 没有收到接收端通告之前，每条流的上限是一个流窗口
+    bool multi = batch && (negotiated_options & OPT_STREAMS);
+    uint32_t stream_window = STREAM_WINDOW_SEGMENTS * (uint32_t)max_seg_size;
+    stream_limits.assign(streams.size(), multi ? stream_window : UINT32_MAX);
+    size_t opened = multi ? 0 : streams.size();   // 已开始发送的流
+    size_t first_active = 0;                      // 之前的流都已发完并被确认
+    size_t peak_active = 0;
+    uint32_t credit_waits = 0;                    // 所有流都到了流量控制上限的次数
+    bool credit_blocked = false;
+    OutStream& main = streams[0];                 // 单一字节流时唯一的流
+
+    // 端到端摘要：读出的每个字节顺带计入所在流的摘要，FIN时交给接收端比对
+    std::vector<char> digest_buf;
+
+    // 断点续传（只用于单一字节流）：跳过接收端已经完整收到的区间（区间随SYN-ACK到达）
+    // 协商了摘要时跳过的区间仍要读出来计入摘要（只读不发），否则直接定位
+    std::vector<SackBlock> done_ranges;
+    size_t next_done = 0;
+    uint32_t skipped = 0;
+    auto skipCompleted = [&]() {
+        while (next_done < done_ranges.size() && done_ranges[next_done].start <= main.sent) {
+            uint32_t end = done_ranges[next_done].end;
+            if (end > main.sent) {
+                skipped += end - main.sent;
+                if (negotiated_options & OPT_DIGEST) {
+                    if (digest_buf.empty()) digest_buf.resize(DIGEST_READ_SIZE);
+                    while (main.sent < end) {
+                        uint32_t n = std::min(DIGEST_READ_SIZE, end - main.sent);
+                        main.source->read(digest_buf.data(), n);
+                        main.digest.update(digest_buf.data(), n);
+                        main.sent += n;
                     }
+                } else {
+                    main.sent = end;
+                    main.source->seek(main.sent);
                 }
             }
+            next_done++;
+        }
+    };
+
+    // 分块压缩：握手完成前按本端意愿乐观地压缩（数据包带标志位，接收端总能解码），
+    // 若SYN-ACK表明对端不同意，之后的块只分块不压缩
+    bool compress = connected ? (negotiated_options & OPT_COMPRESS) != 0 : compress_enabled;
+    uint32_t incompressible_run = 0;  // 连续不可压缩的块数
+    uint32_t skip_blocks = 0;         // 剩余跳过压缩尝试的块数
+    uint64_t wire_bytes = 0;          // 实际发送的数据字节数
+    if (compress) {
+        log("[SEND] Compression enabled (block=%u bytes)", compress_block_size);
+    }
+    if (multi) {
+        log("[STREAM] %zu streams (manifest + files), at most %u active, window %u bytes per stream",
+            streams.size(), STREAM_MAX_ACTIVE, stream_window);
+    }
+
+    // 选择下一个发包的流：已开始的流中最靠前的、还有数据且未超过流量控制上限的；
+    // 都不能发时开始新的流（跳过空文件）。清单发完之前不开始文件流，接收端先能解析清单
+    auto pickStream = [&]() -> int {
+        while (first_active < opened && !streams[first_active].pending() &&
+               streams[first_active].end_seq <= last_ack_seq) {
+            first_active++;
+        }
+        for (size_t i = first_active; i < opened; i++) {
+            if (streams[i].pending() && streams[i].offset < stream_limits[i]) return (int)i;
+        }
+        while (opened < streams.size() && opened - first_active < STREAM_MAX_ACTIVE &&
+               (opened == 0 || !streams[0].pending())) {
+            OutStream& s = streams[opened++];
+            if (s.size == 0) continue;
+            s.owned.reset(batch->openStream(opened - 1));
+            s.source = s.owned.get();
+            peak_active = std::max(peak_active, opened - first_active);
+            return (int)(opened - 1);
+        }
+        return -1;
+    };
+    auto allSent = [&]() -> bool {
+        if (opened < streams.size()) return false;
+        for (size_t i = first_active; i < opened; i++) {
+            if (streams[i].pending()) return false;
+        }
+        return true;
+    };
+
+    auto start_time = transport->now(); // 记录开始时间
+    last_activity_time = start_time;
+    Packet& ack_pkt = *packet_pool.acquire();  // 接收ACK用的缓冲，整个传输期间复用
+
+    while (!allSent()) {
+        if (resume_ranges_ready) {
+            done_ranges.swap(resume_ranges);
+            resume_ranges_ready = false;
+            next_done = 0;
+            if (!multi) skipCompleted();
+            continue;
+        }
+
+        int pick = canSendPacket() ? pickStream() : -1;
+        bool blocked = pick < 0 && canSendPacket();
+        if (blocked && !credit_blocked) credit_waits++;
+        credit_blocked = blocked;
+        if (pick < 0) {
+            // 窗口已满，或者所有流都到了流量控制上限：等待ACK
+            if (recvPacket(ack_pkt, 50)) {
+                handleAckPacket(ack_pkt);
+            }
+            if (!checkHandshake()) {
+                packet_pool.release(&ack_pkt);
+                return false;
+            }
+            pmtuProbe();
             retransmitPackets();
+            if (!checkProgress()) {
+                packet_pool.release(&ack_pkt);
+                return false;
+            }
             continue;
         }
+        OutStream& s = streams[pick];
+
+        // 直接在池缓冲中组包，放入发送窗口时不再拷贝
+        Packet* tx = packet_pool.acquire();
+        Packet& data_pkt = *tx;
+        uint16_t to_send;
+        uint32_t read_limit = !multi && next_done < done_ranges.size() ? done_ranges[next_done].start : s.size;
+        uint32_t credit = stream_limits[pick] - s.offset;
+
+        if (compress) {
+            if (s.block_pos >= s.block_data_len) {
+                // 读取下一个原始块并尝试压缩（不跨越接收端已有的区间）
+                if (s.block_raw.empty()) {
+                    s.block_raw.resize(compress_block_size);
+                    s.block_comp.resize(compress_block_size);
+                }
+                s.block_offset = s.sent;
+                s.block_raw_len = std::min((uint32_t)compress_block_size, read_limit - s.sent);
+                s.source->read(s.block_raw.data(), s.block_raw_len);
+                s.digest.update(s.block_raw.data(), s.block_raw_len);
+                s.sent += s.block_raw_len;
+                if (!multi) skipCompleted();
+
+                // 对端拒绝压缩时只分块不压缩
+                bool try_compress = !connected || (negotiated_options & OPT_COMPRESS);
+                int comp_len = -1;
+                if (!try_compress) {
+                    comp_len = -1;
+                } else if (skip_blocks > 0) {
+                    skip_blocks--;
+                } else {
+                    // 压缩结果不小于原始长度时视为不可压缩
+                    comp_len = lzCompress(s.block_raw.data(), s.block_raw_len,
+                                          s.block_comp.data(), s.block_raw_len - 1);
+                    if (comp_len < 0 && ++incompressible_run >= COMPRESS_GIVEUP_RUN) {
+                        // 连续多块不可压缩（如jpg），暂停一段时间再尝试，节省CPU
+                        skip_blocks = COMPRESS_SKIP_BLOCKS;
+                        incompressible_run = 0;
+                        log("[COMPRESS] Data looks incompressible, skipping next %u blocks", skip_blocks);
+                    } else if (comp_len >= 0) {
+                        incompressible_run = 0;
+                    }
+                }
 
-        Packet data_pkt;
-        uint16_t to_send = std::min((uint32_t)DATA_SIZE, file_size - sent);
+                s.block_compressed = comp_len >= 0;
+                s.block_data = s.block_compressed ? s.block_comp.data() : s.block_raw.data();
+                s.block_data_len = s.block_compressed ? comp_len : s.block_raw_len;
+                s.block_pos = 0;
+            }
+
+            to_send = std::min(std::min((uint32_t)seg_size, s.block_data_len - s.block_pos), credit);
+            memcpy(data_pkt.data, s.block_data + s.block_pos, to_send);
+            if (s.block_pos == 0) data_pkt.header.flags |= FLAG_BLOCK_START;
+            // 压缩块整体解压后写入，偏移取块起始；原始块逐包直接写入
+            data_pkt.header.file_offset = s.block_compressed ? s.block_offset : s.block_offset + s.block_pos;
+            s.block_pos += to_send;
+            if (s.block_pos == s.block_data_len) {
+                data_pkt.header.flags |= FLAG_BLOCK_END;
+                data_pkt.header.block_len = s.block_raw_len;
+            }
+            if (s.block_compressed) data_pkt.header.flags |= FLAG_COMPRESSED;
+        } else {
+            to_send = std::min(std::min((uint32_t)seg_size, read_limit - s.sent), credit);
+            data_pkt.header.file_offset = s.sent;
+            s.source->read(data_pkt.data, to_send);
+            s.digest.update(data_pkt.data, to_send);
+            s.sent += to_send;
+            if (!multi) skipCompleted();
+        }
+
+        if (multi) {
+            data_pkt.header.stream_id = (uint16_t)pick;
+            data_pkt.header.file_offset = s.offset;
+            if (!s.pending()) {
+                // 读完的流关闭数据源，释放压缩缓冲
+                s.owned.reset();
+                s.source = nullptr;
+                std::vector<char>().swap(s.block_raw);
+                std::vector<char>().swap(s.block_comp);
+            }
+        }
+        s.offset += to_send;
+        s.end_seq = seq + to_send;
 
-        file.read(data_pkt.data, to_send);
         data_pkt.header.packet_type = PKT_DATA;
         data_pkt.header.seq_num = seq;
         data_pkt.header.ack_num = recv_base;
         data_pkt.header.data_length = to_send;
         data_pkt.header.file_size = file_size;
-        data_pkt.header.checksum = 0;
-        memset(data_pkt.header.reserved, 0, sizeof(data_pkt.header.reserved));
 
         if (first_data) {
             strncpy_s(data_pkt.header.filename, sizeof(data_pkt.header.filename),
@@ -510,140 +1551,497 @@ bool RdtSocket::sendFile(const char* filename) {
         }
 
         data_pkt.header.checksum = 0;
-        uint32_t header_checksum = calculateChecksum(&data_pkt.header, sizeof(data_pkt.header) - sizeof(data_pkt.header.checksum));
+        uint32_t header_checksum = calculateChecksum(&data_pkt.header, sizeof(data_pkt.header));
         uint32_t data_checksum = calculateChecksum(data_pkt.data, to_send);
         data_pkt.header.checksum = (header_checksum + data_checksum) & 0xFFFF;
+        stampTimestamp(data_pkt);
 
         SendWindowEntry entry;
-        entry.packet = data_pkt;
-        entry.send_time = std::chrono::steady_clock::now();
+        entry.packet = tx;
+        entry.send_time = transport->now();
         entry.retransmit_count = 0;
         send_window[seq] = entry;
 
-        log("[SEND] Data (seq=%u, len=%u, win=%zu, cwnd=%u)",
-            seq, to_send, send_window.size(), cwnd);
+        log("[SEND] Data (seq=%u, len=%u, flags=0x%02x, win=%zu, cwnd=%u)",
+            seq, to_send, data_pkt.header.flags, send_window.size(), cwnd);
         sendPacket(data_pkt);
+        last_activity_time = entry.send_time;
 
-        sent += to_send;
         seq += to_send;
+        wire_bytes += to_send;
 
-        Packet ack_pkt;
         if (recvPacket(ack_pkt, 10)) {
-            if (ack_pkt.header.packet_type == PKT_ACK) {
-                processAck(ack_pkt.header.ack_num);
-
-                if (ack_pkt.header.data_length > 0) {
-                    SackBlock sack_blocks[MAX_SACK_BLOCKS];
-                    uint8_t sack_count = decodeSackBlocks(ack_pkt.data, ack_pkt.header.data_length,
-                                                         sack_blocks, MAX_SACK_BLOCKS);
-                    if (sack_count > 0) {
-                        log("[SACK] Received %u SACK blocks:", sack_count);
-                        for (uint8_t i = 0; i < sack_count; i++) {
-                            log("[SACK]   Block[%u]: %u-%u", i, sack_blocks[i].start, sack_blocks[i].end);
-                            for (uint32_t seq = sack_blocks[i].start; seq < sack_blocks[i].end; seq++) {
-                                if (send_window.find(seq) != send_window.end()) {
-                                    sacked_packets.insert(seq);
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+            handleAckPacket(ack_pkt);
+        }
+        if (!checkHandshake()) {
+            packet_pool.release(&ack_pkt);
+            return false;
         }
+        pmtuProbe();
         retransmitPackets();
+        if (!checkProgress()) {
+            packet_pool.release(&ack_pkt);
+            return false;
+        }
     }
 
+    // 接收端收齐之前一直在等，这里同样只在连续超时过多时放弃
     log("[SEND] Waiting for final ACKs...");
-    auto start = std::chrono::steady_clock::now();
     while (!send_window.empty()) {
-        Packet ack_pkt;
         if (recvPacket(ack_pkt, 100)) {
-            if (ack_pkt.header.packet_type == PKT_ACK) {
-                processAck(ack_pkt.header.ack_num);
-
-                if (ack_pkt.header.data_length > 0) {
-                    SackBlock sack_blocks[MAX_SACK_BLOCKS];
-                    uint8_t sack_count = decodeSackBlocks(ack_pkt.data, ack_pkt.header.data_length,
-                                                         sack_blocks, MAX_SACK_BLOCKS);
-                    if (sack_count > 0) {
-                        log("[SACK] Received %u SACK blocks:", sack_count);
-                        for (uint8_t i = 0; i < sack_count; i++) {
-                            log("[SACK]   Block[%u]: %u-%u", i, sack_blocks[i].start, sack_blocks[i].end);
-                            for (uint32_t seq = sack_blocks[i].start; seq < sack_blocks[i].end; seq++) {
-                                if (send_window.find(seq) != send_window.end()) {
-                                    sacked_packets.insert(seq);
-                                }
-                            }
-                        }
-                    }
-                }
-            }
+            handleAckPacket(ack_pkt);
         }
+        if (!checkHandshake()) {
+            packet_pool.release(&ack_pkt);
+            return false;
+        }
+        pmtuProbe();
         retransmitPackets();
-
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-            std::chrono::steady_clock::now() - start).count();
-        if (elapsed > CONNECT_TIMEOUT_MS) break;
+        if (!checkProgress()) {
+            packet_pool.release(&ack_pkt);
+            return false;
+        }
     }
 
-    file.close();
+    packet_pool.release(&ack_pkt);
 
-    auto end_time = std::chrono::steady_clock::now(); // 记录结束时间
+    auto end_time = transport->now(); // 记录结束时间
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
     double throughput = (file_size / 1024.0 / 1024.0) / (duration / 1000.0); // MB/s
 
     log("[SEND] File transfer completed");
     log("[SEND] Total time: %lld ms", duration);
     log("[SEND] Average throughput: %.2f MB/s", throughput);
+    log("[SEND] Segment size: %u bytes (max %u)", seg_size, max_seg_size);
+    log("[SEND] Retransmits: %u timeout, %u fast (RACK), %u tail probes; "
+        "spurious recoveries undone: %u timeout, %u fast (D-SACKs: %u)",
+        stats.timeout_retransmits, stats.fast_retransmits, stats.tail_loss_probes,
+        stats.spurious_timeouts, stats.spurious_fast_retransmits, stats.dsacks_received);
+    log("[SEND] RTT: srtt=%u us, rttvar=%u us, min=%u us, rto=%u ms (%u samples, timestamps %s)",
+        srtt_us, rttvar_us, min_rtt_us, rto_ms, stats.rtt_samples,
+        (negotiated_options & OPT_TIMESTAMP) ? "on" : "off");
+    if (skipped > 0) {
+        log("[SEND] Resume: skipped %u bytes already at receiver", skipped);
+    }
+    if (compress) {
+        log("[SEND] Compression: %u bytes -> %llu bytes on wire (%.1f%%)",
+            file_size, (unsigned long long)wire_bytes,
+            file_size ? wire_bytes * 100.0 / file_size : 100.0);
+    }
+    if (multi) {
+        log("[STREAM] Peak %zu active streams, all streams at flow-control limit %u times",
+            peak_active, credit_waits);
+    }
+
+    // FIN携带文件内容的摘要（差量传输时字节流是指令流，摘要由数据源在生成指令时算好）。
+    // 多路流时把各流的摘要依次连起来再取摘要，两端都不必按整个字节流的顺序计算
+    uint64_t digest = 0;
+    if (multi) {
+        StreamDigest combined;
+        for (size_t i = 0; i < streams.size(); i++) {
+            char part[DIGEST_SIZE];
+            putDigest(part, streams[i].digest.digest());
+            combined.update(part, DIGEST_SIZE);
+        }
+        digest = combined.digest();
+    } else if (!main.source->contentDigest(digest)) {
+        digest = main.digest.digest();
+    }
 
     Packet fin;
     fin.header.packet_type = PKT_FIN;
     fin.header.seq_num = seq;
     fin.header.ack_num = recv_base;
+    if (negotiated_options & OPT_DIGEST) {
+        putDigest(fin.data, digest);
+        fin.header.data_length = DIGEST_SIZE;
+    }
     fin.header.checksum = 0;
     fin.header.checksum = calculateChecksum(&fin.header,
-                                           sizeof(fin.header) - sizeof(fin.header.checksum));
+                                           sizeof(fin.header));
+    if (fin.header.data_length > 0) {
+        fin.header.checksum = (fin.header.checksum +
+                               calculateChecksum(fin.data, fin.header.data_length)) & 0xFFFF;
+    }
 
-    log("[SEND] Sending FIN");
+    log("[SEND] Sending FIN (digest %016llx)", (unsigned long long)digest);
     sendPacket(fin);
 
+    // 等待FIN-ACK，期间忽略迟到的ACK；FIN丢失时按RTO重发
     Packet fin_ack;
-    if (recvPacket(fin_ack, CONNECT_TIMEOUT_MS) && fin_ack.header.packet_type == PKT_FIN_ACK) {
+    bool closed = false;
+    auto fin_time = transport->now();
+    auto last_fin = fin_time;
+    while (std::chrono::duration_cast<std::chrono::milliseconds>(
+               transport->now() - fin_time).count() < CONNECT_TIMEOUT_MS) {
+        if (recvPacket(fin_ack, 50) && fin_ack.header.packet_type == PKT_FIN_ACK) {
+            closed = true;
+            break;
+        }
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(
+                transport->now() - last_fin).count() >= rto_ms) {
+            sendPacket(fin);
+            last_fin = transport->now();
+        }
+    }
+
+    if (!closed) {
+        log("[SEND] No FIN-ACK from receiver");
+    } else if (!(negotiated_options & OPT_DIGEST)) {
+        log("[SEND] Connection closed");
+    } else if (fin_ack.header.data_length < DIGEST_SIZE) {
+        log("[SEND] Connection closed (receiver could not compute digest)");
+    } else if (getDigest(fin_ack.data) == digest) {
+        log("[SEND] Digest: match (%016llx)", (unsigned long long)digest);
         log("[SEND] Connection closed");
+    } else {
+        log("[ERROR] Digest mismatch: sent %016llx, receiver has %016llx",
+            (unsigned long long)digest, (unsigned long long)getDigest(fin_ack.data));
+        connected = false;
+        traceEvent(TRACE_CONNECTION, TRACE_CONN_CLOSED, 0, local_seq, remote_seq);
+        return false;
     }
 
     connected = false;
+    traceEvent(TRACE_CONNECTION, TRACE_CONN_CLOSED, 0, local_seq, remote_seq);
     return true;
 }
 
 bool RdtSocket::recvFile(const char* save_path) {
-    std::ofstream file(save_path, std::ios::binary);
-    if (!file) {
-        log("[ERROR] Cannot create file: %s", save_path);
-        return false;
-    }
-
     log("\n========== File Reception Started ==========");
     log("[RECV] Save path: %s", save_path);
 
+    // 断点续传日志：记录已写入磁盘的文件区间
+    ReceiveJournal journal;
+    journal.setPath(save_path);
+    bool have_journal = resume_enabled && journal.load();
+    if (have_journal) {
+        log("[RESUME] Found journal: %u / %u bytes already received",
+            journal.completedBytes(), journal.getFileSize());
+    }
+
+    // 得知文件标识（续传请求或首个数据包）后再打开输出文件，
+    // 以决定是在已有文件上续写还是截断重写
+    std::fstream file;
+    uint32_t write_pos = 0;
+    uint32_t unsaved = 0;           // 上次保存日志后新写入的字节数
+
+    // 多文件传输：save_path作为目录，字节流按清单分发到其中的各个文件
+    bool batch_mode = (negotiated_options & OPT_MANIFEST) != 0;
+    bool batch_open = false;
+    bool write_failed = false;
+    BatchWriter batch;
+
+    // 差量传输：save_path处的旧文件作为基准，按指令流重建到临时文件，收齐后替换
+    bool delta_mode = false;
+    bool delta_open = false;
+    bool delta_sized = false;       // 已从首个数据包得知指令流长度
+    DeltaWriter delta;
+    std::vector<char> delta_sig;    // 基准文件的签名，应答发送端的分片请求
+
+    // 端到端摘要：按偏移顺序计入写出的数据（差量传输时由DeltaWriter计算重建出的内容）
+    StreamDigest content_digest;
+    uint32_t digest_pos = 0;        // 已计入摘要的字节数
+    bool digest_valid = true;
+
+    auto openOutput = [&](uint32_t size, const char* name, bool may_resume) -> bool {
+        if (delta_mode) {
+            if (delta_open) return true;
+            delta_open = delta.open(save_path, delta_basis_size, delta_block_size);
+            if (!delta_open) log("[ERROR] %s", delta.lastError().c_str());
+            return delta_open;
+        }
+        if (batch_mode) {
+            if (batch_open) return true;
+            journal.clear(size, name);   // 只在内存中跟踪进度，不保存日志
+            batch_open = batch.open(save_path, size, (negotiated_options & OPT_STREAMS) != 0);
+            if (!batch_open) log("[ERROR] %s", batch.lastError().c_str());
+            return batch_open;
+        }
+        if (file.is_open()) return true;
+        if (may_resume && have_journal && journal.matches(size, name)) {
+            file.open(save_path, std::ios::in | std::ios::out | std::ios::binary);
+            if (file) {
+                log("[RESUME] Resuming into existing file");
+                return true;
+            }
+            file.clear();
+        }
+        journal.clear(size, name);
+        file.open(save_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file) {
+            log("[ERROR] Cannot create file: %s", save_path);
+            return false;
+        }
+        return true;
+    };
+    auto saveJournal = [&]() {
+        if (!resume_enabled || !file.is_open()) return;
+        file.flush();
+        journal.save();
+        unsaved = 0;
+    };
+    // 续传时接收端已有的区间不经过数据通路，从文件读回来补进摘要
+    auto hashFromFile = [&](uint32_t end) {
+        if (batch_mode || !file.is_open()) {
+            digest_valid = false;
+            return;
+        }
+        std::vector<char> buf(DIGEST_READ_SIZE);
+        file.flush();
+        file.seekg(digest_pos);
+        while (digest_pos < end) {
+            uint32_t n = std::min(DIGEST_READ_SIZE, end - digest_pos);
+            if (!file.read(buf.data(), n)) {
+                file.clear();
+                digest_valid = false;
+                break;
+            }
+            content_digest.update(buf.data(), n);
+            digest_pos += n;
+        }
+        write_pos = UINT32_MAX;   // 读操作移动了文件位置，下次写入前重新定位
+    };
+    auto writeAt = [&](uint32_t offset, const char* data, uint32_t len) {
+        if (batch_mode) {
+            if (!batch.write(offset, data, len)) write_failed = true;
+        } else if (delta_mode) {
+            if (!delta.write(offset, data, len)) write_failed = true;
+        } else {
+            if (write_pos != offset) file.seekp(offset);
+            file.write(data, len);
+            write_pos = offset + len;
+        }
+        if (!delta_mode && digest_valid) {
+            if (offset > digest_pos) hashFromFile(offset);
+            if (offset == digest_pos) {
+                content_digest.update(data, len);
+                digest_pos += len;
+            } else {
+                digest_valid = false;
+            }
+        }
+        journal.addRange(offset, offset + len);
+        unsaved += len;
+        if (unsaved >= JOURNAL_FLUSH_BYTES) saveJournal();
+    };
+
     uint32_t total_size = 0;
     uint32_t received = 0;
     char filename_received[32] = {0};
     bool first_packet = true;
 
+    // 压缩块重组缓冲区：收齐一个压缩块后解压再写入文件
+    // 握手完成前的数据可能已经是压缩块，因此只要出现压缩块就分配缓冲区
+    std::vector<char> block_buf, raw_buf;
+
+    // 多路流：清单是流0，第i个文件是流i。包一到达就按流偏移交付给所在的流，
+    // 一条流上的空洞只阻塞它自己；连接级的recv_base只用来生成ACK和释放缓冲
+    bool multi = batch_mode && (negotiated_options & OPT_STREAMS);
+    std::map<uint16_t, InStream> streams;       // 进行中的流（收到过数据、尚未收完）
+    std::vector<char> stream_done;              // 清单解析后分配
+    std::vector<uint64_t> stream_digests;       // 各流收完时的摘要
+    bool stream_failed = false;
+    uint32_t stream_window = STREAM_WINDOW_SEGMENTS * (uint32_t)max_seg_size;
+    stream_credits.clear();
+
+    auto streamError = [&](const char* message, uint16_t id) -> bool {
+        log("[ERROR] Stream %u: %s", id, message);
+        stream_failed = true;
+        return false;
+    };
+    // 交付流内的一段原始数据
+    auto writeStream = [&](uint16_t id, InStream& st, const char* data, uint32_t len) -> bool {
+        if (!(id == 0 ? batch.writeManifest(data, len) : batch.writeFile(id - 1, data, len))) {
+            write_failed = true;
+            return false;
+        }
+        uint32_t base = id == 0 ? 0 : batch.fileOffset(id - 1);
+        journal.addRange(base + st.raw, base + st.raw + len);
+        st.digest.update(data, len);
+        st.raw += len;
+        received += len;
+        return true;
+    };
+    // 交付一个包中还没有交付的部分（发送端回退分段后，小包可能与已交付的大包重叠）
+    auto deliverPacket = [&](uint16_t id, InStream& st, const Packet& pkt) -> bool {
+        uint32_t start = pkt.header.file_offset;
+        uint32_t len = pkt.header.data_length;
+        if (start + len <= st.next) return true;
+        uint32_t skip = st.next - start;
+        st.next = start + len;
+        if (!(pkt.header.flags & FLAG_COMPRESSED)) return writeStream(id, st, pkt.data + skip, len - skip);
+
+        if (skip == 0 && (pkt.header.flags & FLAG_BLOCK_START)) st.block.clear();
+        if (st.block.size() + (len - skip) > COMPRESS_BLOCK_MAX) return streamError("compressed block too large", id);
+        st.block.insert(st.block.end(), pkt.data + skip, pkt.data + len);
+        if (!(pkt.header.flags & FLAG_BLOCK_END)) return true;
+        if (raw_buf.empty()) raw_buf.resize(COMPRESS_BLOCK_MAX);
+        int raw_len = lzDecompress(st.block.data(), (int)st.block.size(), raw_buf.data(), (int)raw_buf.size());
+        if (raw_len < 0 || raw_len != pkt.header.block_len) return streamError("decompression failed", id);
+        st.block.clear();
+        return writeStream(id, st, raw_buf.data(), raw_len);
+    };
+    // 按流偏移顺序交付流id中已经连续的包；文件流要等清单解析后才知道写到哪里
+    std::function<bool(uint16_t)> deliverStream = [&](uint16_t id) -> bool {
+        std::map<uint16_t, InStream>::iterator sit = streams.find(id);
+        if (sit == streams.end() || (id > 0 && !batch.manifestReady())) return true;
+        if (id > batch.fileCount()) return streamError("beyond the last file", id);
+        InStream& st = sit->second;
+        while (!st.pending.empty() && st.pending.begin()->first <= st.next) {
+            RecvBuffer::iterator it = recv_buffer.find(st.pending.begin()->second);
+            st.pending.erase(st.pending.begin());
+            if (it != recv_buffer.end() && !deliverPacket(id, st, *it->second)) return false;
+        }
+        if (!batch.manifestReady() || st.raw < (id == 0 ? batch.manifestSize() : batch.fileSize(id - 1))) {
+            return true;
+        }
+
+        // 流收完：记下摘要，不再跟踪
+        if (id == 0) {
+            stream_done.assign(batch.fileCount() + 1, 0);
+            stream_digests.assign(batch.fileCount() + 1, StreamDigest().digest());
+            for (size_t i = 0; i < batch.fileCount(); i++) {
+                if (batch.fileSize(i) == 0) stream_done[i + 1] = 1;   // 空文件没有自己的流
+            }
+        }
+        stream_done[id] = 1;
+        stream_digests[id] = st.digest.digest();
+        streams.erase(sit);
+        if (id == 0) {
+            // 清单收齐：此前已经到达的文件流现在可以交付
+            std::vector<uint16_t> waiting;
+            for (std::map<uint16_t, InStream>::iterator w = streams.begin(); w != streams.end(); ++w) {
+                waiting.push_back(w->first);
+            }
+            for (size_t i = 0; i < waiting.size(); i++) {
+                if (!deliverStream(waiting[i])) return false;
+            }
+        }
+        return true;
+    };
+    // 每个ACK都带上各条进行中的流的上限：已交付位置之后一个流窗口
+    auto updateCredits = [&]() {
+        stream_credits.clear();
+        for (std::map<uint16_t, InStream>::iterator it = streams.begin(); it != streams.end(); ++it) {
+            StreamCredit credit = {it->first, it->second.next + stream_window};
+            stream_credits.push_back(credit);
+        }
+    };
+
+    // 完成握手：SYN带有文件元数据时先打开输出文件，再在SYN-ACK中带回续传区间
+    std::deque<Packet> pending;
+    if (handshake_pending) {
+        if (negotiated_options & OPT_FILE_INFO) {
+            total_size = peer_file_size;
+            strncpy_s(filename_received, sizeof(filename_received), peer_filename, _TRUNCATE);
+            log("[RECV] Filename: %s", filename_received);
+            log("[RECV] File size: %u bytes", total_size);
+            first_packet = false;
+
+            // 差量传输：save_path已有文件时计算签名；有匹配的续传日志时优先续传
+            if (negotiated_options & OPT_DELTA) {
+                uint32_t basis_size = 0;
+                bool resuming = (negotiated_options & OPT_RESUME) && have_journal &&
+                                journal.matches(total_size, filename_received);
+                if (!resuming && getFileSize(save_path, basis_size) && basis_size > 0) {
+                    auto start = transport->now();
+                    delta_basis_size = basis_size;
+                    delta_block_size = deltaBlockSize(basis_size);
+                    delta_mode = computeSignature(save_path, basis_size, delta_block_size, delta_sig);
+                    log("[DELTA] Basis file: %u bytes, signature %zu bytes (block=%u) in %lld ms",
+                        basis_size, delta_sig.size(), delta_block_size,
+                        (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+                            transport->now() - start).count());
+                }
+                negotiated_options &= delta_mode ? ~OPT_RESUME : ~OPT_DELTA;
+            }
+            if (!openOutput(total_size, filename_received, (negotiated_options & OPT_RESUME) != 0)) {
+                return false;
+            }
+        }
+        sendSynAck(&journal);
+        handshake_pending = false;
+        connected = true;
+        traceEvent(TRACE_CONNECTION, TRACE_CONN_ESTABLISHED, 0, local_seq, remote_seq);
+
+        // 握手完成前已经到达的数据
+        pending.assign(early_packets.begin(), early_packets.end());
+        early_packets.clear();
+    }
+
+    Packet* rx = nullptr;  // 当前接收缓冲，被放入recv_buffer后换一个新的
+    bool complete = false; // 数据已收齐，等待发送端的FIN
+    bool digest_mismatch = false;
     while (true) {
-        Packet data_pkt;
-        if (!recvPacket(data_pkt, CONNECT_TIMEOUT_MS)) {
+        if (!rx) rx = packet_pool.acquire();
+        Packet& data_pkt = *rx;
+        if (!pending.empty()) {
+            data_pkt = pending.front();
+            pending.pop_front();
+        } else if (!recvPacket(data_pkt, RECV_IDLE_TIMEOUT_MS)) {
+            if (complete) {
+                log("[RECV] No FIN from sender, closing (digest not verified)");
+                break;
+            }
             log("[ERROR] Receive timeout");
+            packet_pool.release(rx);
+            saveJournal();
+            if (resume_enabled && file.is_open()) {
+                log("[RESUME] Journal saved (%u / %u bytes), run again to resume",
+                    journal.completedBytes(), total_size);
+            }
             file.close();
             return false;
         }
 
-        if (data_pkt.header.packet_type == PKT_DATA) {
-            // 校验和验证：header（不包括checksum字段）+ data部分
+        if (data_pkt.header.packet_type == PKT_SYN) {
+            // SYN-ACK丢失，发送端重传了SYN
+            log("[RECV] Duplicate SYN, resending SYN-ACK");
+            sendSynAck(&journal);
+
+        } else if (data_pkt.header.packet_type == PKT_PROBE) {
+            // 路径MTU探测：校验通过后回复收到的数据报大小
+            uint32_t received_checksum = data_pkt.header.checksum;
+            data_pkt.header.checksum = 0;
+            uint32_t expected = (calculateChecksum(&data_pkt.header, sizeof(data_pkt.header)) +
+                                 calculateChecksum(data_pkt.data, data_pkt.header.data_length)) & 0xFFFF;
+            if (expected != received_checksum) continue;
+
+            Packet probe_ack;
+            probe_ack.header.packet_type = PKT_PROBE_ACK;
+            probe_ack.header.seq_num = local_seq;
+            probe_ack.header.ack_num = data_pkt.wireSize();
+            probe_ack.header.checksum = 0;  // 计算前清零
+            probe_ack.header.checksum = calculateChecksum(&probe_ack.header, sizeof(probe_ack.header));
+            log("[PMTU] Probe of %u bytes received", probe_ack.header.ack_num);
+            sendPacket(probe_ack);
+
+        } else if (data_pkt.header.packet_type == PKT_SIG_REQ) {
+            // 差量传输：应答签名分片请求，重复的请求原样重发
+            uint32_t received_checksum = data_pkt.header.checksum;
+            data_pkt.header.checksum = 0;
+            if (calculateChecksum(&data_pkt.header, sizeof(data_pkt.header)) != received_checksum) continue;
+            uint32_t index = data_pkt.header.ack_num;
+            if (!delta_mode || index >= (delta_sig.size() + DATA_SIZE - 1) / DATA_SIZE) continue;
+
+            size_t offset = (size_t)index * DATA_SIZE;
+            Packet sig_pkt;
+            sig_pkt.header.packet_type = PKT_SIG;
+            sig_pkt.header.seq_num = local_seq;
+            sig_pkt.header.ack_num = index;
+            sig_pkt.header.data_length = (uint16_t)std::min<size_t>(DATA_SIZE, delta_sig.size() - offset);
+            memcpy(sig_pkt.data, delta_sig.data() + offset, sig_pkt.header.data_length);
+            sig_pkt.header.checksum = 0;  // 计算前清零
+            sig_pkt.header.checksum = (calculateChecksum(&sig_pkt.header, sizeof(sig_pkt.header)) +
+                                       calculateChecksum(sig_pkt.data, sig_pkt.header.data_length)) & 0xFFFF;
+            sendPacket(sig_pkt);
+
+        } else if (data_pkt.header.packet_type == PKT_DATA) {
+            // 校验和验证：header（checksum字段置0）+ data部分
             uint32_t received_checksum = data_pkt.header.checksum;  // 保存接收到的checksum
             data_pkt.header.checksum = 0;  // 清零后再计算
-            uint32_t header_checksum = calculateChecksum(&data_pkt.header, sizeof(data_pkt.header) - sizeof(data_pkt.header.checksum));
+            uint32_t header_checksum = calculateChecksum(&data_pkt.header, sizeof(data_pkt.header));
             uint32_t data_checksum = calculateChecksum(data_pkt.data, data_pkt.header.data_length);
             uint32_t expected = (header_checksum + data_checksum) & 0xFFFF;
 
@@ -653,12 +2051,34 @@ bool RdtSocket::recvFile(const char* save_path) {
                 continue;
             }
 
+            // 记下时间戳，由这个包触发的ACK带回（握手前暂存的包没有到达时间，也不会带时间戳）
+            ts_echo_pending = (data_pkt.header.flags & FLAG_TIMESTAMP) != 0;
+            if (ts_echo_pending) {
+                ts_recent = data_pkt.header.ts.ts_val;
+                ts_recent_rx = last_rx_time;
+            }
+
             if (!isPacketInWindow(data_pkt.header.seq_num)) {
                 log("[RECV] Packet out of window (seq=%u)", data_pkt.header.seq_num);
-                sendAckWithSack(recv_base);
+                if (data_pkt.header.seq_num < recv_base) {
+                    // 已交付的数据又到了一份：原包和重传都到达，用D-SACK告诉发送端
+                    SackBlock dup;
+                    dup.start = data_pkt.header.seq_num;
+                    dup.end = dup.start + data_pkt.header.data_length;
+                    sendAckWithSack(recv_base, &dup);
+                } else {
+                    sendAckWithSack(recv_base);
+                }
                 continue;
             }
 
+            // 差量传输：数据包的file_size是指令流长度，进度按指令流跟踪
+            if (delta_mode && !delta_sized) {
+                total_size = data_pkt.header.file_size;
+                journal.clear(total_size, filename_received);
+                delta_sized = true;
+            }
+
             if (first_packet) {
                 total_size = data_pkt.header.file_size;
                 strncpy_s(filename_received, sizeof(filename_received),
@@ -666,47 +2086,221 @@ bool RdtSocket::recvFile(const char* save_path) {
                 log("[RECV] Filename: %s", filename_received);
                 log("[RECV] File size: %u bytes", total_size);
                 first_packet = false;
+                if (!openOutput(total_size, filename_received, false)) {
+                    packet_pool.release(rx);
+                    return false;
+                }
             }
 
-            recv_buffer[data_pkt.header.seq_num] = data_pkt;
+            // 收到的包直接留在缓冲中。重复的包保留较长的一份：发送端回退分段后，
+            // 小包可能与缓冲中的大包同起点，用小包替换会丢掉已经SACK过的数据
+            Packet*& slot = recv_buffer[data_pkt.header.seq_num];
+            SackBlock dup;
+            bool duplicate = slot != nullptr;
+            if (duplicate) {
+                dup.start = data_pkt.header.seq_num;
+                dup.end = dup.start + data_pkt.header.data_length;
+            }
+            if (!slot || slot->header.data_length < data_pkt.header.data_length) {
+                packet_pool.release(slot);
+                slot = rx;
+                rx = nullptr;
+            }
+
+            // 多路流：到达时就交付给所在的流，不等前面其他流的包
+            if (multi) {
+                Packet& pkt = *slot;
+                uint16_t id = pkt.header.stream_id;
+                if (id >= stream_done.size() || !stream_done[id]) {
+                    InStream& st = streams[id];
+                    if (pkt.header.file_offset + pkt.header.data_length > st.next) {
+                        st.pending[pkt.header.file_offset] = pkt.header.seq_num;
+                    }
+                    deliverStream(id);
+                }
+                updateCredits();
+            }
 
-            while (recv_buffer.find(recv_base) != recv_buffer.end()) {
-                Packet& pkt = recv_buffer[recv_base];
-                file.write(pkt.data, pkt.header.data_length);
-                received += pkt.header.data_length;
-                log("[RECV] Progress: %u / %u bytes", received, total_size);
+            RecvBuffer::iterator it;
+            while (!stream_failed && (it = recv_buffer.find(recv_base)) != recv_buffer.end()) {
+                Packet& pkt = *it->second;
+                uint16_t len = pkt.header.data_length;
+
+                if (multi) {
+                    // 多路流的数据已经交付，这里只推进连接级的确认序号。
+                    // 同一条流的包按序号顺序发出，recv_base之前的包所在的流不会有空洞
+                    std::map<uint16_t, InStream>::iterator sit = streams.find(pkt.header.stream_id);
+                    if (sit != streams.end() && pkt.header.file_offset + len > sit->second.next) {
+                        streamError("data not deliverable in order", pkt.header.stream_id);
+                        break;
+                    }
+                } else if (pkt.header.flags & FLAG_COMPRESSED) {
+                    if (raw_buf.empty()) {
+                        block_buf.reserve(COMPRESS_BLOCK_MAX);
+                        raw_buf.resize(COMPRESS_BLOCK_MAX);
+                    }
+                    if (pkt.header.flags & FLAG_BLOCK_START) block_buf.clear();
+                    if (block_buf.size() + len > COMPRESS_BLOCK_MAX) {
+                        log("[ERROR] Compressed block too large (seq=%u)", recv_base);
+                        packet_pool.release(rx);
+                        saveJournal();
+                        file.close();
+                        return false;
+                    }
+                    block_buf.insert(block_buf.end(), pkt.data, pkt.data + len);
+
+                    if (pkt.header.flags & FLAG_BLOCK_END) {
+                        int raw_len = lzDecompress(block_buf.data(), (int)block_buf.size(),
+                                                   raw_buf.data(), (int)raw_buf.size());
+                        if (raw_len < 0 || raw_len != pkt.header.block_len ||
+                            (uint64_t)pkt.header.file_offset + raw_len > total_size) {
+                            log("[ERROR] Decompression failed (seq=%u, expected=%u, got=%d)",
+                                recv_base, pkt.header.block_len, raw_len);
+                            packet_pool.release(rx);
+                            saveJournal();
+                            file.close();
+                            return false;
+                        }
+                        writeAt(pkt.header.file_offset, raw_buf.data(), raw_len);
+                        received += raw_len;
+                        block_buf.clear();
+                    }
+                } else if ((uint64_t)pkt.header.file_offset + len <= total_size) {
+                    // 未压缩的数据直接写入文件
+                    writeAt(pkt.header.file_offset, pkt.data, len);
+                    received += len;
+                }
+                log("[RECV] Progress: %u / %u bytes", journal.completedBytes(), total_size);
 
-                recv_buffer.erase(recv_base);
-                recv_base += pkt.header.data_length;
+                recv_base += len;
+                packet_pool.release(it->second);
+                recv_buffer.erase(it);
+            }
+            // 分段大小变化后，重新切分的小包可能落在已交付的大包范围内
+            RecvBuffer::iterator stale_end = recv_buffer.lower_bound(recv_base);
+            for (it = recv_buffer.begin(); it != stale_end; ++it) {
+                packet_pool.release(it->second);
+            }
+            recv_buffer.erase(recv_buffer.begin(), stale_end);
+
+            if (write_failed || stream_failed) {
+                if (write_failed) {
+                    log("[ERROR] Output failed: %s",
+                        batch_mode ? batch.lastError().c_str() : delta.lastError().c_str());
+                }
+                packet_pool.release(rx);
+                return false;
             }
 
-            sendAckWithSack(recv_base);
+            sendAckWithSack(recv_base, duplicate ? &dup : nullptr);
 
-            if (received >= total_size) {
-                log("[RECV] All data received");
-                break;
+            // 收齐后不立即退出：最后的ACK或SYN-ACK可能丢失，发送端还会重传
+            if (!complete && journal.isComplete()) {
+                log("[RECV] All data received, waiting for FIN");
+                complete = true;
             }
 
         } else if (data_pkt.header.packet_type == PKT_FIN) {
+            // 带摘要的FIN校验header + data；不带数据的FIN（旧版本发送端）保持原样
+            bool has_digest = data_pkt.header.data_length == DIGEST_SIZE;
+            if (has_digest) {
+                uint32_t received_checksum = data_pkt.header.checksum;
+                data_pkt.header.checksum = 0;
+                uint32_t expected = (calculateChecksum(&data_pkt.header, sizeof(data_pkt.header)) +
+                                     calculateChecksum(data_pkt.data, DIGEST_SIZE)) & 0xFFFF;
+                if (expected != received_checksum) continue;   // 等发送端重发
+            }
             log("[RECV] Received FIN");
 
+            // 数据已全部写入：补上结尾处续传前已有的部分，得到整个文件的摘要
+            uint64_t digest = 0;
+            bool have_digest = false;
+            if (has_digest && journal.isComplete()) {
+                if (delta_mode) {
+                    digest = delta.digest();
+                    have_digest = true;
+                } else if (multi) {
+                    // 多路流：各流的摘要依次连起来再取摘要（与发送端相同）
+                    StreamDigest combined;
+                    for (size_t i = 0; i < stream_digests.size(); i++) {
+                        char part[DIGEST_SIZE];
+                        putDigest(part, stream_digests[i]);
+                        combined.update(part, DIGEST_SIZE);
+                    }
+                    digest = combined.digest();
+                    have_digest = std::find(stream_done.begin(), stream_done.end(), 0) == stream_done.end();
+                } else {
+                    if (digest_valid && digest_pos < total_size) hashFromFile(total_size);
+                    digest = content_digest.digest();
+                    have_digest = digest_valid;
+                }
+            }
+
             Packet fin_ack;
             fin_ack.header.packet_type = PKT_FIN_ACK;
             fin_ack.header.seq_num = local_seq;
             fin_ack.header.ack_num = data_pkt.header.seq_num;
+            if (have_digest) {
+                putDigest(fin_ack.data, digest);
+                fin_ack.header.data_length = DIGEST_SIZE;
+            }
             fin_ack.header.checksum = 0;  // 计算前清零
             fin_ack.header.checksum = calculateChecksum(&fin_ack.header,
-                                                       sizeof(fin_ack.header) - sizeof(fin_ack.header.checksum));
+                                                       sizeof(fin_ack.header));
+            if (have_digest) {
+                fin_ack.header.checksum = (fin_ack.header.checksum +
+                                           calculateChecksum(fin_ack.data, DIGEST_SIZE)) & 0xFFFF;
+            }
             sendPacket(fin_ack);
 
+            if (has_digest && !have_digest) {
+                log("[RECV] Digest not verified (cannot compute local digest)");
+            } else if (has_digest && getDigest(data_pkt.data) == digest) {
+                log("[RECV] Digest: match (%016llx)", (unsigned long long)digest);
+            } else if (has_digest) {
+                log("[ERROR] Digest mismatch: sender %016llx, received %016llx",
+                    (unsigned long long)getDigest(data_pkt.data), (unsigned long long)digest);
+                digest_mismatch = true;
+            }
+
             connected = false;
+            traceEvent(TRACE_CONNECTION, TRACE_CONN_CLOSED, 0, local_seq, remote_seq);
             break;
         }
     }
+    packet_pool.release(rx);
+
+    // 文件完整则删除日志，否则保留以便下次续传
+    if (!first_packet && journal.isComplete()) {
+        journal.remove();
+    } else {
+        saveJournal();
+    }
+    if (!file.is_open() && first_packet) {
+        // 没有收到任何数据（空文件），仍然创建输出文件
+        openOutput(0, "", false);
+    }
 
     file.close();
+    if (digest_mismatch) {
+        // 内容与发送端不一致：差量传输不替换基准文件，普通传输保留文件供检查
+        if (delta_mode) delta.abort();
+        return false;
+    }
+    if (delta_mode) {
+        if (!delta_sized || !journal.isComplete() || !delta.finish()) {
+            log("[ERROR] Delta reconstruction failed: %s",
+                delta_sized && journal.isComplete() ? delta.lastError().c_str() : "stream incomplete");
+            return false;
+        }
+        log("[DELTA] Rebuilt %u bytes: %u copied from basis file, %u literal",
+            delta.targetSize(), delta.copiedBytes(), delta.literalBytes());
+    }
     log("[RECV] File received successfully");
     log("[RECV] Received: %u bytes", received);
+    if (batch_mode) {
+        log("[RECV] Files: %zu / %zu written to %s", batch.filesDone(), batch.fileCount(), save_path);
+    }
     log("[RECV] Connection closed");
     log("==========================================\n");
 
@@ -714,6 +2308,11 @@ bool RdtSocket::recvFile(const char* save_path) {
 }
 
 bool RdtSocket::close() {
+    if (trace) {
+        log("[TRACE] %llu events recorded", (unsigned long long)trace->recorded());
+        trace->close();
+        trace.reset();
+    }
     if (sock != INVALID_SOCKET) {
         closesocket(sock);
         sock = INVALID_SOCKET;
@@ -727,10 +2326,10 @@ int RdtSocket::sendData(const void* data, size_t length) {
     pkt.header.packet_type = PKT_DATA;
     pkt.header.seq_num = local_seq;
     pkt.header.ack_num = recv_base;
-    pkt.header.data_length = std::min(length, (size_t)DATA_SIZE);
+    pkt.header.data_length = std::min(length, (size_t)seg_size);
     memcpy(pkt.data, data, pkt.header.data_length);
     pkt.header.checksum = 0;  // 计算前清零
-    pkt.header.checksum = calculateChecksum(&pkt.header, sizeof(pkt.header) - 4) +
+    pkt.header.checksum = calculateChecksum(&pkt.header, sizeof(pkt.header)) +
                           calculateChecksum(pkt.data, pkt.header.data_length);
 
     return sendPacket(pkt) ? pkt.header.data_length : -1;
@@ -2,20 +2,87 @@
 #define RDT_SOCKET_H
 
 #include "protocol.h"
+#include "journal.h"
+#include "batch.h"
+#include "delta.h"
+#include "transport.h"
+#include "packet_pool.h"
+#include "event_trace.h"
 #include <winsock2.h>
 #include <queue>
 #include <map>
 #include <chrono>
 #include <set>
+#include <memory>
+#include <vector>
+
+// 发送端的传输统计
+struct TransferStats {
+    uint32_t timeout_retransmits;    // 超时重传的包数
+    uint32_t fast_retransmits;       // 快速重传（RACK判定丢失）的包数
+    uint32_t dsacks_received;        // 收到的D-SACK报告数
+    uint32_t spurious_timeouts;      // 被D-SACK证明多余的超时恢复次数
+    uint32_t spurious_fast_retransmits;  // 被D-SACK证明多余的快速恢复次数
+    uint32_t tail_loss_probes;       // 发出的尾部探测数
+    uint32_t rtt_samples;            // 得到的RTT样本数（协商时间戳后每个ACK一个）
+};
+
+// 一轮丢包恢复（从第一次重传开始），用于判断重传是否多余
+struct RecoveryEpisode {
+    bool armed;                  // 本轮还可以撤销
+    bool had_timeout;            // 本轮包含超时重传（否则只有快速重传）
+    uint32_t prior_cwnd;         // 重传前的cwnd
+    uint32_t prior_ssthresh;     // 重传前的ssthresh
+    uint32_t start;              // 本轮开始时最早未确认的序号
+    uint32_t high;               // 本轮开始时已发送的最高序号
+    uint32_t retrans;            // 尚未被D-SACK证明多余的重传次数
+};
 
 // 发送窗口中的包信息
 struct SendWindowEntry {
-    Packet packet;
+    Packet* packet;              // 指向packet_pool中的缓冲
     std::chrono::steady_clock::time_point send_time;
     uint32_t retransmit_count;
 };
 
+// 发送端的一条流：数据源、读取与分块压缩的进度（多路流时清单和每个文件各一条，否则只有一条）
+struct OutStream {
+    StreamSource* source;            // 数据源，多路流时开始发送才打开，读完即关闭
+    std::unique_ptr<StreamSource> owned;
+    uint32_t size;                   // 原始字节数
+    uint32_t sent;                   // 已读取的原始字节数
+    uint32_t offset;                 // 已发出的线上字节数（多路流的流偏移）
+    uint32_t end_seq;                // 本流最后一个包之后的连接序号
+    StreamDigest digest;             // 已读出内容的摘要
+
+    // 分块压缩：当前块的待发送数据（压缩后或原始）及发送进度
+    std::vector<char> block_raw, block_comp;
+    const char* block_data;
+    uint32_t block_data_len;
+    uint32_t block_pos;
+    uint16_t block_raw_len;
+    uint32_t block_offset;
+    bool block_compressed;
+
+    OutStream() : source(nullptr), size(0), sent(0), offset(0), end_seq(0), block_data(nullptr),
+                  block_data_len(0), block_pos(0), block_raw_len(0), block_offset(0), block_compressed(false) {}
+    bool pending() const { return sent < size || block_pos < block_data_len; }
+};
+
+// 接收端的一条流（多路流）：按流偏移独立地按序交付，不等其他流
+struct InStream {
+    uint32_t next;                           // 下一个待交付的流偏移（线上字节）
+    uint32_t raw;                            // 已交付的原始字节数
+    std::map<uint32_t, uint32_t> pending;    // 流内乱序到达的包：流偏移 -> 连接序号（包在recv_buffer中）
+    std::vector<char> block;                 // 正在重组的压缩块
+    StreamDigest digest;                     // 已交付内容的摘要
+
+    InStream() : next(0), raw(0) {}
+};
+
 class RdtSocket {
+    friend class RdtBenchmark;   // bench/bench_rdt.cpp 直接测量内部的SACK生成
+
 public:
     // 构造和析构
     RdtSocket();
@@ -34,13 +101,34 @@ public:
 
     // 文件传输
     bool sendFile(const char* filename);
-    bool recvFile(const char* save_path);
+    bool sendFiles(const std::vector<BatchFile>& files, const char* batch_name);  // 多个文件共用一个连接
+    bool recvFile(const char* save_path);       // 对端发送多个文件时save_path作为目录
+
+    // 可选功能（需在connect/accept之前设置）
+    void setCompression(bool enable, uint16_t block_size = COMPRESS_BLOCK_DEFAULT);
+    void setResume(bool enable);
+    void setMaxSegment(uint16_t max_payload);   // 本端允许的最大数据负载（字节）
+    void setDelta(bool enable);                 // 接收端已有旧文件时只传输变化的部分
+
+    // 替换传输与时钟（模拟器使用，需在connect/listen之前设置，不转移所有权）
+    void setTransport(RdtTransport* custom_transport);
+    void setLogging(bool enable) { logging_enabled = enable; }
+    bool setTrace(const char* path);            // 把连接事件记录到文件（见event_trace.h），accept后随连接转移
 
     // 状态查询
     bool isConnected() const { return connected; }
     SOCKET getRawSocket() const { return sock; }
     uint32_t getLocalSeq() const { return local_seq; }
     uint32_t getRemoteSeq() const { return remote_seq; }
+    uint8_t getNegotiatedOptions() const { return negotiated_options; }
+    uint16_t getSegmentSize() const { return seg_size; }
+    uint32_t getCwnd() const { return cwnd; }
+    uint32_t getSsthresh() const { return ssthresh; }
+    const TransferStats& getStats() const { return stats; }
+    uint32_t getSrttUs() const { return srtt_us; }
+    uint32_t getMinRttUs() const { return min_rtt_us; }
+    uint32_t getRttVarUs() const { return rttvar_us; }
+    uint32_t getRtoMs() const { return rto_ms; }
 
 private:
     // Socket相关
@@ -48,6 +136,9 @@ private:
     sockaddr_in local_addr;
     sockaddr_in remote_addr;
     bool connected;
+    UdpTransport udp_transport;  // 默认传输：本对象的UDP套接字
+    RdtTransport* transport;     // 实际使用的传输与时钟
+    bool logging_enabled;
 
     // 序列号和确认号
     uint32_t local_seq;          // 本地发送的下一个序列号
@@ -56,14 +147,25 @@ private:
 
     // ===== 发送窗口管理（流水线 + 选择确认） =====
     uint32_t send_base;                              // 发送窗口的基序号（已确认的最高序号）
-    std::map<uint32_t, SendWindowEntry> send_window; // 发送窗口中的包
+
+    // ===== 包缓冲与容器节点（须在使用它们的容器之前构造） =====
+    PacketPool packet_pool;                          // 发送窗口和接收缓冲区共用的包缓冲
+    NodeCache node_cache;                            // 窗口容器的节点回收
+
+    typedef std::map<uint32_t, SendWindowEntry, std::less<uint32_t>,
+                     CachedAllocator<std::pair<const uint32_t, SendWindowEntry> > > SendWindow;
+    typedef std::map<uint32_t, Packet*, std::less<uint32_t>,
+                     CachedAllocator<std::pair<const uint32_t, Packet*> > > RecvBuffer;
+    typedef std::set<uint32_t, std::less<uint32_t>, CachedAllocator<uint32_t> > SeqSet;
+
+    SendWindow send_window;                          // 发送窗口中的包
     std::set<uint32_t> acked_packets;                // 已确认的包序号（用于选择确认）
 
     // ===== 接收缓冲区（支持乱序接收） =====
-    std::map<uint32_t, Packet> recv_buffer;          // 接收缓冲区（用于乱序数据）
+    RecvBuffer recv_buffer;                          // 接收缓冲区（用于乱序数据），包缓冲来自packet_pool
 
     // ===== 发送端SACK追踪 =====
-    std::set<uint32_t> sacked_packets;               // 通过SACK确认的包序号（不连续的部分）
+    SeqSet sacked_packets;                           // 通过SACK确认的包序号（不连续的部分）
 
     // ===== 拥塞控制（RENO算法） =====
     CongestionState cong_state;   // 拥塞控制状态
@@ -73,9 +175,82 @@ private:
     uint32_t last_ack_seq;         // 上次ACK的序列号
     uint32_t ca_acc;               // 拥塞避免累加器（定点数实现）
 
+    // ===== 伪重传检测与拥塞状态撤销（D-SACK） =====
+    // 接收端对每个重复收到的包回一个D-SACK；一轮恢复中的每次重传都被D-SACK证明多余时
+    // （原包其实已经到达），恢复到重传前的拥塞状态。ACK越过本轮的high后再次重传开始新一轮，
+    // 上一轮的D-SACK可能在新一轮开始后才到达，所以保留两轮
+    RecoveryEpisode episodes[2];   // [0]当前轮次，[1]上一轮
+
+    // ===== RTT估计 =====
+    // 协商了时间戳选项时每个ACK都是一个样本（包括重传包的ACK），
+    // 否则只用没有重传过的包（Karn算法）
+    uint32_t srtt_us;              // 平滑RTT（微秒，0表示还没有样本）
+    uint32_t rttvar_us;            // RTT平均偏差（微秒）
+    uint32_t min_rtt_us;           // 最小RTT（微秒）
+    uint32_t rto_ms;               // 当前重传超时（毫秒）
+    uint32_t consecutive_rtos;     // 上一个新ACK之后的连续超时次数
+    std::chrono::steady_clock::time_point last_rx_time;   // recvPacket收到的最近一个数据报的到达时间
+    bool ts_echo_pending;          // 接收端：下一个ACK要带回的时间戳
+    uint32_t ts_recent;            // 接收端：触发下一个ACK的DATA包的ts_val
+    std::chrono::steady_clock::time_point ts_recent_rx;   // 接收端：该DATA包的到达时间
+
+    // ===== RACK丢包检测与尾部丢包探测 =====
+    std::chrono::steady_clock::time_point rack_xmit_time;   // 已送达的包中最晚发送的那个的发送时间
+    uint32_t rack_end_seq;         // 该包的结束序号（发送时间相同时用来比较先后）
+    uint32_t rack_rtt_us;          // 该包的RTT（微秒）
+    uint32_t rack_reo_mult;        // 乱序窗口倍数，min_rtt/4为一倍
+    bool in_recovery;              // 正处于快速恢复（一轮只降一次窗口）
+    uint32_t recovery_high;        // 进入快速恢复时已发送的最高序号，ACK越过它即退出
+    bool tlp_pending;              // 尾部探测已发出，等待ACK前进
+    std::chrono::steady_clock::time_point last_activity_time;   // 最近一次发送新数据或收到ACK的时间
+    TransferStats stats;
+
+    // ===== 连接选项协商 =====
+    bool compress_enabled;         // 本端是否支持/请求分块压缩
+    uint16_t compress_block_size;  // 压缩块大小（协商后以SYN-ACK为准）
+    bool resume_enabled;           // 本端是否支持/请求断点续传
+    bool delta_enabled;            // 本端是否支持/请求差量传输
+    uint8_t negotiated_options;    // 双方协商后的连接选项
+
+    // ===== 0-RTT连接建立 =====
+    bool handshake_pending;                          // 发送端：SYN已发未收到SYN-ACK；接收端：SYN-ACK未发
+    Packet syn_packet;                               // 发送端：待重传的SYN
+    std::chrono::steady_clock::time_point syn_first_time;
+    std::chrono::steady_clock::time_point syn_last_time;
+    std::vector<SackBlock> resume_ranges;            // 发送端：SYN-ACK带回的已完成区间
+    bool resume_ranges_ready;                        // resume_ranges是否有待sendFile处理的新内容
+    uint32_t peer_file_size;                         // 接收端：SYN中的文件大小
+    char peer_filename[32];                          // 接收端：SYN中的文件名
+    std::vector<Packet> early_packets;               // 接收端：SYN之前到达的数据包
+
+    // ===== 差量传输 =====
+    uint32_t delta_basis_size;                       // 接收端基准文件（旧文件）的大小
+    uint32_t delta_block_size;                       // 签名的块大小（由接收端决定）
+
+    // ===== 多路流 =====
+    std::vector<uint32_t> stream_limits;             // 发送端：各流的流量控制上限（流偏移），随ACK更新
+    std::vector<StreamCredit> stream_credits;        // 接收端：随每个ACK通告的各流上限
+
+    // ===== 分段大小协商与路径MTU探测 =====
+    uint16_t max_seg_size;         // 最大数据负载（协商后取双方上限的较小值）
+    uint16_t seg_size;             // 当前数据包负载大小，从DATA_SIZE开始，探测成功后增大
+    int probe_level;               // 下一个待探测的PMTU_PROBE_SIZES下标
+    uint16_t probe_size;           // 在途探测包的数据报大小，0表示没有在途探测
+    uint32_t probe_count;          // 当前尺寸已发送的探测次数
+    std::chrono::steady_clock::time_point probe_time;
+    bool probe_done;               // 探测结束（到达上限、探测失败或检测到黑洞）
+
+    // ===== 事件记录 =====
+    std::unique_ptr<EventTrace> trace;             // 没有开启时为空，记录点只多一次判断
+    uint32_t traced_cwnd;                          // 上次记录的拥塞状态，变化时才记录
+    uint32_t traced_ssthresh;
+    uint16_t traced_seg_size;
+    uint8_t traced_state;
+
     // 辅助函数
     bool sendPacket(const Packet& pkt);
     bool recvPacket(Packet& pkt, uint32_t timeout_ms = TIMEOUT_MS);
+    void setSocketOptions();                    // 设置收发缓冲区和不分片标志
 
     // 窗口管理相关
     uint32_t getEffectiveWindow();              // 获取有效发送窗口（考虑拥塞控制）
@@ -85,26 +260,58 @@ private:
     void processAck(uint32_t ack_seq);          // 处理ACK包
 
     // 重传相关
-    void retransmitPackets();                   // 检查超时并重传
+    void retransmitPackets();                   // 尾部探测、RACK丢包检测和超时重传
     bool isTimerExpired(uint32_t seq);          // 检查计时器是否超时
+    void rackOnDelivered(const SendWindowEntry& entry, uint32_t seq);  // 包被确认/SACK时更新RACK状态
+    void rackDetectLoss();                      // 重传RACK判定丢失的包
+    void tailLossProbe();                       // 一段时间没有ACK时重发最后一个未确认的包
+    void onRttSample(uint32_t rtt_us);          // 更新srtt/rttvar/min_rtt并重新计算RTO
+    void stampTimestamp(Packet& pkt);           // 协商了时间戳时写入发送时刻（校验和随之更新）
 
     // 拥塞控制相关（RENO）
     void onNewAck();                            // 收到新的ACK
     void onDuplicateAck();                      // 收到重复ACK
     void onTimeout();                           // 超时事件
+    void onRetransmit(uint32_t seq, bool timeout);   // 记录一次重传，必要时开始新的恢复轮次
+    void onDsack(const SackBlock& block);            // 处理D-SACK，本轮重传全部多余时撤销
     void updateCongestionWindow();              // 更新拥塞窗口
 
-    // 连接建立
-    bool sendSyn();
-    bool sendSynAck();
+    // 文件传输
+    bool sendStream(StreamSource& source, const char* name, uint8_t syn_options);   // 单一字节流
+    bool sendStreams(std::vector<OutStream>& streams, const BatchSource* batch, uint32_t total_size,
+                     const char* name, uint8_t syn_options);   // 发送的主循环；多路流时按需从batch打开各流
+    bool fetchSignature(std::vector<char>& sig);    // 差量传输：从接收端分片拉取基准文件的签名
+    bool sendSigRequest(uint32_t index);            // 请求第index个签名分片
+
+    // 连接建立（0-RTT）
+    bool sendSyn(uint32_t file_size, const char* filename, uint8_t extra_options);   // 发送携带文件元数据的SYN
+    bool sendSynAck(const ReceiveJournal* journal);           // 回复SYN-ACK（可带断点续传区间）
+    bool checkHandshake();                                    // 重传SYN，握手超时返回false
+    bool checkProgress();                                     // 连续超时过多（接收端已不在）返回false
+    bool waitHandshake();                                     // 等待SYN-ACK（不发送0-RTT数据时）
+    void handleAckPacket(Packet& pkt);                        // 发送端处理ACK/SYN-ACK
     bool sendFin();
     bool sendFinAck();
     bool sendAck(uint32_t ack_seq);            // 发送ACK包
-    bool sendAckWithSack(uint32_t ack_seq);    // 发送带SACK块的ACK包
+    bool sendAckWithSack(uint32_t ack_seq, const SackBlock* dsack = nullptr);  // 发送带SACK块的ACK包（可带D-SACK）
+
+    // 路径MTU探测
+    void pmtuProbe();                           // 发送/重发探测包，探测失败时停止
+    bool sendProbe();                           // 发送probe_size大小的探测包
+    void fallbackToBaseSegment();               // 大包疑似被黑洞丢弃，回退到DATA_SIZE并重新切分在途包
+
+    // 选项协商
+    uint8_t localOptions() const;               // 本端支持的选项
 
     // SACK相关
     void generateSackBlocks(SackBlock* blocks, uint8_t& count);  // 从recv_buffer生成SACK块
 
+    // 事件记录
+    void traceEvent(uint8_t type, uint8_t info, uint16_t len, uint32_t a, uint32_t b) {
+        if (trace) trace->record(transport->now(), type, info, len, a, b);
+    }
+    void traceMetrics();                        // cwnd/ssthresh/拥塞状态/分段大小有变化时记录
+
     // 日志输出
     void log(const char* format, ...);
     void logPacketHeader(const char* label, const PacketHeader& header);
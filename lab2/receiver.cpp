@@ -6,7 +6,9 @@
 #pragma comment(lib, "ws2_32.lib")
 
 void printUsage(const char* prog_name) {
-    printf("Usage: %s <local_port> <save_file_path>\n", prog_name);
+    printf("Usage: %s <local_port> <save_file_path> [-q <trace_file>]\n", prog_name);
+    printf("  When the sender sends a directory, save_file_path is created as a directory\n");
+    printf("  -q records connection events (convert with trace_dump)\n");
     printf("Example: %s 5001 l2/received.jpg\n", prog_name);
 }
 
@@ -20,7 +22,8 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    if (argc != 3) {
+    bool has_trace = argc == 5 && strcmp(argv[3], "-q") == 0;
+    if (argc != 3 && !has_trace) {
         printf("[ERROR] Invalid parameters\n");
         printUsage(argv[0]);
         WSACleanup();
@@ -35,6 +38,13 @@ int main(int argc, char* argv[]) {
     printf("========================================\n\n");
 
     RdtSocket receiver;
+    receiver.setCompression(true);  // 接收端总是接受发送端提出的压缩
+    receiver.setResume(true);       // 保存接收日志，支持断点续传
+    receiver.setDelta(true);        // 保存路径已有文件时，发送端可以只发变化的部分
+    if (has_trace && !receiver.setTrace(argv[4])) {
+        WSACleanup();
+        return 1;
+    }
 
     if (!receiver.listen(local_port)) {
         printf("[ERROR] Failed to listen on port\n");
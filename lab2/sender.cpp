@@ -1,13 +1,34 @@
 #include "rdt_socket.h"
 #include <iostream>
 #include <cstring>
+#include <cstdlib>
+#include <cerrno>
 #include <winsock2.h>
 
 #pragma comment(lib, "ws2_32.lib")
 
 void printUsage(const char* prog_name) {
-    printf("Usage: %s <file_path> <receiver_ip> <receiver_port>\n", prog_name);
-    printf("Example: %s l2/testfile/helloworld.txt 127.0.0.1 5001\n", prog_name);
+    printf("Usage: %s <file_path> <receiver_ip> <receiver_port> [options]\n", prog_name);
+    printf("  <file_path> may be a directory or @<list_file> (one path per line) to send\n");
+    printf("  many files over one connection; the receiver saves them under its save path\n");
+    printf("Options:\n");
+    printf("  -z [block_kb]   Enable block compression (default block: %u KB)\n",
+           COMPRESS_BLOCK_DEFAULT / 1024);
+    printf("  -r              Resume: skip ranges the receiver already has\n");
+    printf("  -d              Delta: send only what changed against the receiver's existing copy\n");
+    printf("  -m <bytes>      Max payload per packet (%u-%u, default %u; probing finds the path limit)\n",
+           DATA_SIZE, MAX_DATA_SIZE, MAX_DATA_SIZE);
+    printf("  -q <file>       Record connection events (convert with trace_dump)\n");
+    printf("Example: %s l2/testfile/helloworld.txt 127.0.0.1 5001 -z 16 -r\n", prog_name);
+    printf("Example: %s l2/testfile 127.0.0.1 5001 -z\n", prog_name);
+}
+
+// 解析[min_value, max_value]内的十进制整数，不是数字或超出范围时返回false
+bool parseBounded(const char* text, long min_value, long max_value, long& value) {
+    char* end = nullptr;
+    errno = 0;
+    value = strtol(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0 && value >= min_value && value <= max_value;
 }
 
 int main(int argc, char* argv[]) {
@@ -20,7 +41,7 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    if (argc != 4) {
+    if (argc < 4) {
         printf("[ERROR] Invalid parameters\n");
         printUsage(argv[0]);
         WSACleanup();
@@ -37,6 +58,61 @@ int main(int argc, char* argv[]) {
 
     RdtSocket sender;
 
+    // 解析可选参数
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "-z") == 0) {
+            uint16_t block_size = COMPRESS_BLOCK_DEFAULT;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                long block_kb;
+                if (!parseBounded(argv[++i], COMPRESS_BLOCK_MIN / 1024, COMPRESS_BLOCK_MAX / 1024, block_kb)) {
+                    printf("[ERROR] Invalid block size: %s KB (%u-%u)\n", argv[i],
+                           COMPRESS_BLOCK_MIN / 1024, COMPRESS_BLOCK_MAX / 1024);
+                    printUsage(argv[0]);
+                    WSACleanup();
+                    return 1;
+                }
+                block_size = (uint16_t)(block_kb * 1024);
+            }
+            sender.setCompression(true, block_size);
+        } else if (strcmp(argv[i], "-r") == 0) {
+            sender.setResume(true);
+        } else if (strcmp(argv[i], "-d") == 0) {
+            sender.setDelta(true);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            long max_payload;
+            if (!parseBounded(argv[++i], DATA_SIZE, MAX_DATA_SIZE, max_payload)) {
+                printf("[ERROR] Invalid max payload: %s bytes (%u-%u)\n", argv[i], DATA_SIZE, MAX_DATA_SIZE);
+                printUsage(argv[0]);
+                WSACleanup();
+                return 1;
+            }
+            sender.setMaxSegment((uint16_t)max_payload);
+        } else if (strcmp(argv[i], "-q") == 0 && i + 1 < argc) {
+            if (!sender.setTrace(argv[++i])) {
+                WSACleanup();
+                return 1;
+            }
+        } else {
+            printf("[ERROR] Unknown option: %s\n", argv[i]);
+            printUsage(argv[0]);
+            WSACleanup();
+            return 1;
+        }
+    }
+
+    // 目录或文件列表：所有文件在一个连接中发送
+    std::vector<BatchFile> batch;
+    bool is_batch = file_path[0] == '@' || isDirectory(file_path);
+    if (is_batch) {
+        bool ok = file_path[0] == '@' ? collectList(file_path + 1, batch) : collectDirectory(file_path, batch);
+        if (!ok) {
+            printf("[ERROR] Cannot read %s\n", file_path);
+            WSACleanup();
+            return 1;
+        }
+        printf("[*] Sending %zu files from %s\n", batch.size(), file_path);
+    }
+
     if (!sender.bind("127.0.0.1", 0)) {
         printf("[ERROR] Failed to bind local address\n");
         WSACleanup();
@@ -50,7 +126,8 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    if (!sender.sendFile(file_path)) {
+    bool ok = is_batch ? sender.sendFiles(batch, baseName(file_path).c_str()) : sender.sendFile(file_path);
+    if (!ok) {
         printf("[ERROR] File transfer failed\n");
         sender.close();
         WSACleanup();
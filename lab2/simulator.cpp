@@ -0,0 +1,590 @@
+#include "rdt_socket.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <winsock2.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+// ===== RDT协议离散事件模拟器 =====
+//
+// 发送端和接收端的RdtSocket通过SimEndpoint（实现RdtTransport）接入模拟网络，
+// 时间完全是虚拟的：两端都在等待数据报时，调度器直接跳到下一个事件（数据报到达或等待超时）。
+// 每端运行在自己的线程里，但任一时刻只有一个线程在执行（接力棒式调度），
+// 加上确定性的随机数，同样的参数和种子总是得到完全相同的结果。
+//
+// 链路模型（每个方向独立）：带宽（串行化时延）+ 尾部丢弃的队列 + 随机丢包 + 单向传播时延。
+
+const uint64_t SIM_START_US = 1000000;             // 虚拟时钟起点（避免与默认构造的时间点重合）
+const uint64_t SIM_TIME_LIMIT_US = 3600ULL * 1000000;  // 单次模拟的虚拟时间上限
+const uint64_t SIM_NEVER = ~0ULL;
+const uint32_t UDP_IP_OVERHEAD = 28;               // 每个数据报的IP+UDP头部开销
+
+// 确定性随机数（xorshift64*），不依赖标准库分布的实现
+class SimRandom {
+public:
+    explicit SimRandom(uint64_t seed) : state(seed * 2685821657736338717ULL + 1) {}
+
+    uint64_t next() {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 2685821657736338717ULL;
+    }
+
+    // [0, 1) 均匀分布
+    double uniform() {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    uint64_t state;
+};
+
+// 链路参数
+struct LinkConfig {
+    double bandwidth_mbps;   // 带宽，0表示不限
+    uint32_t delay_ms;       // 单向传播时延
+    double loss;             // 随机丢包率
+    uint32_t queue_bytes;    // 瓶颈队列大小
+};
+
+// 模拟参数
+struct SimConfig {
+    LinkConfig link;
+    bool compress;
+    uint16_t max_segment;
+};
+
+// 单次模拟的结果
+struct SimResult {
+    bool ok;
+    uint64_t complete_us;    // 接收端收齐文件的虚拟时间（从开始算）
+    uint32_t datagrams;      // 发出的数据报总数
+    uint32_t lost;           // 随机丢失的数据报
+    uint32_t queue_drops;    // 队列溢出丢弃的数据报
+    uint32_t final_cwnd;
+    uint32_t retransmits;    // 发送端重传的包数（超时+快速重传）
+    uint32_t spurious;       // 被D-SACK证明多余并撤销的恢复次数
+    uint32_t srtt_us;        // 发送端结束时的平滑RTT
+    uint32_t rtt_samples;    // 发送端得到的RTT样本数
+};
+
+class SimNetwork;
+
+// 模拟网络中的一个端点
+class SimEndpoint : public RdtTransport {
+public:
+    SimEndpoint(SimNetwork& net, int id) : net(net), id(id) {}
+
+    TimePoint now();
+    bool sendTo(const void* data, int len, const sockaddr_in& to);
+    int recvFrom(void* buffer, int capacity, sockaddr_in& from, uint32_t timeout_ms,
+                 TimePoint* rx_time = nullptr);
+
+private:
+    SimNetwork& net;
+    int id;
+};
+
+class SimNetwork {
+public:
+    static const int ENDPOINTS = 2;
+
+    SimNetwork(const LinkConfig& link, uint64_t seed)
+        : link(link), rng(seed), now_us(SIM_START_US), order(0), running(-1), shutdown(false),
+          observed(nullptr), trace(nullptr), trace_last_us(0), delivered_bytes(0), trace_bytes(0),
+          datagrams(0), lost(0), queue_drops(0) {
+        for (int i = 0; i < ENDPOINTS; i++) {
+            memset(&addrs[i], 0, sizeof(addrs[i]));
+            link_free_us[i] = 0;
+            waiting[i] = false;
+            done[i] = false;
+            deadline_us[i] = SIM_NEVER;
+        }
+    }
+
+    void setAddress(int id, const char* ip, uint16_t port) {
+        addrs[id].sin_family = AF_INET;
+        addrs[id].sin_addr.s_addr = inet_addr(ip);
+        addrs[id].sin_port = htons(port);
+    }
+
+    // 跟踪发送端的拥塞窗口和接收端的到达速率
+    void setTrace(FILE* fp, const RdtSocket* sender) {
+        trace = fp;
+        observed = sender;
+        if (trace) fprintf(trace, "time_ms,cwnd,ssthresh,srtt_ms,rto_ms,delivered_bytes,throughput_mbps\n");
+    }
+
+    uint64_t nowUs() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return now_us;
+    }
+
+    uint64_t elapsedUs() {
+        return nowUs() - SIM_START_US;
+    }
+
+    // 发送一个数据报：经过发送方向的链路后加入事件队列
+    bool transmit(int src, const void* data, int len, const sockaddr_in& to) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int dst = -1;
+        for (int i = 0; i < ENDPOINTS; i++) {
+            if (addrs[i].sin_addr.s_addr == to.sin_addr.s_addr && addrs[i].sin_port == to.sin_port) {
+                dst = i;
+            }
+        }
+        if (dst < 0 || dst == src) return true;  // 无人监听的地址，静默丢弃
+        datagrams++;
+        sampleTrace();
+
+        // 瓶颈队列：按尚未发送完的字节数判断是否溢出
+        uint64_t wire_len = len + UDP_IP_OVERHEAD;
+        uint64_t start_us = std::max(now_us, link_free_us[src]);
+        if (link.bandwidth_mbps > 0) {
+            double backlog_bytes = (start_us - now_us) * link.bandwidth_mbps / 8.0;
+            if (backlog_bytes + wire_len > link.queue_bytes) {
+                queue_drops++;
+                return true;
+            }
+            link_free_us[src] = start_us + (uint64_t)(wire_len * 8.0 / link.bandwidth_mbps);
+        } else {
+            link_free_us[src] = start_us;
+        }
+
+        // 随机丢包发生在链路上，数据报仍然占用了带宽
+        if (rng.uniform() < link.loss) {
+            lost++;
+            return true;
+        }
+
+        Delivery d;
+        d.time_us = link_free_us[src] + link.delay_ms * 1000ULL;
+        d.order = order++;
+        d.dst = dst;
+        d.from = addrs[src];
+        d.data.assign((const char*)data, (const char*)data + len);
+        events.push(d);
+        return true;
+    }
+
+    // 等待数据报；收件箱为空时把执行权交还调度器，直到数据报到达或超时
+    int receive(int id, void* buffer, int capacity, sockaddr_in& from, uint32_t timeout_ms,
+                uint64_t& arrival_us) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (shutdown) {
+            // 网络已关闭：只让时间前进，使协议的超时逻辑能够结束
+            now_us += timeout_ms * 1000ULL;
+        } else if (inbox[id].empty()) {
+            deadline_us[id] = timeout_ms ? now_us + timeout_ms * 1000ULL : SIM_NEVER;
+            waiting[id] = true;
+            running = -1;
+            cv.notify_all();
+            cv.wait(lock, [&]() { return running == id; });
+            waiting[id] = false;
+        }
+        if (inbox[id].empty()) return -1;
+
+        Datagram& dgram = inbox[id].front();
+        int n = std::min(capacity, (int)dgram.data.size());
+        memcpy(buffer, dgram.data.data(), n);
+        from = dgram.from;
+        arrival_us = dgram.arrival_us;
+        inbox[id].pop_front();
+        return n;
+    }
+
+    // 在虚拟时间中运行各端点，直到全部结束
+    void run(std::function<void()> bodies[ENDPOINTS]) {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < ENDPOINTS; i++) {
+            waiting[i] = true;
+            deadline_us[i] = now_us;  // 按编号依次启动
+            threads.push_back(std::thread([this, i, bodies]() {
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [&]() { return running == i; });
+                    waiting[i] = false;
+                }
+                bodies[i]();
+                std::lock_guard<std::mutex> lock(mutex);
+                done[i] = true;
+                running = -1;
+                cv.notify_all();
+            }));
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [&]() { return running == -1; });
+
+            bool all_done = true;
+            for (int i = 0; i < ENDPOINTS; i++) all_done = all_done && done[i];
+            if (all_done) break;
+
+            // 下一个事件：最早的数据报到达，或最早的等待超时（同一时刻数据报优先）
+            int wake = -1;
+            uint64_t wake_us = SIM_NEVER;
+            for (int i = 0; i < ENDPOINTS; i++) {
+                if (waiting[i] && !done[i] && deadline_us[i] < wake_us) {
+                    wake = i;
+                    wake_us = deadline_us[i];
+                }
+            }
+            if (!events.empty() && events.top().time_us <= wake_us) {
+                Delivery d = events.top();
+                events.pop();
+                now_us = std::max(now_us, d.time_us);
+                if (done[d.dst]) continue;
+                Datagram dgram;
+                dgram.from = d.from;
+                dgram.arrival_us = d.time_us;
+                dgram.data.swap(d.data);
+                if (d.dst == 0) delivered_bytes += dgram.data.size();  // 到达接收端的字节
+                inbox[d.dst].push_back(dgram);
+                if (!waiting[d.dst]) continue;
+                wake = d.dst;
+            } else if (wake < 0 || wake_us - SIM_START_US > SIM_TIME_LIMIT_US) {
+                // 没有任何事件可以推进（如对端已退出而本端无限等待）：关闭网络
+                shutdown = true;
+                for (int i = 0; i < ENDPOINTS; i++) {
+                    if (waiting[i] && !done[i]) wake = i;
+                }
+            } else {
+                now_us = std::max(now_us, wake_us);
+            }
+
+            running = wake;
+            cv.notify_all();
+        }
+        lock.unlock();
+
+        for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    }
+
+    void fillResult(SimResult& result) {
+        result.datagrams = datagrams;
+        result.lost = lost;
+        result.queue_drops = queue_drops;
+    }
+
+private:
+    struct Datagram {
+        sockaddr_in from;
+        uint64_t arrival_us;     // 送达接收队列的虚拟时间
+        std::vector<char> data;
+    };
+
+    struct Delivery {
+        uint64_t time_us;
+        uint64_t order;      // 同一时刻按发送顺序到达
+        int dst;
+        sockaddr_in from;
+        std::vector<char> data;
+
+        bool operator>(const Delivery& other) const {
+            return time_us != other.time_us ? time_us > other.time_us : order > other.order;
+        }
+    };
+
+    // 每10ms虚拟时间记录一行跟踪数据
+    void sampleTrace() {
+        if (!trace || !observed) return;
+        if (trace_last_us != 0 && now_us - trace_last_us < 10000) return;
+        double mbps = trace_last_us ? (delivered_bytes - trace_bytes) * 8.0 / (now_us - trace_last_us) : 0.0;
+        fprintf(trace, "%.3f,%u,%u,%.3f,%u,%llu,%.3f\n", (now_us - SIM_START_US) / 1000.0,
+                observed->getCwnd(), observed->getSsthresh(),
+                observed->getSrttUs() / 1000.0, observed->getRtoMs(),
+                (unsigned long long)delivered_bytes, mbps);
+        trace_last_us = now_us;
+        trace_bytes = delivered_bytes;
+    }
+
+    LinkConfig link;
+    SimRandom rng;
+    uint64_t now_us;
+    uint64_t order;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    int running;             // 当前持有执行权的端点，-1表示调度器
+    bool shutdown;
+
+    sockaddr_in addrs[ENDPOINTS];
+    uint64_t link_free_us[ENDPOINTS];   // 各端点出方向链路空闲的时刻
+    std::deque<Datagram> inbox[ENDPOINTS];
+    bool waiting[ENDPOINTS];
+    bool done[ENDPOINTS];
+    uint64_t deadline_us[ENDPOINTS];
+    std::priority_queue<Delivery, std::vector<Delivery>, std::greater<Delivery> > events;
+
+    const RdtSocket* observed;
+    FILE* trace;
+    uint64_t trace_last_us;
+    uint64_t delivered_bytes;
+    uint64_t trace_bytes;
+
+    uint32_t datagrams;
+    uint32_t lost;
+    uint32_t queue_drops;
+};
+
+RdtTransport::TimePoint SimEndpoint::now() {
+    return TimePoint(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::microseconds(net.nowUs())));
+}
+
+bool SimEndpoint::sendTo(const void* data, int len, const sockaddr_in& to) {
+    return net.transmit(id, data, len, to);
+}
+
+int SimEndpoint::recvFrom(void* buffer, int capacity, sockaddr_in& from, uint32_t timeout_ms,
+                          TimePoint* rx_time) {
+    uint64_t arrival_us = 0;
+    int n = net.receive(id, buffer, capacity, from, timeout_ms, arrival_us);
+    if (n >= 0 && rx_time) {
+        *rx_time = TimePoint(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::microseconds(arrival_us)));
+    }
+    return n;
+}
+
+// 比较两个文件内容是否一致
+bool sameFile(const char* a, const char* b) {
+    FILE* fa = fopen(a, "rb");
+    FILE* fb = fopen(b, "rb");
+    bool same = fa && fb;
+    char ba[65536], bb[65536];
+    while (same) {
+        size_t na = fread(ba, 1, sizeof(ba), fa);
+        size_t nb = fread(bb, 1, sizeof(bb), fb);
+        same = na == nb && memcmp(ba, bb, na) == 0;
+        if (na == 0) break;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return same;
+}
+
+// 运行一次完整的文件传输模拟
+SimResult runTransfer(const SimConfig& cfg, uint64_t seed, const char* input, const char* output, FILE* trace,
+                      const char* events) {
+    SimNetwork net(cfg.link, seed);
+    SimEndpoint receiver_ep(net, 0), sender_ep(net, 1);
+    net.setAddress(0, "10.0.0.2", 5001);
+    net.setAddress(1, "10.0.0.1", 40000);
+
+    RdtSocket receiver, sender;
+    receiver.setTransport(&receiver_ep);
+    sender.setTransport(&sender_ep);
+    receiver.setLogging(false);
+    sender.setLogging(false);
+    receiver.setCompression(true);
+    sender.setCompression(cfg.compress);
+    if (cfg.max_segment) sender.setMaxSegment(cfg.max_segment);
+    net.setTrace(trace, &sender);
+    if (events && !sender.setTrace(events)) printf("[ERROR] Cannot create event trace: %s\n", events);
+
+    SimResult result;
+    memset(&result, 0, sizeof(result));
+    bool received = false;
+    bool sent = false;
+
+    std::function<void()> bodies[SimNetwork::ENDPOINTS];
+    bodies[0] = [&]() {
+        RdtSocket* client = receiver.accept();
+        if (!client) return;
+        received = client->recvFile(output);
+        result.complete_us = net.elapsedUs();
+        delete client;
+    };
+    bodies[1] = [&]() {
+        sender.connect("10.0.0.2", 5001);
+        sent = sender.sendFile(input);
+    };
+    net.run(bodies);
+
+    net.fillResult(result);
+    result.final_cwnd = sender.getCwnd();
+    const TransferStats& stats = sender.getStats();
+    result.retransmits = stats.timeout_retransmits + stats.fast_retransmits;
+    result.spurious = stats.spurious_timeouts + stats.spurious_fast_retransmits;
+    result.srtt_us = sender.getSrttUs();
+    result.rtt_samples = stats.rtt_samples;
+    result.ok = received && sent && sameFile(input, output);
+    return result;
+}
+
+// 生成确定性的测试文件
+bool makeInput(const char* path, uint32_t size) {
+    FILE* fp = fopen(path, "wb");
+    if (!fp) return false;
+    SimRandom rng(12345);
+    std::vector<char> buf(size);
+    for (uint32_t i = 0; i < size; i++) buf[i] = (char)(rng.next() >> 56);
+    bool ok = fwrite(buf.data(), 1, size, fp) == size;
+    fclose(fp);
+    return ok;
+}
+
+void printUsage(const char* prog_name) {
+    printf("Usage: %s [options]\n", prog_name);
+    printf("Options:\n");
+    printf("  -n <runs>       Number of simulated transfers (default 1)\n");
+    printf("  -s <kb>         Size of the generated test file (default 256 KB)\n");
+    printf("  -f <file>       Transfer this file instead of a generated one\n");
+    printf("  -b <mbps>       Bottleneck bandwidth, 0 = unlimited (default 10)\n");
+    printf("  -d <ms>         One-way propagation delay (default 10)\n");
+    printf("  -l <rate>       Random loss rate 0..1 (default 0)\n");
+    printf("  -q <kb>         Bottleneck queue size (default 64 KB)\n");
+    printf("  -z              Enable block compression\n");
+    printf("  -m <bytes>      Max payload per packet\n");
+    printf("  -r <seed>       Seed of the first run (default 1), run i uses seed+i\n");
+    printf("  -t <file.csv>   Write the cwnd/throughput trace of the first run\n");
+    printf("  -e <file>       Record the sender's connection events of the first run (see trace_dump)\n");
+    printf("  -v              Print one CSV line per run\n");
+    printf("Example: %s -n 1000 -l 0.2 -d 100 -s 64 -v\n", prog_name);
+}
+
+int main(int argc, char* argv[]) {
+    SimConfig cfg;
+    cfg.link.bandwidth_mbps = 10;
+    cfg.link.delay_ms = 10;
+    cfg.link.loss = 0;
+    cfg.link.queue_bytes = 64 * 1024;
+    cfg.compress = false;
+    cfg.max_segment = 0;
+
+    uint32_t runs = 1;
+    uint32_t size_kb = 256;
+    uint64_t seed = 1;
+    const char* input = nullptr;
+    const char* trace_path = nullptr;
+    const char* event_path = nullptr;
+    bool verbose = false;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-n") == 0 && has_value) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && has_value) {
+            size_kb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && has_value) {
+            input = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && has_value) {
+            cfg.link.bandwidth_mbps = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-d") == 0 && has_value) {
+            cfg.link.delay_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && has_value) {
+            cfg.link.loss = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-q") == 0 && has_value) {
+            cfg.link.queue_bytes = atoi(argv[++i]) * 1024;
+        } else if (strcmp(argv[i], "-z") == 0) {
+            cfg.compress = true;
+        } else if (strcmp(argv[i], "-m") == 0 && has_value) {
+            cfg.max_segment = (uint16_t)std::min(atoi(argv[++i]), (int)MAX_DATA_SIZE);
+        } else if (strcmp(argv[i], "-r") == 0 && has_value) {
+            seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "-t") == 0 && has_value) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "-e") == 0 && has_value) {
+            event_path = argv[++i];
+        } else if (strcmp(argv[i], "-v") == 0) {
+            verbose = true;
+        } else {
+            printf("[ERROR] Unknown option: %s\n", argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        printf("[ERROR] WSAStartup failed\n");
+        return 1;
+    }
+
+    const char* generated = "sim_input.tmp";
+    const char* output = "sim_output.tmp";
+    if (!input) {
+        if (!makeInput(generated, size_kb * 1024)) {
+            printf("[ERROR] Cannot create test file\n");
+            return 1;
+        }
+        input = generated;
+    }
+
+    FILE* trace = nullptr;
+    if (trace_path) {
+        trace = fopen(trace_path, "w");
+        if (!trace) {
+            printf("[ERROR] Cannot create trace file: %s\n", trace_path);
+            return 1;
+        }
+    }
+
+    printf("[SIM] bandwidth=%.1f Mbps, delay=%u ms, loss=%.3f, queue=%u bytes, runs=%u\n",
+           cfg.link.bandwidth_mbps, cfg.link.delay_ms, cfg.link.loss, cfg.link.queue_bytes, runs);
+    if (verbose) {
+        printf("run,seed,ok,complete_ms,goodput_mbps,datagrams,lost,queue_drops,final_cwnd,retransmits,spurious,srtt_ms,rtt_samples\n");
+    }
+
+    FILE* fp = fopen(input, "rb");
+    if (!fp) {
+        printf("[ERROR] Cannot open file: %s\n", input);
+        return 1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    fclose(fp);
+
+    auto wall_start = std::chrono::steady_clock::now();
+    uint32_t ok_runs = 0;
+    double total_ms = 0, min_ms = 0, max_ms = 0;
+    uint64_t total_retransmits = 0, total_spurious = 0;
+
+    for (uint32_t run = 0; run < runs; run++) {
+        SimResult r = runTransfer(cfg, seed + run, input, output, run == 0 ? trace : nullptr,
+                                  run == 0 ? event_path : nullptr);
+        double ms = r.complete_us / 1000.0;
+        double mbps = r.complete_us ? file_size * 8.0 / r.complete_us : 0.0;
+        if (verbose) {
+            printf("%u,%llu,%d,%.3f,%.3f,%u,%u,%u,%u,%u,%u,%.3f,%u\n", run, (unsigned long long)(seed + run),
+                   r.ok ? 1 : 0, ms, mbps, r.datagrams, r.lost, r.queue_drops, r.final_cwnd,
+                   r.retransmits, r.spurious, r.srtt_us / 1000.0, r.rtt_samples);
+        }
+        total_retransmits += r.retransmits;
+        total_spurious += r.spurious;
+        if (!r.ok) continue;
+        if (ok_runs == 0 || ms < min_ms) min_ms = ms;
+        if (ok_runs == 0 || ms > max_ms) max_ms = ms;
+        total_ms += ms;
+        ok_runs++;
+    }
+
+    double wall_ms = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - wall_start).count() / 1000.0;
+    double mean_ms = ok_runs ? total_ms / ok_runs : 0.0;
+
+    printf("[SIM] %u / %u transfers correct\n", ok_runs, runs);
+    printf("[SIM] Completion time (virtual): mean %.1f ms, min %.1f ms, max %.1f ms\n", mean_ms, min_ms, max_ms);
+    printf("[SIM] Mean goodput: %.3f Mbps\n", mean_ms > 0 ? file_size * 8.0 / (mean_ms * 1000.0) : 0.0);
+    printf("[SIM] Retransmits: %llu, spurious recoveries undone: %llu\n",
+           (unsigned long long)total_retransmits, (unsigned long long)total_spurious);
+    printf("[SIM] Wall time: %.1f ms (%.0f transfers/s)\n", wall_ms, wall_ms > 0 ? runs * 1000.0 / wall_ms : 0.0);
+
+    if (trace) fclose(trace);
+    remove(output);
+    if (input == generated) remove(generated);
+    WSACleanup();
+    return ok_runs == runs ? 0 : 1;
+}
@@ -0,0 +1,402 @@
+// 事件记录转换工具：读取sender/receiver/simulator用 -q/-e 写出的事件记录（event_trace.h），
+// 输出统计摘要、qlog JSON-SEQ（可用qvis等工具查看），以及序号和cwnd随时间变化的SVG图
+#include "protocol.h"
+#include "event_trace.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// 展开回绕后的事件（时间为微秒）
+struct Event {
+    uint64_t time_us;
+    TraceRecord rec;
+};
+
+static const char* packetTypeName(uint8_t type) {
+    static const char* names[] = {"syn", "syn_ack", "ack", "data", "fin", "fin_ack",
+                                  "probe", "probe_ack", "sig_req", "sig"};
+    return type < sizeof(names) / sizeof(names[0]) ? names[type] : "unknown";
+}
+
+static const char* congestionStateName(uint8_t state) {
+    switch (state) {
+    case TRACE_SLOW_START: return "slow_start";
+    case TRACE_CONGESTION_AVOIDANCE: return "congestion_avoidance";
+    case TRACE_RECOVERY: return "recovery";
+    default: return "unknown";
+    }
+}
+
+static const char* lossTriggerName(uint8_t reason) {
+    switch (reason) {
+    case TRACE_LOSS_RACK: return "time_threshold";
+    case TRACE_LOSS_TIMEOUT: return "retransmission_timeout";
+    case TRACE_LOSS_PROBE: return "pto_expired";
+    default: return "unknown";
+    }
+}
+
+// 文件名放进JSON字符串和SVG文本时的转义（Windows路径里有反斜杠）
+static std::string escapeText(const char* text, bool json) {
+    std::string out;
+    for (const char* p = text; *p; p++) {
+        if (json && (*p == '\\' || *p == '"')) {
+            out += '\\';
+            out += *p;
+        } else if (!json && *p == '<') {
+            out += "&lt;";
+        } else if (!json && *p == '&') {
+            out += "&amp;";
+        } else {
+            out += *p;
+        }
+    }
+    return out;
+}
+
+static bool loadTrace(const char* path, std::vector<Event>& events) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) {
+        printf("[ERROR] Cannot open trace: %s\n", path);
+        return false;
+    }
+    TraceFileHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, "RDTQ", 4) != 0 ||
+        header.version != TRACE_VERSION || header.record_size != sizeof(TraceRecord)) {
+        printf("[ERROR] Not an event trace (or a different version): %s\n", path);
+        fclose(fp);
+        return false;
+    }
+
+    // 记录中的时间是32位微秒，按相邻记录的有符号差值展开：
+    // 既能跨过回绕，也容忍到达时间略早于前一条记录（内核时间戳）
+    TraceRecord rec;
+    uint32_t prev_raw = 0;
+    int64_t now = 0;
+    while (fread(&rec, sizeof(rec), 1, fp) == 1) {
+        now += (int32_t)(rec.time_us - prev_raw);
+        prev_raw = rec.time_us;
+        Event e;
+        e.time_us = now > 0 ? (uint64_t)now : 0;
+        e.rec = rec;
+        events.push_back(e);
+    }
+    fclose(fp);
+    return true;
+}
+
+static void printSummary(const char* path, const std::vector<Event>& events) {
+    uint32_t by_type[8] = {0};
+    uint32_t data_sent = 0, data_received = 0, retransmitted = 0;
+    uint32_t lost[3] = {0};
+    uint64_t rtt_sum = 0;
+    uint32_t rtt_min = 0, rtt_max = 0, rtt_count = 0, cwnd_max = 0;
+    uint32_t high = 0;
+    bool have_high = false;
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceRecord& r = events[i].rec;
+        if (r.type < 8) by_type[r.type]++;
+        if (r.type == TRACE_PACKET_SENT && r.info == PKT_DATA) {
+            data_sent++;
+            if (have_high && r.a < high) retransmitted++;
+            if (!have_high || r.a + r.len > high) high = r.a + r.len;
+            have_high = true;
+        } else if (r.type == TRACE_PACKET_RECEIVED && r.info == PKT_DATA) {
+            data_received++;
+        } else if (r.type == TRACE_PACKET_LOST && r.info < 3) {
+            lost[r.info]++;
+        } else if (r.type == TRACE_RTT) {
+            rtt_sum += r.a;
+            rtt_min = rtt_count == 0 ? r.a : std::min(rtt_min, r.a);
+            rtt_max = std::max(rtt_max, r.a);
+            rtt_count++;
+        } else if (r.type == TRACE_METRICS) {
+            cwnd_max = std::max(cwnd_max, r.a);
+        }
+    }
+
+    double duration_ms = events.empty() ? 0.0 : events.back().time_us / 1000.0;
+    printf("[TRACE] %s: %zu events over %.3f ms\n", path, events.size(), duration_ms);
+    printf("[TRACE] Packets: %u sent, %u received\n", by_type[TRACE_PACKET_SENT], by_type[TRACE_PACKET_RECEIVED]);
+    printf("[TRACE] DATA: %u sent (%u retransmitted), %u received\n", data_sent, retransmitted, data_received);
+    printf("[TRACE] Lost: %u by RACK, %u by timeout; %u tail probes\n",
+           lost[TRACE_LOSS_RACK], lost[TRACE_LOSS_TIMEOUT], lost[TRACE_LOSS_PROBE]);
+    if (rtt_count > 0) {
+        printf("[TRACE] RTT: %u samples, min %.3f ms, mean %.3f ms, max %.3f ms\n", rtt_count,
+               rtt_min / 1000.0, rtt_sum / 1000.0 / rtt_count, rtt_max / 1000.0);
+    }
+    if (by_type[TRACE_METRICS] > 0) {
+        printf("[TRACE] cwnd: %u updates, max %u packets\n", by_type[TRACE_METRICS], cwnd_max);
+    }
+}
+
+// ===== qlog JSON-SEQ =====
+// 每条记录以0x1E开头、换行结尾（RFC 7464）；第一条是qlog文件头，之后每条是一个事件。
+// 序列号按字节计，packet_number直接用序列号
+
+static bool writeQlog(const char* path, const char* title, const std::vector<Event>& events) {
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        printf("[ERROR] Cannot create %s\n", path);
+        return false;
+    }
+    fprintf(fp, "\x1e{\"qlog_version\":\"0.3\",\"qlog_format\":\"JSON-SEQ\",\"title\":\"%s\","
+                "\"trace\":{\"vantage_point\":{\"type\":\"unknown\"},"
+                "\"common_fields\":{\"protocol_type\":[\"RDT\"],\"time_format\":\"relative\",\"reference_time\":0}}}\n",
+            escapeText(title, true).c_str());
+
+    uint16_t seg_size = DATA_SIZE;
+    int last_state = -1;
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceRecord& r = events[i].rec;
+        double t = events[i].time_us / 1000.0;
+        switch (r.type) {
+        case TRACE_PACKET_SENT:
+        case TRACE_PACKET_RECEIVED:
+            fprintf(fp, "\x1e{\"time\":%.3f,\"name\":\"transport:packet_%s\",\"data\":{\"header\":"
+                        "{\"packet_type\":\"%s\",\"packet_number\":%u},\"ack\":%u,\"raw\":{\"payload_length\":%u}}}\n",
+                    t, r.type == TRACE_PACKET_SENT ? "sent" : "received", packetTypeName(r.info), r.a, r.b, r.len);
+            break;
+        case TRACE_PACKET_LOST:
+            fprintf(fp, "\x1e{\"time\":%.3f,\"name\":\"recovery:packet_lost\",\"data\":{\"header\":"
+                        "{\"packet_type\":\"data\",\"packet_number\":%u},\"trigger\":\"%s\"}}\n",
+                    t, r.a, lossTriggerName(r.info));
+            break;
+        case TRACE_METRICS:
+            seg_size = r.len;
+            fprintf(fp, "\x1e{\"time\":%.3f,\"name\":\"recovery:metrics_updated\",\"data\":"
+                        "{\"congestion_window\":%llu,\"ssthresh\":%llu,\"cwnd_packets\":%u,\"segment_size\":%u}}\n",
+                    t, (unsigned long long)r.a * seg_size, (unsigned long long)r.b * seg_size, r.a, seg_size);
+            if (r.info != last_state) {
+                fprintf(fp, "\x1e{\"time\":%.3f,\"name\":\"recovery:congestion_state_updated\",\"data\":"
+                            "{\"new\":\"%s\"}}\n", t, congestionStateName(r.info));
+                last_state = r.info;
+            }
+            break;
+        case TRACE_RTT:
+            fprintf(fp, "\x1e{\"time\":%.3f,\"name\":\"recovery:metrics_updated\",\"data\":"
+                        "{\"latest_rtt\":%.3f,\"smoothed_rtt\":%.3f,\"rto\":%u}}\n",
+                    t, r.a / 1000.0, r.b / 1000.0, r.len);
+            break;
+        case TRACE_CONNECTION:
+            fprintf(fp, "\x1e{\"time\":%.3f,\"name\":\"connectivity:connection_state_updated\",\"data\":"
+                        "{\"new\":\"%s\"}}\n", t, r.info == TRACE_CONN_ESTABLISHED ? "established" : "closed");
+            break;
+        }
+    }
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+// ===== SVG图 =====
+// 上：DATA包的序列号（相对第一个DATA包，KB）和ACK号随时间变化，重传和判定丢失的包标红；
+// 下：cwnd和ssthresh（包数），快速恢复期间加底色
+
+struct Axis {
+    double lo, hi;
+    int pix_lo, pix_hi;
+    double map(double v) const { return pix_lo + (v - lo) / (hi - lo) * (pix_hi - pix_lo); }
+};
+
+// 取1、2、5乘10的幂作为刻度间隔，大约分成5格
+static double tickStep(double range) {
+    if (range <= 0) return 1;
+    double raw = range / 5;
+    double base = pow(10.0, floor(log10(raw)));
+    double m = raw / base;
+    return base * (m < 1.5 ? 1 : m < 3.5 ? 2 : m < 7.5 ? 5 : 10);
+}
+
+static void drawAxes(FILE* fp, const Axis& x, const Axis& y, const char* y_label) {
+    fprintf(fp, "<rect x='%d' y='%d' width='%d' height='%d' fill='none' stroke='#888'/>\n",
+            x.pix_lo, y.pix_hi, x.pix_hi - x.pix_lo, y.pix_lo - y.pix_hi);
+    double xs = tickStep(x.hi - x.lo);
+    for (double v = ceil(x.lo / xs) * xs; v <= x.hi + 1e-9; v += xs) {
+        double px = x.map(v);
+        fprintf(fp, "<line x1='%.1f' y1='%d' x2='%.1f' y2='%d' stroke='#eee'/>\n", px, y.pix_lo, px, y.pix_hi);
+        fprintf(fp, "<text x='%.1f' y='%d' font-size='11' text-anchor='middle'>%g</text>\n", px, y.pix_lo + 14, v);
+    }
+    double ys = tickStep(y.hi - y.lo);
+    for (double v = ceil(y.lo / ys) * ys; v <= y.hi + 1e-9; v += ys) {
+        double py = y.map(v);
+        fprintf(fp, "<line x1='%d' y1='%.1f' x2='%d' y2='%.1f' stroke='#eee'/>\n", x.pix_lo, py, x.pix_hi, py);
+        fprintf(fp, "<text x='%d' y='%.1f' font-size='11' text-anchor='end'>%g</text>\n", x.pix_lo - 4, py + 4, v);
+    }
+    fprintf(fp, "<text x='%d' y='%d' font-size='12'>%s</text>\n", x.pix_lo, y.pix_hi - 6, y_label);
+}
+
+static bool writeSvg(const char* path, const char* title, const std::vector<Event>& events) {
+    // 第一遍：坐标范围
+    bool have_seq = false;
+    uint32_t seq_base = 0, seq_high = 0, cwnd_max = 1;
+    double t_max = events.empty() ? 1.0 : events.back().time_us / 1000.0;
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceRecord& r = events[i].rec;
+        if ((r.type == TRACE_PACKET_SENT || r.type == TRACE_PACKET_RECEIVED) && r.info == PKT_DATA) {
+            if (!have_seq || r.a < seq_base) seq_base = r.a;
+            if (!have_seq || r.a + r.len > seq_high) seq_high = r.a + r.len;
+            have_seq = true;
+        } else if (r.type == TRACE_METRICS) {
+            cwnd_max = std::max(cwnd_max, r.a);
+        }
+    }
+    if (t_max <= 0) t_max = 1.0;
+
+    FILE* fp = fopen(path, "w");
+    if (!fp) {
+        printf("[ERROR] Cannot create %s\n", path);
+        return false;
+    }
+    const int width = 960, height = 760;
+    fprintf(fp, "<svg xmlns='http://www.w3.org/2000/svg' width='%d' height='%d' font-family='sans-serif'>\n",
+            width, height);
+    fprintf(fp, "<rect width='100%%' height='100%%' fill='white'/>\n");
+    fprintf(fp, "<text x='70' y='20' font-size='14'>%s</text>\n", escapeText(title, false).c_str());
+
+    Axis tx = {0, t_max, 70, width - 20};
+    Axis sy = {0, std::max(1.0, (seq_high - seq_base) / 1024.0), 440, 50};
+    Axis cy = {0, cwnd_max * 1.1, 720, 500};
+    drawAxes(fp, tx, sy, "sequence (KB)");
+    drawAxes(fp, tx, cy, "cwnd / ssthresh (packets)");
+    fprintf(fp, "<text x='%d' y='%d' font-size='12' text-anchor='end'>time (ms)</text>\n", width - 20, height - 8);
+
+    // 快速恢复的区间画在最下层
+    double recovery_start = -1;
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceRecord& r = events[i].rec;
+        if (r.type != TRACE_METRICS) continue;
+        double t = events[i].time_us / 1000.0;
+        if (r.info == TRACE_RECOVERY && recovery_start < 0) {
+            recovery_start = t;
+        } else if (r.info != TRACE_RECOVERY && recovery_start >= 0) {
+            fprintf(fp, "<rect x='%.1f' y='%d' width='%.1f' height='%d' fill='#fde0e0'/>\n", tx.map(recovery_start),
+                    cy.pix_hi, std::max(1.0, tx.map(t) - tx.map(recovery_start)), cy.pix_lo - cy.pix_hi);
+            recovery_start = -1;
+        }
+    }
+
+    // 序列号：新数据蓝色，重传红色，收到的数据灰色，ACK号为绿色折线，判定丢失为红叉
+    std::string acks;
+    uint32_t sent_high = seq_base;
+    for (size_t i = 0; i < events.size() && have_seq; i++) {
+        const TraceRecord& r = events[i].rec;
+        double px = tx.map(events[i].time_us / 1000.0);
+        if ((r.type == TRACE_PACKET_SENT || r.type == TRACE_PACKET_RECEIVED) && r.info == PKT_DATA) {
+            const char* color = "#999";
+            if (r.type == TRACE_PACKET_SENT) {
+                color = r.a < sent_high ? "#d62728" : "#1f77b4";
+                sent_high = std::max(sent_high, r.a + r.len);
+            }
+            double y0 = sy.map((r.a - seq_base) / 1024.0), y1 = sy.map((r.a + r.len - seq_base) / 1024.0);
+            fprintf(fp, "<line x1='%.1f' y1='%.1f' x2='%.1f' y2='%.1f' stroke='%s' stroke-width='2'/>\n",
+                    px, y0, px, std::min(y1, y0 - 1), color);
+        } else if (r.type == TRACE_PACKET_LOST && r.info != TRACE_LOSS_PROBE && r.a >= seq_base) {
+            double py = sy.map((r.a - seq_base) / 1024.0);
+            fprintf(fp, "<path d='M%.1f %.1fl6 6m0 -6l-6 6' stroke='#d62728'/>\n", px - 3, py - 3);
+        } else if (r.info == PKT_ACK && r.b >= seq_base && r.b <= seq_high &&
+                   (r.type == TRACE_PACKET_SENT || r.type == TRACE_PACKET_RECEIVED)) {
+            char point[48];
+            snprintf(point, sizeof(point), "%.1f,%.1f ", px, sy.map((r.b - seq_base) / 1024.0));
+            acks += point;
+        }
+    }
+    if (!acks.empty()) {
+        fprintf(fp, "<polyline points='%s' fill='none' stroke='#2ca02c'/>\n", acks.c_str());
+    }
+
+    // cwnd与ssthresh画成阶梯线
+    std::string cwnd_line, ssthresh_line;
+    double last_cwnd = -1, last_ssthresh = -1;
+    for (size_t i = 0; i < events.size(); i++) {
+        const TraceRecord& r = events[i].rec;
+        if (r.type != TRACE_METRICS) continue;
+        double px = tx.map(events[i].time_us / 1000.0);
+        double cw = cy.map(r.a), ss = cy.map(std::min((double)r.b, cy.hi));
+        char point[96];
+        if (last_cwnd >= 0) {
+            snprintf(point, sizeof(point), "%.1f,%.1f %.1f,%.1f ", px, last_cwnd, px, cw);
+            cwnd_line += point;
+            snprintf(point, sizeof(point), "%.1f,%.1f %.1f,%.1f ", px, last_ssthresh, px, ss);
+            ssthresh_line += point;
+        } else {
+            snprintf(point, sizeof(point), "%.1f,%.1f ", px, cw);
+            cwnd_line += point;
+            snprintf(point, sizeof(point), "%.1f,%.1f ", px, ss);
+            ssthresh_line += point;
+        }
+        last_cwnd = cw;
+        last_ssthresh = ss;
+    }
+    if (last_cwnd >= 0) {
+        // 延长到记录结束
+        char point[48];
+        snprintf(point, sizeof(point), "%d,%.1f", tx.pix_hi, last_cwnd);
+        cwnd_line += point;
+        snprintf(point, sizeof(point), "%d,%.1f", tx.pix_hi, last_ssthresh);
+        ssthresh_line += point;
+        fprintf(fp, "<polyline points='%s' fill='none' stroke='#ff7f0e' stroke-dasharray='4 3'/>\n",
+                ssthresh_line.c_str());
+        fprintf(fp, "<polyline points='%s' fill='none' stroke='#1f77b4' stroke-width='1.5'/>\n", cwnd_line.c_str());
+    }
+
+    // 图例
+    fprintf(fp, "<g font-size='11'>"
+                "<rect x='720' y='36' width='10' height='3' fill='#1f77b4'/><text x='734' y='41'>data</text>"
+                "<rect x='770' y='36' width='10' height='3' fill='#d62728'/><text x='784' y='41'>retransmit</text>"
+                "<rect x='850' y='36' width='10' height='3' fill='#2ca02c'/><text x='864' y='41'>ack</text>"
+                "<rect x='720' y='486' width='10' height='3' fill='#1f77b4'/><text x='734' y='491'>cwnd</text>"
+                "<rect x='770' y='486' width='10' height='3' fill='#ff7f0e'/><text x='784' y='491'>ssthresh</text>"
+                "<rect x='850' y='483' width='10' height='8' fill='#fde0e0'/><text x='864' y='491'>recovery</text>"
+                "</g>\n");
+    fprintf(fp, "</svg>\n");
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+void printUsage(const char* prog_name) {
+    printf("Usage: %s <trace_file> [options]\n", prog_name);
+    printf("  Prints a summary of a trace written by sender/receiver -q or simulator -e\n");
+    printf("Options:\n");
+    printf("  -j <file>       Write the events as qlog JSON-SEQ\n");
+    printf("  -s <file.svg>   Plot sequence numbers and cwnd over time\n");
+    printf("Example: %s send.rdtq -j send.qlog -s send.svg\n", prog_name);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    const char* trace_path = argv[1];
+    const char* qlog_path = nullptr;
+    const char* svg_path = nullptr;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            qlog_path = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            svg_path = argv[++i];
+        } else {
+            printf("[ERROR] Unknown option: %s\n", argv[i]);
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Event> events;
+    if (!loadTrace(trace_path, events)) return 1;
+    printSummary(trace_path, events);
+    if (qlog_path) {
+        if (!writeQlog(qlog_path, trace_path, events)) return 1;
+        printf("[TRACE] qlog written to %s\n", qlog_path);
+    }
+    if (svg_path) {
+        if (!writeSvg(svg_path, trace_path, events)) return 1;
+        printf("[TRACE] Plot written to %s\n", svg_path);
+    }
+    return 0;
+}
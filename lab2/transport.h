@@ -0,0 +1,70 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <winsock2.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+// ===== 传输与时钟抽象 =====
+//
+// RdtSocket的协议逻辑只通过这个接口收发数据报和读取时间：
+// 真实运行时使用UdpTransport（Winsock + steady_clock），
+// 模拟器提供虚拟时间和模拟链路的实现，协议代码不需要任何改动。
+//
+// recvFrom可以顺带给出数据报的到达时间，用于计算RTT：UdpTransport取recvfrom返回的时刻，
+// 模拟器取数据报在模拟链路上到达的虚拟时间。
+
+class RdtTransport {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    virtual ~RdtTransport() {}
+
+    // 当前时间
+    virtual TimePoint now() = 0;
+
+    // 发送一个数据报
+    virtual bool sendTo(const void* data, int len, const sockaddr_in& to) = 0;
+
+    // 等待一个数据报，最多等待timeout_ms毫秒（0表示一直等待）
+    // 返回数据报长度，超时或出错返回-1；rx_time非空时写入数据报的到达时间
+    virtual int recvFrom(void* buffer, int capacity, sockaddr_in& from, uint32_t timeout_ms,
+                         TimePoint* rx_time = nullptr) = 0;
+};
+
+// 基于UDP套接字的真实传输
+class UdpTransport : public RdtTransport {
+public:
+    UdpTransport() : sock(INVALID_SOCKET) {}
+
+    void setSocket(SOCKET s) {
+        sock = s;
+    }
+
+    TimePoint now() {
+        return std::chrono::steady_clock::now();
+    }
+
+    bool sendTo(const void* data, int len, const sockaddr_in& to) {
+        return sendto(sock, (const char*)data, len, 0,
+                      (const sockaddr*)&to, sizeof(to)) != SOCKET_ERROR;
+    }
+
+    int recvFrom(void* buffer, int capacity, sockaddr_in& from, uint32_t timeout_ms,
+                 TimePoint* rx_time = nullptr) {
+        int timeout = timeout_ms;
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&timeout, sizeof(timeout));
+
+        int addr_len = sizeof(from);
+        int n = recvfrom(sock, (char*)buffer, capacity, 0, (sockaddr*)&from, &addr_len);
+        if (n == SOCKET_ERROR) return -1;
+        if (rx_time) *rx_time = now();
+        return n;
+    }
+
+private:
+    SOCKET sock;
+};
+
+#endif // TRANSPORT_H